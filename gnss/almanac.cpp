@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "almanac.h"
+#include <errno.h>
+#include <log/log.h>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+namespace ciccloud {
+namespace {
+
+// The fields of a block by the start of their key, every one is required.
+struct Field {
+    const char* key;
+    void (*set)(AlmanacEntry*, const char* value);
+};
+
+const Field kFields[] = {
+    {"ID", [](AlmanacEntry* e, const char* v) { e->prn = static_cast<int16_t>(atoi(v)); }},
+    {"Health", [](AlmanacEntry* e, const char* v) { e->health = atoi(v); }},
+    {"Eccentricity", [](AlmanacEntry* e, const char* v) { e->eccentricity = strtod(v, nullptr); }},
+    {"Time of Applicability", [](AlmanacEntry* e, const char* v) { e->toaSeconds = strtod(v, nullptr); }},
+    {"Orbital Inclination", [](AlmanacEntry* e, const char* v) { e->inclinationRad = strtod(v, nullptr); }},
+    {"Rate of Right Ascen", [](AlmanacEntry* e, const char* v) { e->rateOfRightAscensionRadPerSec = strtod(v, nullptr); }},
+    {"SQRT(A)", [](AlmanacEntry* e, const char* v) { e->sqrtA = strtod(v, nullptr); }},
+    {"Right Ascen at Week", [](AlmanacEntry* e, const char* v) { e->rightAscensionRad = strtod(v, nullptr); }},
+    {"Argument of Perigee", [](AlmanacEntry* e, const char* v) { e->argumentOfPerigeeRad = strtod(v, nullptr); }},
+    {"Mean Anom", [](AlmanacEntry* e, const char* v) { e->meanAnomalyRad = strtod(v, nullptr); }},
+    {"Af0", [](AlmanacEntry* e, const char* v) { e->af0 = strtod(v, nullptr); }},
+    {"Af1", [](AlmanacEntry* e, const char* v) { e->af1 = strtod(v, nullptr); }},
+    {"week", [](AlmanacEntry* e, const char* v) { e->week = atoi(v); }},
+};
+constexpr size_t kFieldCount = sizeof(kFields) / sizeof(kFields[0]);
+constexpr uint32_t kAllFields = (1u << kFieldCount) - 1;
+
+}  // namespace
+
+bool parseYumaAlmanac(const char* text, const size_t size, std::vector<AlmanacEntry>* entries) {
+    entries->clear();
+    AlmanacEntry entry;
+    uint32_t seen = 0;
+
+    const char* end = text + size;
+    for (const char* line = text; line < end;) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', end - line));
+        if (!eol) {
+            eol = end;
+        }
+        const std::string s(line, eol);
+        line = eol + 1;
+
+        const size_t colon = s.find(':');
+        if (colon == std::string::npos) {
+            continue;
+        }
+        for (size_t i = 0; i < kFieldCount; ++i) {
+            if (!s.compare(0, strlen(kFields[i].key), kFields[i].key)) {
+                if (i == 0 && seen) {
+                    ALOGE("%s: the block of PRN %d is incomplete", __PRETTY_FUNCTION__, entry.prn);
+                    return false;
+                }
+                kFields[i].set(&entry, s.c_str() + colon + 1);
+                seen |= 1u << i;
+                break;
+            }
+        }
+        if (seen == kAllFields) {
+            entries->push_back(entry);
+            entry = AlmanacEntry();
+            seen = 0;
+        }
+    }
+    if (seen) {
+        ALOGE("%s: the block of PRN %d is incomplete", __PRETTY_FUNCTION__, entry.prn);
+        return false;
+    }
+    return !entries->empty();
+}
+
+bool loadYumaAlmanac(const char* path, std::vector<AlmanacEntry>* entries) {
+    FILE* f = fopen(path, "re");
+    if (!f) {
+        ALOGE("%s: could not open '%s': %s", __PRETTY_FUNCTION__, path, strerror(errno));
+        return false;
+    }
+    std::string text;
+    char buf[4096];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) {
+        text.append(buf, n);
+    }
+    fclose(f);
+    return parseYumaAlmanac(text.data(), text.size(), entries);
+}
+
+}  // namespace ciccloud
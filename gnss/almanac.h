@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ciccloud {
+
+// The orbit of one satellite, as a YUMA almanac has it (IS-GPS-200 20.3.3.5).
+struct AlmanacEntry {
+    int16_t prn = 0;
+    int health = 0;                // 0 - healthy
+    double eccentricity = 0;
+    double toaSeconds = 0;         // time of applicability, in the week
+    double inclinationRad = 0;
+    double rateOfRightAscensionRadPerSec = 0;
+    double sqrtA = 0;              // sqrt(m)
+    double rightAscensionRad = 0;  // at the start of the week
+    double argumentOfPerigeeRad = 0;
+    double meanAnomalyRad = 0;     // at toa
+    double af0 = 0;                // clock bias, s
+    double af1 = 0;                // clock drift, s/s
+    int week = 0;                  // modulo 1024
+};
+
+// Parses a YUMA almanac, lines of "Key: value" with a block per satellite.
+// Unknown keys and blank or "****" lines are skipped. Returns false if a
+// block is incomplete or nothing was found.
+bool parseYumaAlmanac(const char* text, size_t size, std::vector<AlmanacEntry>* entries);
+bool loadYumaAlmanac(const char* path, std::vector<AlmanacEntry>* entries);
+
+}  // namespace ciccloud
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bench_counters.h"
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+std::atomic<uint64_t> g_allocations(0);
+
+void* countedAlloc(const size_t size) {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+}  // namespace
+
+void* operator new(const size_t size) { return countedAlloc(size); }
+void* operator new[](const size_t size) { return countedAlloc(size); }
+void* operator new(const size_t size, const std::nothrow_t&) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void* operator new[](const size_t size, const std::nothrow_t&) noexcept {
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    return malloc(size ? size : 1);
+}
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace ciccloud {
+namespace bench {
+
+uint64_t allocationCount() {
+    return g_allocations.load(std::memory_order_relaxed);
+}
+
+InstructionCounter::InstructionCounter() {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    m_fd = syscall(__NR_perf_event_open, &attr, 0 /* this thread */, -1, -1, 0);
+}
+
+InstructionCounter::~InstructionCounter() {
+    if (m_fd >= 0) {
+        close(m_fd);
+    }
+}
+
+void InstructionCounter::start() {
+    if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void InstructionCounter::stop() {
+    if (m_fd >= 0) {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+uint64_t InstructionCounter::count() const {
+    uint64_t value = 0;
+    if (m_fd >= 0 && read(m_fd, &value, sizeof(value)) != sizeof(value)) {
+        value = 0;
+    }
+    return value;
+}
+
+}  // namespace bench
+}  // namespace ciccloud
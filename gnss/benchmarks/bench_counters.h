@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstdint>
+
+namespace ciccloud {
+namespace bench {
+
+// Number of operator new calls in this process so far. Linking
+// bench_counters.cpp replaces the global operator new/delete.
+uint64_t allocationCount();
+
+// Instructions retired in user space by the calling thread, via
+// perf_event_open. ok() is false where perf events are not available
+// (containers, perf_event_paranoid), then count() returns 0.
+class InstructionCounter {
+public:
+    InstructionCounter();
+    ~InstructionCounter();
+    InstructionCounter(const InstructionCounter&) = delete;
+    InstructionCounter& operator=(const InstructionCounter&) = delete;
+
+    bool ok() const { return m_fd >= 0; }
+    void start();
+    void stop();
+    uint64_t count() const;
+
+private:
+    int m_fd = -1;
+};
+
+}  // namespace bench
+}  // namespace ciccloud
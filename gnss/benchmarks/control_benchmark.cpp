@@ -0,0 +1,324 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// How long the binder thread is held by the control plane calls, the old
+// synchronous way against ConnController and the epochs of the feed, while
+// a feeder streams into a sink whose callbacks block now and then like a
+// busy framework:
+//   max_ms is the worst call of the run, the time is the mean.
+//
+//   $ gnss_cic_cloud_control_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include "conn_controller.h"
+#include "feeder.h"
+#include "gnss_hw_conn.h"
+#include "measurement_engine.h"
+
+namespace ciccloud {
+namespace {
+using sim::Feeder;
+using sim::FeederConfig;
+using Clock = std::chrono::steady_clock;
+
+constexpr uint16_t kPort = 18770;
+constexpr int kCallbackMs = 20;       // a location callback which blocks
+constexpr int kUpdatePeriodMs = 200;  // of the measurement thread, and of the epochs
+constexpr int kSatellites = 31;
+constexpr double kPi = 3.14159265358979323846;
+constexpr int64_t kGpsTimeNs = 1270000000LL * 1000000000LL;  // 2020-04-05
+
+class SlowSink : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override {
+        ++m_locations;
+        std::this_thread::sleep_for(std::chrono::milliseconds(kCallbackMs));
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+
+    uint64_t locations() const { return m_locations; }
+
+private:
+    mutable std::atomic<uint64_t> m_locations{0};
+};
+
+// A feeder on its own thread until the HAL goes away.
+class Feed {
+public:
+    Feed() : m_feeder(config()) {
+        m_thread = std::thread([this]() {
+            for (int i = 0; i < 100 && !m_feeder.connect(); ++i) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+            m_feeder.run(UINT64_MAX, nullptr);
+        });
+    }
+    ~Feed() {
+        m_feeder.requestStop();
+        m_thread.join();
+    }
+
+private:
+    static FeederConfig config() {
+        FeederConfig config;
+        config.port = kPort;
+        config.rateHz = 100;
+        return config;
+    }
+
+    Feeder m_feeder;
+    std::thread m_thread;
+};
+
+std::unique_ptr<GnssHwConn> makeConn(const GnssSink* sink) {
+    GnssHwConnConfig config;
+    config.tcpPort = kPort;
+    return std::make_unique<GnssHwConn>(sink, config);
+}
+
+void waitForLocations(const SlowSink& sink) {
+    const uint64_t n = sink.locations();
+    for (int i = 0; i < 200 && sink.locations() < n + 2; ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+}
+
+// Times `call` once per iteration, `setup` and `teardown` around it are not.
+template <class Setup, class Call, class Teardown>
+void measure(benchmark::State& state, Setup setup, Call call, Teardown teardown) {
+    double maxMs = 0;
+    for (auto _ : state) {
+        setup();
+        const Clock::time_point t0 = Clock::now();
+        call();
+        const std::chrono::duration<double> d = Clock::now() - t0;
+        teardown();
+        state.SetIterationTime(d.count());
+        maxMs = std::max(maxMs, d.count() * 1e3);
+    }
+    state.counters["max_ms"] = maxMs;
+}
+
+// Gnss20::cleanup before: destroy GnssHwConn on the binder thread.
+void BM_Cleanup_Sync(benchmark::State& state) {
+    SlowSink sink;
+    std::unique_ptr<GnssHwConn> conn;
+    std::unique_ptr<Feed> feed;
+    measure(state,
+            [&]() {
+                conn = makeConn(&sink);
+                conn->start();
+                feed = std::make_unique<Feed>();
+                waitForLocations(sink);
+            },
+            [&]() { conn.reset(); },
+            [&]() { feed.reset(); });
+}
+
+// now: close() waits for a callback in progress, not for the teardown.
+void BM_Cleanup_Async(benchmark::State& state) {
+    SlowSink sink;
+    ConnController controller(&sink, makeConn);
+    std::unique_ptr<Feed> feed;
+    measure(state,
+            [&]() {
+                controller.open();
+                controller.start();
+                controller.waitIdle(5000);
+                feed = std::make_unique<Feed>();
+                waitForLocations(sink);
+            },
+            [&]() { controller.close(); },
+            [&]() {
+                controller.waitIdle(5000);
+                feed.reset();
+            });
+}
+
+// start() and stop() in turn on a streaming connection.
+void BM_StartStop_Sync(benchmark::State& state) {
+    SlowSink sink;
+    std::unique_ptr<GnssHwConn> conn = makeConn(&sink);
+    conn->start();
+    Feed feed;
+    waitForLocations(sink);
+    bool started = true;
+    measure(state, []() {},
+            [&]() {
+                started ? conn->stop() : conn->start();
+                started = !started;
+            },
+            []() {});
+}
+
+void BM_StartStop_Async(benchmark::State& state) {
+    SlowSink sink;
+    ConnController controller(&sink, makeConn);
+    controller.open();
+    controller.start();
+    Feed feed;
+    waitForLocations(sink);
+    bool started = true;
+    measure(state, []() {},
+            [&]() {
+                started ? controller.stop() : controller.start();
+                started = !started;
+            },
+            []() {});
+    controller.close();
+}
+
+// GnssMeasurement20::close before: the update thread slept for its period
+// between updates and close() joined it.
+class SleepingLoop {
+public:
+    void start() {
+        m_running = true;
+        m_thread = std::thread([this]() {
+            while (m_running) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(kUpdatePeriodMs));
+            }
+        });
+    }
+    void stop() {
+        m_running = false;
+        m_thread.join();
+    }
+
+private:
+    std::atomic<bool> m_running{false};
+    std::thread m_thread;
+};
+
+// GnssMeasurement20::close now: the measurements run on the epochs of the
+// feed with the DataSink locked, and close() removes the listener under that
+// lock, so it waits for one MeasurementEngine::update at most. The epochs go
+// on for the whole run, like the feed.
+class EpochLoop {
+public:
+    EpochLoop() : m_engine(makeAlmanac()), m_out(MeasurementEngine::kMaxSatellites) {
+        m_rx.flags = LocationFlags::HAS_LAT_LONG | LocationFlags::HAS_ALTITUDE;
+        m_rx.latitudeDegrees = 37.422;
+        m_rx.longitudeDegrees = -122.084;
+        m_rx.altitudeMeters = 10;
+        m_thread = std::thread([this]() { epochs(); });
+    }
+    ~EpochLoop() {
+        m_running = false;
+        m_thread.join();
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_listening = true;
+    }
+    void stop() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_listening = false;
+    }
+
+private:
+    // planes of satellites evenly spread, like the bundled almanac
+    static std::vector<AlmanacEntry> makeAlmanac() {
+        std::vector<AlmanacEntry> almanac(kSatellites);
+        for (int i = 0; i < kSatellites; ++i) {
+            AlmanacEntry& e = almanac[i];
+            e.prn = i + 1;
+            e.eccentricity = 0.01;
+            e.toaSeconds = 405504;
+            e.inclinationRad = 55 * kPi / 180;
+            e.rateOfRightAscensionRadPerSec = -8e-9;
+            e.sqrtA = 5153.6;
+            e.rightAscensionRad = (i % 6) * 2 * kPi / 6 - kPi;
+            e.meanAnomalyRad = std::remainder((i / 6) * 2 * kPi * 6 / kSatellites + (i % 6) * 0.5,
+                                              2 * kPi);
+            e.week = 142;
+        }
+        return almanac;
+    }
+
+    // DataSink::gnssEpoch()
+    void epochs() {
+        int64_t gpsTimeNs = kGpsTimeNs;
+        while (m_running) {
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (m_listening) {
+                    m_engine.update(m_rx, gpsTimeNs, m_out.data(), m_out.size());
+                    benchmark::DoNotOptimize(m_out.data());
+                }
+            }
+            gpsTimeNs += kUpdatePeriodMs * 1000000LL;
+            std::this_thread::sleep_for(std::chrono::milliseconds(kUpdatePeriodMs));
+        }
+    }
+
+    MeasurementEngine m_engine;
+    std::vector<Measurement> m_out;
+    Location m_rx;
+    std::mutex m_mtx;  // of the DataSink
+    bool m_listening = false;
+    std::atomic<bool> m_running{true};
+    std::thread m_thread;
+};
+
+// close() at a random point of the period.
+template <class Loop>
+void measureClose(benchmark::State& state, Loop* loop) {
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int> delayMs(0, kUpdatePeriodMs - 1);
+    measure(state,
+            [&]() {
+                loop->start();
+                std::this_thread::sleep_for(std::chrono::milliseconds(delayMs(rng)));
+            },
+            [&]() { loop->stop(); },
+            []() {});
+}
+
+void BM_MeasurementClose_Sleep(benchmark::State& state) {
+    SleepingLoop loop;
+    measureClose(state, &loop);
+}
+
+void BM_MeasurementClose_Epoch(benchmark::State& state) {
+    EpochLoop loop;
+    measureClose(state, &loop);
+}
+
+BENCHMARK(BM_Cleanup_Sync)->UseManualTime()->Iterations(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_Cleanup_Async)->UseManualTime()->Iterations(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_StartStop_Sync)->UseManualTime()->Iterations(200)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_StartStop_Async)->UseManualTime()->Iterations(200)->Unit(benchmark::kMicrosecond);
+BENCHMARK(BM_MeasurementClose_Sleep)->UseManualTime()->Iterations(10)->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_MeasurementClose_Epoch)->UseManualTime()->Iterations(10)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
@@ -0,0 +1,201 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// FeedMux fanning one epoch out to 1 to 4096 HAL instances on unix sockets,
+// with all of them on one scenario (shared) or each on its own, as with a
+// feeder per instance:
+//   ns_per_instance is what the loop spends per instance and epoch,
+//   encodes_per_epoch the epochs encoded for it, writes_per_instance the
+//   writev calls, and allocs_per_epoch is counted after a warmup (0 with the
+//   rings filled).
+//
+//   $ gnss_cic_cloud_feed_mux_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "bench_counters.h"
+#include "feed_mux.h"
+
+namespace ciccloud {
+namespace {
+using sim::Endpoint;
+using sim::FeedMux;
+using sim::MuxScenario;
+
+constexpr int64_t kPeriodNs = 100000000LL;  // 10 Hz
+constexpr int kWarmupEpochs = 128;
+
+// The HAL ends: a listener per instance in the abstract namespace, and the
+// connections the mux made to them.
+class Instances {
+public:
+    explicit Instances(const int n) {
+        struct rlimit rl;
+        if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+            rl.rlim_cur = rl.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &rl);
+        }
+        for (int i = 0; i < n; ++i) {
+            char name[64];
+            snprintf(name, sizeof(name), "@gnss-feed-mux-benchmark-%d-%d", getpid(), i);
+            const int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+            struct sockaddr_un addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sun_family = AF_UNIX;
+            strncpy(addr.sun_path + 1, name + 1, sizeof(addr.sun_path) - 2);
+            const socklen_t len = offsetof(struct sockaddr_un, sun_path) + strlen(name);
+            if (fd < 0 || bind(fd, reinterpret_cast<struct sockaddr*>(&addr), len) < 0 ||
+                listen(fd, 1) < 0) {
+                if (fd >= 0) {
+                    close(fd);
+                }
+                break;
+            }
+            m_listeners.push_back(fd);
+            Endpoint ep;
+            ep.udsPath = name;
+            m_endpoints.push_back(ep);
+        }
+    }
+
+    ~Instances() {
+        for (const int fd : m_listeners) {
+            close(fd);
+        }
+        for (const int fd : m_connections) {
+            close(fd);
+        }
+    }
+
+    const std::vector<Endpoint>& endpoints() const { return m_endpoints; }
+
+    bool acceptAll() {
+        for (const int fd : m_listeners) {
+            const int c = accept4(fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (c < 0) {
+                return false;
+            }
+            m_connections.push_back(c);
+        }
+        return true;
+    }
+
+    void sendControl(const char cmd) {
+        for (const int fd : m_connections) {
+            send(fd, &cmd, 1, MSG_NOSIGNAL);
+        }
+    }
+
+    void drain() {
+        char buf[4096];
+        for (const int fd : m_connections) {
+            while (recv(fd, buf, sizeof(buf), MSG_DONTWAIT) > 0) {
+            }
+        }
+    }
+
+private:
+    std::vector<int> m_listeners;
+    std::vector<int> m_connections;
+    std::vector<Endpoint> m_endpoints;
+};
+
+void BM_FanOut(benchmark::State& state) {
+    const int n = state.range(0);
+    const bool shared = state.range(1);
+    Instances instances(n);
+    if (static_cast<int>(instances.endpoints().size()) != n) {
+        state.SkipWithError("could not listen, too few fds?");
+        return;
+    }
+
+    FeedMux mux;
+    MuxScenario scenario;
+    scenario.rateHz = 1e9 / kPeriodNs;
+    for (int i = 0; i < n; ++i) {
+        if (shared && i > 0) {
+            mux.addInstance(instances.endpoints()[i], 0);
+            continue;
+        }
+        scenario.bearingDegrees = 360.0 * i / n;
+        mux.addInstance(instances.endpoints()[i], mux.addScenario(scenario));
+    }
+
+    int64_t nowNs = 0;
+    mux.tick(nowNs);
+    if (!instances.acceptAll()) {
+        state.SkipWithError("connect failed");
+        return;
+    }
+    instances.sendControl(1);
+    for (int i = 0; i < 1000 && mux.stats().started < static_cast<size_t>(n); ++i) {
+        mux.wait(10);
+    }
+
+    auto epoch = [&]() {
+        nowNs += kPeriodNs;
+        mux.wait(0);
+        mux.tick(nowNs);
+    };
+    for (int i = 0; i < kWarmupEpochs; ++i) {
+        epoch();
+        instances.drain();
+    }
+    const uint64_t allocations = bench::allocationCount();
+    for (int i = 0; i < kWarmupEpochs; ++i) {
+        epoch();
+        instances.drain();
+    }
+    const uint64_t allocated = bench::allocationCount() - allocations;
+
+    const FeedMux::Stats s0 = mux.stats();
+    std::chrono::nanoseconds busy(0);
+    for (auto _ : state) {
+        const auto t0 = std::chrono::steady_clock::now();
+        epoch();
+        busy += std::chrono::steady_clock::now() - t0;
+        state.PauseTiming();
+        instances.drain();
+        state.ResumeTiming();
+    }
+    const FeedMux::Stats s1 = mux.stats();
+
+    const double epochs = state.iterations();
+    state.counters["started"] = s1.started;
+    state.counters["ns_per_instance"] = busy.count() / (epochs * n);
+    state.counters["encodes_per_epoch"] = (s1.epochs - s0.epochs) / epochs;
+    state.counters["writes_per_instance"] = (s1.writes - s0.writes) / (epochs * n);
+    state.counters["delivered_per_instance"] = (s1.delivered - s0.delivered) / (epochs * n);
+    state.counters["allocs_per_epoch"] = static_cast<double>(allocated) / kWarmupEpochs;
+}
+BENCHMARK(BM_FanOut)
+    ->ArgNames({"instances", "shared"})
+    ->ArgsProduct({{1, 16, 256, 1024, 4096}, {1, 0}})
+    ->Unit(benchmark::kMicrosecond);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
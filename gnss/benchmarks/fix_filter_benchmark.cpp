@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// FixFilter::update per fix, for both models, on a noisy circular drive
+// (RMC style fixes with speed and bearing, 3 m of noise per axis):
+//   ns_per_fix, allocs_per_fix (should be 0), and how well it filters:
+//   rms_error_raw_m and rms_error_m are the horizontal errors of the fixes
+//   and of the estimates, rms_accuracy_m what the estimates claim.
+//
+//   $ gnss_cic_cloud_fix_filter_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "bench_counters.h"
+#include "fix_filter.h"
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kEarthRadiusMeters = 6371000;
+constexpr int kFixes = 4096;
+constexpr double kNoiseMeters = 3;
+constexpr double kSpeedNoise = .5;
+constexpr int64_t kStartUtcMs = 12 * 3600 * 1000;
+
+struct Fix {
+    Location noisy;
+    sim::TrajectoryPoint truth;
+};
+
+std::vector<Fix> makeFixes(const int rateHz) {
+    const sim::Trajectory trajectory(kStartUtcMs, 37.422, -122.084, 10, 20, 0, 3);
+    std::mt19937 rng(1);
+    std::normal_distribution<double> noise(0, 1);
+    const double metersPerDegree = kEarthRadiusMeters * kPi / 180;
+
+    std::vector<Fix> fixes(kFixes);
+    for (int i = 0; i < kFixes; ++i) {
+        Fix& f = fixes[i];
+        f.truth = trajectory.at(kStartUtcMs + i * 1000LL / rateHz);
+        Location& loc = f.noisy;
+        loc.flags = LocationFlags::HAS_LAT_LONG | LocationFlags::HAS_ALTITUDE |
+                    LocationFlags::HAS_SPEED | LocationFlags::HAS_BEARING |
+                    LocationFlags::HAS_HORIZONTAL_ACCURACY | LocationFlags::HAS_SPEED_ACCURACY;
+        loc.utcTimeOfDayMs = f.truth.utcMs;
+        loc.latitudeDegrees = f.truth.latitudeDegrees + kNoiseMeters * noise(rng) / metersPerDegree;
+        loc.longitudeDegrees = f.truth.longitudeDegrees +
+            kNoiseMeters * noise(rng) /
+            (metersPerDegree * std::cos(f.truth.latitudeDegrees * kPi / 180));
+        loc.altitudeMeters = f.truth.altitudeMeters + 1.5 * kNoiseMeters * noise(rng);
+        loc.horizontalAccuracyMeters = kNoiseMeters * std::sqrt(2.);
+        const double ve = f.truth.speedMetersPerSec *
+                              std::sin(f.truth.bearingDegrees * kPi / 180) + kSpeedNoise * noise(rng);
+        const double vn = f.truth.speedMetersPerSec *
+                              std::cos(f.truth.bearingDegrees * kPi / 180) + kSpeedNoise * noise(rng);
+        loc.speedMetersPerSec = std::hypot(ve, vn);
+        loc.bearingDegrees = std::fmod(std::atan2(ve, vn) * 180 / kPi + 360, 360);
+        loc.speedAccuracyMetersPerSecond = kSpeedNoise;
+    }
+    return fixes;
+}
+
+double horizontalError(const Location& loc, const sim::TrajectoryPoint& truth) {
+    const double metersPerDegree = kEarthRadiusMeters * kPi / 180;
+    const double north = (loc.latitudeDegrees - truth.latitudeDegrees) * metersPerDegree;
+    const double east = (loc.longitudeDegrees - truth.longitudeDegrees) * metersPerDegree *
+                        std::cos(truth.latitudeDegrees * kPi / 180);
+    return std::hypot(east, north);
+}
+
+void BM_Update(benchmark::State& state, const FixFilterModel model) {
+    const std::vector<Fix> fixes = makeFixes(state.range(0));
+    FixFilterConfig config;
+    config.model = model;
+    FixFilter filter(config);
+
+    // the error once the filter settled, over one pass, which also counts
+    // the allocations without those of the benchmark library
+    const uint64_t allocations = bench::allocationCount();
+    double rawSquares = 0;
+    double squares = 0;
+    double accuracySquares = 0;
+    int settled = 0;
+    for (int i = 0; i < kFixes; ++i) {
+        Location loc = fixes[i].noisy;
+        filter.update(&loc, 1);
+        if (i >= kFixes / 8) {
+            rawSquares += std::pow(horizontalError(fixes[i].noisy, fixes[i].truth), 2);
+            squares += std::pow(horizontalError(loc, fixes[i].truth), 2);
+            accuracySquares += std::pow(loc.horizontalAccuracyMeters, 2);
+            ++settled;
+        }
+    }
+    const uint64_t allocated = bench::allocationCount() - allocations;
+
+    size_t i = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        Location loc = fixes[i].noisy;
+        filter.update(&loc, 1);
+        benchmark::DoNotOptimize(loc.latitudeDegrees);
+        if (++i == fixes.size()) {
+            i = 0;
+            filter.reset();
+        }
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const double n = state.iterations();
+    state.counters["ns_per_fix"] = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+    state.counters["allocs_per_fix"] = static_cast<double>(allocated) / kFixes;
+    state.counters["rms_error_raw_m"] = std::sqrt(rawSquares / settled);
+    state.counters["rms_error_m"] = std::sqrt(squares / settled);
+    state.counters["rms_accuracy_m"] = std::sqrt(accuracySquares / settled);
+}
+BENCHMARK_CAPTURE(BM_Update, cv, FixFilterModel::CONSTANT_VELOCITY)->Arg(1)->Arg(10)->Arg(100);
+BENCHMARK_CAPTURE(BM_Update, ca, FixFilterModel::CONSTANT_ACCELERATION)->Arg(1)->Arg(10)->Arg(100);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// FixHub::publish per fix, with 1 to 8 subscribers of one delivery mode,
+// and with subscribers which are too slow to keep up:
+//   ns_per_fix, allocs_per_fix (should be 0 once the pool has grown),
+//   pool (fixes in it), and for the slow ones dropped_per_fix and
+//   superseded_per_fix, what their queue or latest-only slot let go
+//   instead of holding up the publisher.
+//
+//   $ gnss_cic_cloud_fix_hub_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "bench_counters.h"
+#include "fix_hub.h"
+
+namespace ciccloud {
+namespace {
+constexpr int kWarmupFixes = 1024;
+
+class Consumer : public FixSubscriber {
+public:
+    explicit Consumer(const std::chrono::microseconds work = std::chrono::microseconds(0))
+        : m_work(work) {}
+
+    void onFix(const FixRef& fix) override {
+        m_sum.store(m_sum.load(std::memory_order_relaxed) + fix->location().latitudeDegrees,
+                    std::memory_order_relaxed);
+        if (m_work.count()) {
+            std::this_thread::sleep_for(m_work);
+        }
+    }
+
+private:
+    const std::chrono::microseconds m_work;
+    std::atomic<double> m_sum{0};
+};
+
+Location makeLocation(const int i) {
+    Location loc;
+    loc.flags = LocationFlags::HAS_LAT_LONG;
+    loc.latitudeDegrees = 37.422 + i * 1e-7;
+    loc.longitudeDegrees = -122.084;
+    loc.utcTimeOfDayMs = i;
+    return loc;
+}
+
+void run(benchmark::State& state, FixHub* hub, const std::vector<Consumer*>& slow) {
+    for (int i = 0; i < kWarmupFixes; ++i) {
+        hub->publish(makeLocation(i));
+    }
+    const uint64_t allocations = bench::allocationCount();
+    for (int i = 0; i < kWarmupFixes; ++i) {
+        hub->publish(makeLocation(i));
+    }
+    const uint64_t allocated = bench::allocationCount() - allocations;
+
+    int i = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        hub->publish(makeLocation(++i));
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const double n = state.iterations();
+    state.counters["ns_per_fix"] = std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+    state.counters["allocs_per_fix"] = static_cast<double>(allocated) / kWarmupFixes;
+    state.counters["pool"] = hub->poolSize();
+    if (!slow.empty()) {
+        uint64_t dropped = 0;
+        uint64_t superseded = 0;
+        for (const Consumer* c : slow) {
+            const FixHub::SubscriberStats s = hub->stats(c);
+            dropped += s.dropped;
+            superseded += s.superseded;
+        }
+        const double published = n + 2 * kWarmupFixes;
+        state.counters["dropped_per_fix"] = dropped / published;
+        state.counters["superseded_per_fix"] = superseded / published;
+    }
+}
+
+void BM_Publish(benchmark::State& state, const FixDelivery mode) {
+    std::vector<std::unique_ptr<Consumer>> consumers;
+    FixHub hub;
+    for (int64_t i = 0; i < state.range(0); ++i) {
+        consumers.push_back(std::make_unique<Consumer>());
+        hub.subscribe(consumers.back().get(), mode);
+    }
+    run(state, &hub, {});
+    for (const std::unique_ptr<Consumer>& c : consumers) {
+        hub.unsubscribe(c.get());
+    }
+}
+BENCHMARK_CAPTURE(BM_Publish, inline, FixDelivery::INLINE)->Arg(1)->Arg(4)->Arg(8);
+BENCHMARK_CAPTURE(BM_Publish, queue, FixDelivery::QUEUE)->Arg(1)->Arg(4)->Arg(8);
+BENCHMARK_CAPTURE(BM_Publish, latest, FixDelivery::LATEST)->Arg(1)->Arg(4)->Arg(8);
+
+// What the HAL runs with: the callback inline, and consumers which take
+// far longer per fix than the feed gives them, one queued and one
+// latest-only.
+void BM_PublishWithSlowConsumers(benchmark::State& state) {
+    Consumer callback;
+    Consumer recorder(std::chrono::microseconds(200));
+    Consumer snapshot(std::chrono::microseconds(200));
+    FixHub hub;
+    hub.subscribe(&callback, FixDelivery::INLINE);
+    hub.subscribe(&recorder, FixDelivery::QUEUE);
+    hub.subscribe(&snapshot, FixDelivery::LATEST);
+    run(state, &hub, {&recorder, &snapshot});
+    hub.unsubscribe(&recorder);
+    hub.unsubscribe(&snapshot);
+    hub.unsubscribe(&callback);
+}
+BENCHMARK(BM_PublishWithSlowConsumers);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// MeasurementEngine::update per epoch, for growing constellations of nominal
+// orbits (planes of satellites evenly spread, like the bundled almanac):
+//   ns_per_epoch, ns_per_satellite (of the constellation), in_view and
+//   allocs_per_epoch, which should be 0.
+//
+//   $ gnss_cic_cloud_measurement_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "bench_counters.h"
+#include "measurement_engine.h"
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr int kPlanes = 6;
+constexpr int64_t kGpsTimeNs = 1270000000LL * 1000000000LL;  // 2020-04-05
+constexpr int64_t kEpochNs = 1000000000;
+
+std::vector<AlmanacEntry> makeAlmanac(const int satellites) {
+    std::vector<AlmanacEntry> almanac(satellites);
+    for (int i = 0; i < satellites; ++i) {
+        const int plane = i % kPlanes;
+        const int slot = i / kPlanes;
+        AlmanacEntry& e = almanac[i];
+        e.prn = i + 1;
+        e.eccentricity = 0.01;
+        e.toaSeconds = 405504;
+        e.inclinationRad = 55 * kPi / 180;
+        e.rateOfRightAscensionRadPerSec = -8e-9;
+        e.sqrtA = 5153.6;
+        e.rightAscensionRad = plane * 2 * kPi / kPlanes - kPi;
+        e.meanAnomalyRad = std::remainder(slot * 2 * kPi * kPlanes / satellites + plane * 0.5, 2 * kPi);
+        e.week = 142;
+    }
+    return almanac;
+}
+
+void BM_Update(benchmark::State& state) {
+    const int satellites = state.range(0);
+    MeasurementEngine engine(makeAlmanac(satellites));
+    Location rx;
+    rx.flags = LocationFlags::HAS_LAT_LONG | LocationFlags::HAS_ALTITUDE |
+               LocationFlags::HAS_SPEED | LocationFlags::HAS_BEARING;
+    rx.latitudeDegrees = 37.422;
+    rx.longitudeDegrees = -122.084;
+    rx.altitudeMeters = 10;
+    rx.speedMetersPerSec = 20;
+    rx.bearingDegrees = 45;
+
+    std::vector<Measurement> out(MeasurementEngine::kMaxSatellites);
+    int64_t gpsTimeNs = kGpsTimeNs;
+    size_t inView = 0;
+    const uint64_t allocations = bench::allocationCount();
+    const auto t0 = std::chrono::steady_clock::now();
+    for (auto _ : state) {
+        inView += engine.update(rx, gpsTimeNs, out.data(), out.size());
+        benchmark::DoNotOptimize(out.data());
+        gpsTimeNs += kEpochNs;
+    }
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const double n = state.iterations();
+    const double ns = std::chrono::duration<double, std::nano>(t1 - t0).count();
+    state.counters["ns_per_epoch"] = ns / n;
+    state.counters["ns_per_satellite"] = ns / n / satellites;
+    state.counters["in_view"] = inView / n;
+    state.counters["allocs_per_epoch"] = (bench::allocationCount() - allocations) / n;
+}
+BENCHMARK(BM_Update)->Arg(8)->Arg(16)->Arg(32)->Arg(64);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
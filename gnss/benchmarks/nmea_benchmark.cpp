@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Parser and pipeline cost per sentence, for every corpus:
+//   ns_per_sentence, bytes_per_second, allocs_per_sentence and, where perf
+//   events are available, instructions_per_sentence.
+//
+// The steady state must not allocate: a benchmark whose code under test
+// calls operator new after the warm-up pass reports an error, but that
+// does not fail the run. gnss_cic_cloud_allocation_test is the check.
+//
+//   $ gnss_cic_cloud_nmea_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+#include "bench_counters.h"
+#include "gnss_hw_listener.h"
+#include "nmea_generator.h"
+#include "nmea_parser.h"
+#include "sv_status_publisher.h"
+
+namespace ciccloud {
+namespace {
+using sim::Corpus;
+
+constexpr int kEpochs = 1000;
+
+class NullSink : public GnssSink {
+public:
+    void gnssLocation(const Location& loc) const override {
+        benchmark::DoNotOptimize(loc.latitudeDegrees);
+    }
+    void gnssSvStatus(const SvInfo* svInfo, size_t) const override {
+        benchmark::DoNotOptimize(svInfo);
+    }
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char* nmea, size_t) const override {
+        benchmark::DoNotOptimize(nmea);
+    }
+};
+
+// Sets the common counters, `run` is called once per iteration and must
+// process all `sentences` of `bytes`.
+template <class Run>
+void measure(benchmark::State& state, const size_t sentences, const size_t bytes, Run run) {
+    run();  // warm up, the first pass may allocate
+
+    // only what `run` allocates, not the benchmark library
+    bench::InstructionCounter instructions;
+    uint64_t allocations = 0;
+    const auto t0 = std::chrono::steady_clock::now();
+    instructions.start();
+    for (auto _ : state) {
+        const uint64_t before = bench::allocationCount();
+        run();
+        allocations += bench::allocationCount() - before;
+    }
+    instructions.stop();
+    const auto t1 = std::chrono::steady_clock::now();
+
+    const double n = double(state.iterations()) * sentences;
+    state.SetBytesProcessed(state.iterations() * bytes);
+    state.SetItemsProcessed(state.iterations() * sentences);
+    state.counters["ns_per_sentence"] =
+        std::chrono::duration<double, std::nano>(t1 - t0).count() / n;
+    state.counters["allocs_per_sentence"] = allocations / n;
+    if (instructions.ok()) {
+        state.counters["instructions_per_sentence"] = instructions.count() / n;
+    }
+    if (allocations) {
+        state.SkipWithError("heap allocation in the steady state");
+    }
+}
+
+size_t countSentences(const std::string& data) {
+    return std::count(data.begin(), data.end(), '\n');
+}
+
+// Framing, parsing and delivery, the way GnssHwConn drives it.
+void BM_Consume(benchmark::State& state, const Corpus corpus) {
+    const std::string data = sim::makeCorpus(corpus, kEpochs);
+    NullSink sink;
+    SvStatusPublisher publisher(&sink, SvStatusPublisherConfig());
+    GnssHwListener listener(&publisher);
+
+    measure(state, countSentences(data), data.size(), [&]() {
+        listener.consume(data.data(), data.size());
+    });
+}
+
+// NmeaParser::parse alone on pre-framed sentences. Each one is a separate
+// NUL terminated string, like the framer provides: sscanf would otherwise
+// strlen() the rest of the corpus on every call.
+void BM_Parse(benchmark::State& state, const Corpus corpus) {
+    const std::string data = sim::makeCorpus(corpus, kEpochs);
+    std::vector<std::string> sentences;
+    for (size_t i = data.find('$'); i != std::string::npos; i = data.find('$', i + 1)) {
+        const size_t eol = data.find('\n', i);
+        if (eol == std::string::npos) {
+            break;
+        }
+        sentences.push_back(data.substr(i, eol + 1 - i));
+    }
+
+    NullSink sink;
+    NmeaParser parser(&sink);
+    const int64_t nowNs = 1585742400000000000LL;
+
+    measure(state, sentences.size(), data.size(), [&]() {
+        for (const std::string& s : sentences) {
+            const char* end = s.data() + s.size() - 1;
+            if (end[-1] == '\r') {
+                --end;
+            }
+            benchmark::DoNotOptimize(parser.parse(s.data() + 1, end, nowNs, nowNs));
+        }
+    });
+}
+
+BENCHMARK_CAPTURE(BM_Consume, rmc_gga, Corpus::RMC_GGA);
+BENCHMARK_CAPTURE(BM_Consume, multi_talker, Corpus::MULTI_TALKER);
+BENCHMARK_CAPTURE(BM_Consume, high_noise, Corpus::HIGH_NOISE);
+BENCHMARK_CAPTURE(BM_Consume, long_fraction, Corpus::LONG_FRACTION);
+
+BENCHMARK_CAPTURE(BM_Parse, rmc_gga, Corpus::RMC_GGA);
+BENCHMARK_CAPTURE(BM_Parse, multi_talker, Corpus::MULTI_TALKER);
+BENCHMARK_CAPTURE(BM_Parse, high_noise, Corpus::HIGH_NOISE);
+BENCHMARK_CAPTURE(BM_Parse, long_fraction, Corpus::LONG_FRACTION);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
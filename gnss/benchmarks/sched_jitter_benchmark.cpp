@@ -0,0 +1,207 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Delivery jitter of a 50 Hz feed through an in-process GnssHwConn while
+// threads spinning on every CPU (2 per CPU) compete with it, with the HAL
+// threads on the defaults and with the options of ThreadPolicyConfig. The
+// feeder stands in for a remote one and runs with the same policy as the
+// HAL threads, so the hogs do not delay the sends instead:
+//   ivl_sd_ms is the standard deviation of the interval between fixes less
+//   the interval between their sends, what the HAL side added to it,
+//   lat_p50_ms, lat_p99_ms and lat_max_ms how long an epoch took from the
+//   feeder's send to the sink, and applied is 0 where the kernel refused the
+//   policy (no CAP_SYS_NICE or CAP_IPC_LOCK): then it ran on the defaults.
+//
+//   $ gnss_cic_cloud_sched_jitter_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "feeder.h"
+#include "gnss_hw_conn.h"
+#include "thread_policy.h"
+
+namespace ciccloud {
+namespace {
+using sim::Feeder;
+using sim::FeederConfig;
+using sim::steadyNowNs;
+
+constexpr uint16_t kPort = 18771;
+constexpr double kRateHz = 50;
+constexpr uint64_t kEpochs = 250;  // 5 s
+
+// Timestamps the first fix of every epoch.
+class TimingSink : public GnssSink {
+public:
+    explicit TimingSink(std::atomic<int64_t>* deliveredNs) : m_deliveredNs(deliveredNs) {}
+
+    void gnssLocation(const Location& loc) const override {
+        const int64_t seq = Feeder::seqOf(loc.utcTimeOfDayMs, Feeder::epochMs(kRateHz));
+        if (seq >= 0 && static_cast<uint64_t>(seq) < kEpochs) {
+            int64_t expected = 0;
+            m_deliveredNs[seq].compare_exchange_strong(expected, steadyNowNs(),
+                                                       std::memory_order_relaxed);
+        }
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+
+private:
+    std::atomic<int64_t>* const m_deliveredNs;
+};
+
+// Threads which want all the CPU there is, at the default class and nice.
+class CpuHog {
+public:
+    explicit CpuHog(const bool on) {
+        const unsigned n = on ? 2 * std::max(1u, std::thread::hardware_concurrency()) : 0;
+        for (unsigned i = 0; i < n; ++i) {
+            m_threads.emplace_back([this]() {
+                volatile uint64_t x = 0;
+                while (!m_quit.load(std::memory_order_relaxed)) {
+                    x = x + 1;
+                }
+            });
+        }
+    }
+    ~CpuHog() {
+        m_quit = true;
+        for (std::thread& t : m_threads) {
+            t.join();
+        }
+    }
+
+private:
+    std::atomic<bool> m_quit{false};
+    std::vector<std::thread> m_threads;
+};
+
+// Whether the kernel lets a thread have the policy.
+bool canApply(const ThreadPolicyConfig& policy) {
+    bool ok = false;
+    std::thread([&]() { ok = applyThreadPolicy(policy); }).join();
+    return ok;
+}
+
+double percentile(std::vector<double> v, const double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    const size_t i = std::min(v.size() - 1, static_cast<size_t>(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i];
+}
+
+void BM_Jitter(benchmark::State& state, const ThreadPolicyConfig& policy) {
+    const bool hog = state.range(0);
+    std::vector<double> intervalsMs;
+    std::vector<double> latenciesMs;
+    for (auto _ : state) {
+        std::unique_ptr<std::atomic<int64_t>[]> sentNs(new std::atomic<int64_t>[kEpochs]());
+        std::unique_ptr<std::atomic<int64_t>[]> deliveredNs(new std::atomic<int64_t>[kEpochs]());
+        TimingSink sink(deliveredNs.get());
+
+        GnssHwConnConfig config;
+        config.tcpPort = kPort;
+        config.threads = policy;
+        GnssHwConn conn(&sink, config);
+        conn.start();
+        CpuHog cpuHog(hog);
+
+        FeederConfig feederConfig;
+        feederConfig.port = kPort;
+        feederConfig.rateHz = kRateHz;
+        Feeder feeder(feederConfig);
+        for (int i = 0; i < 100 && !feeder.connect(); ++i) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::thread([&]() {
+            applyThreadPolicy(policy);
+            feeder.run(kEpochs, sentNs.get());
+        }).join();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));  // the last ones in flight
+
+        for (uint64_t seq = 0; seq < kEpochs; ++seq) {
+            const int64_t d = deliveredNs[seq].load();
+            const int64_t s = sentNs[seq].load();
+            if (d && s) {
+                latenciesMs.push_back((d - s) / 1e6);
+            }
+            const int64_t prevD = seq ? deliveredNs[seq - 1].load() : 0;
+            const int64_t prevS = seq ? sentNs[seq - 1].load() : 0;
+            if (d && s && prevD && prevS) {
+                intervalsMs.push_back(((d - prevD) - (s - prevS)) / 1e6);
+            }
+        }
+    }
+
+    double mean = 0;
+    for (const double v : intervalsMs) {
+        mean += v;
+    }
+    mean /= std::max<size_t>(1, intervalsMs.size());
+    double var = 0;
+    for (const double v : intervalsMs) {
+        var += (v - mean) * (v - mean);
+    }
+    var /= std::max<size_t>(1, intervalsMs.size());
+
+    state.counters["applied"] = canApply(policy);
+    state.counters["ivl_sd_ms"] = std::sqrt(var);
+    state.counters["lat_p50_ms"] = percentile(latenciesMs, 0.5);
+    state.counters["lat_p99_ms"] = percentile(latenciesMs, 0.99);
+    state.counters["lat_max_ms"] = percentile(latenciesMs, 1);
+    state.counters["lost"] = state.iterations() * kEpochs - latenciesMs.size();
+}
+
+ThreadPolicyConfig nice(const int n) {
+    ThreadPolicyConfig c;
+    c.nice = n;
+    return c;
+}
+
+ThreadPolicyConfig realtime(const SchedClass schedClass, const bool pinned) {
+    ThreadPolicyConfig c;
+    c.schedClass = schedClass;
+    c.priority = 10;
+    if (pinned) {
+        // the last CPU, away from where interrupts and the rest tend to go
+        c.cpus = std::to_string(std::max(1u, std::thread::hardware_concurrency()) - 1);
+        c.lockMemory = true;
+    }
+    return c;
+}
+
+BENCHMARK_CAPTURE(BM_Jitter, default, ThreadPolicyConfig())
+    ->ArgName("hog")->Arg(0)->Arg(1)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Jitter, nice_minus_10, nice(-10))
+    ->ArgName("hog")->Arg(1)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Jitter, fifo, realtime(SchedClass::FIFO, false))
+    ->ArgName("hog")->Arg(1)->Iterations(1)->Unit(benchmark::kMillisecond);
+BENCHMARK_CAPTURE(BM_Jitter, rr_pinned_mlock, realtime(SchedClass::RR, true))
+    ->ArgName("hog")->Arg(1)->Iterations(1)->Unit(benchmark::kMillisecond);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
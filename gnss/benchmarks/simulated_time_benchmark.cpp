@@ -0,0 +1,175 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Hours of a 10 Hz feed through an in-process GnssHwConn on a SimulatedClock:
+// the clock moves to each epoch, the epoch goes over the socket and the next
+// one follows once the sink has its fixes, so nothing waits for real time.
+//   sim_x is how much faster than real time it ran, us_per_epoch the real
+//   time per epoch, and stable is 1 if every iteration delivered exactly the
+//   same fixes with the same timestamps (digest, of the last one).
+//
+// The wakeup policy is off (virtual.gps.wakeup.max_hold_ms = 0): it holds
+// an epoch for real time to pass, and this one waits for the epoch.
+//
+//   $ gnss_cic_cloud_simulated_time_benchmark --benchmark_counters_tabular=true
+
+#include <benchmark/benchmark.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <thread>
+#include "clock.h"
+#include "feeder.h"
+#include "gnss_hw_conn.h"
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace {
+using sim::Feeder;
+
+constexpr uint16_t kPort = 18772;
+constexpr int64_t kPeriodMs = 100;
+constexpr int64_t kBootNs = 3600LL * 1000000000LL;  // an hour after boot
+constexpr uint64_t kLocationsPerEpoch = 2;          // RMC and GGA
+
+// Folds every fix into an FNV-1a digest: time stamps, position and all.
+class DigestSink : public GnssSink {
+public:
+    void gnssLocation(const Location& loc) const override {
+        mix(loc.elapsedRealtimeNs);
+        mix(loc.timestampMs);
+        mix(loc.utcTimeOfDayMs);
+        int64_t bits;
+        memcpy(&bits, &loc.latitudeDegrees, sizeof(bits));
+        mix(bits);
+        memcpy(&bits, &loc.longitudeDegrees, sizeof(bits));
+        mix(bits);
+        m_locations.fetch_add(1, std::memory_order_release);
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+
+    uint64_t locations() const { return m_locations.load(std::memory_order_acquire); }
+    uint64_t digest() const { return m_digest; }
+
+private:
+    void mix(const int64_t v) const {
+        for (int i = 0; i < 8; ++i) {
+            m_digest = (m_digest ^ ((static_cast<uint64_t>(v) >> (8 * i)) & 0xff)) *
+                       1099511628211ULL;
+        }
+    }
+
+    mutable uint64_t m_digest = 14695981039346656037ULL;  // the worker thread's
+    mutable std::atomic<uint64_t> m_locations{0};
+};
+
+int connectFeed() {
+    for (int attempt = 0; attempt < 100; ++attempt) {
+        const int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(kPort);
+        inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+        if (connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) == 0) {
+            const int one = 1;
+            setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            return fd;
+        }
+        close(fd);
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return -1;
+}
+
+// Returns the digest of what the sink got, 0 if it did not get it all.
+uint64_t runSimulated(const uint64_t epochs) {
+    SimulatedClock clock(Feeder::kBaseUtcMs * 1000000LL, kBootNs);
+    DigestSink sink;
+    GnssHwConnConfig config;
+    config.tcpPort = kPort;
+    config.clock = &clock;
+    config.wakeup.maxHoldMs = 0;
+    GnssHwConn conn(&sink, config);
+    conn.start();
+
+    const int fd = connectFeed();
+    char start = 0;
+    if (fd < 0 || recv(fd, &start, 1, MSG_WAITALL) != 1 || start != 1) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return 0;
+    }
+
+    const sim::Trajectory trajectory(Feeder::kBaseUtcMs, 37.4220, -122.0841, 30, 15, 0, 2);
+    sim::NmeaFormat fmt;
+    fmt.timeDecimals = 3;
+    char buf[512];
+    for (uint64_t seq = 0; seq < epochs; ++seq) {
+        clock.advanceTo(kBootNs + seq * kPeriodMs * 1000000LL);
+        const sim::TrajectoryPoint p = trajectory.at(Feeder::kBaseUtcMs + seq * kPeriodMs);
+        size_t size = sim::formatRMC(p, fmt, buf, sizeof(buf));
+        size += sim::formatGGA(p, fmt, buf + size, sizeof(buf) - size);
+        if (send(fd, buf, size, MSG_NOSIGNAL) != static_cast<ssize_t>(size)) {
+            break;
+        }
+        const uint64_t expected = (seq + 1) * kLocationsPerEpoch;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (sink.locations() < expected && std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::yield();
+        }
+    }
+    close(fd);
+    return (sink.locations() == epochs * kLocationsPerEpoch) ? sink.digest() : 0;
+}
+
+void BM_SimulatedHours(benchmark::State& state) {
+    const uint64_t epochs = state.range(0) * 3600 * 1000 / kPeriodMs;
+    uint64_t first = 0;
+    bool stable = true;
+    double realSeconds = 0;
+    for (auto _ : state) {
+        const auto t0 = std::chrono::steady_clock::now();
+        const uint64_t digest = runSimulated(epochs);
+        realSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        if (!first) {
+            first = digest;
+        }
+        stable &= (digest != 0 && digest == first);
+    }
+
+    const double n = state.iterations();
+    state.counters["sim_x"] = n * epochs * kPeriodMs / 1e3 / realSeconds;
+    state.counters["us_per_epoch"] = realSeconds * 1e6 / (n * epochs);
+    state.counters["stable"] = stable;
+    state.counters["digest"] = static_cast<double>(first & 0xffffffff);
+}
+BENCHMARK(BM_SimulatedHours)
+    ->ArgName("hours")->Arg(1)->Arg(24)->Iterations(2)->Unit(benchmark::kSecond);
+
+}  // namespace
+}  // namespace ciccloud
+
+BENCHMARK_MAIN();
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "clock.h"
+#include <algorithm>
+#include "util.h"
+
+namespace ciccloud {
+namespace {
+
+class SystemClock : public Clock {
+public:
+    int64_t utcNanos() const override { return util::nowNanos(); }
+    int64_t bootNanos() const override { return util::bootNanos(); }
+    int64_t rxBootNanos(const int64_t realtimeNs, const int64_t bootNowNs) const override {
+        return util::realtimeToBootNanos(realtimeNs, bootNowNs);
+    }
+};
+
+}  // namespace
+
+Clock& systemClock() {
+    static SystemClock clock;
+    return clock;
+}
+
+SimulatedClock::SimulatedClock(const int64_t utcNs, const int64_t bootNs)
+    : m_utcMinusBootNs(utcNs - bootNs)
+    , m_bootNs(bootNs) {}
+
+int64_t SimulatedClock::utcNanos() const {
+    return m_bootNs.load(std::memory_order_acquire) + m_utcMinusBootNs;
+}
+
+int64_t SimulatedClock::bootNanos() const {
+    return m_bootNs.load(std::memory_order_acquire);
+}
+
+int64_t SimulatedClock::rxBootNanos(int64_t, const int64_t bootNowNs) const {
+    return bootNowNs;
+}
+
+int SimulatedClock::addWaker(std::function<void()> wake) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    const int id = m_nextWakerId++;
+    m_wakers.emplace_back(id, std::move(wake));
+    return id;
+}
+
+void SimulatedClock::removeWaker(const int id) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_wakers.erase(std::remove_if(m_wakers.begin(), m_wakers.end(),
+                                  [id](const std::pair<int, std::function<void()>>& w) {
+                                      return w.first == id;
+                                  }),
+                   m_wakers.end());
+}
+
+void SimulatedClock::advance(const int64_t ns) {
+    advanceTo(bootNanos() + ns);
+}
+
+void SimulatedClock::advanceTo(const int64_t bootNs) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (bootNs <= m_bootNs.load(std::memory_order_relaxed)) {
+        return;
+    }
+    m_bootNs.store(bootNs, std::memory_order_release);
+    for (const std::pair<int, std::function<void()>>& w : m_wakers) {
+        w.second();
+    }
+}
+
+}  // namespace ciccloud
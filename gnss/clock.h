@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace ciccloud {
+
+// The time the feed pipeline runs on: when a sentence arrived, when a fix
+// was taken, when a ping is due. systemClock() is the real one. A
+// SimulatedClock moves only when told to, so a day of feed can go through
+// GnssHwConn in seconds and come out with the same timestamps every run.
+class Clock {
+public:
+    virtual ~Clock() = default;
+
+    virtual int64_t utcNanos() const = 0;   // as util::nowNanos()
+    virtual int64_t bootNanos() const = 0;  // as util::bootNanos()
+    // A kernel receive timestamp (SO_TIMESTAMPNS, CLOCK_REALTIME) of the
+    // recent past on bootNanos(), given bootNanos() of now.
+    virtual int64_t rxBootNanos(int64_t realtimeNs, int64_t bootNowNs) const = 0;
+
+    // For a loop which sleeps until a deadline on this clock: `wake` is
+    // called from the thread which moves the time, whenever it does. The
+    // real clocks move on their own and the timeout of the sleep does it,
+    // so they never call it. Returns an id for removeWaker().
+    virtual int addWaker(std::function<void()> wake) {
+        (void)wake;
+        return 0;
+    }
+    virtual void removeWaker(int id) { (void)id; }
+};
+
+Clock& systemClock();
+
+// Starts at the given times and stands still until advanced.
+class SimulatedClock : public Clock {
+public:
+    SimulatedClock(int64_t utcNs, int64_t bootNs);
+
+    int64_t utcNanos() const override;
+    int64_t bootNanos() const override;
+    // there is no kernel time in a simulation, data arrives when it is read
+    int64_t rxBootNanos(int64_t realtimeNs, int64_t bootNowNs) const override;
+    int addWaker(std::function<void()> wake) override;
+    void removeWaker(int id) override;
+
+    void advance(int64_t ns);
+    void advanceTo(int64_t bootNs);  // never back
+
+private:
+    const int64_t m_utcMinusBootNs;
+    std::atomic<int64_t> m_bootNs;
+    std::mutex m_mtx;  // guards the wakers, held while calling them
+    std::vector<std::pair<int, std::function<void()>>> m_wakers;
+    int m_nextWakerId = 1;
+};
+
+}  // namespace ciccloud
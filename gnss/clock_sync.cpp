@@ -0,0 +1,93 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "clock_sync.h"
+#include <algorithm>
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kDayNs = 24LL * 3600LL * 1000000000LL;
+constexpr int64_t kDriftPpm = 100;  // what two free running clocks may do
+}  // namespace
+
+void ClockSync::reset() {
+    m_count = 0;
+    m_next = 0;
+    m_best = 0;
+    m_exchanges = 0;
+    m_lastPingNs = 0;
+    m_pendingT1Ns = -1;
+    m_supported = false;
+}
+
+int64_t ClockSync::nextPingNs() const {
+    if (!m_supported) {
+        return INT64_MAX;
+    }
+    return m_lastPingNs + ((m_exchanges < kFastPings) ? kFastPingPeriodNs : kPingPeriodNs);
+}
+
+void ClockSync::onPingSent(const int64_t t1Ns) {
+    m_lastPingNs = t1Ns;
+    m_pendingT1Ns = t1Ns;
+}
+
+void ClockSync::onPong(const int64_t t1Ns, const int64_t t2Ns, const int64_t t3Ns,
+                       const int64_t t4Ns) {
+    if (t1Ns != m_pendingT1Ns || t3Ns < t2Ns || t4Ns < t1Ns) {
+        return;  // a late answer to an older ping, or garbage
+    }
+    m_pendingT1Ns = -1;
+    ++m_exchanges;
+
+    Sample& s = m_samples[m_next];
+    s.offsetNs = ((t2Ns - t1Ns) + (t3Ns - t4Ns)) / 2;
+    s.delayNs = std::max<int64_t>(0, (t4Ns - t1Ns) - (t3Ns - t2Ns));
+    s.t4Ns = t4Ns;
+    m_next = (m_next + 1) % kSamples;
+    m_count = std::min(m_count + 1, kSamples);
+
+    m_best = 0;
+    for (size_t i = 1; i < m_count; ++i) {
+        if (m_samples[i].delayNs < m_samples[m_best].delayNs) {
+            m_best = i;
+        }
+    }
+}
+
+bool ClockSync::toBootTime(const int64_t utcTimeOfDayMs, const int64_t rxBootNs,
+                           int64_t* bootNs, int64_t* uncertaintyNs) const {
+    if (m_count == 0) {
+        return false;
+    }
+    const Sample& s = m_samples[m_best];
+
+    // how long before the arrival, in the feeder clock, the fix was taken
+    const int64_t feederTodNs = ((rxBootNs + s.offsetNs) % kDayNs + kDayNs) % kDayNs;
+    int64_t deltaNs = (utcTimeOfDayMs * 1000000LL - feederTodNs) % kDayNs;
+    if (deltaNs < -kDayNs / 2) {
+        deltaNs += kDayNs;
+    } else if (deltaNs >= kDayNs / 2) {
+        deltaNs -= kDayNs;
+    }
+
+    const int64_t ageNs = std::max<int64_t>(0, rxBootNs - s.t4Ns);
+    *uncertaintyNs = s.delayNs / 2 + ageNs / 1000000 * kDriftPpm;
+    *bootNs = rxBootNs + std::min<int64_t>(deltaNs, 0);  // never after it arrived
+    return true;
+}
+
+}  // namespace ciccloud
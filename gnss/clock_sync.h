@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ciccloud {
+
+// Estimates the offset between the feeder clock, the one its sentence times
+// are in, and CLOCK_BOOTTIME, so a fix can be stamped with the time it was
+// taken instead of the time it arrived.
+//
+// The exchange is NTP's: the HAL sends a ping carrying t1 (boottime), the
+// feeder answers $PCCTS,t1,t2,t3 with its receive and send times and the
+// kernel receive timestamp of the answer is t4. Of the last kSamples
+// exchanges the one with the smallest round trip wins, its half round trip
+// is the uncertainty. Only feeders which announce "TS" in $PCCCAP are pinged.
+//
+// Not thread safe, it is owned by the worker thread.
+class ClockSync {
+public:
+    static constexpr size_t kSamples = 8;
+    static constexpr uint64_t kFastPings = 4;  // to get a first estimate quickly
+    static constexpr int64_t kFastPingPeriodNs = 250000000LL;
+    static constexpr int64_t kPingPeriodNs = 2000000000LL;
+
+    void reset();
+
+    void setSupported(bool supported) { m_supported = supported; }
+    bool supported() const { return m_supported; }
+
+    // When the next ping is due (boottime), INT64_MAX if the feeder does not
+    // support them.
+    int64_t nextPingNs() const;
+    void onPingSent(int64_t t1Ns);
+    void onPong(int64_t t1Ns, int64_t t2Ns, int64_t t3Ns, int64_t t4Ns);
+
+    bool synchronized() const { return m_count > 0; }
+
+    // Maps a sentence time of day to boottime, using the arrival time to pick
+    // the day. Returns false if there is no estimate yet.
+    bool toBootTime(int64_t utcTimeOfDayMs, int64_t rxBootNs,
+                    int64_t* bootNs, int64_t* uncertaintyNs) const;
+
+private:
+    struct Sample {
+        int64_t offsetNs;  // feeder - boottime
+        int64_t delayNs;   // round trip without the feeder's turnaround
+        int64_t t4Ns;
+    };
+
+    std::array<Sample, kSamples> m_samples;
+    size_t m_count = 0;
+    size_t m_next = 0;
+    size_t m_best = 0;
+    uint64_t m_exchanges = 0;
+    int64_t m_lastPingNs = 0;
+    int64_t m_pendingT1Ns = -1;  // the ping we wait an answer for
+    bool m_supported = false;
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,168 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "conn_controller.h"
+#include <log/log.h>
+#include <chrono>
+#include "trace.h"
+
+namespace ciccloud {
+
+ConnController::ConnController(const GnssSink* sink, Factory factory)
+    : m_sink(sink)
+    , m_factory(std::move(factory)) {
+    m_thread = std::thread([this]() { controlThread(); });
+}
+
+ConnController::~ConnController() {
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_wanted = State::CLOSED;
+        m_quit = true;
+    }
+    m_wakeup.notify();
+    m_thread.join();
+}
+
+void ConnController::open() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_wanted == State::CLOSED) {
+        m_wanted = State::OPEN;
+        m_idle = false;
+        m_wakeup.notify();
+    }
+}
+
+bool ConnController::start() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_wanted == State::CLOSED) {
+        return false;
+    }
+    m_wanted = State::STARTED;
+    m_idle = false;
+    m_wakeup.notify();
+    return true;
+}
+
+bool ConnController::stop() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_wanted == State::CLOSED) {
+        return false;
+    }
+    m_wanted = State::OPEN;
+    m_idle = false;
+    m_wakeup.notify();
+    return true;
+}
+
+void ConnController::close() {
+    std::shared_ptr<SinkGate> gate;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_wanted = State::CLOSED;
+        m_idle = false;
+        m_wakeup.notify();
+        gate = std::move(m_gate);
+    }
+    if (gate) {
+        gate->close();  // not under m_mtx, a sink call may take long
+    }
+}
+
+bool ConnController::waitIdle(const int timeoutMs) {
+    std::unique_lock<std::mutex> lock(m_mtx);
+    return m_idleCv.wait_for(lock, std::chrono::milliseconds(timeoutMs),
+                             [this]() { return m_idle; });
+}
+
+// One step at a time towards m_wanted, which may change after every step.
+// A GnssHwConn which fails to open is tried again on the next call, one whose
+// gate is shut is torn down even if an open came after the close.
+void ConnController::controlThread() {
+    std::shared_ptr<SinkGate> gate;  // outlives conn
+    std::unique_ptr<GnssHwConn> conn;
+    bool started = false;
+
+    while (true) {
+        State wanted;
+        bool shut;  // by a close(), whatever is wanted now
+        {
+            std::unique_lock<std::mutex> lock(m_mtx);
+            wanted = m_wanted;
+            shut = m_gate != gate;
+            if (m_quit && !conn) {
+                m_idle = true;
+                m_idleCv.notify_all();
+                return;
+            }
+        }
+
+        if ((wanted == State::CLOSED || shut) && conn) {
+            GNSS_TRACE_SCOPE("ConnController::close");
+            conn.reset();  // joins its threads
+            gate.reset();
+            started = false;
+        } else if (wanted != State::CLOSED && !conn) {
+            GNSS_TRACE_SCOPE("ConnController::open");
+            {
+                // a close() from now on shuts the gate of this connection
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (m_wanted == State::CLOSED) {
+                    continue;
+                }
+                gate = std::make_shared<SinkGate>(m_sink);
+                m_gate = gate;
+            }
+            std::unique_ptr<GnssHwConn> c = m_factory(gate.get());
+            if (c && c->ok()) {
+                conn = std::move(c);
+            } else {
+                ALOGE("%s: could not open the GPS connection", __PRETTY_FUNCTION__);
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (m_wanted == wanted) {
+                    m_wanted = State::CLOSED;
+                }
+            }
+        } else if (wanted == State::STARTED && !started) {
+            started = conn->start();
+            if (!started) {
+                ALOGE("%s: could not start the GPS connection", __PRETTY_FUNCTION__);
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (m_wanted == wanted) {
+                    m_wanted = State::OPEN;
+                }
+            }
+        } else if (wanted == State::OPEN && started) {
+            conn->stop();
+            started = false;
+        } else {
+            m_state = !conn ? State::CLOSED : (started ? State::STARTED : State::OPEN);
+            std::unique_lock<std::mutex> lock(m_mtx);
+            if (m_wanted != wanted || m_quit) {
+                continue;  // changed while we were at it
+            }
+            m_idle = true;
+            m_idleCv.notify_all();
+            lock.unlock();
+            m_wakeup.wait(-1);
+            continue;
+        }
+        m_state = !conn ? State::CLOSED : (started ? State::STARTED : State::OPEN);
+    }
+}
+
+}  // namespace ciccloud
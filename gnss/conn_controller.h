@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include "event_fd.h"
+#include "gnss_hw_conn.h"
+#include "sink_gate.h"
+
+namespace ciccloud {
+
+// Runs the life cycle of a GnssHwConn on a thread of its own, so that a
+// binder call (the HAL has one binder thread) does not wait for sockets and
+// threads to come and go. A call records what the framework wants and
+// returns; the control thread catches up with the latest wish. Only
+// Gnss20::setCallback_2_0 waits, for the open, to report a failure. A start and
+// a stop in a row may never reach the feeder, a close while opening tears
+// down what was just built.
+//
+// Every GnssHwConn delivers to the sink through a SinkGate of its own, which
+// close() shuts before it returns: the teardown runs on, but nothing of the
+// old connection reaches the sink (and a callback set after) any more.
+class ConnController {
+public:
+    enum class State { CLOSED, OPEN, STARTED };
+    using Factory = std::function<std::unique_ptr<GnssHwConn>(const GnssSink* sink)>;
+
+    // `sink` has to outlive this.
+    ConnController(const GnssSink* sink, Factory factory);
+    ~ConnController();  // tears down what is left, and waits for it
+
+    void open();
+    bool start();  // false if not open
+    bool stop();   // ditto
+    void close();  // waits for a call into the sink in progress
+
+    // What the control thread reached, and a wait for it to catch up; false
+    // on a timeout.
+    State state() const { return m_state; }
+    bool waitIdle(int timeoutMs);
+
+private:
+    void controlThread();
+
+    const GnssSink* const m_sink;
+    const Factory m_factory;
+    EventFd m_wakeup;
+    std::mutex m_mtx;  // guards m_wanted, m_quit, m_idle, m_gate
+    std::condition_variable m_idleCv;
+    State m_wanted = State::CLOSED;
+    bool m_quit = false;
+    bool m_idle = true;
+    std::shared_ptr<SinkGate> m_gate;  // of the latest connection
+    std::atomic<State> m_state{State::CLOSED};
+    std::thread m_thread;
+};
+
+}  // namespace ciccloud
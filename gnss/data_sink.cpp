@@ -16,46 +16,113 @@
 
 #include "data_sink.h"
 #include <log/log.h>
+#include <algorithm>
+#include "hidl_util.h"
+#include "trace.h"
+#include "util.h"
 
 namespace ciccloud {
 
-void DataSink::gnssLocation(const ahg20::GnssLocation& loc) const {
+DataSink::DataSink() {
+    fixes.subscribe(this, FixDelivery::INLINE);
+}
+
+DataSink::~DataSink() {
+    fixes.unsubscribe(this);
+}
+
+void DataSink::gnssLocation(const Location& loc) const {
+    GNSS_TRACE_SCOPE("DataSink::gnssLocation");
+    fixes.publish(loc);
+}
+
+void DataSink::onFix(const FixRef& fix) {
+    ahg20::GnssLocation loc20;
+    util::toHidl(fix->location(), &loc20);
+
     std::unique_lock<std::mutex> lock(mtx);
     if (cb20) {
-        cb20->gnssLocationCb_2_0(loc);
+        cb20->gnssLocationCb_2_0(loc20);
     }
 }
 
-void DataSink::gnssSvStatus(const hidl_vec<ahg20::IGnssCallback::GnssSvInfo>& svInfoList20) const {
+void DataSink::gnssSvStatus(const SvInfo* svInfo, const size_t size) const {
+    GNSS_TRACE_SCOPE("DataSink::gnssSvStatus");
     std::unique_lock<std::mutex> lock(mtx);
-    if (cb20) {
-        cb20->gnssSvStatusCb_2_0(svInfoList20);
+    if (!cb20) {
+        return;
+    }
+
+    // the list is a view of svInfo20, nothing is allocated per status
+    const size_t n = std::min(size, svInfo20.size());
+    for (size_t i = 0; i < n; ++i) {
+        util::toHidl(svInfo[i], &svInfo20[i]);
     }
+    hidl_vec<ahg20::IGnssCallback::GnssSvInfo> svInfoList20;
+    svInfoList20.setToExternal(svInfo20.data(), n);
+    cb20->gnssSvStatusCb_2_0(svInfoList20);
 }
 
-void DataSink::gnssStatus(const ahg10::IGnssCallback::GnssStatusValue status) const {
+void DataSink::gnssStatus(const GnssStatus status) const {
+    GNSS_TRACE_SCOPE("DataSink::gnssStatus");
     std::unique_lock<std::mutex> lock(mtx);
+    if (status == GnssStatus::SESSION_BEGIN || status == GnssStatus::SESSION_END) {
+        sessionRunning = (status == GnssStatus::SESSION_BEGIN);
+        nmeaWanted = cb20 && sessionRunning;
+        sessionClock.onStatus(status);
+    }
     if (cb20) {
-        cb20->gnssStatusCb(status);
+        cb20->gnssStatusCb(util::toHidl(status));
     }
 }
 
-void DataSink::gnssNmea(const ahg10::GnssUtcTime t,
-                        const hidl_string& nmea) const {
+void DataSink::gnssNmea(const int64_t timestampMs, const char* nmea, const size_t size) const {
+    GNSS_TRACE_SCOPE("DataSink::gnssNmea");
+    hidl_string nmeaStr;
+    nmeaStr.setToExternal(nmea, size);  // no copy, see GnssSink::gnssNmea()
+
     std::unique_lock<std::mutex> lock(mtx);
     if (cb20) {
-        cb20->gnssNmeaCb(t, nmea);
+        cb20->gnssNmeaCb(timestampMs, nmeaStr);
+    }
+}
+
+void DataSink::gnssEpoch(const Location& fix) const {
+    GNSS_TRACE_SCOPE("DataSink::gnssEpoch");
+    std::unique_lock<std::mutex> lock(mtx);
+    if (!epochListener) {
+        return;
+    }
+
+    GnssClockSample clock;
+    if (sessionClock.onEpoch(fix, &clock)) {
+        epochListener->onEpoch(fix, clock);
     }
 }
 
 void DataSink::setCallback20(sp<ahg20::IGnssCallback> cb) {
     std::unique_lock<std::mutex> lock(mtx);
     cb20 = std::move(cb);
+    nmeaWanted = cb20 && sessionRunning;
 }
 
 void DataSink::cleanup() {
     std::unique_lock<std::mutex> lock(mtx);
     cb20 = nullptr;
+    nmeaWanted = false;
+    sessionClock.reset();
+}
+
+void DataSink::setEpochListener(EpochListener* listener) {
+    std::unique_lock<std::mutex> lock(mtx);
+    epochListener = listener;
+}
+
+void DataSink::removeEpochListener(const EpochListener* listener) {
+    std::unique_lock<std::mutex> lock(mtx);
+    if (epochListener == listener) {
+        epochListener = nullptr;
+    }
 }
 
 }  // namespace ciccloud
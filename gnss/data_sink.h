@@ -16,7 +16,12 @@
 
 #pragma once
 #include <android/hardware/gnss/2.0/IGnss.h>
+#include <array>
+#include <atomic>
 #include <mutex>
+#include "fix_hub.h"
+#include "gnss_clock.h"
+#include "gnss_sink.h"
 
 namespace ciccloud {
 namespace ahg = ::android::hardware::gnss;
@@ -27,19 +32,58 @@ using ::android::sp;
 using ::android::hardware::hidl_string;
 using ::android::hardware::hidl_vec;
 
-class DataSink {
+// Gets the epochs of the feed while set, see DataSink::setEpochListener().
+class EpochListener {
 public:
-    void gnssLocation(const ahg20::GnssLocation&) const;
-    void gnssSvStatus(const hidl_vec<ahg20::IGnssCallback::GnssSvInfo>&) const;
-    void gnssStatus(const ahg10::IGnssCallback::GnssStatusValue) const;
-    void gnssNmea(const ahg10::GnssUtcTime, const hidl_string&) const;
+    virtual ~EpochListener() = default;
+    virtual void onEpoch(const Location& fix, const GnssClockSample& clock) = 0;
+};
+
+// Adapts the core library output to the HIDL callback. Fixes go through a
+// FixHub: the callback is one subscriber of it, inline as ever, and others
+// (a recorder, metrics, a geofence engine...) subscribe next to it with a
+// delivery mode of their own, sharing the one copy of each fix.
+class DataSink : public GnssSink, private FixSubscriber {
+public:
+    DataSink();
+    ~DataSink();
+
+    void gnssLocation(const Location&) const override;
+    void gnssSvStatus(const SvInfo* svInfo, size_t size) const override;
+    void gnssStatus(GnssStatus) const override;
+    void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const override;
+    void gnssEpoch(const Location& fix) const override;
+    // while there is a callback and a session
+    bool wantsNmea() const override { return nmeaWanted.load(std::memory_order_relaxed); }
 
     void setCallback20(sp<ahg20::IGnssCallback>);
     void cleanup();
 
+    // Another consumer of the fixes, see FixHub::subscribe().
+    bool subscribe(FixSubscriber* subscriber, FixDelivery mode,
+                   size_t queueDepth = FixHub::kDefaultQueueDepth) {
+        return fixes.subscribe(subscriber, mode, queueDepth);
+    }
+    void unsubscribe(FixSubscriber* subscriber) { fixes.unsubscribe(subscriber); }
+
+    // One listener gets the epochs, with the receiver clock of the session,
+    // until it is removed; it is called with the sink locked, so it is not
+    // called any more once removeEpochListener() returns.
+    void setEpochListener(EpochListener*);
+    void removeEpochListener(const EpochListener*);
+
 private:
+    void onFix(const FixRef& fix) override;  // to the callback
+
     sp<ahg20::IGnssCallback> cb20;
+    EpochListener* epochListener = nullptr;
+    mutable GnssSessionClock sessionClock;
+    mutable bool sessionRunning = false;
+    mutable std::atomic<bool> nmeaWanted{false};  // cb20 && sessionRunning
+    // what gnssSvStatus() converts to, as many as a status can have
+    mutable std::array<ahg20::IGnssCallback::GnssSvInfo, kMaxSvInfo> svInfo20;
     mutable std::mutex mtx;
+    mutable FixHub fixes;  // calls onFix() with its own lock held, then takes mtx
 };
 
 }  // namespace ciccloud
@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "datagram_feed.h"
+#include <ctype.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace ciccloud {
+namespace {
+constexpr char kHeader[] = "$PCCDG,";
+constexpr size_t kHeaderLen = sizeof(kHeader) - 1;
+constexpr size_t kMaxHeaderLine = 64;
+
+// "$...*hh" with the checksum of what is between '$' and '*', a line end
+// after it allowed.
+bool checksumOk(const char* line, const size_t size) {
+    const char* star = static_cast<const char*>(memchr(line, '*', size));
+    if (!star || (line + size - star) < 3) {
+        return false;
+    }
+    unsigned char sum = 0;
+    for (const char* i = line + 1; i < star; ++i) {
+        sum ^= static_cast<unsigned char>(*i);
+    }
+    const char hh[3] = {star[1], star[2], 0};
+    return isxdigit(hh[0]) && isxdigit(hh[1]) && strtoul(hh, nullptr, 16) == sum;
+}
+}  // namespace
+
+const char* DatagramFeed::accept(const char* data, const size_t size) {
+    bump(m_received);
+    if (size < kHeaderLen || memcmp(data, kHeader, kHeaderLen)) {
+        if (m_known) {
+            if (!m_open) {
+                bump(m_rejected);  // not of the session
+                return nullptr;
+            }
+            // the feeder which connected does not number them, the old
+            // session does not take the feed back
+            m_known = false;
+            m_open = false;
+        }
+        return data;  // a feeder which does not number datagrams
+    }
+
+    const char* const end = data + size;
+    const char* eol = static_cast<const char*>(memchr(data, '\n', std::min(size, kMaxHeaderLine)));
+    char line[kMaxHeaderLine + 1];
+    const size_t lineLen = (eol ? eol : end) - data;
+    if (lineLen > kMaxHeaderLine) {
+        bump(m_rejected);
+        return nullptr;
+    }
+    memcpy(line, data, lineLen);
+    line[lineLen] = 0;
+
+    unsigned long long sessionId;
+    unsigned long long seq;
+    if (!checksumOk(line, lineLen) ||
+        sscanf(line + kHeaderLen, "%llx,%llu", &sessionId, &seq) != 2) {
+        bump(m_rejected);
+        return nullptr;
+    }
+    if (m_known && sessionId == m_sessionId) {
+        if (seq <= m_newestSeq) {
+            bump(m_stale);
+            return nullptr;
+        }
+        bump(m_lost, seq - m_newestSeq - 1);
+    } else if (m_open) {
+        m_sessionId = sessionId;
+        m_known = true;
+        m_open = false;
+    } else {
+        bump(m_stale);  // of a session which is over
+        return nullptr;
+    }
+    m_newestSeq = seq;
+    return eol ? (eol + 1) : end;
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ciccloud {
+
+// The UDP feed: one epoch per datagram, with whole sentences only, which
+// starts with a header line
+//
+//   $PCCDG,<session id>,<seq>*hh
+//
+// Nothing is retransmitted, only the newest fix matters: a datagram with a
+// seq not above the newest one of its session is stale (reordered or
+// duplicated) and dropped, a jump forward counts the datagrams in between
+// as lost. A new session id starts over, but only the first one or the
+// first after a feeder connected over TCP (onConnect): a late datagram of
+// an old session is stale too, it does not take the feed back.
+//
+// A feeder which does not number its datagrams sends them without the
+// header, they are taken as they are until a session starts, and after a
+// connect until the first datagram says otherwise. Headerless datagrams
+// during a session, and headers which do not parse or fail their checksum,
+// are rejected.
+//
+// The socket takes datagrams from anyone who can reach the port, there is
+// no check of the source.
+//
+// Counters are atomic so they can be read from any thread, updates are done
+// by the receiving thread only.
+class DatagramFeed {
+public:
+    // Returns where the sentences start, past the header, or nullptr if the
+    // datagram is to be dropped.
+    const char* accept(const char* data, size_t size);
+
+    // A feeder connected, the next new session id may be its own.
+    void onConnect() { m_open = true; }
+
+    // A datagram which did not fit into the receive buffer.
+    void onTruncated() { bump(m_truncated); }
+    // recvmmsg calls which returned datagrams.
+    void onBatch() { bump(m_batches); }
+
+    uint64_t received() const { return m_received.load(std::memory_order_relaxed); }
+    uint64_t stale() const { return m_stale.load(std::memory_order_relaxed); }
+    uint64_t lost() const { return m_lost.load(std::memory_order_relaxed); }
+    uint64_t rejected() const { return m_rejected.load(std::memory_order_relaxed); }
+    uint64_t truncated() const { return m_truncated.load(std::memory_order_relaxed); }
+    uint64_t batches() const { return m_batches.load(std::memory_order_relaxed); }
+
+private:
+    static void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+        c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+    }
+
+    uint64_t m_sessionId = 0;
+    bool m_known = false;
+    bool m_open = true;  // to a new session
+    uint64_t m_newestSeq = 0;
+
+    std::atomic<uint64_t> m_received{0};
+    std::atomic<uint64_t> m_stale{0};
+    std::atomic<uint64_t> m_lost{0};
+    std::atomic<uint64_t> m_rejected{0};
+    std::atomic<uint64_t> m_truncated{0};
+    std::atomic<uint64_t> m_batches{0};
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "event_fd.h"
+#include <errno.h>
+#include <log/log.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cstdint>
+#include <cstring>
+
+namespace ciccloud {
+
+EventFd::EventFd()
+    : m_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)) {
+    if (!m_fd.ok()) {
+        ALOGE("%s:%d: eventfd failed: %s", __PRETTY_FUNCTION__, __LINE__, strerror(errno));
+    }
+}
+
+void EventFd::notify() {
+    const uint64_t one = 1;
+    (void)!TEMP_FAILURE_RETRY(write(m_fd.get(), &one, sizeof(one)));
+}
+
+bool EventFd::wait(const int timeoutMs) {
+    struct pollfd pfd = {.fd = m_fd.get(), .events = POLLIN, .revents = 0};
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, timeoutMs)) <= 0) {
+        return false;
+    }
+    uint64_t value;
+    return TEMP_FAILURE_RETRY(read(m_fd.get(), &value, sizeof(value))) == sizeof(value);
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,43 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <android-base/unique_fd.h>
+
+namespace ciccloud {
+using ::android::base::unique_fd;
+
+// An eventfd for a thread to sleep on instead of sleep_for or a condition
+// variable: another thread can wake it at once, and it can be polled along
+// with sockets. Wakeups add up until the sleeper takes them.
+class EventFd {
+public:
+    EventFd();
+
+    bool ok() const { return m_fd.ok(); }
+    int fd() const { return m_fd.get(); }
+
+    void notify();
+    // True if woken (the wakeups are taken), false after `timeoutMs`, -1
+    // waits for ever.
+    bool wait(int timeoutMs);
+
+private:
+    unique_fd m_fd;
+};
+
+}  // namespace ciccloud
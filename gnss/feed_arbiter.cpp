@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "feed_arbiter.h"
+#include <log/log.h>
+#include <algorithm>
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kDayMs = 24LL * 3600LL * 1000LL;
+constexpr int kHealthyEpochs = 2;  // on time in a row
+constexpr int64_t kMinEpochGapNs = kMsToNs;  // of positions alike, the period unknown
+
+void bump(std::atomic<uint64_t>& c) {
+    c.store(c.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// FNV-1a
+uint64_t hashBytes(const void* data, const size_t size, uint64_t h = 0xcbf29ce484222325ULL) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+}  // namespace
+
+FeedArbiter::FeedArbiter(const GnssSink* downstream, const FeedArbiterConfig& config,
+                         const Clock& clock)
+    : m_downstream(downstream)
+    , m_clock(clock)
+    , m_stallMarginNs(std::max(config.stallMarginMs, 0) * kMsToNs) {
+    for (int i = 0; i < kMaxFeeds; ++i) {
+        m_inputs[i].arbiter = this;
+        m_inputs[i].feed = i;
+    }
+}
+
+void FeedArbiter::connect(const int feed, const uint32_t order) {
+    Feed& f = m_feeds[feed];
+    forget(&f);
+    f.connected = true;
+    f.order = order;
+    f.priority = kDefaultPriority;
+}
+
+void FeedArbiter::disconnect(const int feed) {
+    Feed& f = m_feeds[feed];
+    forget(&f);
+    f.connected = false;
+    if (m_active == feed) {
+        m_active = -1;  // the next feed with an epoch decides
+        m_activeStat.store(-1, std::memory_order_relaxed);
+    }
+}
+
+void FeedArbiter::setPriority(const int feed, const int priority) {
+    m_feeds[feed].priority = priority;
+}
+
+void FeedArbiter::reset() {
+    for (Feed& f : m_feeds) {
+        forget(&f);
+    }
+    m_active = -1;
+    m_activeStat.store(-1, std::memory_order_relaxed);
+    m_deliveredFeed = -1;
+}
+
+void FeedArbiter::forget(Feed* f) const {
+    f->hasKey = false;
+    f->delivered = true;
+    f->lastEpochNs = 0;
+    f->periodNs = 0;
+    f->onTime = 0;
+}
+
+FeedArbiter::Stats FeedArbiter::stats() const {
+    Stats stats;
+    stats.active = m_activeStat.load(std::memory_order_relaxed);
+    stats.epochs = m_epochs.load(std::memory_order_relaxed);
+    stats.duplicates = m_duplicates.load(std::memory_order_relaxed);
+    stats.standby = m_standby.load(std::memory_order_relaxed);
+    stats.failovers = m_failovers.load(std::memory_order_relaxed);
+    return stats;
+}
+
+FeedArbiter::EpochKey FeedArbiter::epochKey(const Location& loc) {
+    EpochKey key;
+    if (loc.utcTimeOfDayMs >= 0) {
+        key.timed = true;
+        key.value = loc.utcTimeOfDayMs;
+    } else {
+        uint64_t h = hashBytes(&loc.latitudeDegrees, sizeof(loc.latitudeDegrees));
+        h = hashBytes(&loc.longitudeDegrees, sizeof(loc.longitudeDegrees), h);
+        h = hashBytes(&loc.altitudeMeters, sizeof(loc.altitudeMeters), h);
+        key.value = static_cast<int64_t>(h);
+    }
+    return key;
+}
+
+// Sentence times wrap at midnight, the nearer way round counts. A position
+// hash is only ever equal or not.
+bool FeedArbiter::newer(const EpochKey& a, const EpochKey& b) {
+    if (a.timed != b.timed) {
+        return true;
+    } else if (!a.timed) {
+        return a.value != b.value;
+    }
+    int64_t d = a.value - b.value;
+    if (d <= -kDayMs / 2) {
+        d += kDayMs;
+    } else if (d > kDayMs / 2) {
+        d -= kDayMs;
+    }
+    return d > 0;
+}
+
+// A position repeated by a stationary receiver is a new epoch only once a
+// good part of the period has gone by.
+bool FeedArbiter::newEpoch(const Feed& f, const EpochKey& key, const int64_t nowNs) {
+    if (!f.hasKey || key.timed != f.key.timed || key.value != f.key.value) {
+        return true;
+    }
+    return !key.timed && nowNs - f.lastEpochNs >= std::max(f.periodNs / 2, kMinEpochGapNs);
+}
+
+void FeedArbiter::onLocation(const int feed, const Location& loc) {
+    Feed& f = m_feeds[feed];
+    const EpochKey key = epochKey(loc);
+    const int64_t nowNs = m_clock.bootNanos();
+    if (newEpoch(f, key, nowNs)) {
+        f.hasKey = true;
+        f.key = key;
+        onEpoch(feed, key, nowNs);
+    }
+    if (f.delivered) {
+        m_downstream->gnssLocation(loc);
+    }
+}
+
+void FeedArbiter::onEpoch(const int feed, const EpochKey& key, const int64_t nowNs) {
+    Feed& f = m_feeds[feed];
+    const int64_t gapNs = nowNs - f.lastEpochNs;
+    if (f.lastEpochNs && (!f.periodNs || gapNs <= f.periodNs + stallMarginNs(f))) {
+        f.periodNs = f.periodNs ? (f.periodNs + (gapNs - f.periodNs) / 8) : gapNs;
+        ++f.onTime;
+    } else {
+        // the first epoch, or the first after a stall: the period may have
+        // changed too, learn it again
+        f.periodNs = 0;
+        f.onTime = 1;
+    }
+    f.lastEpochNs = nowNs;
+
+    int best = -1;
+    for (int i = 0; i < kMaxFeeds; ++i) {
+        if (healthy(i, nowNs) && (best < 0 || preferred(i, best))) {
+            best = i;
+        }
+    }
+    if (best < 0) {
+        // none is healthy (yet): stay with what we have
+        best = (m_active >= 0) ? m_active : feed;
+    }
+    if (best != m_active) {
+        if (m_active >= 0) {
+            ALOGI("%s:%d: feed %d takes over from feed %d", __PRETTY_FUNCTION__, __LINE__, best,
+                  m_active);
+            bump(m_failovers);
+        }
+        m_active = best;
+        m_activeStat.store(best, std::memory_order_relaxed);
+    }
+
+    f.delivered = false;
+    if (feed != m_active) {
+        bump(m_standby);
+    } else if (m_deliveredFeed >= 0 && m_deliveredFeed != feed && !newer(key, m_delivered)) {
+        bump(m_duplicates);
+        if (!key.timed) {
+            m_deliveredFeed = feed;  // its next epochs are its own
+        }
+    } else {
+        f.delivered = true;
+        m_deliveredFeed = feed;
+        m_delivered = key;
+        bump(m_epochs);
+    }
+}
+
+bool FeedArbiter::healthy(const int feed, const int64_t nowNs) const {
+    const Feed& f = m_feeds[feed];
+    return f.connected && f.onTime >= kHealthyEpochs &&
+           nowNs - f.lastEpochNs <= f.periodNs + stallMarginNs(f);
+}
+
+// Within one epoch at any rate.
+int64_t FeedArbiter::stallMarginNs(const Feed& f) const {
+    return std::min(m_stallMarginNs, f.periodNs / 2);
+}
+
+bool FeedArbiter::preferred(const int a, const int b) const {
+    const Feed& fa = m_feeds[a];
+    const Feed& fb = m_feeds[b];
+    return (fa.priority != fb.priority) ? (fa.priority < fb.priority) : (fa.order < fb.order);
+}
+
+// A feed which has not had a fix yet can be the active one too, if there is
+// none: a feed of NMEA without fixes goes through as it did with one feed.
+bool FeedArbiter::passes(const int feed) {
+    if (m_active < 0) {
+        m_active = feed;
+        m_activeStat.store(feed, std::memory_order_relaxed);
+    }
+    return feed == m_active && m_feeds[feed].delivered;
+}
+
+void FeedArbiter::Input::gnssLocation(const Location& loc) const {
+    arbiter->onLocation(feed, loc);
+}
+
+void FeedArbiter::Input::gnssSvStatus(const SvInfo* svInfo, const size_t size) const {
+    if (arbiter->passes(feed)) {
+        arbiter->m_downstream->gnssSvStatus(svInfo, size);
+    }
+}
+
+void FeedArbiter::Input::gnssStatus(const GnssStatus status) const {
+    if (arbiter->passes(feed)) {
+        arbiter->m_downstream->gnssStatus(status);
+    }
+}
+
+void FeedArbiter::Input::gnssNmea(const int64_t timestampMs, const char* nmea,
+                                  const size_t size) const {
+    if (arbiter->passes(feed)) {
+        arbiter->m_downstream->gnssNmea(timestampMs, nmea, size);
+    }
+}
+
+void FeedArbiter::Input::gnssEpoch(const Location& fix) const {
+    if (arbiter->passes(feed)) {
+        arbiter->m_downstream->gnssEpoch(fix);
+    }
+}
+
+bool FeedArbiter::Input::wantsNmea() const {
+    return arbiter->m_downstream->wantsNmea();
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "clock.h"
+#include "gnss_sink.h"
+
+namespace ciccloud {
+
+struct FeedArbiterConfig {
+    // how late past its period an epoch of a feed may be before the feed
+    // counts as stalled, at most half the period
+    int stallMarginMs = 250;
+};
+
+// Picks one of several concurrent feeds, the one of the highest priority
+// which is healthy, and passes only its output downstream. Every feed has a
+// listener of its own which delivers into input(feed).
+//
+// A feed is healthy if its last two epochs came on time, each within its
+// period plus the stall margin of the one before. When the active feed
+// stalls, the first epoch of a healthy standby after the margin makes it
+// the active feed: a failover costs one epoch at most, none if the active
+// feed disconnects. A feed which recovers takes over again once it is
+// healthy. A single feed goes through as it is.
+//
+// Epochs are known by their sentence time, or a hash of the position if
+// there is none. A stationary receiver repeats its position, so the same
+// hash again half a period on (a millisecond while the period is not known)
+// is a new epoch: the sentences of one epoch come together. An epoch of
+// another feed which is not newer than the last one delivered, as a
+// redundant feed sends it after a failover, is suppressed with all its
+// output. Positions say nothing of which is newer, so without sentence
+// times only the first epoch after a failover is suppressed, if it repeats
+// the last position delivered. Satellite status and NMEA follow the latest
+// epoch of their feed.
+//
+// Priorities are announced by the feeder ($PCCPRI, see FeedSession), lower
+// is preferred; among equals the older connection is.
+//
+// Called from the worker thread only, the stats from anywhere.
+class FeedArbiter {
+public:
+    static constexpr int kMaxFeeds = 4;
+    static constexpr int kDefaultPriority = 128;  // if the feeder does not say
+
+    struct Stats {
+        int active = -1;          // the feed delivered now, -1 - none
+        uint64_t epochs = 0;      // delivered
+        uint64_t duplicates = 0;  // suppressed, not newer than the last one of another feed
+        uint64_t standby = 0;     // not delivered, their feed was not active
+        uint64_t failovers = 0;   // changes of the active feed
+    };
+
+    FeedArbiter(const GnssSink* downstream, const FeedArbiterConfig&,
+                const Clock& clock = systemClock());
+
+    // Where the listener of `feed` delivers, 0 <= feed < kMaxFeeds.
+    const GnssSink* input(int feed) const { return &m_inputs[feed]; }
+
+    // A new connection of `feed`, it replaces the one before. `order` says
+    // which of two connections is the older one, lower is.
+    void connect(int feed, uint32_t order);
+    void disconnect(int feed);
+    void setPriority(int feed, int priority);
+    // A new session: forgets the epochs and the health of the feeds.
+    void reset();
+
+    Stats stats() const;
+
+private:
+    class Input : public GnssSink {
+    public:
+        void gnssLocation(const Location&) const override;
+        void gnssSvStatus(const SvInfo* svInfo, size_t size) const override;
+        void gnssStatus(GnssStatus) const override;
+        void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const override;
+        void gnssEpoch(const Location& fix) const override;
+        bool wantsNmea() const override;
+
+        FeedArbiter* arbiter = nullptr;
+        int feed = 0;
+    };
+
+    struct EpochKey {
+        bool timed = false;  // `value` is the sentence time, else a position hash
+        int64_t value = 0;
+    };
+
+    struct Feed {
+        bool connected = false;
+        uint32_t order = 0;
+        int priority = kDefaultPriority;
+        bool hasKey = false;
+        EpochKey key;                // of its latest epoch
+        bool delivered = true;       // its latest epoch went downstream
+        int64_t lastEpochNs = 0;     // when the latest epoch came, boottime
+        int64_t periodNs = 0;        // between epochs, smoothed, 0 - unknown
+        int onTime = 0;              // epochs in a row which came on time
+    };
+
+    static EpochKey epochKey(const Location&);
+    static bool newer(const EpochKey& a, const EpochKey& b);
+    static bool newEpoch(const Feed&, const EpochKey&, int64_t nowNs);
+
+    void onLocation(int feed, const Location&);
+    void onEpoch(int feed, const EpochKey&, int64_t nowNs);
+    bool healthy(int feed, int64_t nowNs) const;
+    int64_t stallMarginNs(const Feed&) const;
+    bool preferred(int a, int b) const;
+    // Whether the output of `feed` goes downstream, for all but locations.
+    bool passes(int feed);
+    void forget(Feed*) const;
+
+    const GnssSink* const m_downstream;
+    const Clock& m_clock;
+    const int64_t m_stallMarginNs;
+    Input m_inputs[kMaxFeeds];
+    Feed m_feeds[kMaxFeeds];
+    int m_active = -1;
+    int m_deliveredFeed = -1;  // of the last epoch which went downstream
+    EpochKey m_delivered;
+
+    std::atomic<int> m_activeStat{-1};
+    std::atomic<uint64_t> m_epochs{0};
+    std::atomic<uint64_t> m_duplicates{0};
+    std::atomic<uint64_t> m_standby{0};
+    std::atomic<uint64_t> m_failovers{0};
+};
+
+}  // namespace ciccloud
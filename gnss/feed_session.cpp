@@ -0,0 +1,77 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "feed_session.h"
+#include <log/log.h>
+#include <algorithm>
+
+namespace ciccloud {
+
+void FeedSession::onHello(const uint64_t sessionId, const uint64_t feederNextSeq) {
+    if (m_known && sessionId == m_sessionId) {
+        // the feeder cannot have sent less than we delivered
+        m_resumeSeq = std::min(m_nextSeq, feederNextSeq);
+        ++m_resumes;
+        ALOGI("%s: resuming session %016llx at %llu, the feeder is at %llu", __PRETTY_FUNCTION__,
+              static_cast<unsigned long long>(sessionId), static_cast<unsigned long long>(m_resumeSeq),
+              static_cast<unsigned long long>(feederNextSeq));
+    } else {
+        m_sessionId = sessionId;
+        m_known = true;
+        m_resumeSeq = feederNextSeq;
+        ALOGI("%s: new session %016llx at %llu", __PRETTY_FUNCTION__,
+              static_cast<unsigned long long>(sessionId), static_cast<unsigned long long>(feederNextSeq));
+    }
+    m_nextSeq = m_resumeSeq;
+    m_numbered = false;
+    m_resumePending = true;
+}
+
+void FeedSession::onHeader(const uint64_t sessionId, const uint64_t seq) {
+    if (!m_known || sessionId != m_sessionId) {
+        // numbered, but it never said hello to us: take it from here
+        m_sessionId = sessionId;
+        m_known = true;
+        m_nextSeq = seq;
+    }
+    m_cursor = seq;
+    m_numbered = true;
+}
+
+bool FeedSession::accept() {
+    if (!m_numbered) {
+        return true;  // a feeder without sessions
+    }
+
+    const uint64_t seq = m_cursor++;
+    if (seq < m_nextSeq) {
+        ++m_duplicates;
+        return false;
+    }
+    m_lost += seq - m_nextSeq;
+    m_nextSeq = seq + 1;
+    return true;
+}
+
+bool FeedSession::resumePending(uint64_t* seq) const {
+    if (!m_resumePending) {
+        return false;
+    }
+    *seq = m_resumeSeq;
+    return true;
+}
+
+}  // namespace ciccloud
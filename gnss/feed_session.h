@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <cstdint>
+
+namespace ciccloud {
+
+// Resumable feed sessions. A feeder which supports them numbers the data
+// sentences it sends and keeps the last few for a retransmit:
+//
+//   feeder: $PCCSES,<session id>,<next seq>    after connect and start
+//   HAL:    control byte 4 + the seq it wants next (8 bytes little endian)
+//   feeder: $PCCSEQ,<session id>,<seq>         then sentences seq, seq+1, ...
+//
+// For a session we know, the HAL asks for the first seq it has not seen, so
+// the feeder replays only what was lost in flight; a new session starts
+// where the feeder is. Sentences below the next expected seq are
+// duplicates and dropped, a jump forward is counted as lost. Protocol
+// sentences ($PCC...) are not numbered.
+//
+// A feeder which runs alongside others may also say how much it is to be
+// preferred, see FeedArbiter:
+//
+//   feeder: $PCCPRI,<priority>                 0 - the most preferred
+//
+// Not thread safe, it is owned by the worker thread. It survives
+// reconnects, which is the point.
+class FeedSession {
+public:
+    // $PCCSES
+    void onHello(uint64_t sessionId, uint64_t feederNextSeq);
+    // $PCCSEQ
+    void onHeader(uint64_t sessionId, uint64_t seq);
+    // $PCCPRI
+    void onPriority(int priority) { m_priority = priority; }
+    // The connection is gone, sentences are not numbered until the next
+    // header, and a resume not sent yet was for the feeder which left.
+    void onDisconnect() {
+        m_numbered = false;
+        m_resumePending = false;
+        m_priority = -1;
+    }
+
+    // For every data sentence: false if it is a duplicate to drop.
+    bool accept();
+
+    // The answer to a hello which is still to be sent. It stays pending
+    // until onResumeSent(): a resume which could not be written goes with
+    // the next try.
+    bool resumePending(uint64_t* seq) const;
+    void onResumeSent() { m_resumePending = false; }
+
+    uint64_t duplicates() const { return m_duplicates; }
+    uint64_t lost() const { return m_lost; }
+    uint64_t resumes() const { return m_resumes; }
+    // The one the feeder announced, -1 if it did not.
+    int priority() const { return m_priority; }
+
+private:
+    uint64_t m_sessionId = 0;
+    bool m_known = false;
+    bool m_numbered = false;
+    uint64_t m_nextSeq = 0;  // the first seq we have not delivered
+    uint64_t m_cursor = 0;   // the seq of the next sentence on the wire
+    bool m_resumePending = false;
+    uint64_t m_resumeSeq = 0;
+    int m_priority = -1;
+
+    uint64_t m_duplicates = 0;
+    uint64_t m_lost = 0;
+    uint64_t m_resumes = 0;
+};
+
+}  // namespace ciccloud
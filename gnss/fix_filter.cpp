@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fix_filter.h"
+#include <cmath>
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kEarthRadiusMeters = 6371000;
+constexpr int64_t kDayMs = 86400000;
+constexpr int64_t kMaxGapMs = 10000;      // longer without a fix starts over
+constexpr double kRebaseMeters = 10000;   // the plane is flat enough within
+constexpr double kVerticalFactor = 1.5;   // VDOP / HDOP, GGA has no VDOP
+constexpr double kVerticalAccelerationNoise = 0.5;  // m/s^2
+constexpr double kInitialSpeedVar = 30 * 30;        // (m/s)^2, no velocity yet
+constexpr double kInitialAccelerationVar = 5 * 5;   // (m/s^2)^2
+
+// Of a fix of each GGA quality: invalid, GPS, DGPS, PPS, RTK fixed, RTK
+// float, dead reckoning, manual input, simulation.
+constexpr float kUserRangeErrorMeters[] = {0, 4, 1, 3, .03f, .3f, 15, 4, 4};
+
+double square(const double x) { return x * x; }
+}  // namespace
+
+float horizontalErrorMeters(const float hdop, const int fixQuality) {
+    constexpr int kQualities = sizeof(kUserRangeErrorMeters) / sizeof(kUserRangeErrorMeters[0]);
+    const float uere = (fixQuality >= 0 && fixQuality < kQualities)
+        ? kUserRangeErrorMeters[fixQuality] : kUserRangeErrorMeters[1];
+    return hdop * uere;
+}
+
+float verticalErrorMeters(const float hdop, const int fixQuality) {
+    return kVerticalFactor * horizontalErrorMeters(hdop, fixQuality);
+}
+
+FixFilter::FixFilter(const FixFilterConfig& config)
+    : m_dim((config.model == FixFilterModel::CONSTANT_VELOCITY) ? 2
+            : (config.model == FixFilterModel::CONSTANT_ACCELERATION) ? 3 : 0)
+    , m_noise((config.model == FixFilterModel::CONSTANT_VELOCITY) ? config.accelerationNoise
+                                                                   : config.jerkNoise) {}
+
+void FixFilter::update(Location* loc, const int fixQuality) {
+    if (!m_dim || !(loc->flags & LocationFlags::HAS_LAT_LONG)) {
+        return;
+    }
+
+    // The horizontal accuracy is a radius for both axes, split it.
+    const double positionVar = (loc->flags & LocationFlags::HAS_HORIZONTAL_ACCURACY)
+        ? square(loc->horizontalAccuracyMeters) / 2 : 0;
+    const bool measured = (fixQuality != 0) && (positionVar > 0);
+
+    int64_t timeMs = (loc->utcTimeOfDayMs >= 0) ? loc->utcTimeOfDayMs
+                                                 : loc->elapsedRealtimeNs / 1000000;
+    if (m_initialized && loc->utcTimeOfDayMs >= 0) {
+        // unwrap across midnight, the state time runs on
+        timeMs += (m_timeMs - timeMs + kDayMs / 2) / kDayMs * kDayMs;
+    }
+    if (!m_initialized || timeMs < m_timeMs || (timeMs - m_timeMs) > kMaxGapMs) {
+        if (!measured) {
+            m_initialized = false;
+            return;  // nothing to start from
+        }
+        init(*loc, positionVar, timeMs);
+    } else if (timeMs > m_timeMs) {
+        predict((timeMs - m_timeMs) / 1000.);
+        m_timeMs = timeMs;
+        m_epochPosition = false;
+        m_epochVelocity = false;
+        m_epochAltitude = false;
+    }
+
+    if (measured && !m_epochPosition) {
+        const double east = (loc->longitudeDegrees * kPi / 180 - m_lon0) * m_metersPerRadLon;
+        const double north = (loc->latitudeDegrees * kPi / 180 - m_lat0) * m_metersPerRadLat;
+        updateScalar(0, {east, north}, positionVar);
+        m_epochPosition = true;
+    }
+    if (measured && !m_epochVelocity && (loc->flags & LocationFlags::HAS_SPEED) &&
+        (loc->flags & LocationFlags::HAS_BEARING)) {
+        const double bearing = loc->bearingDegrees * kPi / 180;
+        const double speed = loc->speedMetersPerSec;
+        const double var = (loc->flags & LocationFlags::HAS_SPEED_ACCURACY)
+            ? square(loc->speedAccuracyMetersPerSecond) : 1;
+        updateScalar(1, {speed * std::sin(bearing), speed * std::cos(bearing)}, var);
+        m_epochVelocity = true;
+    }
+    if (measured && !m_epochAltitude && (loc->flags & LocationFlags::HAS_ALTITUDE)) {
+        const double var = (loc->flags & LocationFlags::HAS_VERTICAL_ACCURACY)
+            ? square(loc->verticalAccuracyMeters) : square(kVerticalFactor) * 2 * positionVar;
+        if (!m_hasAltitude) {
+            m_z = {loc->altitudeMeters, 0};
+            m_pz = {{{var, 0}, {0, 1}}};
+            m_hasAltitude = true;
+        } else {
+            const double s = m_pz[0][0] + var;
+            const double k0 = m_pz[0][0] / s;
+            const double k1 = m_pz[1][0] / s;
+            const double innovation = loc->altitudeMeters - m_z[0];
+            m_z[0] += k0 * innovation;
+            m_z[1] += k1 * innovation;
+            const double p00 = m_pz[0][0];
+            const double p01 = m_pz[0][1];
+            m_pz[0][0] -= k0 * p00;
+            m_pz[0][1] -= k0 * p01;
+            m_pz[1][0] = m_pz[0][1];
+            m_pz[1][1] -= k1 * p01;
+        }
+        m_epochAltitude = true;
+    }
+
+    rebase();
+    output(loc);
+}
+
+void FixFilter::init(const Location& loc, const double positionVar, const int64_t timeMs) {
+    m_lat0 = loc.latitudeDegrees * kPi / 180;
+    m_lon0 = loc.longitudeDegrees * kPi / 180;
+    m_metersPerRadLat = kEarthRadiusMeters;
+    m_metersPerRadLon = kEarthRadiusMeters * std::cos(m_lat0);
+
+    m_x = {};
+    m_p = {};
+    m_p[0][0] = positionVar;
+    m_p[1][1] = kInitialSpeedVar;
+    m_p[2][2] = kInitialAccelerationVar;
+    m_hasAltitude = false;
+
+    m_initialized = true;
+    m_timeMs = timeMs;
+    m_epochPosition = true;  // the state is the position
+    m_epochVelocity = false;
+    m_epochAltitude = false;
+}
+
+// x = F x, P = F P F' + Q with the discrete white noise of the highest
+// derivative, per axis.
+void FixFilter::predict(const double dt) {
+    const double dt2 = dt * dt / 2;
+    for (auto& x : m_x) {
+        x[0] += dt * x[1] + ((m_dim == 3) ? dt2 * x[2] : 0);
+        x[1] += (m_dim == 3) ? dt * x[2] : 0;
+    }
+
+    Matrix f = {};
+    for (int i = 0; i < m_dim; ++i) {
+        f[i][i] = 1;
+    }
+    f[0][1] = dt;
+    if (m_dim == 3) {
+        f[0][2] = dt2;
+        f[1][2] = dt;
+    }
+    const double g[kMaxDim] = {(m_dim == 3) ? dt * dt2 / 3 : dt2,
+                               (m_dim == 3) ? dt2 : dt,
+                               dt};
+
+    Matrix fp = {};
+    for (int i = 0; i < m_dim; ++i) {
+        for (int j = 0; j < m_dim; ++j) {
+            for (int k = i; k < m_dim; ++k) {  // f is upper triangular
+                fp[i][j] += f[i][k] * m_p[k][j];
+            }
+        }
+    }
+    const double q = m_noise * m_noise;
+    for (int i = 0; i < m_dim; ++i) {
+        for (int j = i; j < m_dim; ++j) {
+            double v = q * g[i] * g[j];
+            for (int k = j; k < m_dim; ++k) {
+                v += fp[i][k] * f[j][k];
+            }
+            m_p[i][j] = v;
+            m_p[j][i] = v;
+        }
+    }
+
+    if (m_hasAltitude) {
+        m_z[0] += dt * m_z[1];
+        const double qz = square(kVerticalAccelerationNoise);
+        const double p00 = m_pz[0][0] + 2 * dt * m_pz[0][1] + dt * dt * m_pz[1][1];
+        const double p01 = m_pz[0][1] + dt * m_pz[1][1];
+        m_pz[0][0] = p00 + qz * dt2 * dt2;
+        m_pz[0][1] = p01 + qz * dt2 * dt;
+        m_pz[1][0] = m_pz[0][1];
+        m_pz[1][1] += qz * dt * dt;
+    }
+}
+
+// Measures state `component` of both axes, with the same variance, so the
+// covariance update is shared.
+void FixFilter::updateScalar(const int c, const double (&z)[2], const double var) {
+    const double s = m_p[c][c] + var;
+    double k[kMaxDim];
+    for (int i = 0; i < m_dim; ++i) {
+        k[i] = m_p[i][c] / s;
+    }
+    for (int axis = 0; axis < 2; ++axis) {
+        const double innovation = z[axis] - m_x[axis][c];
+        for (int i = 0; i < m_dim; ++i) {
+            m_x[axis][i] += k[i] * innovation;
+        }
+    }
+
+    double pc[kMaxDim];
+    for (int j = 0; j < m_dim; ++j) {
+        pc[j] = m_p[c][j];
+    }
+    for (int i = 0; i < m_dim; ++i) {
+        for (int j = i; j < m_dim; ++j) {
+            const double v = m_p[i][j] - k[i] * pc[j];
+            m_p[i][j] = v;
+            m_p[j][i] = v;
+        }
+    }
+}
+
+// Moves the reference point onto the estimate once it is far off.
+void FixFilter::rebase() {
+    if (std::fabs(m_x[0][0]) < kRebaseMeters && std::fabs(m_x[1][0]) < kRebaseMeters) {
+        return;
+    }
+    m_lat0 += m_x[1][0] / m_metersPerRadLat;
+    m_lon0 += m_x[0][0] / m_metersPerRadLon;
+    m_metersPerRadLon = kEarthRadiusMeters * std::cos(m_lat0);
+    m_x[0][0] = 0;
+    m_x[1][0] = 0;
+}
+
+void FixFilter::output(Location* loc) const {
+    loc->latitudeDegrees = (m_lat0 + m_x[1][0] / m_metersPerRadLat) * 180 / kPi;
+    loc->longitudeDegrees = (m_lon0 + m_x[0][0] / m_metersPerRadLon) * 180 / kPi;
+    loc->horizontalAccuracyMeters = std::sqrt(2 * m_p[0][0]);
+    loc->flags |= LocationFlags::HAS_HORIZONTAL_ACCURACY;
+
+    if ((loc->flags & LocationFlags::HAS_SPEED) && (loc->flags & LocationFlags::HAS_BEARING)) {
+        const double speed = std::hypot(m_x[0][1], m_x[1][1]);
+        const double sigma = std::sqrt(m_p[1][1]);
+        double bearing = std::atan2(m_x[0][1], m_x[1][1]) * 180 / kPi;
+        bearing += (bearing < 0) ? 360 : 0;
+        loc->speedMetersPerSec = speed;
+        loc->bearingDegrees = bearing;
+        loc->speedAccuracyMetersPerSecond = sigma;
+        loc->bearingAccuracyDegrees = std::atan2(sigma, speed) * 180 / kPi;
+        loc->flags |= LocationFlags::HAS_SPEED_ACCURACY | LocationFlags::HAS_BEARING_ACCURACY;
+    }
+
+    if ((loc->flags & LocationFlags::HAS_ALTITUDE) && m_hasAltitude) {
+        loc->altitudeMeters = m_z[0];
+        loc->verticalAccuracyMeters = std::sqrt(m_pz[0][0]);
+        loc->flags |= LocationFlags::HAS_VERTICAL_ACCURACY;
+    }
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+enum class FixFilterModel : uint8_t {
+    OFF,
+    CONSTANT_VELOCITY,      // white acceleration
+    CONSTANT_ACCELERATION,  // white jerk
+};
+
+struct FixFilterConfig {
+    FixFilterModel model = FixFilterModel::OFF;
+    float accelerationNoise = 2;  // m/s^2, of the constant velocity model
+    float jerkNoise = 1;          // m/s^3, of the constant acceleration model
+};
+
+// The 68% horizontal error of a fix of GGA `fixQuality` with `hdop`: HDOP
+// times a user range error which depends on the kind of fix. 0 if the fix
+// is invalid. GGA has no VDOP, the vertical one assumes the usual 1.5 HDOP.
+float horizontalErrorMeters(float hdop, int fixQuality);
+float verticalErrorMeters(float hdop, int fixQuality);
+
+// A Kalman filter over the fixes of the feed, per GnssSink location.
+//
+// East and north (in meters, on a plane tangent at a reference point which
+// follows the fixes) share one model and, since both see the same noise,
+// one covariance; the altitude has a constant velocity model of its own.
+// Positions are measured with the horizontal error of the fix, which comes
+// from the HDOP and fix quality of GGA, velocities with speedAccuracyMeters-
+// PerSecond. The sentences of one epoch (same sentence time) are one
+// measurement: what a second one adds is used, a repeated position is not.
+// A fix of quality 0 only advances the prediction.
+//
+// Positions, speed and bearing of a location are replaced by the estimate,
+// their accuracies by the ones of the covariance. Fixed size, no allocation.
+// Not thread safe.
+class FixFilter {
+public:
+    explicit FixFilter(const FixFilterConfig&);
+
+    bool enabled() const { return m_dim > 0; }
+    void reset() { m_initialized = false; }
+
+    // `loc` is a parsed fix, with the accuracies of the fix.
+    void update(Location* loc, int fixQuality);
+
+private:
+    static constexpr int kMaxDim = 3;
+    using Matrix = std::array<std::array<double, kMaxDim>, kMaxDim>;
+
+    void init(const Location&, double positionVar, int64_t timeMs);
+    void predict(double dt);
+    void updateScalar(int component, const double (&z)[2], double var);
+    void rebase();
+    void output(Location* loc) const;
+
+    const int m_dim;  // 2 or 3, 0 - off
+    const double m_noise;
+
+    bool m_initialized = false;
+    int64_t m_timeMs = 0;  // of the state, unwrapped sentence time
+    bool m_epochPosition = false;  // measured at m_timeMs already
+    bool m_epochVelocity = false;
+    bool m_epochAltitude = false;
+
+    double m_lat0 = 0;  // reference point, radians
+    double m_lon0 = 0;
+    double m_metersPerRadLat = 0;
+    double m_metersPerRadLon = 0;
+
+    std::array<std::array<double, kMaxDim>, 2> m_x = {};  // east, north: position, velocity...
+    Matrix m_p = {};
+
+    std::array<double, 2> m_z = {};  // altitude, vertical speed
+    std::array<std::array<double, 2>, 2> m_pz = {};
+    bool m_hasAltitude = false;
+};
+
+}  // namespace ciccloud
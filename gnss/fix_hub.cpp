@@ -0,0 +1,217 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "fix_hub.h"
+#include <log/log.h>
+#include <algorithm>
+
+namespace ciccloud {
+
+FixRef& FixRef::operator=(const FixRef& other) {
+    other.retain();
+    reset();
+    m_fix = other.m_fix;
+    return *this;
+}
+
+FixRef& FixRef::operator=(FixRef&& other) noexcept {
+    if (this != &other) {
+        reset();
+        m_fix = other.m_fix;
+        other.m_fix = nullptr;
+    }
+    return *this;
+}
+
+void FixRef::retain() const {
+    if (m_fix) {
+        m_fix->m_refs.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FixRef::reset() {
+    if (m_fix && m_fix->m_refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        m_fix->m_hub->release(m_fix);
+    }
+    m_fix = nullptr;
+}
+
+FixHub::~FixHub() {
+    for (std::unique_ptr<Subscription>& s : m_subscriptions) {
+        if (s) {
+            stop(s.get());
+            s.reset();
+        }
+    }
+}
+
+bool FixHub::subscribe(FixSubscriber* subscriber, const FixDelivery mode,
+                       const size_t queueDepth) {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    std::unique_ptr<Subscription>* slot = nullptr;
+    for (std::unique_ptr<Subscription>& s : m_subscriptions) {
+        if (s && s->subscriber == subscriber) {
+            return false;
+        } else if (!s && !slot) {
+            slot = &s;
+        }
+    }
+    if (!slot) {
+        ALOGE("%s:%d: no room for another subscriber", __PRETTY_FUNCTION__, __LINE__);
+        return false;
+    }
+
+    std::unique_ptr<Subscription> s = std::make_unique<Subscription>();
+    s->subscriber = subscriber;
+    s->mode = mode;
+    if (mode != FixDelivery::INLINE) {
+        s->ring.resize((mode == FixDelivery::QUEUE) ? std::max<size_t>(queueDepth, 1) : 1);
+        Subscription* raw = s.get();
+        s->thread = std::thread([raw]() { run(raw); });
+    }
+    *slot = std::move(s);
+    return true;
+}
+
+void FixHub::unsubscribe(FixSubscriber* subscriber) {
+    std::unique_ptr<Subscription> gone;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        for (std::unique_ptr<Subscription>& s : m_subscriptions) {
+            if (s && s->subscriber == subscriber) {
+                gone = std::move(s);
+                break;
+            }
+        }
+    }
+    if (gone) {
+        stop(gone.get());
+    }
+}
+
+void FixHub::publish(const Location& loc) {
+    Fix* fix = acquire();
+    fix->m_location = loc;
+
+    std::lock_guard<std::mutex> lock(m_mtx);
+    fix->m_seq = ++m_seq;
+    const FixRef ref(fix);
+    for (std::unique_ptr<Subscription>& s : m_subscriptions) {
+        if (!s) {
+            continue;
+        } else if (s->mode == FixDelivery::INLINE) {
+            s->subscriber->onFix(ref);
+            s->delivered.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            deliver(s.get(), ref);
+        }
+    }
+}
+
+FixHub::SubscriberStats FixHub::stats(const FixSubscriber* subscriber) const {
+    SubscriberStats stats;
+    std::lock_guard<std::mutex> lock(m_mtx);
+    for (const std::unique_ptr<Subscription>& s : m_subscriptions) {
+        if (s && s->subscriber == subscriber) {
+            stats.delivered = s->delivered.load(std::memory_order_relaxed);
+            stats.dropped = s->dropped.load(std::memory_order_relaxed);
+            stats.superseded = s->superseded.load(std::memory_order_relaxed);
+        }
+    }
+    return stats;
+}
+
+size_t FixHub::poolSize() const {
+    std::lock_guard<std::mutex> lock(m_poolMtx);
+    return m_chunks.size() * kPoolChunk;
+}
+
+// The queue drops its oldest when it is full, the latest-only slot its
+// only one: the publisher never waits for a subscriber.
+void FixHub::deliver(Subscription* s, const FixRef& fix) {
+    {
+        std::lock_guard<std::mutex> lock(s->mtx);
+        const size_t depth = s->ring.size();
+        if (s->size == depth) {
+            s->ring[s->head].reset();
+            s->head = (s->head + 1) % depth;
+            --s->size;
+            (s->mode == FixDelivery::LATEST ? s->superseded : s->dropped)
+                .fetch_add(1, std::memory_order_relaxed);
+        }
+        s->ring[(s->head + s->size) % depth] = fix;
+        ++s->size;
+    }
+    s->cv.notify_one();
+}
+
+void FixHub::run(Subscription* s) {
+    while (true) {
+        FixRef fix;
+        {
+            std::unique_lock<std::mutex> lock(s->mtx);
+            s->cv.wait(lock, [s]() { return s->quit || s->size > 0; });
+            if (s->quit) {
+                return;
+            }
+            fix = std::move(s->ring[s->head]);
+            s->head = (s->head + 1) % s->ring.size();
+            --s->size;
+        }
+        s->subscriber->onFix(fix);
+        s->delivered.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void FixHub::stop(Subscription* s) {
+    if (s->thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(s->mtx);
+            s->quit = true;
+        }
+        s->cv.notify_one();
+        s->thread.join();
+    }
+    for (FixRef& fix : s->ring) {
+        fix.reset();
+    }
+    s->size = 0;
+}
+
+Fix* FixHub::acquire() {
+    std::lock_guard<std::mutex> lock(m_poolMtx);
+    if (!m_free) {
+        std::unique_ptr<Fix[]> chunk(new Fix[kPoolChunk]);
+        for (size_t i = 0; i < kPoolChunk; ++i) {
+            chunk[i].m_hub = this;
+            chunk[i].m_nextFree = m_free;
+            m_free = &chunk[i];
+        }
+        m_chunks.push_back(std::move(chunk));
+    }
+    Fix* fix = m_free;
+    m_free = fix->m_nextFree;
+    return fix;
+}
+
+void FixHub::release(Fix* fix) {
+    std::lock_guard<std::mutex> lock(m_poolMtx);
+    fix->m_nextFree = m_free;
+    m_free = fix;
+}
+
+}  // namespace ciccloud
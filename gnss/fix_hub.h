@@ -0,0 +1,167 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+class FixHub;
+
+// A fix as FixHub hands it out: immutable, and shared by reference among
+// all the subscribers which hold it. It goes back to the pool of its hub
+// when the last FixRef to it is gone.
+class Fix {
+public:
+    const Location& location() const { return m_location; }
+    uint64_t seq() const { return m_seq; }  // of the hub, counts up from 1
+
+private:
+    friend class FixHub;
+    friend class FixRef;
+
+    Location m_location;
+    uint64_t m_seq = 0;
+    mutable std::atomic<int> m_refs{0};
+    FixHub* m_hub = nullptr;
+    Fix* m_nextFree = nullptr;
+};
+
+// A counted reference to a Fix, cheap to copy.
+class FixRef {
+public:
+    FixRef() = default;
+    FixRef(const FixRef& other) : m_fix(other.m_fix) { retain(); }
+    FixRef(FixRef&& other) noexcept : m_fix(other.m_fix) { other.m_fix = nullptr; }
+    FixRef& operator=(const FixRef& other);
+    FixRef& operator=(FixRef&& other) noexcept;
+    ~FixRef() { reset(); }
+
+    void reset();
+
+    const Fix* get() const { return m_fix; }
+    const Fix& operator*() const { return *m_fix; }
+    const Fix* operator->() const { return m_fix; }
+    explicit operator bool() const { return m_fix != nullptr; }
+
+private:
+    friend class FixHub;
+    explicit FixRef(Fix* fix) : m_fix(fix) { retain(); }
+    void retain() const;
+
+    Fix* m_fix = nullptr;
+};
+
+enum class FixDelivery : uint8_t {
+    INLINE,  // on the thread which publishes, it must not block
+    QUEUE,   // every fix, in order, on a thread of the subscriber's own
+    LATEST,  // on a thread of its own too, only the newest if it falls behind
+};
+
+class FixSubscriber {
+public:
+    virtual ~FixSubscriber() = default;
+    // A subscriber may keep the reference beyond the call, but must let it
+    // go before the hub is destroyed.
+    virtual void onFix(const FixRef& fix) = 0;
+};
+
+// Hands every fix to any number of subscribers without a copy per
+// subscriber: the location is copied once into a pooled Fix, and each
+// subscriber gets a reference to it the way it subscribed. A queue which is
+// full drops its oldest fix, so a slow subscriber never holds up the one
+// which publishes, nor the other subscribers. Once the pool has grown to
+// what the subscribers hold at most, publishing does not allocate.
+//
+// Thread safe. Inline subscribers are called with the hub locked: they must
+// not subscribe or unsubscribe from onFix().
+class FixHub {
+public:
+    static constexpr size_t kMaxSubscribers = 8;
+    static constexpr size_t kDefaultQueueDepth = 16;
+
+    struct SubscriberStats {
+        uint64_t delivered = 0;   // onFix() calls
+        uint64_t dropped = 0;     // QUEUE: the oldest, when the queue was full
+        uint64_t superseded = 0;  // LATEST: replaced by a newer one before delivery
+    };
+
+    FixHub() = default;
+    ~FixHub();
+    FixHub(const FixHub&) = delete;
+    FixHub& operator=(const FixHub&) = delete;
+
+    // `subscriber` gets the fixes published from now on. QUEUE keeps up to
+    // `queueDepth` waiting. False if there is no room for one more.
+    bool subscribe(FixSubscriber* subscriber, FixDelivery mode,
+                   size_t queueDepth = kDefaultQueueDepth);
+    // Once it returns, `subscriber` is not called any more, and what was
+    // waiting for it is released.
+    void unsubscribe(FixSubscriber* subscriber);
+
+    // One Fix of `loc` for all the subscribers.
+    void publish(const Location& loc);
+
+    // Of a subscriber, zeros if it is not subscribed.
+    SubscriberStats stats(const FixSubscriber* subscriber) const;
+    // Fixes in the pool, in use or not: what the subscribers hold at most.
+    size_t poolSize() const;
+
+private:
+    friend class FixRef;
+    static constexpr size_t kPoolChunk = 32;
+
+    // an async subscriber and its thread
+    struct Subscription {
+        FixSubscriber* subscriber = nullptr;
+        FixDelivery mode = FixDelivery::INLINE;
+        std::vector<FixRef> ring;  // QUEUE: depth slots, LATEST: one
+        size_t head = 0;           // the oldest waiting
+        size_t size = 0;           // waiting
+        bool quit = false;
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::thread thread;
+        std::atomic<uint64_t> delivered{0};
+        std::atomic<uint64_t> dropped{0};
+        std::atomic<uint64_t> superseded{0};
+    };
+
+    Fix* acquire();
+    void release(Fix* fix);
+    void deliver(Subscription* s, const FixRef& fix);
+    static void run(Subscription* s);
+    static void stop(Subscription* s);
+
+    mutable std::mutex m_mtx;  // the subscriptions
+    std::unique_ptr<Subscription> m_subscriptions[kMaxSubscribers];
+    uint64_t m_seq = 0;
+
+    mutable std::mutex m_poolMtx;
+    Fix* m_free = nullptr;
+    std::vector<std::unique_ptr<Fix[]>> m_chunks;
+};
+
+}  // namespace ciccloud
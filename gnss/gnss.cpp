@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <cutils/properties.h>
 #include <log/log.h>
+#include <cstring>
 
 #include "agnss.h"
 #include "gnss.h"
@@ -23,10 +25,109 @@
 
 namespace {
 constexpr char kGnssDeviceName[] = "AIC virtual GPS";
+constexpr char kDefaultAlmanacPath[] = "/vendor/etc/gnss/gps_almanac.yuma";
+constexpr int kOpenTimeoutMs = 1000;
+
+ciccloud::GnssHwConnConfig loadGnssHwConnConfig() {
+    ciccloud::GnssHwConnConfig config;
+
+    char buf[PROPERTY_VALUE_MAX] = {
+        '\0',
+    };
+    if (property_get("virtual.gps.tcp.port", buf, "") > 0) {
+        config.tcpPort = atoi(buf);
+    }
+    if (property_get("virtual.gps.udp.port", buf, "") > 0) {
+        config.udpPort = atoi(buf);
+    }
+    if (property_get("virtual.gps.feeds", buf, "") > 0) {
+        config.feeds = atoi(buf);
+    }
+    if (property_get("virtual.gps.feeds.stall_margin_ms", buf, "") > 0) {
+        config.feedArbiter.stallMarginMs = atoi(buf);
+    }
+    if (property_get("virtual.gps.jitter_buffer.delay_ms", buf, "") > 0) {
+        config.jitterBuffer.targetDelayMs = atoi(buf);
+    }
+    if (property_get("virtual.gps.jitter_buffer.adaptive", buf, "") > 0) {
+        config.jitterBuffer.adaptive = (atoi(buf) != 0);
+    }
+    if (property_get("virtual.gps.sv_status.min_interval_ms", buf, "") > 0) {
+        config.svStatus.minIntervalMs = atoi(buf);
+    }
+    if (property_get("virtual.gps.sv_status.cn0_threshold_dbhz", buf, "") > 0) {
+        config.svStatus.cn0ThresholdDbhz = atoi(buf);
+    }
+    if (property_get("virtual.gps.nmea.mode", buf, "") > 0 &&
+        !ciccloud::parseNmeaForwardMode(buf, &config.nmea.mode)) {
+        ALOGW("%s:%d: unknown NMEA mode '%s', NMEA is off", __PRETTY_FUNCTION__, __LINE__, buf);
+        config.nmea.mode = ciccloud::NmeaForwardMode::OFF;
+    }
+    if (property_get("virtual.gps.nmea.sentences", buf, "") > 0) {
+        config.nmea.sentences = buf;
+    }
+    if (property_get("virtual.gps.nmea.decimation", buf, "") > 0) {
+        config.nmea.decimation = atoi(buf);
+    }
+    if (property_get("virtual.gps.nmea.batch", buf, "") > 0) {
+        config.nmea.batch = (atoi(buf) != 0);
+    }
+    if (property_get("virtual.gps.filter", buf, "") > 0) {
+        if (!strcmp(buf, "cv")) {
+            config.fixFilter.model = ciccloud::FixFilterModel::CONSTANT_VELOCITY;
+        } else if (!strcmp(buf, "ca")) {
+            config.fixFilter.model = ciccloud::FixFilterModel::CONSTANT_ACCELERATION;
+        } else {
+            config.fixFilter.model = ciccloud::FixFilterModel::OFF;
+        }
+    }
+    if (property_get("virtual.gps.wakeup.max_hold_ms", buf, "") > 0) {
+        config.wakeup.maxHoldMs = atoi(buf);
+    }
+    if (property_get("virtual.gps.io_uring", buf, "") > 0) {
+        config.ioUring = (atoi(buf) != 0);
+    }
+    if (property_get("virtual.gps.sched.class", buf, "") > 0 &&
+        !ciccloud::parseSchedClass(buf, &config.threads.schedClass)) {
+        ALOGW("%s:%d: unknown scheduling class '%s'", __PRETTY_FUNCTION__, __LINE__, buf);
+    }
+    if (property_get("virtual.gps.sched.priority", buf, "") > 0) {
+        config.threads.priority = atoi(buf);
+    }
+    if (property_get("virtual.gps.sched.nice", buf, "") > 0) {
+        config.threads.nice = atoi(buf);
+    }
+    if (property_get("virtual.gps.sched.cpus", buf, "") > 0) {
+        config.threads.cpus = buf;
+    }
+    if (property_get("virtual.gps.sched.mlock", buf, "") > 0) {
+        config.threads.lockMemory = (atoi(buf) != 0);
+    }
+
+    return config;
+}
+
+std::vector<ciccloud::AlmanacEntry> loadAlmanac() {
+    char path[PROPERTY_VALUE_MAX];
+    property_get("virtual.gps.almanac", path, kDefaultAlmanacPath);
+
+    std::vector<ciccloud::AlmanacEntry> almanac;
+    if (!ciccloud::loadYumaAlmanac(path, &almanac)) {
+        ALOGW("%s:%d: no almanac at '%s', the measurements will be empty",
+              __PRETTY_FUNCTION__, __LINE__, path);
+    }
+    return almanac;
+}
 };
 
 namespace ciccloud {
 
+Gnss20::Gnss20()
+    : m_almanac(loadAlmanac())
+    , m_connController(&m_dataSink, [](const GnssSink* sink) {
+        return std::make_unique<GnssHwConn>(sink, loadGnssHwConnConfig());
+    }) {}
+
 Return<sp<ahg20::IGnssConfiguration>> Gnss20::getExtensionGnssConfiguration_2_0() {
     return new GnssConfiguration20();
 }
@@ -44,23 +145,30 @@ Return<sp<ahg20::IAGnssRil>> Gnss20::getExtensionAGnssRil_2_0() {
 }
 
 Return<sp<ahg20::IGnssMeasurement>> Gnss20::getExtensionGnssMeasurement_2_0() {
-    return new GnssMeasurement20();
+    return new GnssMeasurement20(m_almanac, &m_dataSink);
 }
 
 Return<bool> Gnss20::setCallback_2_0(const sp<ahg20::IGnssCallback>& callback) {
     if (callback == nullptr) {
         return false;
-    } else if (open()) {
-        using Caps = ahg20::IGnssCallback::Capabilities;
-        callback->gnssSetCapabilitiesCb_2_0(Caps::MEASUREMENTS | 0);
-        callback->gnssNameCb(kGnssDeviceName);
-        callback->gnssSetSystemInfoCb({.yearOfHw = 2020});
-
-        m_dataSink.setCallback20(callback);
-        return true;
-    } else {
-        return false;
     }
+
+    // the framework is told if the connection cannot open, so this call
+    // waits for it (after the teardown of the previous one, if any)
+    m_connController.open();
+    if (!m_connController.waitIdle(kOpenTimeoutMs)) {
+        ALOGW("%s:%d: the GPS connection is still opening", __PRETTY_FUNCTION__, __LINE__);
+    } else if (m_connController.state() == ConnController::State::CLOSED) {
+        return false;  // logged by the controller
+    }
+
+    using Caps = ahg20::IGnssCallback::Capabilities;
+    callback->gnssSetCapabilitiesCb_2_0(Caps::MEASUREMENTS | 0);
+    callback->gnssNameCb(kGnssDeviceName);
+    callback->gnssSetSystemInfoCb({.yearOfHw = 2020});
+
+    m_dataSink.setCallback20(callback);
+    return true;
 }
 
 Return<sp<ahgmc10::IMeasurementCorrections>> Gnss20::getExtensionMeasurementCorrections() {
@@ -96,29 +204,17 @@ Return<bool> Gnss20::setPositionMode_1_1(ahg10::IGnss::GnssPositionMode mode,
 }
 
 Return<bool> Gnss20::start() {
-    std::unique_lock<std::mutex> lock(m_gnssHwConnMtx);
-    if (m_gnssHwConn) {
-        return m_gnssHwConn->start();
-    } else {
-        return false;
-    }
+    return m_connController.start();
 }
 
 Return<bool> Gnss20::stop() {
-    std::unique_lock<std::mutex> lock(m_gnssHwConnMtx);
-    if (m_gnssHwConn) {
-        return m_gnssHwConn->stop();
-    } else {
-        return false;
-    }
+    return m_connController.stop();
 }
 
 Return<void> Gnss20::cleanup() {
-    {
-        std::unique_lock<std::mutex> lock(m_gnssHwConnMtx);
-        m_gnssHwConn.reset();
-    }
-
+    // the teardown finishes in the background, but the old connection
+    // delivers nothing more, to this callback or the next
+    m_connController.close();
     m_dataSink.cleanup();
 
     return {};
@@ -155,22 +251,6 @@ Return<sp<ahg10::IGnssXtra>> Gnss20::getExtensionXtra() {
     return nullptr;
 }
 
-////////////////////////////////////////////////////////////////////////////////
-bool Gnss20::open() {
-    std::unique_lock<std::mutex> lock(m_gnssHwConnMtx);
-    if (m_gnssHwConn) {
-        return true;
-    } else {
-        auto conn = std::make_unique<GnssHwConn>(&m_dataSink);
-        if (conn->ok()) {
-            m_gnssHwConn = std::move(conn);
-            return true;
-        } else {
-            return false;
-        }
-    }
-}
-
 //// deprecated and old versions ///////////////////////////////////////////////
 Return<bool> Gnss20::setCallback_1_1(const sp<ahg11::IGnssCallback>&) {
     return false;
@@ -16,10 +16,10 @@
 
 #pragma once
 #include <android/hardware/gnss/2.0/IGnss.h>
-#include <memory>
-#include <mutex>
+#include <vector>
+#include "almanac.h"
+#include "conn_controller.h"
 #include "data_sink.h"
-#include "gnss_hw_conn.h"
 
 namespace ciccloud {
 namespace ahg = ::android::hardware::gnss;
@@ -33,6 +33,8 @@ using ::android::sp;
 using ::android::hardware::Return;
 
 struct Gnss20 : public ahg20::IGnss {
+    Gnss20();
+
     // Methods from V2_0::IGnss follow.
     Return<sp<ahg20::IGnssConfiguration>> getExtensionGnssConfiguration_2_0() override;
     Return<sp<ahg20::IGnssDebug>> getExtensionGnssDebug_2_0() override;
@@ -83,15 +85,15 @@ struct Gnss20 : public ahg20::IGnss {
     Return<sp<ahg10::IGnssBatching>> getExtensionGnssBatching() override;
 
 private:
-    bool open();
     void cleanupImpl();
     bool injectBestLocationImpl(const ahg10::GnssLocation&,
                                 const ahg20::ElapsedRealtime);
 
     DataSink m_dataSink;  // all updates go here
+    std::vector<AlmanacEntry> m_almanac;  // for the measurements, empty if missing
 
-    std::unique_ptr<GnssHwConn> m_gnssHwConn;
-    mutable std::mutex m_gnssHwConnMtx;
+    // opens, starts, stops and tears down GnssHwConn off the binder thread
+    ConnController m_connController;
 };
 
 }  // namespace ciccloud
@@ -0,0 +1,89 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "gnss_clock.h"
+#include <algorithm>
+#include <cmath>
+#include "util.h"
+
+namespace ciccloud {
+namespace {
+constexpr double kBiasGain = 1.0 / 16;
+constexpr double kDriftGain = 1.0 / 1024;
+}  // namespace
+
+void GnssClockModel::reset() {
+    if (m_anchored) {
+        m_anchored = false;
+        ++m_discontinuities;  // the next anchor starts a new timeline
+    }
+}
+
+bool GnssClockModel::update(const int64_t bootNs, const int64_t gpsTimeNs,
+                            GnssClockSample* sample) {
+    if (m_anchored && gpsTimeNs <= m_lastGpsTimeNs) {
+        return false;
+    }
+
+    const int64_t offsetNs = bootNs - gpsTimeNs;
+    if (m_anchored) {
+        const double dtS = (gpsTimeNs - m_lastGpsTimeNs) * 1e-9;
+        const double predictedNs = m_biasNs + m_driftNsps * dtS;
+        const double errorNs = (offsetNs - m_fullBiasNs) - predictedNs;
+        if (std::abs(errorNs) > kResyncNs) {
+            m_anchored = false;
+            ++m_discontinuities;
+        } else {
+            m_biasNs = predictedNs + kBiasGain * errorNs;
+            m_driftNsps += kDriftGain * errorNs / dtS;
+            m_errorNs += (std::abs(errorNs) - m_errorNs) * kBiasGain;
+        }
+    }
+    if (!m_anchored) {
+        m_anchored = true;
+        m_fullBiasNs = offsetNs;
+        m_biasNs = 0;
+        m_driftNsps = 0;
+        m_errorNs = 0;
+    }
+    m_lastGpsTimeNs = gpsTimeNs;
+
+    // whole nanoseconds of the bias go into timeNs, so that the reported
+    // fullBiasNs + biasNs gives GPS time exactly
+    const int64_t biasNs = std::llround(m_biasNs);
+    sample->gpsTimeNs = gpsTimeNs;
+    sample->timeNs = gpsTimeNs + m_fullBiasNs + biasNs;
+    sample->fullBiasNs = m_fullBiasNs;
+    sample->biasNs = biasNs;
+    sample->driftNsps = m_driftNsps;
+    sample->biasUncertaintyNs = std::max(1.0, m_errorNs);
+    sample->discontinuities = m_discontinuities;
+    return true;
+}
+
+void GnssSessionClock::onStatus(const GnssStatus status) {
+    if (status == GnssStatus::SESSION_BEGIN) {
+        m_model.reset();
+    }
+}
+
+bool GnssSessionClock::onEpoch(const Location& fix, GnssClockSample* sample) {
+    return m_model.update(fix.elapsedRealtimeNs, util::utcToGpsNanos(util::fixUtcNanos(fix)),
+                          sample);
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+// The receiver clock as GnssMeasurement reports it: GPS time is
+// timeNs - (fullBiasNs + biasNs).
+struct GnssClockSample {
+    int64_t gpsTimeNs = 0;       // since 1980-01-06
+    int64_t timeNs = 0;          // of the local hardware clock
+    int64_t fullBiasNs = 0;
+    double biasNs = 0;
+    double driftNsps = 0;
+    double biasUncertaintyNs = 0;
+    uint32_t discontinuities = 0;  // hwClockDiscontinuityCount
+};
+
+// Models the local hardware clock of the measurements from the epochs of the
+// feed, so that timeNs advances with GPS time and fullBiasNs stays put
+// between epochs.
+//
+// The local clock is CLOCK_BOOTTIME. Every epoch brings its GPS time and
+// the boottime of the fix, whose offset jitters with the feed (or with
+// ClockSync). The offset at the first epoch becomes fullBiasNs, a second
+// order loop follows the rest in biasNs and driftNsps, and timeNs is GPS
+// time plus both. An offset too far from the prediction re-anchors
+// fullBiasNs and counts as a discontinuity.
+//
+// Not thread safe.
+class GnssClockModel {
+public:
+    static constexpr int64_t kResyncNs = 100000000;  // 100ms
+
+    void reset();
+
+    // Returns false for an epoch not after the previous one.
+    bool update(int64_t bootNs, int64_t gpsTimeNs, GnssClockSample* sample);
+
+private:
+    bool m_anchored = false;
+    int64_t m_fullBiasNs = 0;
+    int64_t m_lastGpsTimeNs = 0;
+    double m_biasNs = 0;
+    double m_driftNsps = 0;
+    double m_errorNs = 0;  // average absolute loop error
+    uint32_t m_discontinuities = 0;
+};
+
+// The model fed with the fixes of the epochs, a new session starting a new
+// timeline: what the receiver clock did before the session stopped says
+// nothing about it after.
+//
+// Not thread safe.
+class GnssSessionClock {
+public:
+    void onStatus(GnssStatus);
+    void reset() { m_model.reset(); }
+
+    // Returns false for an epoch not after the previous one.
+    bool onEpoch(const Location& fix, GnssClockSample* sample);
+
+private:
+    GnssClockModel m_model;
+};
+
+}  // namespace ciccloud
@@ -16,20 +16,35 @@
 // #define LOG_NDEBUG 0
 #define LOG_NIDEBUG 0
 #include "gnss_hw_conn.h"
-#include <cutils/properties.h>
-#include <cutils/sockets.h>
+#include <arpa/inet.h>
 #include <fcntl.h>
 #include <log/log.h>
+#include <netinet/in.h>
+#include <pthread.h>
 #include <sys/epoll.h>
+#include <sys/ioctl.h>
 #include <sys/socket.h>
-#include "gnss_hw_listener.h"
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <memory>
+#include <vector>
+#include "gnss_hw_conn_worker.h"
+#include "io_uring_loop.h"
+#include "trace.h"
 
 namespace {
 constexpr char kCMD_QUIT = 'q';
 constexpr char kCMD_START = 'a';
 constexpr char kCMD_STOP = 'o';
+constexpr char kCMD_TICK = 't';  // the clock jumped, see Clock::addWaker
 
-int epollCtlAdd(int epollFd, int fd) {
+std::atomic<int32_t> g_sessionCookie(0);  // async trace track per session
+
+// The event data has the fd in the low half and `tag` (the client
+// generation, if it is a client) in the high half.
+int epollCtlAdd(int epollFd, int fd, uint32_t events = EPOLLIN, uint32_t tag = 0) {
     int ret;
 
     /* make the fd non-blocking */
@@ -43,8 +58,8 @@ int epollCtlAdd(int epollFd, int fd) {
     }
 
     struct epoll_event ev;
-    ev.events = EPOLLIN;
-    ev.data.fd = fd;
+    ev.events = events;
+    ev.data.u64 = (static_cast<uint64_t>(tag) << 32) | static_cast<uint32_t>(fd);
 
     return TEMP_FAILURE_RETRY(epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &ev));
 }
@@ -52,31 +67,179 @@ int epollCtlAdd(int epollFd, int fd) {
 int epollCtlRemove(int epollFd, int fd) {
     return TEMP_FAILURE_RETRY(epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL));
 }
+
+// The kernel receive timestamp of `msg` (SO_TIMESTAMPNS, CLOCK_REALTIME)
+// moved to the boot time of `clock`, or `bootNs` (now) if there is none.
+int64_t rxBootNanos(const ciccloud::Clock& clock, struct msghdr* msg, const int64_t bootNs) {
+    for (struct cmsghdr* c = CMSG_FIRSTHDR(msg); c; c = CMSG_NXTHDR(msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec rx;
+            memcpy(&rx, CMSG_DATA(c), sizeof(rx));
+            return clock.rxBootNanos(rx.tv_sec * 1000000000LL + rx.tv_nsec, bootNs);
+        }
+    }
+    return bootNs;
+}
+
+// Reads like read(2), and returns when the data arrived in *rxBootNs.
+ssize_t readTimestamped(const ciccloud::Clock& clock, const int fd, char* buf, const size_t size,
+                        int64_t* rxBootNs) {
+    struct iovec iov = {.iov_base = buf, .iov_len = size};
+    char control[CMSG_SPACE(sizeof(struct timespec))];
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    const ssize_t n = TEMP_FAILURE_RETRY(recvmsg(fd, &msg, 0));
+    const int64_t bootNs = clock.bootNanos();
+    *rxBootNs = (n > 0) ? rxBootNanos(clock, &msg, bootNs) : bootNs;
+    return n;
+}
+
+// An epoch with all GSV parts fits into one read.
+constexpr size_t kReadSize = 2048;
+
+// Datagrams are drained up to kDatagramBatch per recvmmsg call, an epoch
+// with all GSV parts fits into kDatagramSize easily.
+constexpr int kDatagramBatch = 16;
+constexpr size_t kDatagramSize = 2048;
+
+struct DatagramBatch {
+    struct mmsghdr msgs[kDatagramBatch];
+    struct iovec iov[kDatagramBatch];
+    char data[kDatagramBatch][kDatagramSize];
+    char control[kDatagramBatch][CMSG_SPACE(sizeof(struct timespec))];
+};
+
+// Drains the UDP socket into onDatagram(data, size, rxBootNs), nullptr
+// data for a truncated one. Returns the number of recvmmsg calls.
+template <typename OnDatagram>
+int readDatagrams(const ciccloud::Clock& clock, const int fd, DatagramBatch* b,
+                  OnDatagram onDatagram) {
+    for (int calls = 1;; ++calls) {
+        for (int i = 0; i < kDatagramBatch; ++i) {
+            b->iov[i] = {.iov_base = b->data[i], .iov_len = kDatagramSize};
+            struct msghdr* h = &b->msgs[i].msg_hdr;
+            memset(h, 0, sizeof(*h));
+            h->msg_iov = &b->iov[i];
+            h->msg_iovlen = 1;
+            h->msg_control = b->control[i];
+            h->msg_controllen = sizeof(b->control[i]);
+        }
+        const int n = TEMP_FAILURE_RETRY(recvmmsg(fd, b->msgs, kDatagramBatch, MSG_DONTWAIT, nullptr));
+        if (n <= 0) {
+            return calls;
+        }
+        GNSS_TRACE_COUNTER("gnss.datagrams_per_read", n);
+
+        const int64_t bootNs = clock.bootNanos();
+        for (int i = 0; i < n; ++i) {
+            struct msghdr* h = &b->msgs[i].msg_hdr;
+            const bool truncated = h->msg_flags & MSG_TRUNC;
+            onDatagram(truncated ? nullptr : b->data[i], b->msgs[i].msg_len,
+                       rxBootNanos(clock, h, bootNs));
+        }
+        if (n < kDatagramBatch) {
+            return calls;
+        }
+    }
+}
+
+ciccloud::unique_fd openUdpSocket(const uint16_t port) {
+    ciccloud::unique_fd fd(socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0));
+    if (!fd.ok()) {
+        ALOGE("%s: socket failed: %s", __PRETTY_FUNCTION__, strerror(errno));
+        return {};
+    }
+    const int one = 1;
+    setsockopt(fd.get(), SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one));
+    // a burst after a stall must not overflow the socket
+    const int rcvbuf = 256 * 1024;
+    setsockopt(fd.get(), SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(fd.get(), (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        ALOGE("%s: could not bind udp port %u: %s", __PRETTY_FUNCTION__, port, strerror(errno));
+        return {};
+    }
+    return fd;
+}
 }  // namespace
 
 namespace ciccloud {
 
-GnssHwConn::GnssHwConn(const DataSink* sink) {
+GnssHwConn::GnssHwConn(const GnssSink* sink, const GnssHwConnConfig& config)
+    : m_feeds(std::clamp(config.feeds, 1, FeedArbiter::kMaxFeeds))
+    , m_wakeupConfig(config.wakeup)
+    , m_nmeaConfig(config.nmea)
+    , m_fixFilterConfig(config.fixFilter)
+    , m_threadPolicy(config.threads)
+    , m_clock(config.clock) {
     m_gsstLoopExit = false;
     m_gpsSocketServerFd.reset();
 
-    m_tcpPort = 8766;
-    char buf[PROPERTY_VALUE_MAX] = {
-        '\0',
-    };
-    if (property_get("virtual.gps.tcp.port", buf, "") > 0) {
-        m_tcpPort = atoi(buf);
-    }
+    m_tcpPort = config.tcpPort;
     ALOGI("Virtual gps will read with port '%u'", (unsigned int)m_tcpPort);
 
     m_needNotifyClientStart = 0;
+    m_clientGeneration = 0;
+    m_syscalls = 0;
+    m_wakeups = 0;
+    m_timerWakeups = 0;
+    m_reads = 0;
+
+    if (config.jitterBuffer.targetDelayMs > 0) {
+        JitterBufferConfig jitterBuffer = config.jitterBuffer;
+        jitterBuffer.threads = config.threads;
+        m_jitterBuffer = std::make_unique<JitterBuffer>(sink, jitterBuffer, *m_clock);
+        if (m_jitterBuffer->ok()) {
+            ALOGI("Virtual gps will de-jitter locations, target delay %dms",
+                  config.jitterBuffer.targetDelayMs);
+            sink = m_jitterBuffer.get();
+        } else {
+            m_jitterBuffer.reset();
+        }
+    }
+    m_svStatusPublisher = std::make_unique<SvStatusPublisher>(sink, config.svStatus, *m_clock);
+    sink = m_svStatusPublisher.get();
+    m_feedArbiter = std::make_unique<FeedArbiter>(sink, config.feedArbiter, *m_clock);
+    if (m_feeds > 1) {
+        ALOGI("Virtual gps will take up to %d feeds at a time", m_feeds);
+    }
+
     m_epollFd.reset(epoll_create1(0));
     if (!m_epollFd.ok()) {
         ALOGE("%s:%d: epoll_create1 failed", __PRETTY_FUNCTION__, __LINE__);
         return;
     }
 
-    m_gpsSocketServerThread = std::thread([this]() { gpsSocketServerThread(this); });
+    if (config.udpPort) {
+        m_udpFd = openUdpSocket(config.udpPort);
+        if (m_udpFd.ok()) {
+            ALOGI("Virtual gps will also read datagrams with port '%u'", config.udpPort);
+        }
+    }
+
+    if (config.ioUring) {
+        m_ioUringLoop = IoUringLoop::create(m_udpFd.ok());
+        if (m_ioUringLoop) {
+            ALOGI("Virtual gps will run on io_uring");
+        } else {
+            ALOGW("io_uring is not available, virtual gps falls back to epoll");
+        }
+    }
+
+    // with io_uring the worker thread accepts clients too
+    if (!m_ioUringLoop) {
+        m_gpsSocketServerThread = std::thread([this]() { gpsSocketServerThread(this); });
+    }
 
     if (!::android::base::Socketpair(AF_LOCAL, SOCK_STREAM, 0,
                                      &m_callersFd, &m_threadsFd)) {
@@ -85,14 +248,27 @@ GnssHwConn::GnssHwConn(const DataSink* sink) {
         return;
     }
 
+    if (!m_threadPolicy.isDefault()) {
+        ALOGI("Virtual gps threads will run %s, priority %d, nice %d, on CPUs '%s'%s",
+              toString(m_threadPolicy.schedClass), m_threadPolicy.priority, m_threadPolicy.nice,
+              m_threadPolicy.cpus.c_str(), m_threadPolicy.lockMemory ? ", memory locked" : "");
+    }
+    // the deadlines of the worker are on m_clock, when it jumps they may be due
+    m_clockWaker = m_clock->addWaker([this]() {
+        if (!m_tickPending.exchange(true)) {
+            sendWorkerThreadCommand(kCMD_TICK);
+        }
+    });
     m_thread = std::thread([this, sink]() {
-        sink->gnssStatus(ahg10::IGnssCallback::GnssStatusValue::ENGINE_ON);
+        applyThreadPolicy(m_threadPolicy);
+        sink->gnssStatus(GnssStatus::ENGINE_ON);
         workerThread(this, sink);
-        sink->gnssStatus(ahg10::IGnssCallback::GnssStatusValue::ENGINE_OFF);
+        sink->gnssStatus(GnssStatus::ENGINE_OFF);
     });
 }
 
 GnssHwConn::~GnssHwConn() {
+    m_clock->removeWaker(m_clockWaker);
     if (m_thread.joinable()) {
         sendWorkerThreadCommand(kCMD_QUIT);
         m_thread.join();
@@ -100,22 +276,22 @@ GnssHwConn::~GnssHwConn() {
 
     // kCMD_QUIT, P uses CMD_QUIT = 0. For compatibility, transfer kCMD_QUIT to CMD_QUIT.
     char cmd = 0;
-    int ret = 0;
-    if (m_clientFd.ok()) {
-        ret = TEMP_FAILURE_RETRY(write(m_clientFd.get(), &cmd, 1));
-        if (ret != 1)
-            ALOGE("%s: could not notify client(%d) to quit: ret=%d: %s", __PRETTY_FUNCTION__, m_clientFd.get(), ret, strerror(errno));
-        else
-            ALOGI("%s Notify client(%d) to quit", __PRETTY_FUNCTION__, m_clientFd.get());
+    if (writeClients(&cmd, 1)) {
+        ALOGI("%s Notify client to quit", __PRETTY_FUNCTION__);
     } else {
-        ALOGI("%s No client is connected. Do not need to send quit message.", __PRETTY_FUNCTION__);
+        ALOGI("%s No client is connected or it is gone. Do not need to send quit message.", __PRETTY_FUNCTION__);
     }
 
     m_gsstLoopExit = true;
     shutdown(m_gpsSocketServerFd.get(), SHUT_RDWR);
     m_gpsSocketServerFd.reset();
-    shutdown(m_clientFd.get(), SHUT_RDWR);
-    m_clientFd.reset();
+    {
+        std::lock_guard<std::mutex> lock(m_clientFdMtx);
+        for (Client& client : m_clients) {
+            shutdown(client.fd.get(), SHUT_RDWR);
+            client.fd.reset();
+        }
+    }
 
     if (m_gpsSocketServerThread.joinable()) {
         m_gpsSocketServerThread.join();
@@ -123,19 +299,33 @@ GnssHwConn::~GnssHwConn() {
 }
 
 bool GnssHwConn::ok() const {
-    return m_thread.joinable() && m_gpsSocketServerThread.joinable();
+    return m_thread.joinable() && (m_ioUringLoop || m_gpsSocketServerThread.joinable());
+}
+
+GnssHwConn::IoStats GnssHwConn::ioStats() const {
+    IoStats stats;
+    stats.ioUring = static_cast<bool>(m_ioUringLoop);
+    stats.syscalls = m_syscalls.load(std::memory_order_relaxed);
+    stats.wakeups = m_wakeups.load(std::memory_order_relaxed);
+    stats.timerWakeups = m_timerWakeups.load(std::memory_order_relaxed);
+    stats.reads = m_reads.load(std::memory_order_relaxed);
+    for (const std::thread* t : {&m_thread, &m_gpsSocketServerThread}) {
+        clockid_t clock;
+        struct timespec ts;
+        if (t->joinable() &&
+            !pthread_getcpuclockid(const_cast<std::thread*>(t)->native_handle(), &clock) &&
+            !clock_gettime(clock, &ts)) {
+            stats.cpuNs += ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+    }
+    return stats;
 }
 
 bool GnssHwConn::start() {
     // kCMD_START, P uses CMD_START = 1. For compatibility, transfer kCMD_START to CMD_START.
     char cmd = 1;
-    int ret = 0;
-    if (m_clientFd.ok()) {
-        ret = TEMP_FAILURE_RETRY(write(m_clientFd.get(), &cmd, 1));
-        if (ret != 1)
-            ALOGE("%s: could not notify client(%d) to start: ret=%d: %s", __PRETTY_FUNCTION__, m_clientFd.get(), ret, strerror(errno));
-        else
-            ALOGV("%s Notify client(%d) to start", __PRETTY_FUNCTION__, m_clientFd.get());
+    if (writeClients(&cmd, 1)) {
+        ALOGV("%s Notify client to start", __PRETTY_FUNCTION__);
     }
     m_needNotifyClientStart = true;
 
@@ -145,32 +335,225 @@ bool GnssHwConn::start() {
 bool GnssHwConn::stop() {
     // kCMD_STOP, P uses CMD_STOP = 2. For compatibility, transfer kCMD_STOP to CMD_STOP.
     char cmd = 2;
-    int ret = 0;
-    if (m_clientFd.ok()) {
-        ret = TEMP_FAILURE_RETRY(write(m_clientFd.get(), &cmd, 1));
-        if (ret != 1)
-            ALOGE("%s: could not notify client(%d) to stop: ret=%d: %s", __PRETTY_FUNCTION__, m_clientFd.get(), ret, strerror(errno));
-        else
-            ALOGV("%s Notify client(%d) to stop", __PRETTY_FUNCTION__, m_clientFd.get());
+    if (writeClients(&cmd, 1)) {
+        ALOGV("%s Notify client to stop", __PRETTY_FUNCTION__);
     }
     m_needNotifyClientStart = false;
 
     return ok() && sendWorkerThreadCommand(kCMD_STOP);
 }
 
-void GnssHwConn::workerThread(void* paramGnssHwConn, const DataSink* sink) {
+GnssHwConn::Worker::Worker(GnssHwConn* conn, const GnssSink* sink)
+    : m_conn(conn)
+    , m_sink(sink)
+    , m_arbiter(conn->m_feedArbiter.get()) {
+    for (int slot = 0; slot < conn->m_feeds; ++slot) {
+        m_listeners[slot] = std::make_unique<GnssHwListener>(
+            m_arbiter->input(slot), conn->m_nmeaConfig, conn->m_fixFilterConfig, *conn->m_clock);
+        if (conn->m_udpFd.ok()) {
+            m_datagramListeners[slot] = std::make_unique<GnssHwListener>(
+                m_arbiter->input(slot), conn->m_nmeaConfig, conn->m_fixFilterConfig,
+                *conn->m_clock, &m_listeners[slot]->clockSync());
+        }
+    }
+}
+
+bool GnssHwConn::Worker::onCommand(const int cmd) {
+    GNSS_TRACE_SCOPE("GnssHwConn::command");
+    switch (cmd) {
+        case kCMD_QUIT:
+            if (m_running) {
+                GNSS_TRACE_ASYNC_END("gnss.session", m_sessionCookie);
+            }
+            return false;
+
+        case kCMD_START:
+            if (!m_running) {
+                m_sessionCookie = ++g_sessionCookie;
+                GNSS_TRACE_ASYNC_BEGIN("gnss.session", m_sessionCookie);
+                for (int slot = 0; slot < m_conn->m_feeds; ++slot) {
+                    m_listeners[slot]->reset();
+                    if (m_datagramListeners[slot]) {
+                        m_datagramListeners[slot]->reset();
+                    }
+                }
+                m_arbiter->reset();
+                m_sink->gnssStatus(GnssStatus::SESSION_BEGIN);
+                m_running = true;
+            }
+            break;
+
+        case kCMD_TICK:
+            m_conn->m_tickPending = false;  // the loop looks at the deadlines next
+            break;
+
+        case kCMD_STOP:
+            if (m_running) {
+                m_running = false;
+                m_sink->gnssStatus(GnssStatus::SESSION_END);
+                GNSS_TRACE_ASYNC_END("gnss.session", m_sessionCookie);
+            }
+            break;
+
+        default:
+            ALOGE("%s:%d: workerThreadRcvCommand returned unexpected command, cmd=%d", __PRETTY_FUNCTION__, __LINE__, cmd);
+            ::abort();
+            break;
+    }
+    return true;
+}
+
+void GnssHwConn::Worker::onClientData(const uint32_t generation, const char* data,
+                                      const size_t size, const int64_t rxBootNs) {
+    const int slot = clientSlot(generation);
+    if (generation != m_conn->m_clients[slot].generation) {
+        return;  // queued before the client was replaced
+    }
+    if (generation != m_clientGenerations[slot]) {
+        onNewClient(generation);
+    }
+    GnssHwListener& listener = *m_listeners[slot];
+    if (m_running) {
+        listener.consume(data, size, rxBootNs);
+        const int priority = listener.feedSession().priority();
+        m_arbiter->setPriority(slot, priority >= 0 ? priority : FeedArbiter::kDefaultPriority);
+    }
+}
+
+// Catches up with the clients adopted since, the server thread does that
+// with the epoll loop. A feeder which sends datagrams may send nothing else.
+void GnssHwConn::Worker::syncClients() {
+    for (int slot = 0; slot < m_conn->m_feeds; ++slot) {
+        const uint32_t generation = m_conn->m_clients[slot].generation;
+        if (generation && generation != m_clientGenerations[slot]) {
+            onNewClient(generation);
+        }
+    }
+}
+
+// A new connection: drop a sentence cut by the old one of the slot.
+void GnssHwConn::Worker::onNewClient(const uint32_t generation) {
+    const int slot = clientSlot(generation);
+    GnssHwListener& listener = *m_listeners[slot];
+    m_clientGenerations[slot] = generation;
+    m_datagramSlot = slot;
+    listener.reset();
+    listener.clockSync().reset();
+    listener.feedSession().onDisconnect();
+    if (m_datagramListeners[slot]) {
+        m_datagramListeners[slot]->reset();
+    }
+    m_arbiter->connect(slot, generation / FeedArbiter::kMaxFeeds);
+    m_conn->m_datagramFeed.onConnect();
+}
+
+void GnssHwConn::Worker::onClientGone(const uint32_t generation) {
+    m_conn->dropClient(generation);
+    const int slot = clientSlot(generation);
+    if (generation == m_clientGenerations[slot]) {
+        m_arbiter->disconnect(slot);
+    }
+}
+
+void GnssHwConn::Worker::onDatagramBatch() {
+    if (m_running) {
+        syncClients();
+    }
+    m_conn->m_datagramFeed.onBatch();
+}
+
+// Datagrams hold whole sentences, they go to the datagram listener as they
+// are. Not to the TCP one: a sentence cut by the stream, the epochs and the
+// session of the stream are its own.
+void GnssHwConn::Worker::onDatagram(const char* data, const size_t size, const int64_t rxBootNs) {
+    const char* sentences = m_conn->m_datagramFeed.accept(data, size);
+    if (sentences && m_running) {
+        m_datagramListeners[m_datagramSlot]->consume(sentences, data + size - sentences, rxBootNs);
+    }
+}
+
+void GnssHwConn::workerThread(void* paramGnssHwConn, const GnssSink* sink) {
     GnssHwConn* pGnssHwConn = (GnssHwConn*)paramGnssHwConn;
+    Worker worker(pGnssHwConn, sink);
+    if (pGnssHwConn->m_ioUringLoop) {
+        pGnssHwConn->m_ioUringLoop->run(pGnssHwConn, &worker);
+    } else {
+        epollLoop(pGnssHwConn, &worker);
+    }
+}
+
+void GnssHwConn::epollLoop(GnssHwConn* pGnssHwConn, Worker* worker) {
     epollCtlAdd(pGnssHwConn->m_epollFd.get(), pGnssHwConn->m_threadsFd.get());
 
-    GnssHwListener listener(sink);
-    bool running = false;
+    std::unique_ptr<DatagramBatch> datagramBatch;
+    if (pGnssHwConn->m_udpFd.ok()) {
+        datagramBatch = std::make_unique<DatagramBatch>();
+        epollCtlAdd(pGnssHwConn->m_epollFd.get(), pGnssHwConn->m_udpFd.get());
+    }
+
+    // per client slot
+    std::vector<WakeupPolicy> wakeupPolicies(pGnssHwConn->m_feeds,
+                                             WakeupPolicy(pGnssHwConn->m_wakeupConfig));
+    std::vector<uint32_t> wakeupGenerations(pGnssHwConn->m_feeds, 0);  // of the clients they know
+
+    // Reads the client until the kernel has no more, returns the bytes. The
+    // client fd is edge triggered: a short read means we have it all, more
+    // data brings a new edge. Unless the peer is closing, we want the 0 then.
+    const auto readClient = [pGnssHwConn, worker](const int fd, const uint32_t generation,
+                                                  const bool drain) -> size_t {
+        GNSS_TRACE_SCOPE("GnssHwConn::read");
+        if (GNSS_TRACE_ENABLED()) {
+            // what waits in the socket when we wake up, how far behind we are
+            int queued = 0;
+            worker->countSyscalls();
+            if (ioctl(fd, FIONREAD, &queued) == 0) {
+                GNSS_TRACE_COUNTER("gnss.rx_queue_bytes", queued);
+            }
+        }
+        size_t rxBytes = 0;
+        char buf[kReadSize];
+        while (true) {
+            int64_t rxBootNs;
+            int n = readTimestamped(*pGnssHwConn->m_clock, fd, buf, sizeof(buf), &rxBootNs);
+            worker->countSyscalls();
+            worker->countReads();
+            if (n > 0) {
+                ALOGV("%s:%d Received %d bytes: %.*s", __PRETTY_FUNCTION__, __LINE__, n, n, buf);
+                rxBytes += n;
+                worker->onClientData(generation, buf, n, rxBootNs);
+                if (!drain && static_cast<size_t>(n) < sizeof(buf)) {
+                    break;
+                }
+            } else if (n == 0) {
+                ALOGV("%s:%d GPS socket client may close. Remove client(%d) and let it reconnect.", __PRETTY_FUNCTION__, __LINE__, fd);
+                worker->onClientGone(generation);
+                break;
+            } else {
+                break;
+            }
+        }
+        GNSS_TRACE_COUNTER("gnss.rx_bytes_per_wakeup", rxBytes);
+        return rxBytes;
+    };
 
     while (true) {
-        struct epoll_event events[2];
-        const int kTimeoutMs = 60000;
+        int timeoutMs = worker->sendDueControl([pGnssHwConn, worker](int slot, const char* ctrl) {
+            worker->countSyscalls();
+            return pGnssHwConn->writeClient(slot, ctrl, kCTRL_SIZE);
+        });
+        const int64_t bootNs = pGnssHwConn->m_clock->bootNanos();
+        for (const WakeupPolicy& wakeupPolicy : wakeupPolicies) {
+            const int holdMs = wakeupPolicy.timeoutMs(bootNs);
+            if (holdMs >= 0) {
+                timeoutMs = std::min(timeoutMs, holdMs);
+            }
+        }
+
+        struct epoll_event events[2 + FeedArbiter::kMaxFeeds];
         const int n = TEMP_FAILURE_RETRY(epoll_wait(pGnssHwConn->m_epollFd.get(),
-                                                    events, 2,
-                                                    kTimeoutMs));
+                                                    events, 2 + pGnssHwConn->m_feeds,
+                                                    timeoutMs));
+        worker->countSyscalls();
         if (n < 0) {
             ALOGE("%s:%d: epoll_wait failed with '%s'", __PRETTY_FUNCTION__, __LINE__, strerror(errno));
             continue;
@@ -178,70 +561,71 @@ void GnssHwConn::workerThread(void* paramGnssHwConn, const DataSink* sink) {
 
         for (int i = 0; i < n; ++i) {
             const struct epoll_event* ev = &events[i];
-            const int fd = ev->data.fd;
+            const int fd = static_cast<int>(ev->data.u64 & 0xffffffff);
             const int ev_events = ev->events;
 
-            if (fd == pGnssHwConn->m_clientFd.get()) {
+            if (fd == pGnssHwConn->m_udpFd.get()) {
+                GNSS_TRACE_SCOPE("GnssHwConn::readDatagrams");
+                worker->countWakeup();
+                worker->onDatagramBatch();
+                const int calls = readDatagrams(*pGnssHwConn->m_clock, fd, datagramBatch.get(),
+                    [worker](const char* data, size_t size, int64_t rxBootNs) {
+                        if (data) {
+                            worker->onDatagram(data, size, rxBootNs);
+                        } else {
+                            worker->onDatagramTruncated();
+                        }
+                    });
+                worker->countSyscalls(calls);
+                worker->countReads(calls);
+            } else if (fd != pGnssHwConn->m_threadsFd.get()) {
+                const uint32_t generation = static_cast<uint32_t>(ev->data.u64 >> 32);
+                const int slot = clientSlot(generation);
+                WakeupPolicy& wakeupPolicy = wakeupPolicies[slot];
+                if (generation != wakeupGenerations[slot]) {
+                    wakeupPolicy.reset(fd);
+                    wakeupGenerations[slot] = generation;
+                }
                 if (ev_events & (EPOLLERR | EPOLLHUP)) {
-                    ALOGV("%s:%d: epoll_wait: ev_events=%x GPS socket client may close. Remove pGnssHwConn->m_clientFd(%d) and reset it. Let client to reconnect.", __PRETTY_FUNCTION__, __LINE__, ev_events, pGnssHwConn->m_clientFd.get());
-                    epollCtlRemove(pGnssHwConn->m_epollFd.get(), pGnssHwConn->m_clientFd.get());
-                    shutdown(pGnssHwConn->m_clientFd.get(), SHUT_RDWR);
-                    pGnssHwConn->m_clientFd.reset();
+                    ALOGV("%s:%d: epoll_wait: ev_events=%x GPS socket client may close. Remove client(%d) and let it reconnect.", __PRETTY_FUNCTION__, __LINE__, ev_events, fd);
+                    worker->onClientGone(generation);
+                    wakeupPolicy.reset(-1);
                     continue;
                 } else if (ev_events & EPOLLIN) {
-                    char buf[64];
-                    while (true) {
-                        int n = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)));
-                        if (n > 0) {
-                            ALOGV("%s:%d Received %d bytes: %s", __PRETTY_FUNCTION__, __LINE__, n, buf);
-                            if (running) {
-                                for (int i = 0; i < n; ++i) {
-                                    listener.consume(buf[i]);
-                                }
-                            }
-                        } else if (n == 0) {
-                            ALOGV("%s:%d GPS socket client may close. Remove pGnssHwConn->m_clientFd(%d) and reset it. Let client to reconnect.", __PRETTY_FUNCTION__, __LINE__, pGnssHwConn->m_clientFd.get());
-                            epollCtlRemove(pGnssHwConn->m_epollFd.get(), pGnssHwConn->m_clientFd.get());
-                            shutdown(pGnssHwConn->m_clientFd.get(), SHUT_RDWR);
-                            pGnssHwConn->m_clientFd.reset();
-                        } else {
-                            break;
-                        }
-                    }
+                    worker->countWakeup();
+                    readClient(fd, generation, ev_events & EPOLLRDHUP);
+                    const GnssHwListener& listener = worker->listener(slot);
+                    wakeupPolicy.onEpochs(listener.epochs(), listener.lastEpochBytes(),
+                                          listener.epochStartRxBootNs());
                 }
-            } else if (fd == pGnssHwConn->m_threadsFd.get()) {
+            } else {
                 if (ev_events & (EPOLLERR | EPOLLHUP)) {
                     ALOGE("%s:%d: epoll_wait: pGnssHwConn->m_threadsFd.get() has an error, ev_events=%x", __PRETTY_FUNCTION__, __LINE__, ev_events);
                     ::abort();
                 } else if (ev_events & EPOLLIN) {
-                    const int cmd = workerThreadRcvCommand(fd);
-                    switch (cmd) {
-                        case kCMD_QUIT:
-                            return;
-
-                        case kCMD_START:
-                            if (!running) {
-                                listener.reset();
-                                sink->gnssStatus(ahg10::IGnssCallback::GnssStatusValue::SESSION_BEGIN);
-                                running = true;
-                            }
-                            break;
-
-                        case kCMD_STOP:
-                            if (running) {
-                                running = false;
-                                sink->gnssStatus(ahg10::IGnssCallback::GnssStatusValue::SESSION_END);
-                            }
-                            break;
-
-                        default:
-                            ALOGE("%s:%d: workerThreadRcvCommand returned unexpected command, cmd=%d", __PRETTY_FUNCTION__, __LINE__, cmd);
-                            ::abort();
-                            break;
+                    worker->countSyscalls();
+                    if (!worker->onCommand(workerThreadRcvCommand(fd))) {
+                        return;
                     }
                 }
-            } else {
-                ALOGE("%s:%d: epoll_wait() returned unexpected fd", __PRETTY_FUNCTION__, __LINE__);
+            }
+        }
+
+        // the next epoch is overdue: it may be below the low water mark
+        const int64_t nowNs = pGnssHwConn->m_clock->bootNanos();
+        for (int slot = 0; slot < pGnssHwConn->m_feeds; ++slot) {
+            WakeupPolicy& wakeupPolicy = wakeupPolicies[slot];
+            const Client& client = pGnssHwConn->m_clients[slot];
+            if (wakeupPolicy.due(nowNs) && wakeupGenerations[slot] == client.generation) {
+                worker->countWakeup(true);
+                int fd;
+                {
+                    std::lock_guard<std::mutex> lock(pGnssHwConn->m_clientFdMtx);
+                    fd = client.fd.get();
+                }
+                wakeupPolicy.onPolled(fd >= 0 ? readClient(fd, wakeupGenerations[slot], true) : 0);
+            } else if (wakeupPolicy.due(nowNs)) {
+                wakeupPolicy.reset(-1);  // the client is gone or replaced
             }
         }
     }
@@ -260,8 +644,49 @@ bool GnssHwConn::sendWorkerThreadCommand(char cmd) const {
     return TEMP_FAILURE_RETRY(write(m_callersFd.get(), &cmd, 1)) == 1;
 }
 
-void GnssHwConn::gpsSocketServerThread(void* paramGnssHwConn) {
-    GnssHwConn* pGnssHwConn = (GnssHwConn*)paramGnssHwConn;
+bool GnssHwConn::writeClient(const int slot, const char* data, const size_t size) {
+    std::lock_guard<std::mutex> lock(m_clientFdMtx);
+    const unique_fd& fd = m_clients[slot].fd;
+    if (!fd.ok()) {
+        return false;
+    }
+    const ssize_t ret = TEMP_FAILURE_RETRY(write(fd.get(), data, size));
+    if (ret == static_cast<ssize_t>(size)) {
+        return true;
+    } else if (ret > 0) {
+        // the feeder would take the next message for the rest of this one:
+        // hang up, its read of 0 has the worker drop the client
+        ALOGE("%s:%d: wrote %zd of %zu bytes to client(%d), dropping it", __PRETTY_FUNCTION__, __LINE__, ret, size, fd.get());
+        shutdown(fd.get(), SHUT_RDWR);
+    } else {
+        ALOGE("%s: could not write %zu bytes to client(%d): ret=%zd: %s", __PRETTY_FUNCTION__, size, fd.get(), ret, strerror(errno));
+    }
+    return false;
+}
+
+// To every client, true if one of them got it.
+bool GnssHwConn::writeClients(const char* data, const size_t size) {
+    bool written = false;
+    for (int slot = 0; slot < m_feeds; ++slot) {
+        written = writeClient(slot, data, size) || written;
+    }
+    return written;
+}
+
+// Only if the client of `generation` is still there: the server thread may
+// have replaced it with a new connection already.
+void GnssHwConn::dropClient(const uint32_t generation) {
+    std::lock_guard<std::mutex> lock(m_clientFdMtx);
+    Client& client = m_clients[clientSlot(generation)];
+    if (client.generation == generation && client.fd.ok()) {
+        epollCtlRemove(m_epollFd.get(), client.fd.get());
+        shutdown(client.fd.get(), SHUT_RDWR);
+        client.fd.reset();
+        client.generation = 0;
+    }
+}
+
+bool GnssHwConn::openServerSocket() {
     int ret = 0;
     int so_reuseaddr = 1;
     int gpsSocketServerFd = -1;
@@ -270,66 +695,117 @@ void GnssHwConn::gpsSocketServerThread(void* paramGnssHwConn) {
     gpsSocketServerFd = socket(AF_INET, SOCK_STREAM, 0);
     if (gpsSocketServerFd < 0) {
         ALOGE("%s:%d Fail to construct tcp socket with error: %s", __PRETTY_FUNCTION__, __LINE__, strerror(errno));
-        return;
+        return false;
     }
 
     if (setsockopt(gpsSocketServerFd, SOL_SOCKET, SO_REUSEADDR, &so_reuseaddr, sizeof(int)) < 0) {
         ALOGE("%s setsockopt(SO_REUSEADDR) failed. gpsSocketServerFd: %d\n", __PRETTY_FUNCTION__, gpsSocketServerFd);
         close(gpsSocketServerFd);
         gpsSocketServerFd = -1;
-        return;
+        return false;
     }
-    pGnssHwConn->m_gpsSocketServerFd.reset(gpsSocketServerFd);
+    m_gpsSocketServerFd.reset(gpsSocketServerFd);
 
     struct sockaddr_in addr;
     memset(&addr, 0, sizeof(addr));
     addr.sin_family = AF_INET;
     addr.sin_addr.s_addr = htonl(INADDR_ANY);
-    addr.sin_port = htons(pGnssHwConn->m_tcpPort);
+    addr.sin_port = htons(m_tcpPort);
 
-    ret = bind(pGnssHwConn->m_gpsSocketServerFd.get(), (struct sockaddr*)&addr, sizeof(struct sockaddr_in));
+    ret = bind(m_gpsSocketServerFd.get(), (struct sockaddr*)&addr, sizeof(struct sockaddr_in));
     if (ret < 0) {
         ALOGE("%s Failed to bind server socket address %d, %s", __PRETTY_FUNCTION__, ret, strerror(errno));
-        return;
+        return false;
     }
 
-    ret = listen(pGnssHwConn->m_gpsSocketServerFd.get(), 5);
+    ret = listen(m_gpsSocketServerFd.get(), 5);
     if (ret < 0) {
         ALOGE("%s Failed to listen on server socket", __PRETTY_FUNCTION__);
+        return false;
+    }
+    return true;
+}
+
+// Makes `clientFd` a client, returns its generation, which has the slot of
+// the client in it (see clientSlot). It goes into a free slot, the lowest
+// one so that a feeder which reconnects gets its old slot, and its feed
+// session, back. If all are taken, the new one replaces the oldest: the
+// worker may not have seen that one go yet. With one feed, the new client
+// always replaces the old one.
+uint32_t GnssHwConn::adoptClient(const int clientFd) {
+    ALOGI("%s A GPS client connected to server. clientFd = %d", __PRETTY_FUNCTION__, clientFd);
+    const int one = 1;
+    if (setsockopt(clientFd, SOL_SOCKET, SO_TIMESTAMPNS, &one, sizeof(one)) < 0) {
+        ALOGW("%s setsockopt(SO_TIMESTAMPNS) failed, fixes will be stamped on read: %s", __PRETTY_FUNCTION__, strerror(errno));
+    }
+
+    std::lock_guard<std::mutex> lock(m_clientFdMtx);
+    int slot = 0;
+    for (int i = 0; i < m_feeds; ++i) {
+        if (!m_clients[i].fd.ok()) {
+            slot = i;
+            break;
+        } else if (m_clients[i].generation < m_clients[slot].generation) {
+            slot = i;
+        }
+    }
+    Client& client = m_clients[slot];
+    if (client.fd.ok()) {
+        ALOGV("%s replacing client(%d)", __PRETTY_FUNCTION__, client.fd.get());
+        epollCtlRemove(m_epollFd.get(), client.fd.get());
+        shutdown(client.fd.get(), SHUT_RDWR);
+    }
+    client.fd.reset(clientFd);
+    const uint32_t generation = ++m_clientGeneration * FeedArbiter::kMaxFeeds + slot;
+    client.generation = generation;
+    if (m_epollFd.ok() && !m_ioUringLoop) {
+        ALOGV("%s register client(%d) to m_epollFd(%d)", __PRETTY_FUNCTION__, clientFd, m_epollFd.get());
+        // edge triggered, the worker reads until a short read, see epollLoop
+        epollCtlAdd(m_epollFd.get(), clientFd, EPOLLIN | EPOLLET | EPOLLRDHUP, generation);
+    }
+
+    //Android already triggered start command. Notify client to start when it connect to server.
+    if (m_needNotifyClientStart) {
+        ALOGV("%s Android already triggered start command. Notify client to start when it connect to server.", __PRETTY_FUNCTION__);
+        // kCMD_START, P uses CMD_START = 1. For compatibility, transfer kCMD_START to CMD_START.
+        char cmd = 1;
+        const int ret = TEMP_FAILURE_RETRY(write(clientFd, &cmd, 1));
+        if (ret != 1)
+            ALOGE("%s: could not notify client(%d) to start: ret=%d: %s", __PRETTY_FUNCTION__, clientFd, ret, strerror(errno));
+        else
+            ALOGV("%s Notify client(%d) to start", __PRETTY_FUNCTION__, clientFd);
+    }
+    return generation;
+}
+
+void GnssHwConn::gpsSocketServerThread(void* paramGnssHwConn) {
+    GnssHwConn* pGnssHwConn = (GnssHwConn*)paramGnssHwConn;
+    applyThreadPolicy(pGnssHwConn->m_threadPolicy);
+    if (!pGnssHwConn->openServerSocket()) {
         return;
     }
 
     while (!pGnssHwConn->m_gsstLoopExit) {
+        struct sockaddr_in addr;
         socklen_t alen = sizeof(struct sockaddr_in);
         ALOGV("%s Wait a GPS client to connect...", __PRETTY_FUNCTION__);
         int clientFd = -1;
         clientFd = accept(pGnssHwConn->m_gpsSocketServerFd.get(), (struct sockaddr*)&addr, &alen);
+        pGnssHwConn->m_syscalls.fetch_add(1, std::memory_order_relaxed);
         if (clientFd >= 0) {
-            ALOGI("%s A GPS client connected to server. clientFd = %d", __PRETTY_FUNCTION__, clientFd);
-            pGnssHwConn->m_clientFd.reset(clientFd);
-            if (pGnssHwConn->m_epollFd.ok()) {
-                ALOGV("%s register pGnssHwConn->m_clientFd(%d) to pGnssHwConn->m_epollFd(%d)", __PRETTY_FUNCTION__, pGnssHwConn->m_clientFd.get(), pGnssHwConn->m_epollFd.get());
-                epollCtlAdd(pGnssHwConn->m_epollFd.get(), pGnssHwConn->m_clientFd.get());
-            }
-
-            //Android already triggered start command. Notify client to start when it connect to server.
-            if (pGnssHwConn->m_needNotifyClientStart) {
-                ALOGV("%s Android already triggered start command. Notify client to start when it connect to server.", __PRETTY_FUNCTION__);
-                // kCMD_START, P uses CMD_START = 1. For compatibility, transfer kCMD_START to CMD_START.
-                char cmd = 1;
-                ret = TEMP_FAILURE_RETRY(write(pGnssHwConn->m_clientFd.get(), &cmd, 1));
-                if (ret != 1)
-                    ALOGE("%s: could not notify client(%d) to start: ret=%d: %s", __PRETTY_FUNCTION__, pGnssHwConn->m_clientFd.get(), ret, strerror(errno));
-                else
-                    ALOGV("%s Notify client(%d) to start", __PRETTY_FUNCTION__, pGnssHwConn->m_clientFd.get());
-            }
+            pGnssHwConn->adoptClient(clientFd);
         } else {
-            ALOGV("%s GPS socket server maybe shutdown as quit command is got. Or else, error happen. pGnssHwConn->m_clientFd = %d %s.", __PRETTY_FUNCTION__, pGnssHwConn->m_clientFd.get(), strerror(errno));
+            ALOGV("%s GPS socket server maybe shutdown as quit command is got. Or else, error happen. %s.", __PRETTY_FUNCTION__, strerror(errno));
         }
     }
 
-    shutdown(pGnssHwConn->m_clientFd.get(), SHUT_RDWR);
-    pGnssHwConn->m_clientFd.reset();
+    {
+        std::lock_guard<std::mutex> lock(pGnssHwConn->m_clientFdMtx);
+        for (Client& client : pGnssHwConn->m_clients) {
+            shutdown(client.fd.get(), SHUT_RDWR);
+            client.fd.reset();
+        }
+    }
     shutdown(pGnssHwConn->m_gpsSocketServerFd.get(), SHUT_RDWR);
     pGnssHwConn->m_gpsSocketServerFd.reset();
     ALOGI("%s Quit", __PRETTY_FUNCTION__);
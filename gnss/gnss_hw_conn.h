@@ -16,26 +16,85 @@
 
 #pragma once
 #include <android-base/unique_fd.h>
+#include <atomic>
+#include <memory>
 #include <mutex>
 #include <thread>
-#include "data_sink.h"
+#include "clock.h"
+#include "datagram_feed.h"
+#include "feed_arbiter.h"
+#include "fix_filter.h"
+#include "gnss_sink.h"
+#include "jitter_buffer.h"
+#include "nmea_forwarder.h"
+#include "sv_status_publisher.h"
+#include "thread_policy.h"
+#include "wakeup_policy.h"
 
 namespace ciccloud {
 using ::android::base::unique_fd;
 
+class IoUringLoop;
+
+struct GnssHwConnConfig {
+    uint16_t tcpPort = 8766;  // virtual gps tcp port
+    uint16_t udpPort = 0;     // datagram feed, see DatagramFeed, 0 - off
+    bool ioUring = false;     // the io_uring loop if the kernel has it, else epoll
+    int feeds = 1;            // concurrent feed connections, see FeedArbiter
+    FeedArbiterConfig feedArbiter;
+    JitterBufferConfig jitterBuffer;
+    SvStatusPublisherConfig svStatus;
+    NmeaForwardConfig nmea;
+    FixFilterConfig fixFilter;
+    WakeupPolicyConfig wakeup;  // the epoll loop only
+    // of the worker, the server and the jitter buffer thread: what carries
+    // a fix from the socket to the sink
+    ThreadPolicyConfig threads;
+    // what the pipeline takes the time from, a SimulatedClock runs it on
+    // simulated time; it has to outlive the GnssHwConn
+    Clock* clock = &systemClock();
+};
+
 class GnssHwConn {
 public:
-    explicit GnssHwConn(const DataSink* sink);
+    GnssHwConn(const GnssSink* sink, const GnssHwConnConfig& config);
     ~GnssHwConn();
 
     bool ok() const;
     bool start();
     bool stop();
 
+    const DatagramFeed& datagramFeed() const { return m_datagramFeed; }
+
+    // What the feed costs the I/O threads, to compare the loops.
+    struct IoStats {
+        bool ioUring = false;       // which loop runs
+        uint64_t syscalls = 0;      // made by the I/O threads for the feed
+        int64_t cpuNs = 0;          // CPU time of the I/O threads
+        uint64_t wakeups = 0;       // of the worker for feed data
+        uint64_t timerWakeups = 0;  // of them, to pick up a held epoch, see WakeupPolicy
+        uint64_t reads = 0;         // of feed data, recv calls or completions
+    };
+    IoStats ioStats() const;
+
+    SvStatusPublisher::Stats svStatusStats() const { return m_svStatusPublisher->stats(); }
+    FeedArbiter::Stats feedStats() const { return m_feedArbiter->stats(); }
+
 private:
-    static void workerThread(void* paramGnssHwConn, const DataSink* sink);
+    friend class IoUringLoop;
+    class Worker;  // see gnss_hw_conn_worker.h
+
+    static void workerThread(void* paramGnssHwConn, const GnssSink* sink);
+    static void epollLoop(GnssHwConn* pGnssHwConn, Worker* worker);
     static int workerThreadRcvCommand(int fd);
     bool sendWorkerThreadCommand(char cmd) const;
+    bool writeClient(int slot, const char* data, size_t size);
+    bool writeClients(const char* data, size_t size);
+    void dropClient(uint32_t generation);
+    bool openServerSocket();
+    uint32_t adoptClient(int clientFd);
+    // The slot of the client of `generation`, see adoptClient.
+    static int clientSlot(uint32_t generation) { return generation % FeedArbiter::kMaxFeeds; }
 
     unique_fd m_devFd;  // GPS client socket fd
     // a pair of connected sockets to talk to the worker thread
@@ -49,7 +108,38 @@ private:
     unique_fd m_epollFd;
     std::atomic<u_int16_t> m_tcpPort;  // virtual gps tcp port
     std::atomic<bool> m_needNotifyClientStart;
-    unique_fd m_clientFd;
+    // the server thread adopts clients, the worker drops them, callers
+    // write control bytes to them: all under m_clientFdMtx. A client is a
+    // feed of its own, in the slot of the same index of the feed arbiter.
+    struct Client {
+        unique_fd fd;
+        std::atomic<uint32_t> generation{0};  // 0 - none, see adoptClient
+    };
+    std::mutex m_clientFdMtx;
+    Client m_clients[FeedArbiter::kMaxFeeds];
+    std::atomic<uint32_t> m_clientGeneration;  // bumped on every accept
+    const int m_feeds;  // slots in use of m_clients
+    // datagrams carry the data, the TCP client still gets start/stop
+    unique_fd m_udpFd;
+    DatagramFeed m_datagramFeed;
+    std::unique_ptr<JitterBuffer> m_jitterBuffer;  // between the listener and the sink
+    std::unique_ptr<SvStatusPublisher> m_svStatusPublisher;  // in front of the jitter buffer
+    std::unique_ptr<FeedArbiter> m_feedArbiter;  // between the listeners and the rest
+    // if set, the worker thread also accepts clients and there is no server thread
+    std::unique_ptr<IoUringLoop> m_ioUringLoop;
+    std::atomic<uint64_t> m_syscalls;
+    std::atomic<uint64_t> m_wakeups;
+    std::atomic<uint64_t> m_timerWakeups;
+    std::atomic<uint64_t> m_reads;
+    const WakeupPolicyConfig m_wakeupConfig;
+    const NmeaForwardConfig m_nmeaConfig;
+    const FixFilterConfig m_fixFilterConfig;
+    const ThreadPolicyConfig m_threadPolicy;
+    Clock* const m_clock;
+    int m_clockWaker = 0;
+    // a tick command is on its way to the worker, one is enough to have it
+    // look at its deadlines again
+    std::atomic<bool> m_tickPending{false};
 };
 
 }  // namespace ciccloud
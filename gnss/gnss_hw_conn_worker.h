@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include "gnss_hw_conn.h"
+#include "gnss_hw_listener.h"
+
+namespace ciccloud {
+
+// Feeder protocol extensions, sent only to feeders which asked for them:
+//   3 - time ping, followed by t1 (CLOCK_BOOTTIME), see ClockSync
+//   4 - resume, followed by the next record seq we want, see FeedSession
+// Payloads are 8 bytes little endian.
+constexpr char kCTRL_PING = 3;
+constexpr char kCTRL_RESUME = 4;
+constexpr size_t kCTRL_SIZE = 9;
+
+inline void encodeControl(const char ctrl, const uint64_t payload, char (*out)[kCTRL_SIZE]) {
+    (*out)[0] = ctrl;
+    for (size_t i = 0; i < sizeof(payload); ++i) {
+        (*out)[1 + i] = static_cast<char>(payload >> (8 * i));
+    }
+}
+
+// The worker thread of GnssHwConn without its loop: what to do with
+// commands, feed data and timers. The epoll loop and IoUringLoop drive it.
+class GnssHwConn::Worker {
+public:
+    Worker(GnssHwConn* conn, const GnssSink* sink);
+
+    // One of kCMD_*, false on quit.
+    bool onCommand(int cmd);
+
+    // Data from the client of `generation` (see adoptClient), dropped if
+    // that client was replaced in the meantime.
+    void onClientData(uint32_t generation, const char* data, size_t size, int64_t rxBootNs);
+    // The client of `generation` closed or failed.
+    void onClientGone(uint32_t generation);
+
+    // One datagram, see DatagramFeed.
+    void onDatagram(const char* data, size_t size, int64_t rxBootNs);
+    void onDatagramTruncated() { m_conn->m_datagramFeed.onTruncated(); }
+    // Before the datagrams of a wakeup: a client which connected since may
+    // bring a new session.
+    void onDatagramBatch();
+
+    // Hands the resume answers and the pings which are due to
+    // `send(slot, ctrl)`, which returns if it could send to the client in
+    // `slot`, and sends an SV status which waited for a quiet feed. Returns
+    // how long the loop may wait, in ms.
+    template <typename Send>
+    int sendDueControl(Send send);
+
+    void countSyscalls(uint64_t n = 1) {
+        m_conn->m_syscalls.fetch_add(n, std::memory_order_relaxed);
+    }
+    void countWakeup(bool timer = false) {
+        m_conn->m_wakeups.fetch_add(1, std::memory_order_relaxed);
+        if (timer) {
+            m_conn->m_timerWakeups.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+    void countReads(uint64_t n = 1) {
+        m_conn->m_reads.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    const GnssHwListener& listener(int slot) const { return *m_listeners[slot]; }
+
+private:
+    static constexpr int kIdleTimeoutMs = 60000;
+
+    void syncClients();
+    void onNewClient(uint32_t generation);
+    template <typename Send>
+    int sendDueControl(int slot, Send send);
+
+    GnssHwConn* const m_conn;
+    const GnssSink* const m_sink;
+    FeedArbiter* const m_arbiter;
+    // one per client slot, each delivers into its input of the arbiter
+    std::unique_ptr<GnssHwListener> m_listeners[FeedArbiter::kMaxFeeds];
+    // the same for the datagrams of the feeder of the slot, with a framing
+    // of their own and the ClockSync of its TCP listener; none without UDP
+    std::unique_ptr<GnssHwListener> m_datagramListeners[FeedArbiter::kMaxFeeds];
+    bool m_running = false;
+    int32_t m_sessionCookie = 0;
+    uint32_t m_clientGenerations[FeedArbiter::kMaxFeeds] = {};  // seen last, per slot
+    // datagrams come from the feeder of the newest client, which gets the
+    // pings and resumes of the feed; they go to the input of its slot
+    int m_datagramSlot = 0;
+};
+
+template <typename Send>
+int GnssHwConn::Worker::sendDueControl(Send send) {
+    if (!m_running) {
+        return kIdleTimeoutMs;
+    }
+
+    syncClients();
+    int timeoutMs = kIdleTimeoutMs;
+    for (int slot = 0; slot < m_conn->m_feeds; ++slot) {
+        if (m_clientGenerations[slot]) {
+            timeoutMs = std::min(timeoutMs, sendDueControl(slot, send));
+        }
+    }
+
+    const SvStatusPublisher& svStatus = *m_conn->m_svStatusPublisher;
+    svStatus.sendDue();
+    const int64_t svStatusNs = svStatus.nextSendNs();
+    if (svStatusNs != INT64_MAX) {
+        const int64_t nowNs = m_conn->m_clock->bootNanos();
+        timeoutMs = std::min<int64_t>(timeoutMs, (svStatusNs - nowNs) / 1000000 + 1);  // not due yet
+    }
+    return timeoutMs;
+}
+
+template <typename Send>
+int GnssHwConn::Worker::sendDueControl(const int slot, Send send) {
+    GnssHwListener& listener = *m_listeners[slot];
+    char ctrl[kCTRL_SIZE];
+    uint64_t resumeSeq;
+    FeedSession& feedSession = listener.feedSession();
+    if (feedSession.resumePending(&resumeSeq)) {
+        encodeControl(kCTRL_RESUME, resumeSeq, &ctrl);
+        if (!send(slot, ctrl)) {
+            return kIdleTimeoutMs;
+        }
+        feedSession.onResumeSent();
+    }
+
+    ClockSync& clockSync = listener.clockSync();
+    const int64_t nowNs = m_conn->m_clock->bootNanos();
+    int64_t pingNs = clockSync.nextPingNs();
+    if (pingNs <= nowNs) {
+        encodeControl(kCTRL_PING, nowNs, &ctrl);
+        if (!send(slot, ctrl)) {
+            return kIdleTimeoutMs;  // no client, the next one starts a new round
+        }
+        clockSync.onPingSent(nowNs);
+        pingNs = clockSync.nextPingNs();
+    }
+    if (pingNs == INT64_MAX) {
+        return kIdleTimeoutMs;
+    }
+    return std::min<int64_t>(kIdleTimeoutMs, (pingNs - nowNs) / 1000000 + 1);
+}
+
+}  // namespace ciccloud
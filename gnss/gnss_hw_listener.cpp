@@ -16,287 +16,138 @@
 
 #include "gnss_hw_listener.h"
 #include <log/log.h>
-#include <utils/SystemClock.h>
-#include <chrono>
-#include "util.h"
+#include <algorithm>
+#include <cstring>
+#include "trace.h"
 
 namespace ciccloud {
-namespace {
-const char* testNmeaField(const char* i, const char* end, const char* v, const char sep) {
-    while (i < end) {
-        if (*v == 0) {
-            return (*i == sep) ? (i + 1) : nullptr;
-        } else if (*v == *i) {
-            ++v;
-            ++i;
-        } else {
-            return nullptr;
-        }
-    }
 
-    return nullptr;
-}
+GnssHwListener::GnssHwListener(const GnssSink* sink, const NmeaForwardConfig& nmea,
+                               const FixFilterConfig& filter, const Clock& clock,
+                               ClockSync* clockSync)
+    : m_sink(sink)
+    , m_clock(clock)
+    , m_clockSync(clockSync ? clockSync : &m_ownClockSync)
+    , m_parser(sink, m_clockSync, &m_feedSession, filter)
+    , m_nmeaForwarder(sink, nmea) {}
 
-const char* skipAfter(const char* i, const char* end, const char c) {
-    for (; i < end; ++i) {
-        if (*i == c) {
-            return i + 1;
-        }
-    }
-    return nullptr;
+void GnssHwListener::reset() {
+    m_framer.reset();
+    m_nmeaForwarder.reset();
+    m_epochLeader[0] = 0;  // the next feeder may lead with another type
+    m_epochStartByte = UINT64_MAX;
 }
 
-double convertDMMF(const int dmm, const int f, int p10) {
-    const int d = dmm / 100;
-    const int m = dmm % 100;
-    int base10 = 1;
-    for (; p10 > 0; --p10) {
-        base10 *= 10;
+void GnssHwListener::consume(const char c) {
+    ++m_bytes;
+    switch (m_framer.consume(c)) {
+        case NmeaFramer::Event::SENTENCE:
+            onSentence();
+            break;
+
+        case NmeaFramer::Event::OVERFLOW:
+            onFailure(ParseResult::OVERFLOW, m_clock.utcNanos());
+            break;
+
+        default:
+            if (m_framer.size() == 1) {
+                m_sentenceRxBootNs = m_rxBootNs;  // a fix is as old as its first byte
+                m_sentenceByte = m_bytes - 1;
+            }
+            break;
     }
-
-    return double(d) + (m + (f / double(base10))) / 60.0;
-}
-
-double sign(char m, char positive) {
-    return (m == positive) ? 1.0 : -1;
-}
-
-}  // namespace
-
-GnssHwListener::GnssHwListener(const DataSink* sink)
-    : m_sink(sink) {
-    m_buffer.reserve(256);
 }
 
-void GnssHwListener::reset() {
-    m_buffer.clear();
+void GnssHwListener::consume(const char* data, const size_t size) {
+    consume(data, size, m_clock.bootNanos());
 }
 
-void GnssHwListener::consume(char c) {
-    if (c == '$' || !m_buffer.empty()) {
-        m_buffer.push_back(c);
+void GnssHwListener::consume(const char* data, const size_t size, const int64_t rxBootNs) {
+    m_rxBootNs = rxBootNs;
+    for (size_t i = 0; i < size; ++i) {
+        consume(data[i]);
     }
-    if (c == '\n') {
-        const ahg20::ElapsedRealtime ts = util::makeElapsedRealtime(util::nowNanos());
-
-        if (parse(m_buffer.data() + 1, m_buffer.data() + m_buffer.size() - 2, ts)) {
-            m_sink->gnssNmea(ts.timestampNs / 1000000,
-                             hidl_string(m_buffer.data(), m_buffer.size()));
-        } else {
-            m_buffer.back() = 0;
-            ALOGW("%s:%d: failed to parse an NMEA message, '%s'",
-                  __PRETTY_FUNCTION__, __LINE__, m_buffer.data());
-        }
-        m_buffer.clear();
-    } else if (m_buffer.size() >= 1024) {
-        ALOGW("%s:%d buffer was too long, dropped", __PRETTY_FUNCTION__, __LINE__);
-        m_buffer.clear();
+    // Our feeders write an epoch at once, the worker picks it up as a whole
+    // (see WakeupPolicy) and a datagram holds one: when the data runs out
+    // between sentences, the epoch is complete.
+    if (!m_framer.inSentence()) {
+        m_nmeaForwarder.endEpoch();
     }
 }
 
-bool GnssHwListener::parse(const char* begin, const char* end, const ahg20::ElapsedRealtime& ts) {
-    if (const char* fields = testNmeaField(begin, end, "GPRMC", ',')) {
-        return parseGPRMC(fields, end, ts);
-    } else if (const char* fields = testNmeaField(begin, end, "GPGGA", ',')) {
-        return parseGPGGA(fields, end, ts);
-    } else {
-        return false;
-    }
-}
-
-//        begin                                                          end
-// $GPRMC,195206,A,1000.0000,N,10000.0000,E,173.8,231.8,010420,004.2,W*47
-//          1    2    3      4    5       6     7     8      9    10 11 12
-//      1  195206     Time Stamp
-//      2  A          validity - A-ok, V-invalid
-//      3  1000.0000  current Latitude
-//      4  N          North/South
-//      5  10000.0000 current Longitude
-//      6  E          East/West
-//      7  173.8      Speed in knots
-//      8  231.8      True course
-//      9  010420     Date Stamp (13 June 1994)
-//     10  004.2      Variation
-//     11  W          East/West
-//     12  *70        checksum
-bool GnssHwListener::parseGPRMC(const char* begin, const char*, const ahg20::ElapsedRealtime& ts) {
-    double speedKnots = 0;
-    double course = 0;
-    double variation = 0;
-    int latdmm = 0;
-    int londmm = 0;
-    int latf = 0;
-    int lonf = 0;
-    int latdmmConsumed = 0;
-    int latfConsumed = 0;
-    int londmmConsumed = 0;
-    int lonfConsumed = 0;
-    int hhmmss = -1;
-    int sss = 0;
-    int ddmoyy = 0;
-    char validity = 0;
-    char ns = 0;  // north/south
-    char ew = 0;  // east/west
-    char var_ew = 0;
+void GnssHwListener::onSentence() {
+    GNSS_TRACE_SCOPE("GnssHwListener::parse");
+    const int64_t nowNs = m_clock.utcNanos();
 
-    if (sscanf(begin, "%06d.%d,%c,%d.%n%d%n,%c,%d.%n%d%n,%c,%lf,%lf,%d,%lf,%c*",
-               &hhmmss, &sss, &validity,
-               &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
-               &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
-               &speedKnots, &course,
-               &ddmoyy,
-               &variation, &var_ew) != 14) {
-        return false;
+    // protocol sentences are not numbered, see FeedSession
+    const char* payload = m_framer.payloadBegin();
+    const bool control = (m_framer.payloadEnd() - payload) > 3 &&
+                         payload[0] == 'P' && payload[1] == 'C' && payload[2] == 'C';
+    if (!control && !m_feedSession.accept()) {
+        return;  // replayed after a reconnect, delivered before
     }
-    if (validity != 'A') {
-        return false;
+    const bool typed = !control &&
+        (m_framer.payloadEnd() - payload) >= static_cast<ptrdiff_t>(sizeof(m_epochLeader));
+    bool leader = typed && m_epochLeader[0] &&
+                  !memcmp(m_epochLeader, payload, sizeof(m_epochLeader));
+    if (leader) {
+        beginEpoch();
     }
 
-    const double lat = convertDMMF(latdmm, latf, latfConsumed - latdmmConsumed) * sign(ns, 'N');
-    const double lon = convertDMMF(londmm, lonf, lonfConsumed - londmmConsumed) * sign(ew, 'E');
-    const double speed = speedKnots * 0.514444;
-
-    ahg20::GnssLocation loc20;
-    loc20.elapsedRealtime = ts;
-
-    auto& loc10 = loc20.v1_0;
-
-    loc10.latitudeDegrees = lat;
-    loc10.longitudeDegrees = lon;
-    loc10.speedMetersPerSec = speed;
-    loc10.bearingDegrees = course;
-    loc10.horizontalAccuracyMeters = 5;
-    loc10.speedAccuracyMetersPerSecond = .5;
-    loc10.bearingAccuracyDegrees = 30;
-    loc10.timestamp = ts.timestampNs / 1000000;
-
-    using ahg10::GnssLocationFlags;
-    loc10.gnssLocationFlags =
-        GnssLocationFlags::HAS_LAT_LONG |
-        GnssLocationFlags::HAS_SPEED |
-        GnssLocationFlags::HAS_BEARING |
-        GnssLocationFlags::HAS_HORIZONTAL_ACCURACY |
-        GnssLocationFlags::HAS_SPEED_ACCURACY |
-        GnssLocationFlags::HAS_BEARING_ACCURACY;
-
-    if (m_flags & GnssLocationFlags::HAS_ALTITUDE) {
-        loc10.altitudeMeters = m_altitude;
-        loc10.verticalAccuracyMeters = .5;
-        loc10.gnssLocationFlags |= GnssLocationFlags::HAS_ALTITUDE |
-                                   GnssLocationFlags::HAS_VERTICAL_ACCURACY;
+    const ParseResult r = m_parser.parse(m_framer.payloadBegin(), m_framer.payloadEnd(), nowNs,
+                                         m_sentenceRxBootNs);
+    // The first fix sentence which parses leads, a GSV or a broken sentence
+    // ahead of it does not. Its epoch begins after it was parsed, which for
+    // the first one of the feed makes no difference.
+    if (typed && !m_epochLeader[0] && r == ParseResult::OK &&
+        (!memcmp(payload + 2, "RMC", 3) || !memcmp(payload + 2, "GGA", 3))) {
+        memcpy(m_epochLeader, payload, sizeof(m_epochLeader));
+        beginEpoch();
+        leader = true;
     }
-
-    m_sink->gnssLocation(loc20);
-    return true;
-}
-
-// $GPGGA,123519,4807.0382,N,12204.9799,W,1,6,,4.2,M,0.,M,,,*47
-//    time of fix      123519     12:35:19 UTC
-//    latitude         4807.0382  48 degrees, 07.0382 minutes
-//    north/south      N or S
-//    longitude        12204.9799 122 degrees, 04.9799 minutes
-//    east/west        E or W
-//    fix quality      1          standard GPS fix
-//    satellites       1 to 12    number of satellites being tracked
-//    HDOP             <dontcare> horizontal dilution
-//    altitude         4.2        altitude above sea-level
-//    altitude units   M          to indicate meters
-//    diff             <dontcare> height of sea-level above ellipsoid
-//    diff units       M          to indicate meters (should be <dontcare>)
-//    dgps age         <dontcare> time in seconds since last DGPS fix
-//    dgps sid         <dontcare> DGPS station id
-bool GnssHwListener::parseGPGGA(const char* begin, const char* end, const ahg20::ElapsedRealtime& ts) {
-    double altitude = 0;
-    int latdmm = 0;
-    int londmm = 0;
-    int latf = 0;
-    int lonf = 0;
-    int latdmmConsumed = 0;
-    int latfConsumed = 0;
-    int londmmConsumed = 0;
-    int lonfConsumed = 0;
-    int hhmmss = 0;
-    int sss = 0;
-    int fixQuality = 0;
-    int nSatellites = 0;
-    int consumed = 0;
-    char ns = 0;
-    char ew = 0;
-    char altitudeUnit = 0;
-
-    if (sscanf(begin, "%06d.%d,%d.%n%d%n,%c,%d.%n%d%n,%c,%d,%d,%n",
-               &hhmmss, &sss,
-               &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
-               &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
-               &fixQuality,
-               &nSatellites,
-               &consumed) != 10) {
-        if (sscanf(begin, "%06d.%d,%d.%n%d%n,%c,%d.%n%d%n,%c,%d,,%n",
-                   &hhmmss, &sss,
-                   &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
-                   &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
-                   &fixQuality,
-                   &consumed) != 9) { // satellites is null.
-            return false;
-        }
-    }
-
-    begin = skipAfter(begin + consumed, end, ',');  // skip HDOP
-    if (!begin) {
-        return false;
+    if (r == ParseResult::OK) {
+        m_stats.record(r);
+    } else if (r == ParseResult::CONTROL) {
+        m_stats.record(r);  // between the feeder and us, not for the framework
+    } else {
+        onFailure(r, nowNs);
     }
-    if (sscanf(begin, "%lf,%c,", &altitude, &altitudeUnit) != 2) {
-        return false;
+    // whatever a receiver could have sent, even if we do not parse it
+    if (r == ParseResult::OK || r == ParseResult::UNKNOWN_TYPE || r == ParseResult::INVALID_FIX) {
+        m_nmeaForwarder.forward(nowNs / 1000000, m_framer.data(), m_framer.size());
     }
-    if (altitudeUnit != 'M') {
-        return false;
+    if (leader) {
+        if (const Location* fix = m_parser.lastLocation()) {
+            m_sink->gnssEpoch(*fix);
+        }
     }
+    m_stats.maybeLogSummary(nowNs);
+}
 
-    const double lat = convertDMMF(latdmm, latf, latfConsumed - latdmmConsumed) * sign(ns, 'N');
-    const double lon = convertDMMF(londmm, lonf, lonfConsumed - londmmConsumed) * sign(ew, 'E');
-
-    ahg20::GnssLocation loc20;
-    loc20.elapsedRealtime = ts;
-
-    auto& loc10 = loc20.v1_0;
-
-    loc10.latitudeDegrees = lat;
-    loc10.longitudeDegrees = lon;
-    loc10.horizontalAccuracyMeters = 5;
-    loc10.timestamp = ts.timestampNs / 1000000;
-    loc10.altitudeMeters = altitude;
-    loc10.verticalAccuracyMeters = .5;
-
-    using ahg10::GnssLocationFlags;
-    loc10.gnssLocationFlags =
-        GnssLocationFlags::HAS_LAT_LONG |
-        GnssLocationFlags::HAS_HORIZONTAL_ACCURACY |
-        GnssLocationFlags::HAS_ALTITUDE |
-        GnssLocationFlags::HAS_VERTICAL_ACCURACY;
-
-    m_sink->gnssLocation(loc20);
-
-    m_altitude = altitude;
-    m_flags |= ahg10::GnssLocationFlags::HAS_ALTITUDE;
-
-    hidl_vec<ahg20::IGnssCallback::GnssSvInfo> svInfo(nSatellites);
-    for (int i = 0; i < nSatellites; ++i) {
-        auto* info20 = &svInfo[i];
-        auto* info10 = &info20->v1_0;
+// A sentence of the leading type starts a new epoch.
+void GnssHwListener::beginEpoch() {
+    m_parser.endEpoch();
+    m_nmeaForwarder.beginEpoch();
 
-        info20->constellation = ahg20::GnssConstellationType::GPS;
-        info10->svid = i + 3;
-        info10->constellation = ahg10::GnssConstellationType::GPS;
-        info10->cN0Dbhz = 30;
-        info10->elevationDegrees = 0;
-        info10->azimuthDegrees = 0;
-        info10->carrierFrequencyHz = 1.59975e+09;
-        info10->svFlag = ahg10::IGnssCallback::GnssSvFlags::HAS_CARRIER_FREQUENCY | 0;
+    if (m_epochStartByte != UINT64_MAX) {
+        m_lastEpochBytes = m_sentenceByte - m_epochStartByte;
+        ++m_epochs;
     }
+    m_epochStartByte = m_sentenceByte;
+    m_epochStartRxBootNs = m_sentenceRxBootNs;
+}
 
-    m_sink->gnssSvStatus(svInfo);
+void GnssHwListener::onFailure(const ParseResult r, const int64_t nowNs) {
+    if (!m_stats.recordFailure(r, nowNs)) {
+        return;
+    }
 
-    return true;
+    // NMEA sentences are at most 82 characters, anything longer is noise.
+    // The framer keeps what it has seen until the next byte.
+    const int len = std::min<int>(m_framer.size(), 82);
+    const int printable = (len > 0 && m_framer.data()[len - 1] == '\n') ? (len - 1) : len;
+    ALOGW("%s:%d: failed to parse an NMEA message (%s), '%.*s'",
+          __PRETTY_FUNCTION__, __LINE__, toString(r), printable, m_framer.data());
 }
 
 }  // namespace ciccloud
@@ -15,29 +15,74 @@
  */
 
 #pragma once
-#include <vector>
-#include "data_sink.h"
+#include <cstddef>
+#include <cstdint>
+#include "clock.h"
+#include "clock_sync.h"
+#include "feed_session.h"
+#include "gnss_sink.h"
+#include "nmea_forwarder.h"
+#include "nmea_framer.h"
+#include "nmea_parser.h"
+#include "parse_stats.h"
 
 namespace ciccloud {
-using ::android::hardware::hidl_bitfield;
 
+// The pipeline behind the feed socket: framing, parsing and delivery of the
+// parsed sentences to the sink, and of the sentences themselves as the
+// forwarding config says.
 class GnssHwListener {
 public:
-    explicit GnssHwListener(const DataSink* sink);
+    // `clock` stamps what arrives, it has to outlive this. `clockSync` is
+    // that of another listener of the same feeder, e.g. the one of its TCP
+    // connection, which gets the pongs; the listener has its own if null.
+    explicit GnssHwListener(const GnssSink* sink,
+                            const NmeaForwardConfig& nmea = NmeaForwardConfig(),
+                            const FixFilterConfig& filter = FixFilterConfig(),
+                            const Clock& clock = systemClock(),
+                            ClockSync* clockSync = nullptr);
     void reset();
     void consume(char);
+    void consume(const char* data, size_t size);
+    // `rxBootNs` is when the data arrived, e.g. the kernel receive timestamp.
+    // Data which ends between sentences ends the epoch for the NMEA batch.
+    void consume(const char* data, size_t size, int64_t rxBootNs);
 
-private:
-    bool parse(const char* begin, const char* end, const ahg20::ElapsedRealtime&);
-    bool parseGPRMC(const char* begin, const char* end, const ahg20::ElapsedRealtime&);
-    bool parseGPGGA(const char* begin, const char* end, const ahg20::ElapsedRealtime&);
+    const ParseStats& stats() const { return m_stats; }
+    const NmeaForwarder& nmeaForwarder() const { return m_nmeaForwarder; }
+    ClockSync& clockSync() { return *m_clockSync; }
+    FeedSession& feedSession() { return m_feedSession; }
 
-    const DataSink* m_sink;
-    std::vector<char> m_buffer;
+    // Epochs are told apart by the type of the first RMC or GGA of the feed
+    // which parses, it comes again at the start of every epoch (RMC from our
+    // feeders). A reset forgets it.
+    uint64_t epochs() const { return m_epochs; }                // complete ones
+    size_t lastEpochBytes() const { return m_lastEpochBytes; }  // of the last complete one
+    int64_t epochStartRxBootNs() const { return m_epochStartRxBootNs; }  // of the current one
 
-    double m_altitude = 0;
+private:
+    void onSentence();
+    void onFailure(ParseResult, int64_t nowNs);
+    void beginEpoch();
 
-    hidl_bitfield<ahg10::GnssLocationFlags> m_flags;
+    const GnssSink* m_sink;
+    const Clock& m_clock;
+    ClockSync m_ownClockSync;
+    ClockSync* const m_clockSync;
+    FeedSession m_feedSession;
+    int64_t m_rxBootNs = 0;          // of the data being consumed
+    int64_t m_sentenceRxBootNs = 0;  // of the '$' of the current sentence
+    uint64_t m_bytes = 0;            // consumed so far
+    uint64_t m_sentenceByte = 0;     // where the current sentence starts in them
+    char m_epochLeader[5] = {};      // e.g. "GPRMC", empty until the first fix sentence
+    uint64_t m_epochStartByte = UINT64_MAX;  // unknown after a reset
+    int64_t m_epochStartRxBootNs = 0;
+    uint64_t m_epochs = 0;
+    size_t m_lastEpochBytes = 0;
+    NmeaFramer m_framer;
+    NmeaParser m_parser;
+    NmeaForwarder m_nmeaForwarder;
+    ParseStats m_stats;
 };
 
 }  // namespace ciccloud
@@ -15,18 +15,46 @@
  */
 
 #include "gnss_measurement.h"
-#include <chrono>
+#include "hidl_util.h"
+#include "trace.h"
 #include "util.h"
 
 namespace ciccloud {
-using ::android::hardware::hidl_vec;
 
-GnssMeasurement20::~GnssMeasurement20() {
-    if (m_isRunning) {
-        stopLocked();
+namespace {
+std::atomic<int32_t> g_traceCookie(0);
+}  // namespace
+
+GnssMeasurement20::GnssMeasurement20(const std::vector<AlmanacEntry>& almanac,
+                                     DataSink* dataSink)
+    : m_dataSink(dataSink), m_engine(almanac) {
+    using GnssMeasurementFlags10 = ahg10::IGnssMeasurementCallback::GnssMeasurementFlags;
+    using GnssMeasurementState20 = ahg20::IGnssMeasurementCallback::GnssMeasurementState;
+
+    for (auto& m : m_hidlMeasurements) {
+        ahg10::IGnssMeasurementCallback::GnssMeasurement& m10 = m.v1_1.v1_0;
+        m10.flags = GnssMeasurementFlags10::HAS_CARRIER_FREQUENCY | 0;
+        m10.constellation = ahg10::GnssConstellationType::GPS;
+        m10.timeOffsetNs = 0;
+        m10.receivedSvTimeUncertaintyInNs = 10;
+        m10.pseudorangeRateUncertaintyMps = 0.05;
+        m10.accumulatedDeltaRangeState = 0;
+        m10.multipathIndicator = ahg10::IGnssMeasurementCallback::GnssMultipathIndicator::INDICATOR_UNKNOWN;
+
+        m.codeType = "C";
+        m.state = GnssMeasurementState20::STATE_CODE_LOCK |
+                  GnssMeasurementState20::STATE_BIT_SYNC |
+                  GnssMeasurementState20::STATE_SUBFRAME_SYNC |
+                  GnssMeasurementState20::STATE_TOW_DECODED |
+                  GnssMeasurementState20::STATE_TOW_KNOWN;
+        m.constellation = ahg20::GnssConstellationType::GPS;
     }
 }
 
+GnssMeasurement20::~GnssMeasurement20() {
+    m_dataSink->removeEpochListener(this);
+}
+
 Return<GnssMeasurementStatus10>
 GnssMeasurement20::setCallback_2_0(const sp<ahg20::IGnssMeasurementCallback>& callback,
                                    bool enableFullTracking) {
@@ -35,107 +63,83 @@ GnssMeasurement20::setCallback_2_0(const sp<ahg20::IGnssMeasurementCallback>& ca
         return GnssMeasurementStatus10::ERROR_GENERIC;
     }
 
-    std::unique_lock<std::mutex> lock(m_mtx);
-    if (m_isRunning) {
-        stopLocked();
+    // a new callback takes over a running session
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        if (!m_callback) {
+            m_traceCookie = ++g_traceCookie;
+            GNSS_TRACE_ASYNC_BEGIN("gnss.measurement_session", m_traceCookie);
+        }
+        m_callback = callback;
     }
-
-    m_callback = callback;
-    startLocked();
+    // not under m_mtx: onEpoch() takes it under the lock of the DataSink
+    m_dataSink->setEpochListener(this);
 
     return GnssMeasurementStatus10::SUCCESS;
 }
 
+// No epoch reaches onEpoch() once the listener is removed.
 Return<void> GnssMeasurement20::close() {
+    m_dataSink->removeEpochListener(this);
+
     std::unique_lock<std::mutex> lock(m_mtx);
-    if (m_isRunning) {
-        stopLocked();
+    if (m_callback) {
+        GNSS_TRACE_ASYNC_END("gnss.measurement_session", m_traceCookie);
     }
-
     m_callback = nullptr;
     return {};
 }
 
-void GnssMeasurement20::startLocked() {
-    m_thread = std::thread([this]() {
-        while (m_isRunning) {
-            update();
-            std::this_thread::sleep_for(std::chrono::milliseconds(1000));
-        }
-    });
-    m_isRunning = true;
-}
-
-void GnssMeasurement20::stopLocked() {
-    m_isRunning = false;
-    m_thread.join();
-}
-
-void GnssMeasurement20::update() {
-    using GnssMeasurement20 = ahg20::IGnssMeasurementCallback::GnssMeasurement;
-    using GnssAccumulatedDeltaRangeState10 = ahg10::IGnssMeasurementCallback::GnssAccumulatedDeltaRangeState;
-    using GnssMeasurementFlags10 = ahg10::IGnssMeasurementCallback::GnssMeasurementFlags;
-    using GnssMultipathIndicator10 = ahg10::IGnssMeasurementCallback::GnssMultipathIndicator;
-    using GnssMeasurementState20 = ahg20::IGnssMeasurementCallback::GnssMeasurementState;
+void GnssMeasurement20::onEpoch(const Location& fix, const GnssClockSample& clock) {
+    GNSS_TRACE_SCOPE("GnssMeasurement20::onEpoch");
+    using GnssClockFlags10 = ahg10::IGnssMeasurementCallback::GnssClockFlags;
     using GnssData = ahg20::IGnssMeasurementCallback::GnssData;
 
-    ahg10::IGnssMeasurementCallback::GnssMeasurement measurement10 = {
-        .flags = GnssMeasurementFlags10::HAS_CARRIER_FREQUENCY | 0,
-        .svid = 6,
-        .constellation = ahg10::GnssConstellationType::GPS,
-        .timeOffsetNs = 0.0,
-        .receivedSvTimeInNs = 8195997131077,
-        .receivedSvTimeUncertaintyInNs = 15,
-        .cN0DbHz = 30.0,
-        .pseudorangeRateMps = -484.13739013671875,
-        .pseudorangeRateUncertaintyMps = 0.12,
-        .accumulatedDeltaRangeState = GnssAccumulatedDeltaRangeState10::ADR_STATE_UNKNOWN | 0,
-        .accumulatedDeltaRangeM = 0.0,
-        .accumulatedDeltaRangeUncertaintyM = 0.0,
-        .carrierFrequencyHz = 1.59975e+09,
-        .multipathIndicator = GnssMultipathIndicator10::INDICATOR_UNKNOWN};
-    ahg11::IGnssMeasurementCallback::GnssMeasurement measurement11 = {
-        .v1_0 = measurement10,
-        .accumulatedDeltaRangeState = 0};
-
-    ahg20::IGnssMeasurementCallback::GnssMeasurement measurement20 = {
-        .v1_1 = measurement11,
-        .codeType = "C",
-        .state = GnssMeasurementState20::STATE_CODE_LOCK |
-                 GnssMeasurementState20::STATE_BIT_SYNC |
-                 GnssMeasurementState20::STATE_SUBFRAME_SYNC |
-                 GnssMeasurementState20::STATE_TOW_DECODED |
-                 GnssMeasurementState20::STATE_GLO_STRING_SYNC |
-                 GnssMeasurementState20::STATE_GLO_TOD_DECODED,
-        .constellation = ahg20::GnssConstellationType::GPS,
-    };
-
-    hidl_vec<GnssMeasurement20> measurements(1);
-    measurements[0] = measurement20;
-
-    const int64_t nowNs = util::nowNanos();
-    const int64_t fullBiasNs = (nowNs % 15331) * ((nowNs & 1) ? -1 : 1);
-    const int64_t hwTimeNs = nowNs + fullBiasNs;  // local hardware clock
+    sp<ahg20::IGnssMeasurementCallback> callback;
+    {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        callback = m_callback;
+    }
+    if (!callback) {
+        return;
+    }
+
+    const size_t n = m_engine.update(fix, clock.gpsTimeNs, m_measurements.data(),
+                                     m_measurements.size());
+    for (size_t i = 0; i < n; ++i) {
+        const Measurement& m = m_measurements[i];
+        ahg10::IGnssMeasurementCallback::GnssMeasurement& m10 = m_hidlMeasurements[i].v1_1.v1_0;
+        m10.svid = m.svid;
+        m10.receivedSvTimeInNs = m.receivedSvTimeNs;
+        m10.cN0DbHz = m.cN0Dbhz;
+        m10.pseudorangeRateMps = m.pseudorangeRateMps;
+        m10.carrierFrequencyHz = m.carrierFrequencyHz;
+    }
 
     ahg10::IGnssMeasurementCallback::GnssClock clock10 = {
-        .gnssClockFlags = 0,
-        .leapSecond = 0,
-        .timeNs = hwTimeNs,
-        .timeUncertaintyNs = 4.5,
-        .fullBiasNs = fullBiasNs,
-        .biasNs = 1.5,
-        .biasUncertaintyNs = .7,
-        .driftNsps = -51.757811607455452,
-        .driftUncertaintyNsps = 310.64968328491528,
-        .hwClockDiscontinuityCount = 1};
+        .gnssClockFlags = GnssClockFlags10::HAS_LEAP_SECOND |
+                          GnssClockFlags10::HAS_FULL_BIAS |
+                          GnssClockFlags10::HAS_BIAS |
+                          GnssClockFlags10::HAS_BIAS_UNCERTAINTY |
+                          GnssClockFlags10::HAS_DRIFT,
+        .leapSecond = 18,
+        .timeNs = clock.timeNs,
+        .timeUncertaintyNs = 0,
+        .fullBiasNs = clock.fullBiasNs,
+        .biasNs = clock.biasNs,
+        .biasUncertaintyNs = clock.biasUncertaintyNs,
+        .driftNsps = clock.driftNsps,
+        .driftUncertaintyNsps = 0,
+        .hwClockDiscontinuityCount = clock.discontinuities};
 
     GnssData gnssData = {
-        .measurements = measurements,
+        .measurements = {},
         .clock = clock10,
-        .elapsedRealtime = util::makeElapsedRealtime(util::nowNanos())};
+        .elapsedRealtime = util::makeElapsedRealtime(fix.elapsedRealtimeNs,
+                                                     fix.elapsedRealtimeUncertaintyNs)};
+    gnssData.measurements.setToExternal(m_hidlMeasurements.data(), n);
 
-    std::unique_lock<std::mutex> lock(m_mtx);
-    m_callback->gnssMeasurementCb_2_0(gnssData);
+    callback->gnssMeasurementCb_2_0(gnssData);
 }
 
 /// old and deprecated /////////////////////////////////////////////////////////
@@ -16,9 +16,10 @@
 
 #pragma once
 #include <android/hardware/gnss/2.0/IGnssMeasurement.h>
-#include <atomic>
+#include <array>
 #include <mutex>
-#include <thread>
+#include "data_sink.h"
+#include "measurement_engine.h"
 
 namespace ciccloud {
 namespace ahg = ::android::hardware::gnss;
@@ -30,7 +31,11 @@ using GnssMeasurementStatus10 = ahg10::IGnssMeasurement::GnssMeasurementStatus;
 using ::android::sp;
 using ::android::hardware::Return;
 
-struct GnssMeasurement20 : public ahg20::IGnssMeasurement {
+// Measures the satellites of an almanac from the fix of every epoch of the
+// feed, at the feed rate, while a callback is set.
+struct GnssMeasurement20 : public ahg20::IGnssMeasurement, private EpochListener {
+    // `dataSink` has to outlive this.
+    GnssMeasurement20(const std::vector<AlmanacEntry>& almanac, DataSink* dataSink);
     ~GnssMeasurement20();
 
     // Methods from V2_0::IGnssMeasurement follow.
@@ -44,14 +49,19 @@ struct GnssMeasurement20 : public ahg20::IGnssMeasurement {
     Return<void> close() override;
 
 private:
-    void startLocked();
-    void stopLocked();
-    void update();
+    // on the GnssHwConn worker thread, with the data sink locked
+    void onEpoch(const Location& fix, const GnssClockSample& clock) override;
+
+    DataSink* const m_dataSink;
+    MeasurementEngine m_engine;  // only used by onEpoch()
+    std::array<Measurement, MeasurementEngine::kMaxSatellites> m_measurements;
+    // what onEpoch() sends a view of, the constant fields are set once
+    std::array<ahg20::IGnssMeasurementCallback::GnssMeasurement,
+               MeasurementEngine::kMaxSatellites> m_hidlMeasurements;
 
     sp<ahg20::IGnssMeasurementCallback> m_callback;
-    std::thread m_thread;
-    std::atomic<bool> m_isRunning;
-    mutable std::mutex m_mtx;
+    int32_t m_traceCookie = 0;
+    mutable std::mutex m_mtx;  // guards the above two, never held over a callback
 };
 
 }  // namespace ciccloud
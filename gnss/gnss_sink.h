@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+// Where the core library delivers its output. The HAL implements it with
+// DataSink, benchmarks and host tools with their own stubs. Methods are
+// called from the GnssHwConn worker thread.
+class GnssSink {
+public:
+    static constexpr size_t kMaxSvInfo = 64;  // per gnssSvStatus()
+
+    virtual ~GnssSink() = default;
+
+    virtual void gnssLocation(const Location&) const = 0;
+    virtual void gnssSvStatus(const SvInfo* svInfo, size_t size) const = 0;
+    virtual void gnssStatus(GnssStatus) const = 0;
+    // `nmea` is followed by a '\0' and only valid during the call.
+    virtual void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const = 0;
+
+    // Once per epoch of the feed, after its leading sentence, with the latest
+    // fix (the one of that sentence if it has one). Measurements hang off it.
+    virtual void gnssEpoch(const Location& fix) const { (void)fix; }
+
+    // Whether gnssNmea() is of any use now, asked once per epoch if NMEA
+    // is forwarded on demand. Sinks in between ask theirs.
+    virtual bool wantsNmea() const { return true; }
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstdint>
+
+// Platform neutral fix types used by the core library. The values of flags and
+// enums match the android.hardware.gnss HIDL types, so the HIDL adapter can
+// copy them as they are.
+namespace ciccloud {
+
+struct LocationFlags {
+    static constexpr uint16_t HAS_LAT_LONG = 0x0001;
+    static constexpr uint16_t HAS_ALTITUDE = 0x0002;
+    static constexpr uint16_t HAS_SPEED = 0x0004;
+    static constexpr uint16_t HAS_BEARING = 0x0008;
+    static constexpr uint16_t HAS_HORIZONTAL_ACCURACY = 0x0010;
+    static constexpr uint16_t HAS_VERTICAL_ACCURACY = 0x0020;
+    static constexpr uint16_t HAS_SPEED_ACCURACY = 0x0040;
+    static constexpr uint16_t HAS_BEARING_ACCURACY = 0x0080;
+};
+
+struct Location {
+    uint16_t flags = 0;  // LocationFlags
+    double latitudeDegrees = 0;
+    double longitudeDegrees = 0;
+    double altitudeMeters = 0;
+    float speedMetersPerSec = 0;
+    float bearingDegrees = 0;
+    float horizontalAccuracyMeters = 0;
+    float verticalAccuracyMeters = 0;
+    float speedAccuracyMetersPerSecond = 0;
+    float bearingAccuracyDegrees = 0;
+    int64_t timestampMs = 0;  // UTC
+    int64_t utcTimeOfDayMs = -1;  // the fix time in the sentence, -1 if unknown
+    int64_t elapsedRealtimeNs = 0;
+    int64_t elapsedRealtimeUncertaintyNs = 0;
+};
+
+enum class Constellation : uint8_t {
+    UNKNOWN = 0,
+    GPS = 1,
+    SBAS = 2,
+    GLONASS = 3,
+    QZSS = 4,
+    BEIDOU = 5,
+    GALILEO = 6,
+    IRNSS = 7,
+};
+
+struct SvFlags {
+    static constexpr uint8_t HAS_EPHEMERIS_DATA = 0x01;
+    static constexpr uint8_t HAS_ALMANAC_DATA = 0x02;
+    static constexpr uint8_t USED_IN_FIX = 0x04;
+    static constexpr uint8_t HAS_CARRIER_FREQUENCY = 0x08;
+};
+
+struct SvInfo {
+    int16_t svid = 0;
+    Constellation constellation = Constellation::UNKNOWN;
+    float cN0Dbhz = 0;
+    float elevationDegrees = 0;
+    float azimuthDegrees = 0;
+    float carrierFrequencyHz = 0;
+    uint8_t flags = 0;  // SvFlags
+};
+
+// A raw measurement of one satellite, see MeasurementEngine.
+struct Measurement {
+    int16_t svid = 0;
+    Constellation constellation = Constellation::UNKNOWN;
+    float cN0Dbhz = 0;
+    float elevationDegrees = 0;
+    float azimuthDegrees = 0;
+    float carrierFrequencyHz = 0;
+    double pseudorangeMeters = 0;
+    double pseudorangeRateMps = 0;
+    int64_t receivedSvTimeNs = 0;  // GPS time of week when the signal left
+};
+
+enum class GnssStatus : uint8_t {
+    NONE = 0,
+    SESSION_BEGIN = 1,
+    SESSION_END = 2,
+    ENGINE_ON = 3,
+    ENGINE_OFF = 4,
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hidl_util.h"
+
+namespace ciccloud {
+namespace util {
+
+static_assert(LocationFlags::HAS_LAT_LONG ==
+              static_cast<uint16_t>(ahg10::GnssLocationFlags::HAS_LAT_LONG), "");
+static_assert(LocationFlags::HAS_BEARING_ACCURACY ==
+              static_cast<uint16_t>(ahg10::GnssLocationFlags::HAS_BEARING_ACCURACY), "");
+static_assert(SvFlags::HAS_CARRIER_FREQUENCY ==
+              static_cast<uint8_t>(ahg10::IGnssCallback::GnssSvFlags::HAS_CARRIER_FREQUENCY), "");
+static_assert(static_cast<uint8_t>(Constellation::IRNSS) ==
+              static_cast<uint8_t>(ahg20::GnssConstellationType::IRNSS), "");
+static_assert(static_cast<uint8_t>(GnssStatus::ENGINE_OFF) ==
+              static_cast<uint8_t>(ahg10::IGnssCallback::GnssStatusValue::ENGINE_OFF), "");
+
+ahg20::ElapsedRealtime makeElapsedRealtime(long long timestampNs, long long timeUncertaintyNs) {
+    ahg20::ElapsedRealtime ts = {
+        .flags = ahg20::ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
+                 ahg20::ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
+        .timestampNs = static_cast<uint64_t>(timestampNs),
+        .timeUncertaintyNs = static_cast<uint64_t>(timeUncertaintyNs)};
+
+    return ts;
+}
+
+void toHidl(const Location& loc, ahg20::GnssLocation* loc20) {
+    loc20->elapsedRealtime = makeElapsedRealtime(loc.elapsedRealtimeNs,
+                                                 loc.elapsedRealtimeUncertaintyNs);
+
+    auto& loc10 = loc20->v1_0;
+    loc10.gnssLocationFlags = loc.flags;
+    loc10.latitudeDegrees = loc.latitudeDegrees;
+    loc10.longitudeDegrees = loc.longitudeDegrees;
+    loc10.altitudeMeters = loc.altitudeMeters;
+    loc10.speedMetersPerSec = loc.speedMetersPerSec;
+    loc10.bearingDegrees = loc.bearingDegrees;
+    loc10.horizontalAccuracyMeters = loc.horizontalAccuracyMeters;
+    loc10.verticalAccuracyMeters = loc.verticalAccuracyMeters;
+    loc10.speedAccuracyMetersPerSecond = loc.speedAccuracyMetersPerSecond;
+    loc10.bearingAccuracyDegrees = loc.bearingAccuracyDegrees;
+    loc10.timestamp = loc.timestampMs;
+}
+
+void toHidl(const SvInfo& sv, ahg20::IGnssCallback::GnssSvInfo* info20) {
+    auto* info10 = &info20->v1_0;
+
+    info20->constellation = static_cast<ahg20::GnssConstellationType>(sv.constellation);
+    info10->svid = sv.svid;
+    // IRNSS does not exist in 1.0, the 2.0 field above is the one used.
+    info10->constellation = (sv.constellation == Constellation::IRNSS)
+        ? ahg10::GnssConstellationType::UNKNOWN
+        : static_cast<ahg10::GnssConstellationType>(sv.constellation);
+    info10->cN0Dbhz = sv.cN0Dbhz;
+    info10->elevationDegrees = sv.elevationDegrees;
+    info10->azimuthDegrees = sv.azimuthDegrees;
+    info10->carrierFrequencyHz = sv.carrierFrequencyHz;
+    info10->svFlag = sv.flags;
+}
+
+ahg10::IGnssCallback::GnssStatusValue toHidl(const GnssStatus status) {
+    return static_cast<ahg10::IGnssCallback::GnssStatusValue>(status);
+}
+
+}  // namespace util
+}  // namespace ciccloud
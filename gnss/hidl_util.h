@@ -0,0 +1,37 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <android/hardware/gnss/2.0/IGnss.h>
+#include "gnss_types.h"
+
+namespace ciccloud {
+namespace ahg = ::android::hardware::gnss;
+namespace ahg20 = ahg::V2_0;
+namespace ahg10 = ahg::V1_0;
+
+// Conversions from the core library types to HIDL.
+namespace util {
+
+ahg20::ElapsedRealtime makeElapsedRealtime(long long timestampNs,
+                                           long long timeUncertaintyNs = 1000000);
+
+void toHidl(const Location&, ahg20::GnssLocation*);
+void toHidl(const SvInfo&, ahg20::IGnssCallback::GnssSvInfo*);
+ahg10::IGnssCallback::GnssStatusValue toHidl(GnssStatus);
+
+}  // namespace util
+}  // namespace ciccloud
@@ -0,0 +1,374 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "io_uring_loop.h"
+#include <errno.h>
+#include <log/log.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <cstring>
+#include "gnss_hw_conn_worker.h"
+#include "trace.h"
+
+namespace ciccloud {
+namespace {
+constexpr int kOpShift = 56;
+constexpr int kGenerationShift = 24;
+constexpr uint64_t kFdMask = (1ULL << kGenerationShift) - 1;
+
+uint64_t makeUserData(const uint8_t op, const int fd, const uint32_t generation = 0) {
+    return (static_cast<uint64_t>(op) << kOpShift) |
+           (static_cast<uint64_t>(generation) << kGenerationShift) |
+           (static_cast<uint64_t>(fd) & kFdMask);
+}
+
+// The kernel receive timestamp in a multishot recvmsg buffer, moved to the
+// boot time of `clock`, or `bootNs` (now) if there is none.
+int64_t rxBootNanos(const Clock& clock, struct io_uring_recvmsg_out* o, struct msghdr* msg,
+                    const int64_t bootNs) {
+    for (struct cmsghdr* c = io_uring_recvmsg_cmsg_firsthdr(o, msg); c;
+         c = io_uring_recvmsg_cmsg_nexthdr(o, msg, c)) {
+        if (c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_TIMESTAMPNS) {
+            struct timespec rx;
+            memcpy(&rx, CMSG_DATA(c), sizeof(rx));
+            return clock.rxBootNanos(rx.tv_sec * 1000000000LL + rx.tv_nsec, bootNs);
+        }
+    }
+    return bootNs;
+}
+
+// io_uring_buf_ring_add() without the bufs member: in C++ the uapi
+// __DECLARE_FLEX_ARRAY of older headers puts it behind an empty struct,
+// 8 bytes into the ring, and every entry lands half a slot away from where
+// the kernel reads it. The ring is an array of io_uring_buf whose first
+// entry shares its last field with the tail.
+void bufRingAdd(struct io_uring_buf_ring* br, char* addr, const unsigned len,
+                const unsigned short bid, const int mask, const int offset) {
+    struct io_uring_buf* buf =
+            reinterpret_cast<struct io_uring_buf*>(br) + ((br->tail + offset) & mask);
+    buf->addr = reinterpret_cast<uintptr_t>(addr);
+    buf->len = len;
+    buf->bid = bid;
+}
+}  // namespace
+
+std::unique_ptr<IoUringLoop> IoUringLoop::create(const bool datagrams) {
+    std::unique_ptr<IoUringLoop> loop(new IoUringLoop());
+    if (!loop->init(datagrams)) {
+        return nullptr;
+    }
+    return loop;
+}
+
+IoUringLoop::~IoUringLoop() {
+    if (m_ringOk) {
+        if (m_bufRing) {
+            io_uring_free_buf_ring(&m_ring, m_bufRing, kBufferCount, kBufferGroup);
+        }
+        io_uring_queue_exit(&m_ring);
+    }
+}
+
+bool IoUringLoop::init(const bool datagrams) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    int ret = io_uring_queue_init_params(kEntries, &m_ring, &params);
+    if (ret < 0) {
+        ALOGW("%s: io_uring_queue_init_params failed: %s", __PRETTY_FUNCTION__, strerror(-ret));
+        return false;
+    }
+    m_ringOk = true;
+    if (!(params.features & IORING_FEAT_EXT_ARG)) {
+        ALOGW("%s: no IORING_FEAT_EXT_ARG, the kernel is too old", __PRETTY_FUNCTION__);
+        return false;
+    }
+
+    m_buffers.reset(new char[kBufferCount * kBufferSize]);
+    m_bufRing = io_uring_setup_buf_ring(&m_ring, kBufferCount, kBufferGroup, 0, &ret);
+    if (!m_bufRing) {
+        ALOGW("%s: io_uring_setup_buf_ring failed: %s", __PRETTY_FUNCTION__, strerror(-ret));
+        return false;
+    }
+    for (unsigned bid = 0; bid < kBufferCount; ++bid) {
+        bufRingAdd(m_bufRing, m_buffers.get() + bid * kBufferSize, kBufferSize, bid,
+                   io_uring_buf_ring_mask(kBufferCount), bid);
+    }
+    io_uring_buf_ring_advance(m_bufRing, kBufferCount);
+
+    struct iovec control = {.iov_base = m_control, .iov_len = sizeof(m_control)};
+    ret = io_uring_register_buffers(&m_ring, &control, 1);
+    if (ret < 0) {
+        ALOGW("%s: io_uring_register_buffers failed: %s", __PRETTY_FUNCTION__, strerror(-ret));
+        return false;
+    }
+
+    memset(&m_recvmsg, 0, sizeof(m_recvmsg));
+    m_recvmsg.msg_controllen = CMSG_SPACE(sizeof(struct timespec));
+    m_datagrams = datagrams;
+    return probeRecvmsgMultishot();
+}
+
+// Multishot recvmsg is the newest thing we use (6.0), an older kernel
+// rejects it with EINVAL on the first completion. Try it on a socketpair.
+bool IoUringLoop::probeRecvmsgMultishot() {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) {
+        return false;
+    }
+    armRecvmsg(PROBE, sv[0], 0);
+    const char byte = 0;
+    bool supported = (write(sv[1], &byte, 1) == 1);
+    for (bool more = supported; more;) {
+        struct io_uring_cqe* cqe = nullptr;
+        const int ret = io_uring_submit_and_wait_timeout(&m_ring, &cqe, 1, nullptr, nullptr);
+        if (ret < 0 || !cqe) {
+            supported = false;
+            break;
+        }
+        more = cqe->flags & IORING_CQE_F_MORE;
+        if (cqe->res < 0) {
+            supported = false;
+        }
+        recycle(cqe);
+        io_uring_cq_advance(&m_ring, 1);
+        if (more) {
+            shutdown(sv[0], SHUT_RDWR);  // ends it
+        }
+    }
+    io_uring_buf_ring_advance(m_bufRing, m_recycled);
+    m_recycled = 0;
+    close(sv[0]);
+    close(sv[1]);
+    if (!supported) {
+        ALOGW("%s: no multishot recvmsg, the kernel is too old", __PRETTY_FUNCTION__);
+    }
+    return supported;
+}
+
+struct io_uring_sqe* IoUringLoop::getSqe() {
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&m_ring);
+    if (!sqe) {
+        io_uring_submit(&m_ring);  // full, make room
+        sqe = io_uring_get_sqe(&m_ring);
+    }
+    return sqe;
+}
+
+void IoUringLoop::armAccept(const int fd) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_multishot_accept(sqe, fd, nullptr, nullptr, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, makeUserData(ACCEPT, fd));
+}
+
+void IoUringLoop::armCommands(const int fd) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    io_uring_sqe_set_data64(sqe, makeUserData(COMMAND, fd));
+}
+
+void IoUringLoop::armRecvmsg(const Op op, const int fd, const uint32_t generation) {
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_recvmsg_multishot(sqe, fd, &m_recvmsg, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufferGroup;
+    io_uring_sqe_set_data64(sqe, makeUserData(op, fd, generation));
+}
+
+// Queues a control message to the client, it goes out with the next
+// submission. False if all the slots are still in flight.
+bool IoUringLoop::queueControl(const int fd, const uint32_t generation, const char* ctrl) {
+    if (m_controlInFlight == kControlSlots) {
+        return false;
+    }
+    char* slot = m_control[m_controlNext++ % kControlSlots];
+    memcpy(slot, ctrl, kCTRL_SIZE);
+    struct io_uring_sqe* sqe = getSqe();
+    io_uring_prep_write_fixed(sqe, fd, slot, kCTRL_SIZE, 0, 0);
+    io_uring_sqe_set_data64(sqe, makeUserData(CONTROL, fd, generation));
+    ++m_controlInFlight;
+    return true;
+}
+
+char* IoUringLoop::buffer(const struct io_uring_cqe* cqe) const {
+    return m_buffers.get() + (cqe->flags >> IORING_CQE_BUFFER_SHIFT) * kBufferSize;
+}
+
+void IoUringLoop::recycle(const struct io_uring_cqe* cqe) {
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        bufRingAdd(m_bufRing, buffer(cqe), kBufferSize, cqe->flags >> IORING_CQE_BUFFER_SHIFT,
+                   io_uring_buf_ring_mask(kBufferCount), m_recycled++);
+    }
+}
+
+void IoUringLoop::run(GnssHwConn* conn, GnssHwConn::Worker* worker) {
+    if (conn->openServerSocket()) {
+        armAccept(conn->m_gpsSocketServerFd.get());
+    }
+    armCommands(conn->m_threadsFd.get());
+    if (m_datagrams) {
+        armRecvmsg(DATAGRAM, conn->m_udpFd.get(), 0);
+    }
+
+    while (true) {
+        // only this thread adopts or drops clients
+        const int timeoutMs = worker->sendDueControl([this, conn](int slot, const char* ctrl) {
+            const GnssHwConn::Client& client = conn->m_clients[slot];
+            return client.fd.ok() && queueControl(client.fd.get(), client.generation, ctrl);
+        });
+
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+        struct io_uring_cqe* cqe = nullptr;
+        const int ret = io_uring_submit_and_wait_timeout(&m_ring, &cqe, 1, &ts, nullptr);
+        worker->countSyscalls();
+        if (ret < 0 && ret != -ETIME && ret != -EINTR) {
+            ALOGE("%s:%d: io_uring_submit_and_wait_timeout failed with '%s'", __PRETTY_FUNCTION__, __LINE__, strerror(-ret));
+        }
+
+        bool quit = false;
+        unsigned head;
+        unsigned seen = 0;
+        m_sawDatagrams = false;
+        m_sawFeed = false;
+        io_uring_for_each_cqe(&m_ring, head, cqe) {
+            ++seen;
+            if (!onCompletion(conn, worker, cqe)) {
+                quit = true;
+                break;
+            }
+        }
+        io_uring_cq_advance(&m_ring, seen);
+        if (m_recycled) {
+            io_uring_buf_ring_advance(m_bufRing, m_recycled);
+            m_recycled = 0;
+        }
+        if (m_sawDatagrams) {
+            worker->onDatagramBatch();
+        }
+        if (m_sawFeed) {
+            worker->countWakeup();
+        }
+        if (quit) {
+            return;
+        }
+    }
+}
+
+// False on a quit command. A multishot request which ends without an error
+// (it ran out of buffers, say) is armed again.
+bool IoUringLoop::onCompletion(GnssHwConn* conn, GnssHwConn::Worker* worker,
+                               const struct io_uring_cqe* cqe) {
+    const uint64_t userData = io_uring_cqe_get_data64(cqe);
+    const Op op = static_cast<Op>(userData >> kOpShift);
+    const int fd = static_cast<int>(userData & kFdMask);
+    const uint32_t generation = static_cast<uint32_t>(userData >> kGenerationShift);
+    const bool more = cqe->flags & IORING_CQE_F_MORE;
+
+    switch (op) {
+        case ACCEPT:
+            if (cqe->res >= 0) {
+                armRecvmsg(CLIENT, cqe->res, conn->adoptClient(cqe->res));
+            } else {
+                ALOGV("%s GPS socket server maybe shutdown, or else, error happen. %s.", __PRETTY_FUNCTION__, strerror(-cqe->res));
+            }
+            if (!more && (cqe->res >= 0 || cqe->res == -ECONNABORTED || cqe->res == -EINTR)) {
+                armAccept(fd);
+            }
+            break;
+
+        case COMMAND:
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                const char* cmds = buffer(cqe);
+                for (int i = 0; i < cqe->res; ++i) {
+                    if (!worker->onCommand(cmds[i])) {
+                        recycle(cqe);
+                        return false;
+                    }
+                }
+            } else if (cqe->res < 0 && cqe->res != -ENOBUFS) {
+                ALOGE("%s:%d: the command socket has an error: %s", __PRETTY_FUNCTION__, __LINE__, strerror(-cqe->res));
+                ::abort();
+            }
+            recycle(cqe);
+            if (!more) {
+                armCommands(fd);
+            }
+            break;
+
+        case CLIENT:
+        case DATAGRAM: {
+            const bool current = (op == DATAGRAM) ||
+                                 (generation == conn->m_clients[GnssHwConn::clientSlot(generation)].generation);
+            bool gone = (cqe->res == 0) || (cqe->res < 0 && cqe->res != -ENOBUFS);
+            if (cqe->res > 0 && (cqe->flags & IORING_CQE_F_BUFFER)) {
+                struct io_uring_recvmsg_out* o = io_uring_recvmsg_validate(buffer(cqe), cqe->res, &m_recvmsg);
+                if (o) {
+                    m_sawFeed = true;
+                    worker->countReads();
+                    const char* payload = static_cast<const char*>(io_uring_recvmsg_payload(o, &m_recvmsg));
+                    const unsigned size = io_uring_recvmsg_payload_length(o, cqe->res, &m_recvmsg);
+                    const int64_t rxBootNs = rxBootNanos(*conn->m_clock, o, &m_recvmsg,
+                                                         conn->m_clock->bootNanos());
+                    if (op == CLIENT) {
+                        gone = (size == 0);  // the peer closed
+                        if (!gone) {
+                            GNSS_TRACE_COUNTER("gnss.rx_bytes_per_wakeup", size);
+                            worker->onClientData(generation, payload, size, rxBootNs);
+                        }
+                    } else if (o->flags & MSG_TRUNC) {
+                        m_sawDatagrams = true;
+                        worker->onDatagramTruncated();
+                    } else {
+                        m_sawDatagrams = true;
+                        worker->onDatagram(payload, size, rxBootNs);
+                    }
+                }
+                recycle(cqe);
+            }
+            if (op == CLIENT && gone && current) {
+                ALOGV("%s:%d GPS socket client may close. Remove client(%d) and let it reconnect.", __PRETTY_FUNCTION__, __LINE__, fd);
+                worker->onClientGone(generation);
+            } else if (!more && !gone && current) {
+                armRecvmsg(op, fd, generation);
+            }
+            break;
+        }
+
+        case CONTROL:
+            --m_controlInFlight;
+            if (cqe->res < 0) {
+                ALOGV("%s: a control write to client(%d) failed: %s", __PRETTY_FUNCTION__, fd, strerror(-cqe->res));
+            } else if (static_cast<size_t>(cqe->res) != kCTRL_SIZE &&
+                       generation == conn->m_clients[GnssHwConn::clientSlot(generation)].generation) {
+                // as GnssHwConn::writeClient: the feeder would take the next
+                // message for the rest of this one, the recv of 0 drops it
+                ALOGE("%s:%d: wrote %d of %zu bytes to client(%d), dropping it", __PRETTY_FUNCTION__, __LINE__, cqe->res, kCTRL_SIZE, fd);
+                shutdown(fd, SHUT_RDWR);
+            }
+            break;
+
+        case PROBE:
+            recycle(cqe);
+            break;
+    }
+    return true;
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,84 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <liburing.h>
+#include <sys/socket.h>
+#include <cstdint>
+#include <memory>
+#include "gnss_hw_conn.h"
+#include "gnss_hw_conn_worker.h"
+
+namespace ciccloud {
+
+// The io_uring loop of the GnssHwConn worker thread. One ring takes the
+// whole job of the epoll loop and the server thread: a multishot accept on
+// the server socket, multishot recvmsg on the clients and the UDP socket
+// (with the kernel receive timestamps), a multishot recv on the command
+// socketpair, all into one ring of provided buffers, and control writes to
+// the clients from registered buffers. Submissions ride along with the wait
+// for completions, one io_uring_enter per loop.
+//
+// create() fails if the kernel does not have what we use (5.19+ for
+// provided buffer rings, 6.0+ for multishot recvmsg), or io_uring is not
+// allowed to us. GnssHwConn falls back to epoll then.
+class IoUringLoop {
+public:
+    static std::unique_ptr<IoUringLoop> create(bool datagrams);
+    ~IoUringLoop();
+
+    // Opens the server socket and serves until a quit command.
+    void run(GnssHwConn* conn, GnssHwConn::Worker* worker);
+
+private:
+    static constexpr unsigned kEntries = 64;
+    static constexpr unsigned kBufferCount = 64;  // a power of 2
+    static constexpr size_t kBufferSize = 2048;
+    static constexpr int kBufferGroup = 0;
+    static constexpr unsigned kControlSlots = 16;
+
+    enum Op : uint8_t { ACCEPT = 1, COMMAND, CLIENT, DATAGRAM, CONTROL, PROBE };
+
+    IoUringLoop() = default;
+    bool init(bool datagrams);
+    bool probeRecvmsgMultishot();
+
+    struct io_uring_sqe* getSqe();
+    void armAccept(int fd);
+    void armCommands(int fd);
+    void armRecvmsg(Op op, int fd, uint32_t generation);
+    bool queueControl(int fd, uint32_t generation, const char* ctrl);
+
+    bool onCompletion(GnssHwConn* conn, GnssHwConn::Worker* worker, const struct io_uring_cqe* cqe);
+    char* buffer(const struct io_uring_cqe* cqe) const;
+    void recycle(const struct io_uring_cqe* cqe);
+
+    struct io_uring m_ring;
+    bool m_ringOk = false;
+    struct io_uring_buf_ring* m_bufRing = nullptr;
+    std::unique_ptr<char[]> m_buffers;  // kBufferCount x kBufferSize
+    unsigned m_recycled = 0;            // to hand back to the kernel
+    char m_control[kControlSlots][kCTRL_SIZE];  // registered as buffer 0
+    unsigned m_controlNext = 0;
+    unsigned m_controlInFlight = 0;
+    struct msghdr m_recvmsg;  // what multishot recvmsg leaves room for
+    bool m_datagrams = false;
+    bool m_sawDatagrams = false;  // in this round of completions
+    bool m_sawFeed = false;       // data from the client or datagrams, ditto
+};
+
+}  // namespace ciccloud
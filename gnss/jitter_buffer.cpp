@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "jitter_buffer.h"
+#include <errno.h>
+#include <log/log.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "trace.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kDayNs = 24LL * 3600LL * 1000LL * kMsToNs;
+constexpr int64_t kResyncNs = 5000LL * kMsToNs;  // the feeder jumped, start over
+constexpr int64_t kBaseDriftNs = 1000;            // per location, lets the base follow a slower path
+constexpr int kJitterMultiple = 4;
+}  // namespace
+
+JitterBuffer::JitterBuffer(const GnssSink* downstream, const JitterBufferConfig& config,
+                           Clock& clock)
+    : m_downstream(downstream)
+    , m_config(config)
+    , m_clock(clock) {
+    m_state.delayNs = config.targetDelayMs * kMsToNs;
+
+    m_timerFd.reset(timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC | TFD_NONBLOCK));
+    m_eventFd.reset(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK));
+    if (!m_timerFd.ok() || !m_eventFd.ok()) {
+        ALOGE("%s:%d: timerfd/eventfd failed: %s", __PRETTY_FUNCTION__, __LINE__, strerror(errno));
+        return;
+    }
+
+    // the timer runs in real time, a simulated clock wakes us when it moves
+    m_clockWaker = m_clock.addWaker([this]() { wake(); });
+    m_thread = std::thread([this]() {
+        applyThreadPolicy(m_config.threads);
+        threadLoop();
+    });
+}
+
+JitterBuffer::~JitterBuffer() {
+    if (m_thread.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_quit = true;
+        }
+        wake();
+        m_thread.join();
+    }
+    m_clock.removeWaker(m_clockWaker);
+}
+
+JitterBuffer::Stats JitterBuffer::stats() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    Stats s = m_state.stats;
+    s.delayNs = m_state.delayNs;
+    s.jitterNs = m_state.jitterNs;
+    return s;
+}
+
+void JitterBuffer::gnssLocation(const Location& loc) const {
+    if (loc.utcTimeOfDayMs < 0) {
+        m_downstream->gnssLocation(loc);  // nothing to pace it by
+        return;
+    }
+
+    bool newHead;
+    {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        newHead = push(loc, m_clock.bootNanos());
+    }
+    if (newHead) {
+        wake();
+    }
+}
+
+void JitterBuffer::gnssSvStatus(const SvInfo* svInfo, const size_t size) const {
+    m_downstream->gnssSvStatus(svInfo, size);
+}
+
+void JitterBuffer::gnssStatus(const GnssStatus status) const {
+    std::lock_guard<std::mutex> deliveryLock(m_deliveryMtx);
+    if (status == GnssStatus::SESSION_BEGIN || status == GnssStatus::SESSION_END) {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        if (status == GnssStatus::SESSION_END) {
+            const Stats& s = m_state.stats;
+            ALOGI("%s: released=%llu late=%llu dropped=%llu delay=%lldms jitter=%lldms",
+                  __PRETTY_FUNCTION__, static_cast<unsigned long long>(s.released),
+                  static_cast<unsigned long long>(s.late), static_cast<unsigned long long>(s.dropped),
+                  static_cast<long long>(m_state.delayNs / kMsToNs),
+                  static_cast<long long>(m_state.jitterNs / kMsToNs));
+        }
+        clear();
+    }
+    m_downstream->gnssStatus(status);
+}
+
+void JitterBuffer::gnssNmea(const int64_t timestampMs, const char* nmea, const size_t size) const {
+    m_downstream->gnssNmea(timestampMs, nmea, size);
+}
+
+void JitterBuffer::gnssEpoch(const Location& fix) const {
+    if (fix.utcTimeOfDayMs >= 0) {
+        // the epoch comes right after its location, which is the last queued
+        std::lock_guard<std::mutex> lock(m_mtx);
+        State& s = m_state;
+        if (s.size > 0) {
+            Entry& tail = s.queue[(s.head + s.size - 1) % kCapacity];
+            if (tail.location.utcTimeOfDayMs == fix.utcTimeOfDayMs) {
+                tail.epoch = true;
+                return;
+            }
+        }
+    }
+    m_downstream->gnssEpoch(fix);
+}
+
+bool JitterBuffer::push(const Location& loc, const int64_t arrivalNs) const {
+    State& s = m_state;
+
+    // unwrap the time of day, a session may run over midnight
+    const int64_t todNs = loc.utcTimeOfDayMs * kMsToNs;
+    int64_t sentenceNs = todNs;
+    if (s.anchored) {
+        int64_t delta = (todNs - s.lastSentenceNs) % kDayNs;
+        if (delta < -kDayNs / 2) {
+            delta += kDayNs;
+        } else if (delta >= kDayNs / 2) {
+            delta -= kDayNs;
+        }
+        sentenceNs = s.lastSentenceNs + delta;
+    }
+    const int64_t transitNs = arrivalNs - sentenceNs;
+
+    if (!s.anchored || std::abs(transitNs - s.baseTransitNs) > kResyncNs) {
+        // what is queued is on the old timeline, and would have the new
+        // locations dropped as reordered after a jump back
+        s.stats.dropped += s.size;
+        s.head = 0;
+        s.size = 0;
+        s.anchored = true;
+        s.baseTransitNs = transitNs;
+        s.jitterNs = 0;
+        s.delayNs = m_config.targetDelayMs * kMsToNs;
+        s.lastPlayoutNs = 0;
+        s.lastReleasedNs = INT64_MIN;
+    } else {
+        adapt(sentenceNs, arrivalNs, transitNs);
+    }
+    s.lastSentenceNs = sentenceNs;
+    s.lastArrivalNs = arrivalNs;
+
+    const size_t tail = (s.head + s.size + kCapacity - 1) % kCapacity;
+    if (sentenceNs < s.lastReleasedNs || (s.size > 0 && sentenceNs < s.queue[tail].sentenceNs)) {
+        ++s.stats.dropped;  // reordered, its successor is already out or queued
+        return false;
+    }
+
+    int64_t playoutNs = sentenceNs + s.baseTransitNs + s.delayNs;
+    if (playoutNs <= arrivalNs) {
+        ++s.stats.late;
+        if (m_config.adaptive) {
+            // do not wait for the average to catch up with a spike
+            s.delayNs = std::min<int64_t>(m_config.maxDelayMs * kMsToNs,
+                                          s.delayNs + (arrivalNs - playoutNs));
+        }
+        playoutNs = arrivalNs;
+    }
+    playoutNs = std::max(playoutNs, s.lastPlayoutNs);  // never reorder
+    s.lastPlayoutNs = playoutNs;
+
+    if (s.size == kCapacity) {
+        s.head = (s.head + 1) % kCapacity;
+        --s.size;
+        ++s.stats.dropped;
+    }
+    Entry& e = s.queue[(s.head + s.size) % kCapacity];
+    e.playoutNs = playoutNs;
+    e.sentenceNs = sentenceNs;
+    e.location = loc;
+    e.epoch = false;
+    ++s.size;
+    return s.size == 1;
+}
+
+void JitterBuffer::adapt(const int64_t sentenceNs, const int64_t arrivalNs,
+                         const int64_t transitNs) const {
+    State& s = m_state;
+    if (transitNs < s.baseTransitNs) {
+        s.baseTransitNs = transitNs;
+    } else {
+        s.baseTransitNs += kBaseDriftNs;
+    }
+
+    // RFC 3550 interarrival jitter, once per epoch
+    if (sentenceNs != s.lastSentenceNs) {
+        const int64_t d = std::abs((arrivalNs - s.lastArrivalNs) - (sentenceNs - s.lastSentenceNs));
+        s.jitterNs += (d - s.jitterNs) / 16;
+
+        if (m_config.adaptive) {
+            const int64_t wantNs = std::min<int64_t>(
+                m_config.maxDelayMs * kMsToNs,
+                std::max<int64_t>(m_config.minDelayMs * kMsToNs, kJitterMultiple * s.jitterNs));
+            s.delayNs += (wantNs - s.delayNs) / 8;
+            GNSS_TRACE_COUNTER("gnss.jitter_buffer_delay_ms", s.delayNs / kMsToNs);
+        }
+    }
+}
+
+void JitterBuffer::clear() const {
+    State& s = m_state;
+    s.stats.dropped += s.size;
+    s.head = 0;
+    s.size = 0;
+    s.anchored = false;
+}
+
+void JitterBuffer::wake() const {
+    const uint64_t one = 1;
+    (void)!TEMP_FAILURE_RETRY(write(m_eventFd.get(), &one, sizeof(one)));
+}
+
+void JitterBuffer::threadLoop() {
+    while (true) {
+        Location loc;
+        bool release = false;
+        bool epoch = false;
+        {
+            std::unique_lock<std::mutex> deliveryLock(m_deliveryMtx);
+            {
+                std::lock_guard<std::mutex> lock(m_mtx);
+                if (m_quit) {
+                    return;
+                }
+
+                State& s = m_state;
+                struct itimerspec its = {};
+                if (s.size > 0) {
+                    const Entry& e = s.queue[s.head];
+                    const int64_t nowNs = m_clock.bootNanos();
+                    if (e.playoutNs <= nowNs) {
+                        loc = e.location;
+                        epoch = e.epoch;
+                        s.lastReleasedNs = e.sentenceNs;
+                        s.head = (s.head + 1) % kCapacity;
+                        --s.size;
+                        ++s.stats.released;
+                        release = true;
+                    } else {
+                        its.it_value.tv_sec = (e.playoutNs - nowNs) / 1000000000LL;
+                        its.it_value.tv_nsec = (e.playoutNs - nowNs) % 1000000000LL;
+                    }
+                }
+                if (!release) {
+                    // arms for the head, or disarms if the queue is empty
+                    timerfd_settime(m_timerFd.get(), 0, &its, nullptr);
+                }
+            }
+
+            if (release) {
+                GNSS_TRACE_SCOPE("JitterBuffer::release");
+                m_downstream->gnssLocation(loc);
+                if (epoch) {
+                    m_downstream->gnssEpoch(loc);
+                }
+                continue;
+            }
+        }
+
+        struct pollfd pfds[2] = {
+            {.fd = m_timerFd.get(), .events = POLLIN, .revents = 0},
+            {.fd = m_eventFd.get(), .events = POLLIN, .revents = 0},
+        };
+        if (TEMP_FAILURE_RETRY(poll(pfds, 2, -1)) > 0) {
+            uint64_t value;
+            if (pfds[0].revents & POLLIN) {
+                (void)!read(m_timerFd.get(), &value, sizeof(value));
+            }
+            if (pfds[1].revents & POLLIN) {
+                (void)!read(m_eventFd.get(), &value, sizeof(value));
+            }
+        }
+    }
+}
+
+}  // namespace ciccloud
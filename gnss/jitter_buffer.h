@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <android-base/unique_fd.h>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include "clock.h"
+#include "gnss_sink.h"
+#include "thread_policy.h"
+
+namespace ciccloud {
+using ::android::base::unique_fd;
+
+struct JitterBufferConfig {
+    int targetDelayMs = 0;  // the initial playout delay, 0 - no jitter buffer
+    int minDelayMs = 20;
+    int maxDelayMs = 1000;
+    bool adaptive = true;   // follow the observed jitter within [min, max]
+    ThreadPolicyConfig threads;  // of the release thread
+};
+
+// De-jitters locations between the listener and the framework sink.
+//
+// A location is released at its sentence time (utcTimeOfDayMs) mapped onto
+// the boot time of the clock plus the playout delay, so the output keeps the
+// cadence of the feeder rather than that of the network. The mapping uses the smallest
+// transit time seen; the delay starts at the target and, if adaptive, tracks
+// 4x the RFC 3550 interarrival jitter and jumps up on a late location.
+//
+// Late locations (past their playout time on arrival) are released at once,
+// stale ones (older than what was released) and overflows are dropped. A
+// transit time off by more than 5 s starts over and drops the queue.
+// An epoch goes out right after the location it carries; locations without
+// a sentence time, other epochs, SV status and NMEA pass through.
+class JitterBuffer : public GnssSink {
+public:
+    struct Stats {
+        uint64_t released = 0;
+        uint64_t late = 0;
+        uint64_t dropped = 0;
+        int64_t delayNs = 0;
+        int64_t jitterNs = 0;
+    };
+
+    JitterBuffer(const GnssSink* downstream, const JitterBufferConfig&,
+                 Clock& clock = systemClock());
+    ~JitterBuffer();
+
+    bool ok() const { return m_thread.joinable(); }
+    Stats stats() const;
+
+    void gnssLocation(const Location&) const override;
+    void gnssSvStatus(const SvInfo* svInfo, size_t size) const override;
+    void gnssStatus(GnssStatus) const override;
+    void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const override;
+    void gnssEpoch(const Location& fix) const override;
+    bool wantsNmea() const override { return m_downstream->wantsNmea(); }
+
+private:
+    static constexpr size_t kCapacity = 32;
+
+    struct Entry {
+        int64_t playoutNs;
+        int64_t sentenceNs;
+        Location location;
+        bool epoch;  // also release an epoch with it
+    };
+
+    // guarded by m_mtx, updated through the const sink interface
+    struct State {
+        std::array<Entry, kCapacity> queue;  // a ring, ordered by sentence time
+        size_t head = 0;
+        size_t size = 0;
+        bool anchored = false;
+        int64_t baseTransitNs = 0;  // arrival - sentence time, smallest seen
+        int64_t delayNs = 0;
+        int64_t jitterNs = 0;
+        int64_t lastSentenceNs = 0;  // unwrapped across midnight
+        int64_t lastArrivalNs = 0;
+        int64_t lastPlayoutNs = 0;
+        int64_t lastReleasedNs = INT64_MIN;  // sentence time
+        Stats stats;
+    };
+
+    void threadLoop();
+    bool push(const Location&, int64_t arrivalNs) const;
+    void adapt(int64_t sentenceNs, int64_t arrivalNs, int64_t transitNs) const;
+    void clear() const;
+    void wake() const;
+
+    const GnssSink* const m_downstream;
+    const JitterBufferConfig m_config;
+    Clock& m_clock;
+    int m_clockWaker = 0;
+
+    mutable std::mutex m_mtx;
+    mutable State m_state;
+
+    // the release thread holds it while calling downstream, so a session
+    // end is not overtaken by a location released before it
+    mutable std::mutex m_deliveryMtx;
+
+    unique_fd m_timerFd;
+    unique_fd m_eventFd;
+    bool m_quit = false;
+    std::thread m_thread;
+};
+
+}  // namespace ciccloud
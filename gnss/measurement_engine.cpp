@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "measurement_engine.h"
+#include <algorithm>
+#include <cmath>
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kDegToRad = kPi / 180;
+constexpr double kSpeedOfLight = 299792458.0;
+constexpr double kMu = 3.986005e14;               // WGS 84 earth gravitational constant
+constexpr double kEarthRotation = 7.2921151467e-5;  // rad/s
+constexpr double kWgs84A = 6378137.0;
+constexpr double kWgs84E2 = 6.69437999014e-3;
+constexpr double kWeekSeconds = 604800;
+constexpr double kRolloverSeconds = 1024 * kWeekSeconds;
+constexpr int64_t kWeekNs = 604800LL * 1000000000LL;
+constexpr int kKeplerIterations = 4;  // Newton, from E = M, enough for e < 0.05
+constexpr float kL1Hz = 1575.42e6f;
+constexpr float kCn0HorizonDbhz = 30;
+constexpr float kCn0ZenithDbhz = 47;
+constexpr size_t kLanes = 4;  // doubles in the widest vector we pad for
+
+// Rounds to the nearest integer (ties to even) with the default rounding
+// mode and no branch or libm call, so loops around it vectorize. |x| < 2^51.
+inline double roundNearest(const double x) {
+    constexpr double kMagic = 6755399441055744.0;  // 1.5 * 2^52
+    return (x + kMagic) - kMagic;
+}
+
+// sin and cos for |x| < 2^20 * pi/2: Cody-Waite reduction to [-pi/4, pi/4]
+// and the fdlibm kernels, within a couple of ulp. Branch free, unlike libm.
+inline void sinCos(const double x, double* s, double* c) {
+    constexpr double kTwoOverPi = 6.36619772367581382433e-01;
+    constexpr double kPio2_1 = 1.57079632673412561417e+00;   // the first 33 bits of pi/2
+    constexpr double kPio2_2 = 6.07710050630396597660e-11;   // the next 33 bits
+    constexpr double kPio2_2t = 2.02226624879595063154e-21;  // pi/2 - (kPio2_1 + kPio2_2)
+    const double q = roundNearest(x * kTwoOverPi);
+    const double r = ((x - q * kPio2_1) - q * kPio2_2) - q * kPio2_2t;
+
+    const double z = r * r;
+    const double sr = r + r * z * (-1.66666666666666324348e-01 +
+                      z * (8.33333333332248946124e-03 +
+                      z * (-1.98412698298579493134e-04 +
+                      z * (2.75573137070700676789e-06 +
+                      z * (-2.50507602534068634195e-08 +
+                      z * 1.58969099521155010221e-10)))));
+    const double cr = 1 - 0.5 * z + z * z * (4.16666666666666019037e-02 +
+                      z * (-1.38888888888741095749e-03 +
+                      z * (2.48015872894767294178e-05 +
+                      z * (-2.75573143513906633035e-07 +
+                      z * (2.08757232129817482790e-09 +
+                      z * -1.13596475577881948265e-11)))));
+
+    // the quadrant, as q mod 4 in [-2, 2]: 0 -> (s, c), 1 -> (c, -s),
+    // +-2 -> (-s, -c), -1 -> (-c, s)
+    const double m = q - 4 * roundNearest(q * 0.25);
+    const bool odd = (m == 1) | (m == -1);
+    const double bs = odd ? cr : sr;
+    const double bc = odd ? sr : cr;
+    *s = ((m < -0.5) | (m > 1.5)) ? -bs : bs;
+    *c = ((m > 0.5) | (m < -1.5)) ? -bc : bc;
+}
+
+// atan2 the same way: folded to an octant, then to |t| <= tan(pi/8), and
+// the fdlibm atan polynomial. Also within a couple of ulp.
+inline double atan2Fast(const double y, const double x) {
+    constexpr double kTanPiOver8 = 0.41421356237309504880;
+    const double ax = std::fabs(x), ay = std::fabs(y);
+    const double a = std::min(ax, ay) / (std::max(ax, ay) + 1e-300);  // 0 / 0 is 0
+    // atan(a) = atan(c) + atan((a - c) / (1 + c a)), c is 1 above tan(pi/8)
+    // else 0, by rounding: with a select gcc splits the division in two
+    // branches and gives up on the loop
+    const double c = roundNearest(a + (0.5 - kTanPiOver8));
+    const double t = (a - c) / (1 + c * a);
+
+    const double z = t * t;
+    double r = t - t * z * (3.33333333333329318027e-01 +
+                      z * (-1.99999999998764832476e-01 +
+                      z * (1.42857142725034663711e-01 +
+                      z * (-1.11111104054623557880e-01 +
+                      z * (9.09088713343650656196e-02 +
+                      z * (-7.69187620504482999495e-02 +
+                      z * (6.66107313738753120669e-02 +
+                      z * (-5.83357013379057348645e-02 +
+                      z * (4.97687799461593236017e-02 +
+                      z * (-3.65315727442169155270e-02 +
+                      z * 1.62858201153657823623e-02))))))))));
+    r += c * (kPi / 4);
+
+    // back to the octant, pi/2 - r and pi - r as sign flips and offsets
+    const bool steep = ay > ax;
+    r = (steep ? -r : r) + (steep ? kPi / 2 : 0);
+    r = ((x < 0) ? -r : r) + ((x < 0) ? kPi : 0);
+    return std::copysign(r, y);
+}
+}  // namespace
+
+MeasurementEngine::MeasurementEngine(const std::vector<AlmanacEntry>& almanac) {
+    for (const AlmanacEntry& e : almanac) {
+        if (m_count == kMaxSatellites) {
+            break;
+        } else if (e.health != 0 || e.sqrtA <= 0) {
+            continue;
+        }
+        const size_t i = m_count++;
+        m_prn[i] = e.prn;
+        m_a[i] = e.sqrtA * e.sqrtA;
+        m_n[i] = std::sqrt(kMu / (m_a[i] * m_a[i] * m_a[i]));
+        m_e[i] = e.eccentricity;
+        m_sqrt1mE2[i] = std::sqrt(1 - e.eccentricity * e.eccentricity);
+        m_cosI[i] = std::cos(e.inclinationRad);
+        m_sinI[i] = std::sin(e.inclinationRad);
+        m_cosW[i] = std::cos(e.argumentOfPerigeeRad);
+        m_sinW[i] = std::sin(e.argumentOfPerigeeRad);
+        m_omega0[i] = e.rightAscensionRad - kEarthRotation * e.toaSeconds;
+        m_omegaDot[i] = e.rateOfRightAscensionRadPerSec - kEarthRotation;
+        m_m0[i] = e.meanAnomalyRad;
+        m_toa[i] = (e.week % 1024) * kWeekSeconds + e.toaSeconds;
+        m_af0[i] = e.af0;
+        m_af1[i] = e.af1;
+    }
+
+    // the padding computes a copy of the first orbit, nobody looks at it
+    m_padded = std::min(kMaxSatellites, (m_count + kLanes - 1) / kLanes * kLanes);
+    for (size_t i = m_count; i < m_padded; ++i) {
+        m_prn[i] = m_prn[0];
+        for (Column* column : {&m_a, &m_n, &m_e, &m_sqrt1mE2, &m_cosI, &m_sinI, &m_cosW, &m_sinW,
+                               &m_omega0, &m_omegaDot, &m_m0, &m_toa, &m_af0, &m_af1}) {
+            (*column)[i] = (*column)[0];
+        }
+    }
+}
+
+void MeasurementEngine::propagate(const double tSeconds) {
+    for (size_t i = 0; i < m_padded; ++i) {
+        double tk = tSeconds - m_travel[i] - m_toa[i];
+        tk -= roundNearest(tk * (1 / kRolloverSeconds)) * kRolloverSeconds;
+
+        // Kepler's equation for the eccentric anomaly
+        const double mk = m_m0[i] + m_n[i] * tk;
+        double ek = mk;
+        double sE, cE;
+        for (int k = 0; k < kKeplerIterations; ++k) {
+            sinCos(ek, &sE, &cE);
+            ek -= (ek - m_e[i] * sE - mk) / (1 - m_e[i] * cE);
+        }
+        sinCos(ek, &sE, &cE);
+        const double eDot = m_n[i] / (1 - m_e[i] * cE);
+
+        // in the orbital plane, from the perigee, then from the node
+        const double xo = m_a[i] * (cE - m_e[i]);
+        const double yo = m_a[i] * m_sqrt1mE2[i] * sE;
+        const double xoDot = -m_a[i] * sE * eDot;
+        const double yoDot = m_a[i] * m_sqrt1mE2[i] * cE * eDot;
+        const double xp = xo * m_cosW[i] - yo * m_sinW[i];
+        const double yp = xo * m_sinW[i] + yo * m_cosW[i];
+        const double xpDot = xoDot * m_cosW[i] - yoDot * m_sinW[i];
+        const double ypDot = xoDot * m_sinW[i] + yoDot * m_cosW[i];
+
+        // ECEF at the time of transmission
+        double sO, cO;
+        sinCos(m_omega0[i] + m_omegaDot[i] * tk, &sO, &cO);
+        const double ypI = yp * m_cosI[i];
+        const double ypDotI = ypDot * m_cosI[i];
+        const double x = xp * cO - ypI * sO;
+        const double y = xp * sO + ypI * cO;
+        m_z[i] = yp * m_sinI[i];
+        m_vx[i] = xpDot * cO - ypDotI * sO - m_omegaDot[i] * y;
+        m_vy[i] = xpDot * sO + ypDotI * cO + m_omegaDot[i] * x;
+        m_vz[i] = ypDot * m_sinI[i];
+
+        // the earth turned on while the signal travelled
+        const double theta = kEarthRotation * m_travel[i];
+        m_x[i] = x + theta * y;
+        m_y[i] = y - theta * x;
+
+        m_clock[i] = m_af0[i] + m_af1[i] * tk;
+    }
+}
+
+size_t MeasurementEngine::update(const Location& rx, const int64_t gpsTimeNs,
+                                 Measurement* out, const size_t capacity) {
+    if (!m_count) {
+        return 0;
+    }
+
+    // the receiver in ECEF, and its east, north, up
+    const double lat = rx.latitudeDegrees * kDegToRad;
+    const double lon = rx.longitudeDegrees * kDegToRad;
+    const double sinLat = std::sin(lat), cosLat = std::cos(lat);
+    const double sinLon = std::sin(lon), cosLon = std::cos(lon);
+    const double nu = kWgs84A / std::sqrt(1 - kWgs84E2 * sinLat * sinLat);
+    const double h = (rx.flags & LocationFlags::HAS_ALTITUDE) ? rx.altitudeMeters : 0;
+    const double rxX = (nu + h) * cosLat * cosLon;
+    const double rxY = (nu + h) * cosLat * sinLon;
+    const double rxZ = (nu * (1 - kWgs84E2) + h) * sinLat;
+    const double eX = -sinLon, eY = cosLon;
+    const double nX = -sinLat * cosLon, nY = -sinLat * sinLon, nZ = cosLat;
+    const double uX = cosLat * cosLon, uY = cosLat * sinLon, uZ = sinLat;
+
+    double rvX = 0, rvY = 0, rvZ = 0;
+    const uint16_t kMotion = LocationFlags::HAS_SPEED | LocationFlags::HAS_BEARING;
+    if ((rx.flags & kMotion) == kMotion) {
+        const double bearing = rx.bearingDegrees * kDegToRad;
+        const double ve = rx.speedMetersPerSec * std::sin(bearing);
+        const double vn = rx.speedMetersPerSec * std::cos(bearing);
+        rvX = ve * eX + vn * nX;
+        rvY = ve * eY + vn * nY;
+        rvZ = vn * nZ;
+    }
+
+    // the travel time from a first guess, then the geometry with it
+    const double t = gpsTimeNs * 1e-9;
+    std::fill(m_travel.begin(), m_travel.begin() + m_padded, 0.075);
+    propagate(t);
+    for (size_t i = 0; i < m_padded; ++i) {
+        const double dx = m_x[i] - rxX, dy = m_y[i] - rxY, dz = m_z[i] - rxZ;
+        m_travel[i] = std::sqrt(dx * dx + dy * dy + dz * dz) * (1 / kSpeedOfLight);
+    }
+    propagate(t);
+    for (size_t i = 0; i < m_padded; ++i) {
+        const double dx = m_x[i] - rxX, dy = m_y[i] - rxY, dz = m_z[i] - rxZ;
+        const double range = std::sqrt(dx * dx + dy * dy + dz * dz);
+        const double inv = 1 / range;
+        const double up = dx * uX + dy * uY + dz * uZ;
+        const double east = dx * eX + dy * eY;
+        const double north = dx * nX + dy * nY + dz * nZ;
+        const double azimuth = atan2Fast(east, north) / kDegToRad;
+        m_range[i] = range;
+        m_sinEl[i] = up * inv;
+        m_elevation[i] = atan2Fast(up, std::sqrt(east * east + north * north)) / kDegToRad;
+        m_azimuth[i] = azimuth + ((azimuth < 0) ? 360 : 0);
+        m_rangeRate[i] = ((m_vx[i] - rvX) * dx + (m_vy[i] - rvY) * dy + (m_vz[i] - rvZ) * dz) * inv;
+    }
+
+    // the ones in view, highest first
+    std::array<uint8_t, kMaxSatellites> inView;
+    size_t n = 0;
+    const double sinMask = std::sin(kElevationMaskDegrees * kDegToRad);
+    for (size_t i = 0; i < m_count; ++i) {
+        if (m_sinEl[i] >= sinMask) {
+            inView[n++] = static_cast<uint8_t>(i);
+        }
+    }
+    std::sort(inView.begin(), inView.begin() + n,
+              [this](const uint8_t a, const uint8_t b) { return m_sinEl[a] > m_sinEl[b]; });
+
+    n = std::min(n, capacity);
+    for (size_t k = 0; k < n; ++k) {
+        const size_t i = inView[k];
+        Measurement& m = out[k];
+        m.svid = m_prn[i];
+        m.constellation = Constellation::GPS;
+        m.elevationDegrees = static_cast<float>(m_elevation[i]);
+        m.azimuthDegrees = static_cast<float>(m_azimuth[i]);
+        m.cN0Dbhz = kCn0HorizonDbhz + (kCn0ZenithDbhz - kCn0HorizonDbhz) * static_cast<float>(m_sinEl[i]);
+        m.carrierFrequencyHz = kL1Hz;
+        m.pseudorangeMeters = m_range[i] - kSpeedOfLight * m_clock[i];
+        m.pseudorangeRateMps = m_rangeRate[i] - kSpeedOfLight * m_af1[i];
+        const int64_t txNs = gpsTimeNs - std::llround(m.pseudorangeMeters * (1e9 / kSpeedOfLight));
+        m.receivedSvTimeNs = ((txNs % kWeekNs) + kWeekNs) % kWeekNs;
+    }
+    return n;
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "almanac.h"
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+// Raw GPS L1 C/A measurements for a receiver at the latest fix: the
+// constellation of an almanac is propagated to the time of the measurement
+// (IS-GPS-200 20.3.3.4.3, with the Sagnac and light time corrections),
+// which gives pseudoranges with the satellite clock, Doppler, C/N0 from the
+// elevation, and elevation and azimuth. There is no receiver clock error,
+// ionosphere or troposphere.
+//
+// The orbits are kept as a structure of arrays and every step runs over all
+// satellites at once in a branch free loop (with polynomial sincos and
+// atan2), which the compiler vectorizes; only the satellites in view are
+// then sorted and copied out. update() does not allocate.
+class MeasurementEngine {
+public:
+    static constexpr size_t kMaxSatellites = 64;
+    static constexpr double kElevationMaskDegrees = 5;
+
+    explicit MeasurementEngine(const std::vector<AlmanacEntry>& almanac);
+
+    size_t satellites() const { return m_count; }
+
+    // The satellites above the mask seen from `rx` (position, and speed and
+    // bearing if it has them) at `gpsTimeNs` (since 1980-01-06), by
+    // elevation. Returns how many went to `out`, at most `capacity`.
+    size_t update(const Location& rx, int64_t gpsTimeNs, Measurement* out, size_t capacity);
+
+private:
+    using Column = std::array<double, kMaxSatellites>;
+
+    // Satellite positions and velocities (ECEF of the reception time) for
+    // signals which left `m_travel` seconds before `tSeconds`.
+    void propagate(double tSeconds);
+
+    size_t m_count = 0;
+    size_t m_padded = 0;  // m_count rounded up to whole vectors
+
+    // the orbits, constant
+    std::array<int16_t, kMaxSatellites> m_prn;
+    alignas(32) Column m_a;             // semi major axis
+    alignas(32) Column m_n;             // mean motion
+    alignas(32) Column m_e;
+    alignas(32) Column m_sqrt1mE2;      // sqrt(1 - e^2)
+    alignas(32) Column m_cosI;
+    alignas(32) Column m_sinI;
+    alignas(32) Column m_cosW;          // of the argument of perigee
+    alignas(32) Column m_sinW;
+    alignas(32) Column m_omega0;        // right ascension at the week start
+    alignas(32) Column m_omegaDot;      // its rate less the earth rotation
+    alignas(32) Column m_m0;
+    alignas(32) Column m_toa;           // seconds since the GPS epoch, modulo 1024 weeks
+    alignas(32) Column m_af0;
+    alignas(32) Column m_af1;
+
+    // per update
+    alignas(32) Column m_travel;        // signal travel time, s
+    alignas(32) Column m_x, m_y, m_z;
+    alignas(32) Column m_vx, m_vy, m_vz;
+    alignas(32) Column m_clock;         // satellite clock bias, s
+    alignas(32) Column m_range;
+    alignas(32) Column m_rangeRate;
+    alignas(32) Column m_sinEl;
+    alignas(32) Column m_elevation;     // degrees
+    alignas(32) Column m_azimuth;
+};
+
+}  // namespace ciccloud
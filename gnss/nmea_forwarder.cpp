@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nmea_forwarder.h"
+#include <log/log.h>
+#include <algorithm>
+#include <cstring>
+
+namespace ciccloud {
+
+bool parseNmeaForwardMode(const char* name, NmeaForwardMode* mode) {
+    if (!strcmp(name, "off")) {
+        *mode = NmeaForwardMode::OFF;
+    } else if (!strcmp(name, "all")) {
+        *mode = NmeaForwardMode::ALL;
+    } else if (!strcmp(name, "on_demand")) {
+        *mode = NmeaForwardMode::ON_DEMAND;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+NmeaForwarder::NmeaForwarder(const GnssSink* sink, const NmeaForwardConfig& config)
+    : m_sink(sink)
+    , m_mode(config.mode)
+    , m_decimation(std::max(config.decimation, 1))
+    , m_batch(config.batch)
+    , m_epochForwarded(config.mode == NmeaForwardMode::ALL) {
+    const std::string& s = config.sentences;
+    for (size_t begin = 0; begin < s.size();) {
+        const size_t end = std::min(s.find(',', begin), s.size());
+        const size_t len = end - begin;
+        if (len == 3 || len == 5) {
+            if (m_typeCount < kMaxTypes) {
+                memcpy(m_types[m_typeCount++].data(), s.data() + begin, len);
+            } else {
+                ALOGW("%s:%d: more than %zu NMEA sentence types, '%s' is ignored",
+                      __PRETTY_FUNCTION__, __LINE__, kMaxTypes, s.substr(begin, len).c_str());
+            }
+        } else if (len) {
+            ALOGW("%s:%d: '%s' is not an NMEA sentence type", __PRETTY_FUNCTION__, __LINE__,
+                  s.substr(begin, len).c_str());
+        }
+        begin = end + 1;
+    }
+}
+
+void NmeaForwarder::beginEpoch() {
+    flush();  // nothing unless the end of the last epoch was not seen
+    if (m_mode == NmeaForwardMode::OFF) {
+        return;
+    }
+
+    if (m_epochCountdown == 0) {
+        m_epochCountdown = m_decimation;
+    }
+    --m_epochCountdown;
+    m_epochForwarded = (m_epochCountdown == m_decimation - 1) &&
+                       (m_mode != NmeaForwardMode::ON_DEMAND || m_sink->wantsNmea());
+}
+
+void NmeaForwarder::forward(const int64_t timestampMs, const char* sentence, const size_t size) {
+    if (!m_epochForwarded || !allowed(sentence, size)) {
+        return;
+    }
+
+    ++m_sentences;
+    if (!m_batch) {
+        ++m_callbacks;
+        m_sink->gnssNmea(timestampMs, sentence, size);
+        return;
+    }
+
+    if (m_size + size > kBatchSize) {
+        flush();
+        if (size > kBatchSize) {
+            return;  // the framer does not make these
+        }
+    }
+    if (!m_size) {
+        m_timestampMs = timestampMs;
+    }
+    memcpy(m_buffer.data() + m_size, sentence, size);
+    m_size += size;
+}
+
+// `sentence` is "$ttsss,..."
+bool NmeaForwarder::allowed(const char* sentence, const size_t size) const {
+    if (!m_typeCount) {
+        return true;
+    }
+    if (size < 7) {
+        return false;
+    }
+
+    const char* talker = sentence + 1;
+    const char* type = sentence + 3;
+    for (size_t i = 0; i < m_typeCount; ++i) {
+        const char* t = m_types[i].data();
+        if (t[3] ? !memcmp(t, talker, 5) : !memcmp(t, type, 3)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void NmeaForwarder::flush() {
+    if (!m_size) {
+        return;
+    }
+
+    m_buffer[m_size] = '\0';
+    ++m_callbacks;
+    m_sink->gnssNmea(m_timestampMs, m_buffer.data(), m_size);
+    m_size = 0;
+}
+
+}  // namespace ciccloud
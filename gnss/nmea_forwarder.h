@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "gnss_sink.h"
+
+namespace ciccloud {
+
+enum class NmeaForwardMode : uint8_t {
+    OFF,
+    ALL,        // every epoch, or every decimation-th
+    ON_DEMAND,  // the same, while the sink wants NMEA, see GnssSink::wantsNmea()
+};
+
+struct NmeaForwardConfig {
+    NmeaForwardMode mode = NmeaForwardMode::ALL;
+    // Sentence types to forward, e.g. "GGA,RMC" or "GPGSV": 3 letters match
+    // any talker, 5 letters one. Empty - all of them.
+    std::string sentences;
+    int decimation = 1;  // the sentences of every n-th epoch
+    bool batch = false;  // one callback per epoch with all its sentences
+};
+
+// "off", "all" or "on_demand".
+bool parseNmeaForwardMode(const char* name, NmeaForwardMode*);
+
+// Decides which sentences of the feed the framework sees through
+// GnssSink::gnssNmea(). Well formed sentences (parsed or not, with or
+// without a fix) are candidates, broken ones and the feeder protocol never
+// are. When batching, the sentences of an epoch are collected and go out
+// when the epoch ends, or earlier if the batch is full.
+//
+// Owned by the listener, not thread safe.
+class NmeaForwarder {
+public:
+    static constexpr size_t kBatchSize = 4096;  // ~50 sentences
+    static constexpr size_t kMaxTypes = 8;
+
+    NmeaForwarder(const GnssSink* sink, const NmeaForwardConfig&);
+
+    // A new epoch starts: decides whether the sentences of this one are
+    // forwarded. Sends what is left of the previous one if its end was
+    // not seen.
+    void beginEpoch();
+
+    // The epoch has ended: sends the batch.
+    void endEpoch() { flush(); }
+
+    // One framed sentence, "$...\r\n" followed by a '\0'.
+    void forward(int64_t timestampMs, const char* sentence, size_t size);
+
+    // The connection was lost, e.g. within an epoch: sends the batch.
+    void reset() { flush(); }
+
+    uint64_t sentences() const { return m_sentences; }  // forwarded
+    uint64_t callbacks() const { return m_callbacks; }
+
+private:
+    bool allowed(const char* sentence, size_t size) const;
+    void flush();
+
+    const GnssSink* const m_sink;
+    const NmeaForwardMode m_mode;
+    const uint32_t m_decimation;
+    const bool m_batch;
+
+    std::array<std::array<char, 5>, kMaxTypes> m_types = {};  // '\0' padded
+    size_t m_typeCount = 0;
+
+    bool m_epochForwarded;
+    uint32_t m_epochCountdown = 0;  // to the next forwarded epoch
+    std::array<char, kBatchSize + 1> m_buffer;
+    size_t m_size = 0;
+    int64_t m_timestampMs = 0;  // of the first sentence in the batch
+    uint64_t m_sentences = 0;
+    uint64_t m_callbacks = 0;
+};
+
+}  // namespace ciccloud
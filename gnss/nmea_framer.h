@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <cstddef>
+
+namespace ciccloud {
+
+// Cuts a byte stream into NMEA sentences: from '$' up to and including '\n'.
+// Bytes outside of a sentence are ignored.
+class NmeaFramer {
+public:
+    static constexpr size_t kMaxSize = 1024;
+
+    enum class Event {
+        NONE,
+        SENTENCE,  // a complete sentence is available until the next consume
+        OVERFLOW,  // no '\n' within kMaxSize bytes, the data was dropped
+    };
+
+    void reset() { m_size = 0; }
+
+    // Whether a sentence is started and not complete yet.
+    bool inSentence() const { return m_size > 0 && !m_complete; }
+
+    Event consume(const char c) {
+        if (m_complete) {
+            m_complete = false;
+            m_size = 0;
+        }
+
+        if (c == '$' || m_size > 0) {
+            m_buffer[m_size++] = c;
+        }
+
+        if (c == '\n' && m_size > 0) {
+            m_buffer[m_size] = 0;  // so sscanf can never run past the sentence
+            m_complete = true;
+            return Event::SENTENCE;
+        } else if (m_size >= kMaxSize) {
+            m_complete = true;  // dropped on the next byte
+            return Event::OVERFLOW;
+        } else {
+            return Event::NONE;
+        }
+    }
+
+    // The whole sentence including '$' and the line terminator, or what was
+    // collected before an overflow.
+    const char* data() const { return m_buffer.data(); }
+    size_t size() const { return m_size; }
+
+    // The sentence payload: after '$' and before "\r\n" or "\n".
+    const char* payloadBegin() const { return m_buffer.data() + 1; }
+    const char* payloadEnd() const {
+        const char* end = m_buffer.data() + m_size - 1;
+        return (end[-1] == '\r') ? (end - 1) : end;
+    }
+
+private:
+    std::array<char, kMaxSize + 1> m_buffer;
+    size_t m_size = 0;
+    bool m_complete = false;
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,595 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nmea_parser.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include "trace.h"
+
+namespace ciccloud {
+namespace {
+const char* testNmeaField(const char* i, const char* end, const char* v, const char sep) {
+    while (i < end) {
+        if (*v == 0) {
+            return (*i == sep) ? (i + 1) : nullptr;
+        } else if (*v == *i) {
+            ++v;
+            ++i;
+        } else {
+            return nullptr;
+        }
+    }
+
+    return nullptr;
+}
+
+const char* skipAfter(const char* i, const char* end, const char c) {
+    for (; i < end; ++i) {
+        if (*i == c) {
+            return i + 1;
+        }
+    }
+    return nullptr;
+}
+
+int hexDigit(const char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    } else if (c >= 'A' && c <= 'F') {
+        return c - 'A' + 10;
+    } else if (c >= 'a' && c <= 'f') {
+        return c - 'a' + 10;
+    } else {
+        return -1;
+    }
+}
+
+// [begin, end) is the sentence without '$' and the line terminator. Sentences
+// without the optional '*hh' suffix are accepted.
+bool checksumOk(const char* begin, const char* end) {
+    unsigned char sum = 0;
+    for (const char* i = begin; i < end; ++i) {
+        if (*i == '*') {
+            if ((end - i) < 3) {
+                return false;
+            }
+            const int hi = hexDigit(i[1]);
+            const int lo = hexDigit(i[2]);
+            return (hi >= 0) && (lo >= 0) && (sum == ((hi << 4) | lo));
+        }
+        sum ^= static_cast<unsigned char>(*i);
+    }
+    return true;
+}
+
+// The next field of [i, end), up to the '*' of the checksum, as an integer
+// (the part before a '.'), -1 if it is empty. Returns where the field after
+// it starts, nullptr if there is no field at `i`.
+const char* intField(const char* i, const char* end, int* value) {
+    if (!i || i >= end || *i == '*') {
+        return nullptr;
+    }
+
+    int v = -1;
+    for (; i < end && *i >= '0' && *i <= '9'; ++i) {
+        v = ((v < 0) ? 0 : (v * 10)) + (*i - '0');
+    }
+    for (; i < end && *i != ',' && *i != '*'; ++i) {
+    }
+    *value = v;
+    return (i < end && *i == ',') ? (i + 1) : i;
+}
+
+// The talker of a sentence with satellites, GB and BD are both BeiDou.
+bool svTalker(const char* begin, SvTable::Talker* talker) {
+    static constexpr struct {
+        char id[3];
+        SvTable::Talker talker;
+    } kTalkers[] = {
+        {"GP", SvTable::Talker::GP}, {"GL", SvTable::Talker::GL}, {"GA", SvTable::Talker::GA},
+        {"GB", SvTable::Talker::GB}, {"BD", SvTable::Talker::GB}, {"GQ", SvTable::Talker::GQ},
+        {"GN", SvTable::Talker::GN},
+    };
+    for (const auto& t : kTalkers) {
+        if (begin[0] == t.id[0] && begin[1] == t.id[1]) {
+            *talker = t.talker;
+            return true;
+        }
+    }
+    return false;
+}
+
+double convertDMMF(const int dmm, const int f, int p10) {
+    const int d = dmm / 100;
+    const int m = dmm % 100;
+    int base10 = 1;
+    for (; p10 > 0; --p10) {
+        base10 *= 10;
+    }
+
+    return double(d) + (m + (f / double(base10))) / 60.0;
+}
+
+double sign(char m, char positive) {
+    return (m == positive) ? 1.0 : -1;
+}
+
+// hhmmss.sss -> milliseconds since midnight UTC
+int64_t utcTimeOfDayMs(const int hhmmss, int frac, int fracDigits) {
+    for (; fracDigits < 3; ++fracDigits) {
+        frac *= 10;
+    }
+    for (; fracDigits > 3; --fracDigits) {
+        frac /= 10;
+    }
+
+    const int hh = hhmmss / 10000;
+    const int mm = (hhmmss / 100) % 100;
+    const int ss = hhmmss % 100;
+    return ((hh * 60LL + mm) * 60LL + ss) * 1000LL + frac;
+}
+
+// How old the fix is when we deliver it, assuming the feeder and we are
+// synchronized to UTC. Only meaningful in a trace.
+void traceFixAge(const int64_t fixTimeOfDayMs, const int64_t nowNs) {
+    constexpr int64_t kDayMs = 24LL * 3600LL * 1000LL;
+    int64_t ageMs = (nowNs / 1000000) % kDayMs - fixTimeOfDayMs;
+    if (ageMs < -kDayMs / 2) {
+        ageMs += kDayMs;
+    } else if (ageMs > kDayMs / 2) {
+        ageMs -= kDayMs;
+    }
+    GNSS_TRACE_COUNTER("gnss.fix_age_ms", ageMs);
+}
+
+}  // namespace
+
+NmeaParser::NmeaParser(const GnssSink* sink, ClockSync* clockSync, FeedSession* feedSession,
+                       const FixFilterConfig& filter)
+    : m_sink(sink)
+    , m_clockSync(clockSync)
+    , m_feedSession(feedSession)
+    , m_filter(filter) {}
+
+ParseResult NmeaParser::parse(const char* begin, const char* end, const int64_t nowNs,
+                              const int64_t rxBootNs) {
+    SvTable::Talker talker;
+    if (!checksumOk(begin, end)) {
+        return ParseResult::BAD_CHECKSUM;
+    } else if (const char* fields = testNmeaField(begin, end, "GPRMC", ',')) {
+        return parseGPRMC(fields, end, nowNs, rxBootNs);
+    } else if (const char* fields = testNmeaField(begin, end, "GPGGA", ',')) {
+        return parseGPGGA(fields, end, nowNs, rxBootNs);
+    } else if ((end - begin) > 6 && begin[5] == ',' && !memcmp(begin + 2, "GSV", 3) &&
+               svTalker(begin, &talker)) {
+        return parseGSV(talker, begin + 6, end);
+    } else if ((end - begin) > 6 && begin[5] == ',' && !memcmp(begin + 2, "GSA", 3) &&
+               svTalker(begin, &talker)) {
+        return parseGSA(talker, begin + 6, end);
+    } else if (const char* fields = testNmeaField(begin, end, "PCCTS", ',')) {
+        return parsePCCTS(fields, end, rxBootNs);
+    } else if (const char* fields = testNmeaField(begin, end, "PCCSEQ", ',')) {
+        return parsePCCSEQ(fields, end);
+    } else if (const char* fields = testNmeaField(begin, end, "PCCCAP", ',')) {
+        return parsePCCCAP(fields, end);
+    } else if (const char* fields = testNmeaField(begin, end, "PCCSES", ',')) {
+        return parsePCCSES(fields, end);
+    } else if (const char* fields = testNmeaField(begin, end, "PCCPRI", ',')) {
+        return parsePCCPRI(fields, end);
+    } else {
+        return ParseResult::UNKNOWN_TYPE;
+    }
+}
+
+//        begin                                                          end
+// $GPRMC,195206,A,1000.0000,N,10000.0000,E,173.8,231.8,010420,004.2,W*47
+//          1    2    3      4    5       6     7     8      9    10 11 12
+//      1  195206     Time Stamp
+//      2  A          validity - A-ok, V-invalid
+//      3  1000.0000  current Latitude
+//      4  N          North/South
+//      5  10000.0000 current Longitude
+//      6  E          East/West
+//      7  173.8      Speed in knots
+//      8  231.8      True course
+//      9  010420     Date Stamp (13 June 1994)
+//     10  004.2      Variation
+//     11  W          East/West
+//     12  *70        checksum
+ParseResult NmeaParser::parseGPRMC(const char* begin, const char*, const int64_t nowNs,
+                                   const int64_t rxBootNs) {
+    double speedKnots = 0;
+    double course = 0;
+    double variation = 0;
+    int latdmm = 0;
+    int londmm = 0;
+    int latf = 0;
+    int lonf = 0;
+    int latdmmConsumed = 0;
+    int latfConsumed = 0;
+    int londmmConsumed = 0;
+    int lonfConsumed = 0;
+    int hhmmss = -1;
+    int sss = 0;
+    int sssBegin = 0;
+    int sssEnd = 0;
+    int ddmoyy = 0;
+    char validity = 0;
+    char ns = 0;  // north/south
+    char ew = 0;  // east/west
+    char var_ew = 0;
+
+    if (sscanf(begin, "%06d.%n%d%n,%c,%d.%n%d%n,%c,%d.%n%d%n,%c,%lf,%lf,%d,%lf,%c*",
+               &hhmmss, &sssBegin, &sss, &sssEnd, &validity,
+               &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
+               &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
+               &speedKnots, &course,
+               &ddmoyy,
+               &variation, &var_ew) != 14) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (validity != 'A') {
+        return ParseResult::INVALID_FIX;
+    }
+
+    const double lat = convertDMMF(latdmm, latf, latfConsumed - latdmmConsumed) * sign(ns, 'N');
+    const double lon = convertDMMF(londmm, lonf, lonfConsumed - londmmConsumed) * sign(ew, 'E');
+    const double speed = speedKnots * 0.514444;
+
+    Location loc;
+    loc.utcTimeOfDayMs = utcTimeOfDayMs(hhmmss, sss, sssEnd - sssBegin);
+    setTimestamps(&loc, nowNs, rxBootNs);
+
+    loc.latitudeDegrees = lat;
+    loc.longitudeDegrees = lon;
+    loc.speedMetersPerSec = speed;
+    loc.bearingDegrees = course;
+    loc.speedAccuracyMetersPerSecond = .5;
+    loc.bearingAccuracyDegrees = 30;
+
+    loc.flags =
+        LocationFlags::HAS_LAT_LONG |
+        LocationFlags::HAS_SPEED |
+        LocationFlags::HAS_BEARING |
+        LocationFlags::HAS_HORIZONTAL_ACCURACY |
+        LocationFlags::HAS_SPEED_ACCURACY |
+        LocationFlags::HAS_BEARING_ACCURACY;
+
+    if (m_flags & LocationFlags::HAS_ALTITUDE) {
+        loc.altitudeMeters = m_altitude;
+        loc.flags |= LocationFlags::HAS_ALTITUDE |
+                     LocationFlags::HAS_VERTICAL_ACCURACY;
+    }
+    setAccuracies(&loc);
+
+    deliver(loc);
+    if (GNSS_TRACE_ENABLED()) {
+        traceFixAge(loc.utcTimeOfDayMs, nowNs);
+    }
+    return ParseResult::OK;
+}
+
+// $GPGGA,123519,4807.0382,N,12204.9799,W,1,6,,4.2,M,0.,M,,,*47
+//    time of fix      123519     12:35:19 UTC
+//    latitude         4807.0382  48 degrees, 07.0382 minutes
+//    north/south      N or S
+//    longitude        12204.9799 122 degrees, 04.9799 minutes
+//    east/west        E or W
+//    fix quality      1          standard GPS fix
+//    satellites       1 to 12    number of satellites being tracked
+//    HDOP             0.9        horizontal dilution, may be empty
+//    altitude         4.2        altitude above sea-level
+//    altitude units   M          to indicate meters
+//    diff             <dontcare> height of sea-level above ellipsoid
+//    diff units       M          to indicate meters (should be <dontcare>)
+//    dgps age         <dontcare> time in seconds since last DGPS fix
+//    dgps sid         <dontcare> DGPS station id
+ParseResult NmeaParser::parseGPGGA(const char* begin, const char* end, const int64_t nowNs,
+                                   const int64_t rxBootNs) {
+    double altitude = 0;
+    int latdmm = 0;
+    int londmm = 0;
+    int latf = 0;
+    int lonf = 0;
+    int latdmmConsumed = 0;
+    int latfConsumed = 0;
+    int londmmConsumed = 0;
+    int lonfConsumed = 0;
+    int hhmmss = 0;
+    int sss = 0;
+    int sssBegin = 0;
+    int sssEnd = 0;
+    int fixQuality = 0;
+    int nSatellites = 0;
+    int consumed = 0;
+    char ns = 0;
+    char ew = 0;
+    char altitudeUnit = 0;
+
+    if (sscanf(begin, "%06d.%n%d%n,%d.%n%d%n,%c,%d.%n%d%n,%c,%d,%d,%n",
+               &hhmmss, &sssBegin, &sss, &sssEnd,
+               &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
+               &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
+               &fixQuality,
+               &nSatellites,
+               &consumed) != 10) {
+        if (sscanf(begin, "%06d.%n%d%n,%d.%n%d%n,%c,%d.%n%d%n,%c,%d,,%n",
+                   &hhmmss, &sssBegin, &sss, &sssEnd,
+                   &latdmm, &latdmmConsumed, &latf, &latfConsumed, &ns,
+                   &londmm, &londmmConsumed, &lonf, &lonfConsumed, &ew,
+                   &fixQuality,
+                   &consumed) != 9) { // satellites is null.
+            return ParseResult::FIELD_ERROR;
+        }
+    }
+
+    float hdop = 0;
+    if (sscanf(begin + consumed, "%f", &hdop) != 1 || hdop < 0) {
+        hdop = 0;
+    }
+    begin = skipAfter(begin + consumed, end, ',');
+    if (!begin) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (sscanf(begin, "%lf,%c,", &altitude, &altitudeUnit) != 2) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (altitudeUnit != 'M') {
+        return ParseResult::FIELD_ERROR;
+    }
+
+    const double lat = convertDMMF(latdmm, latf, latfConsumed - latdmmConsumed) * sign(ns, 'N');
+    const double lon = convertDMMF(londmm, lonf, lonfConsumed - londmmConsumed) * sign(ew, 'E');
+
+    Location loc;
+    loc.utcTimeOfDayMs = utcTimeOfDayMs(hhmmss, sss, sssEnd - sssBegin);
+    setTimestamps(&loc, nowNs, rxBootNs);
+
+    loc.latitudeDegrees = lat;
+    loc.longitudeDegrees = lon;
+    loc.altitudeMeters = altitude;
+
+    loc.flags =
+        LocationFlags::HAS_LAT_LONG |
+        LocationFlags::HAS_HORIZONTAL_ACCURACY |
+        LocationFlags::HAS_ALTITUDE |
+        LocationFlags::HAS_VERTICAL_ACCURACY;
+
+    m_hdop = hdop;
+    m_fixQuality = fixQuality;
+    setAccuracies(&loc);
+    deliver(loc);
+    if (GNSS_TRACE_ENABLED()) {
+        traceFixAge(loc.utcTimeOfDayMs, nowNs);
+    }
+
+    m_altitude = altitude;
+    m_flags |= LocationFlags::HAS_ALTITUDE;
+
+    return ParseResult::OK;
+}
+
+// $GPGSV,3,1,11,03,03,111,00,04,15,270,00,06,01,010,00,13,06,292,00*74
+//    1  3          number of sentences of the cycle
+//    2  1          this one
+//    3  11         satellites in view
+//    4  03         satellite id, then elevation (degrees), azimuth (degrees)
+//                  and SNR (dB-Hz), for up to 4 satellites; empty ones are
+//                  not known (or not tracked for the SNR)
+//    n  1          NMEA 4.11 signal id, ignored
+ParseResult NmeaParser::parseGSV(const SvTable::Talker talker, const char* begin,
+                                 const char* end) {
+    int parts = 0;
+    int part = 0;
+    int total = 0;
+    const char* i = intField(begin, end, &parts);
+    i = intField(i, end, &part);
+    i = intField(i, end, &total);
+    if (!i || parts < 1 || part < 1) {
+        return ParseResult::FIELD_ERROR;
+    }
+
+    const bool inCycle = m_svTable.beginViewPart(talker, part, parts);
+    while (true) {
+        int id = -1;
+        int elevation = -1;
+        int azimuth = -1;
+        int snr = -1;
+        i = intField(i, end, &id);
+        const char* next = intField(intField(intField(i, end, &elevation), end, &azimuth), end, &snr);
+        if (!next) {
+            break;  // no more satellites, or the signal id
+        }
+        i = next;
+
+        Constellation constellation;
+        int16_t svid;
+        if (inCycle && SvTable::fromNmea(talker, id, &constellation, &svid)) {
+            m_svTable.inView(constellation, svid, std::max(snr, 0), std::max(elevation, 0),
+                             std::max(azimuth, 0));
+        }
+    }
+    if (inCycle) {
+        m_svTable.endViewPart(talker, part, parts);
+    }
+    return ParseResult::OK;
+}
+
+// $GNGSA,A,3,80,71,73,79,69,,,,,,,,1.83,1.09,1.47,2*0E
+//    1  A          selection mode
+//    2  3          fix: 1 - none, 2 - 2D, 3 - 3D
+//    3  80         ids of the 12 satellites used in the fix, or empty
+//   15  1.83       PDOP, HDOP and VDOP
+//   18  2          NMEA 4.11 system id: 1 GPS, 2 GLONASS, 3 Galileo,
+//                  4 BeiDou, 5 QZSS; GN sentences are otherwise split up by
+//                  the id ranges
+ParseResult NmeaParser::parseGSA(SvTable::Talker talker, const char* begin, const char* end) {
+    const char* i = skipAfter(begin, end, ',');  // the selection mode
+    int fix = 0;
+    i = intField(i, end, &fix);
+    std::array<int, 12> ids;
+    for (int& id : ids) {
+        i = intField(i, end, &id);
+    }
+    int dop = 0;
+    for (int k = 0; k < 3; ++k) {
+        i = intField(i, end, &dop);
+    }
+    if (!i) {
+        return ParseResult::FIELD_ERROR;
+    }
+
+    int systemId = 0;
+    if (talker == SvTable::Talker::GN && intField(i, end, &systemId) && systemId >= 1 &&
+        systemId <= 5) {
+        static constexpr SvTable::Talker kSystems[] = {
+            SvTable::Talker::GP, SvTable::Talker::GL, SvTable::Talker::GA,
+            SvTable::Talker::GB, SvTable::Talker::GQ,
+        };
+        talker = kSystems[systemId - 1];
+    }
+
+    m_svTable.beginUsed(talker);
+    for (const int id : ids) {
+        Constellation constellation;
+        int16_t svid;
+        if (fix >= 2 && SvTable::fromNmea(talker, id, &constellation, &svid)) {
+            m_svTable.used(constellation, svid);
+        }
+    }
+    m_svTable.endUsed();
+    return ParseResult::OK;
+}
+
+// $PCCCAP,TS,SEQ*hh
+//    the feeder protocol extensions the feeder speaks, comma separated:
+//    TS   answers time pings with $PCCTS
+//    SEQ  resumable sessions, says $PCCSES hello
+ParseResult NmeaParser::parsePCCCAP(const char* begin, const char* end) {
+    if (m_clockSync) {
+        bool ts = false;
+        for (const char* i = begin; i < end;) {
+            const char* e = i;
+            while (e < end && *e != ',' && *e != '*') {
+                ++e;
+            }
+            ts = ts || ((e - i) == 2 && i[0] == 'T' && i[1] == 'S');
+            i = (e < end && *e == ',') ? (e + 1) : end;
+        }
+        m_clockSync->setSupported(ts);
+    }
+    return ParseResult::CONTROL;
+}
+
+// $PCCTS,t1,t2,t3*hh
+//    t1   the ping's boottime, echoed
+//    t2   when the feeder received the ping, feeder clock, ns
+//    t3   when the feeder sent this, feeder clock, ns
+ParseResult NmeaParser::parsePCCTS(const char* begin, const char*, const int64_t rxBootNs) {
+    long long t1 = 0;
+    long long t2 = 0;
+    long long t3 = 0;
+    if (sscanf(begin, "%lld,%lld,%lld", &t1, &t2, &t3) != 3) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (m_clockSync) {
+        m_clockSync->onPong(t1, t2, t3, rxBootNs);
+    }
+    return ParseResult::CONTROL;
+}
+
+// $PCCSES,0123456789abcdef,42*hh
+//    session id, hex
+//    the seq of the next sentence the feeder would send
+ParseResult NmeaParser::parsePCCSES(const char* begin, const char*) {
+    unsigned long long sessionId = 0;
+    unsigned long long seq = 0;
+    if (sscanf(begin, "%llx,%llu", &sessionId, &seq) != 2) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (m_feedSession) {
+        m_feedSession->onHello(sessionId, seq);
+    }
+    return ParseResult::CONTROL;
+}
+
+// $PCCSEQ,0123456789abcdef,42*hh
+//    session id, hex
+//    the seq of the next data sentence, the ones after it count up
+ParseResult NmeaParser::parsePCCSEQ(const char* begin, const char*) {
+    unsigned long long sessionId = 0;
+    unsigned long long seq = 0;
+    if (sscanf(begin, "%llx,%llu", &sessionId, &seq) != 2) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (m_feedSession) {
+        m_feedSession->onHeader(sessionId, seq);
+    }
+    return ParseResult::CONTROL;
+}
+
+// $PCCPRI,1*hh
+//    the priority of the feed among concurrent ones, 0 - the most preferred
+ParseResult NmeaParser::parsePCCPRI(const char* begin, const char*) {
+    int priority = 0;
+    if (sscanf(begin, "%d", &priority) != 1 || priority < 0) {
+        return ParseResult::FIELD_ERROR;
+    }
+    if (m_feedSession) {
+        m_feedSession->onPriority(priority);
+    }
+    return ParseResult::CONTROL;
+}
+
+void NmeaParser::endEpoch() {
+    if (m_svTable.changed()) {
+        const size_t n = m_svTable.snapshot(m_svInfo.data(), m_svInfo.size());
+        m_sink->gnssSvStatus(m_svInfo.data(), n);
+    }
+}
+
+// From the HDOP and fix quality if GGA has them, else what we always had.
+void NmeaParser::setAccuracies(Location* loc) const {
+    const float horizontal = horizontalErrorMeters(m_hdop, m_fixQuality);
+    loc->horizontalAccuracyMeters = (horizontal > 0) ? horizontal : 5;
+    loc->verticalAccuracyMeters = (horizontal > 0) ? verticalErrorMeters(m_hdop, m_fixQuality)
+                                                   : .5f;
+}
+
+void NmeaParser::deliver(Location loc) {
+    if (m_filter.enabled()) {
+        m_filter.update(&loc, m_fixQuality);
+    }
+    m_location = loc;
+    m_hasLocation = true;
+    m_sink->gnssLocation(loc);
+}
+
+// The fix time: the sentence time mapped to boottime if we know the feeder
+// clock, else the arrival time. Either way the uncertainty is a guess at
+// best without a sync, so keep the historic 1ms there.
+void NmeaParser::setTimestamps(Location* loc, const int64_t nowNs, const int64_t rxBootNs) const {
+    loc->timestampMs = nowNs / 1000000;
+    if (!m_clockSync ||
+        !m_clockSync->toBootTime(loc->utcTimeOfDayMs, rxBootNs,
+                                 &loc->elapsedRealtimeNs, &loc->elapsedRealtimeUncertaintyNs)) {
+        loc->elapsedRealtimeNs = rxBootNs;
+        loc->elapsedRealtimeUncertaintyNs = 1000000;
+    }
+}
+
+}  // namespace ciccloud
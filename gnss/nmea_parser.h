@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <cstdint>
+#include "clock_sync.h"
+#include "feed_session.h"
+#include "fix_filter.h"
+#include "gnss_sink.h"
+#include "parse_stats.h"
+#include "sv_table.h"
+
+namespace ciccloud {
+
+// Turns one NMEA sentence into locations and satellite status for the sink.
+// Feeder protocol sentences ($PCC...) go to `clockSync` and `feedSession`
+// if there are. GSV and GSA of every talker go into a satellite table which
+// is published once per epoch, see endEpoch(). Fixes get the accuracies of
+// the HDOP and fix quality of the latest GGA and go through the fix filter
+// if it is configured.
+class NmeaParser {
+public:
+    static constexpr int kMaxSatellites = static_cast<int>(GnssSink::kMaxSvInfo);
+
+    explicit NmeaParser(const GnssSink* sink, ClockSync* clockSync = nullptr,
+                        FeedSession* feedSession = nullptr,
+                        const FixFilterConfig& filter = FixFilterConfig());
+
+    // [begin, end) is the sentence without '$' and the line terminator, it
+    // must be followed by a terminator or a '\0' in memory. `nowNs` is UTC,
+    // `rxBootNs` is when the sentence arrived (CLOCK_BOOTTIME).
+    ParseResult parse(const char* begin, const char* end, int64_t nowNs, int64_t rxBootNs);
+
+    // Sends the satellite status if GSV or GSA changed it during the epoch.
+    // Called before the first sentence of the next one.
+    void endEpoch();
+
+    // The last location sent to the sink, nullptr before the first one.
+    const Location* lastLocation() const { return m_hasLocation ? &m_location : nullptr; }
+
+private:
+    ParseResult parseGPRMC(const char* begin, const char* end, int64_t nowNs, int64_t rxBootNs);
+    ParseResult parseGPGGA(const char* begin, const char* end, int64_t nowNs, int64_t rxBootNs);
+    ParseResult parseGSV(SvTable::Talker, const char* begin, const char* end);
+    ParseResult parseGSA(SvTable::Talker, const char* begin, const char* end);
+    ParseResult parsePCCCAP(const char* begin, const char* end);
+    ParseResult parsePCCTS(const char* begin, const char* end, int64_t rxBootNs);
+    ParseResult parsePCCSES(const char* begin, const char* end);
+    ParseResult parsePCCSEQ(const char* begin, const char* end);
+    ParseResult parsePCCPRI(const char* begin, const char* end);
+    void setTimestamps(Location* loc, int64_t nowNs, int64_t rxBootNs) const;
+    void setAccuracies(Location* loc) const;
+    void deliver(Location);
+
+    const GnssSink* m_sink;
+    ClockSync* m_clockSync;
+    FeedSession* m_feedSession;
+
+    double m_altitude = 0;
+    uint16_t m_flags = 0;
+    float m_hdop = 0;       // of the latest GGA, 0 if unknown
+    int m_fixQuality = 1;   // of the latest GGA
+    FixFilter m_filter;
+    Location m_location;
+    bool m_hasLocation = false;
+
+    SvTable m_svTable;
+    std::array<SvInfo, kMaxSatellites> m_svInfo;  // what endEpoch() sends
+};
+
+}  // namespace ciccloud
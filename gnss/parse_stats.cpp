@@ -0,0 +1,118 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "parse_stats.h"
+#include <log/log.h>
+#include <algorithm>
+
+namespace ciccloud {
+namespace {
+constexpr int kLogRatePerSec = 1;
+constexpr int kLogBurst = 5;
+}  // namespace
+
+const char* toString(const ParseResult r) {
+    switch (r) {
+        case ParseResult::OK: return "ok";
+        case ParseResult::CONTROL: return "control";
+        case ParseResult::UNKNOWN_TYPE: return "unknown_type";
+        case ParseResult::BAD_CHECKSUM: return "bad_checksum";
+        case ParseResult::FIELD_ERROR: return "field_error";
+        case ParseResult::INVALID_FIX: return "invalid_fix";
+        case ParseResult::OVERFLOW: return "overflow";
+        default: return "?";
+    }
+}
+
+LogRateLimiter::LogRateLimiter(const int ratePerSec, const int burst)
+    : m_nsPerToken(1000000000LL / ratePerSec)
+    , m_burstNs(m_nsPerToken * burst) {}
+
+bool LogRateLimiter::tryAcquire(const int64_t nowNs) {
+    // GCRA form of the token bucket: a single timestamp instead of a token
+    // count plus a refill time.
+    const int64_t tat = std::max(m_tat, nowNs);
+    if (tat - nowNs > m_burstNs - m_nsPerToken) {
+        return false;
+    }
+    m_tat = tat + m_nsPerToken;
+    return true;
+}
+
+ParseStats::ParseStats()
+    : m_limiter(kLogRatePerSec, kLogBurst) {
+    for (auto& c : m_counters) {
+        c.store(0, std::memory_order_relaxed);
+    }
+    m_sampleCountdown.fill(0);
+    m_lastSummary.fill(0);
+}
+
+bool ParseStats::recordFailure(const ParseResult r, const int64_t nowNs) {
+    const size_t i = static_cast<size_t>(r);
+    m_counters[i].fetch_add(1, std::memory_order_relaxed);
+    ++m_failuresSinceSummary;
+
+    if (m_sampleCountdown[i] > 0) {
+        --m_sampleCountdown[i];
+        ++m_suppressed;
+        return false;
+    }
+    m_sampleCountdown[i] = kSampleEvery - 1;
+
+    if (m_limiter.tryAcquire(nowNs)) {
+        return true;
+    } else {
+        ++m_suppressed;
+        return false;
+    }
+}
+
+void ParseStats::maybeLogSummary(const int64_t nowNs) {
+    if (nowNs < m_nextSummaryNs) {
+        return;
+    } else if (!m_nextSummaryNs) {
+        m_nextSummaryNs = nowNs + kSummaryPeriodNs;
+        return;
+    }
+    m_nextSummaryNs = nowNs + kSummaryPeriodNs;
+    if (!m_failuresSinceSummary) {
+        return;
+    }
+
+    uint64_t now[static_cast<size_t>(ParseResult::COUNT)];
+    for (size_t i = 0; i < m_counters.size(); ++i) {
+        now[i] = m_counters[i].load(std::memory_order_relaxed);
+    }
+
+    using R = ParseResult;
+    auto delta = [&](const R r) {
+        const size_t i = static_cast<size_t>(r);
+        return static_cast<unsigned long long>(now[i] - m_lastSummary[i]);
+    };
+
+    ALOGW("NMEA parse summary: ok=%llu unknown_type=%llu bad_checksum=%llu "
+          "field_error=%llu invalid_fix=%llu overflow=%llu, %llu log lines suppressed",
+          delta(R::OK), delta(R::UNKNOWN_TYPE), delta(R::BAD_CHECKSUM),
+          delta(R::FIELD_ERROR), delta(R::INVALID_FIX), delta(R::OVERFLOW),
+          static_cast<unsigned long long>(m_suppressed));
+
+    std::copy(std::begin(now), std::end(now), m_lastSummary.begin());
+    m_suppressed = 0;
+    m_failuresSinceSummary = 0;
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace ciccloud {
+
+enum class ParseResult {
+    OK,
+    CONTROL,        // a feeder protocol sentence ($PCC...), consumed by the HAL
+    UNKNOWN_TYPE,   // a talker/sentence we do not parse, e.g. GNRMC, GPGSV
+    BAD_CHECKSUM,   // '*hh' present but does not match the payload
+    FIELD_ERROR,    // a known sentence with missing or malformed fields
+    INVALID_FIX,    // well formed, but the receiver reports no valid fix
+    OVERFLOW,       // no line terminator within the buffer limit
+    COUNT
+};
+
+const char* toString(ParseResult);
+
+// Token bucket: `ratePerSec` tokens are added every second, up to `burst`.
+// Not thread safe, it is owned by the thread which parses.
+class LogRateLimiter {
+public:
+    LogRateLimiter(int ratePerSec, int burst);
+
+    bool tryAcquire(int64_t nowNs);
+
+private:
+    const int64_t m_nsPerToken;
+    const int64_t m_burstNs;
+    int64_t m_tat = 0;  // when the bucket is full again
+};
+
+// Counts parse outcomes and decides which failures are worth a log line.
+// Counters are atomic so they can be read from any thread, updates are done
+// by the parsing thread only.
+class ParseStats {
+public:
+    ParseStats();
+
+    void record(ParseResult r) {
+        m_counters[static_cast<size_t>(r)].fetch_add(1, std::memory_order_relaxed);
+    }
+    uint64_t count(ParseResult r) const {
+        return m_counters[static_cast<size_t>(r)].load(std::memory_order_relaxed);
+    }
+
+    // Records a failure and returns true if it should be logged. Only every
+    // kSampleEvery-th failure of a class is offered to the rate limiter, the
+    // rest cost a couple of increments.
+    bool recordFailure(ParseResult r, int64_t nowNs);
+
+    // Logs one summary line if there were failures since the last one and
+    // at least kSummaryPeriodNs passed.
+    void maybeLogSummary(int64_t nowNs);
+
+private:
+    static constexpr int64_t kSampleEvery = 16;
+    static constexpr int64_t kSummaryPeriodNs = 60LL * 1000000000LL;
+
+    std::array<std::atomic<uint64_t>, static_cast<size_t>(ParseResult::COUNT)> m_counters;
+    std::array<uint32_t, static_cast<size_t>(ParseResult::COUNT)> m_sampleCountdown;
+    std::array<uint64_t, static_cast<size_t>(ParseResult::COUNT)> m_lastSummary;
+    LogRateLimiter m_limiter;
+    uint64_t m_suppressed = 0;
+    uint64_t m_failuresSinceSummary = 0;
+    int64_t m_nextSummaryNs = 0;
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,426 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "feed_mux.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <stddef.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include "feeder.h"
+
+namespace ciccloud {
+namespace sim {
+namespace {
+constexpr int kMaxEvents = 256;
+
+// "@name" is in the abstract namespace.
+socklen_t makeUnixAddress(const std::string& path, struct sockaddr_un* addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    const size_t len = std::min(path.size(), sizeof(addr->sun_path) - 1);
+    memcpy(addr->sun_path, path.data(), len);
+    if (len > 0 && path[0] == '@') {
+        addr->sun_path[0] = '\0';
+        return offsetof(struct sockaddr_un, sun_path) + len;
+    }
+    return sizeof(*addr);
+}
+
+}  // namespace
+
+FeedMux::Scenario::Scenario(const MuxScenario& c)
+    : config(c)
+    , trajectory(Feeder::kBaseUtcMs, c.latitudeDegrees, c.longitudeDegrees, c.altitudeMeters,
+                 c.speedMetersPerSec, c.bearingDegrees, c.turnRateDegreesPerSec)
+    , epochMs(Feeder::epochMs(c.rateHz))
+    , periodNs(std::max<int64_t>(1, static_cast<int64_t>(1e9 / c.rateHz))) {}
+
+FeedMux::FeedMux(const FeedMuxConfig& config)
+    : m_config(config)
+    // the oldest epoch in a backlog must still be in the ring
+    , m_maxBacklog(std::max<size_t>(1, std::min(config.maxBacklogEpochs, kRingEpochs - 1)))
+    , m_epollFd(epoll_create1(EPOLL_CLOEXEC)) {}
+
+FeedMux::~FeedMux() {
+    for (Instance& in : m_instances) {
+        if (in.fd >= 0) {
+            close(in.fd);
+        }
+    }
+    if (m_epollFd >= 0) {
+        close(m_epollFd);
+    }
+}
+
+int FeedMux::addScenario(const MuxScenario& scenario) {
+    if (!(scenario.rateHz > 0)) {
+        return -1;
+    }
+    m_scenarios.push_back(std::make_unique<Scenario>(scenario));
+    return static_cast<int>(m_scenarios.size()) - 1;
+}
+
+int FeedMux::addInstance(const Endpoint& endpoint, const int scenario) {
+    if (scenario < 0 || static_cast<size_t>(scenario) >= m_scenarios.size()) {
+        return -1;
+    }
+    const int index = static_cast<int>(m_instances.size());
+    m_instances.emplace_back();
+    m_instances.back().endpoint = endpoint;
+    m_instances.back().scenario = scenario;
+    m_scenarios[scenario]->instances.push_back(index);
+    m_nextRetryNs = 0;  // connect it with the next tick
+    return index;
+}
+
+// Non-blocking: the connection completes, or fails, with EPOLLOUT.
+void FeedMux::connect(const int index) {
+    Instance& in = m_instances[index];
+    const Endpoint& ep = in.endpoint;
+    const bool uds = !ep.udsPath.empty();
+    in.fd = socket(uds ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (in.fd < 0) {
+        disconnect(index);
+        return;
+    }
+
+    int ret;
+    if (uds) {
+        struct sockaddr_un addr;
+        const socklen_t len = makeUnixAddress(ep.udsPath, &addr);
+        ret = ::connect(in.fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(ep.port);
+        if (inet_pton(AF_INET, ep.host.c_str(), &addr.sin_addr) != 1) {
+            disconnect(index);
+            return;
+        }
+        const int one = 1;
+        setsockopt(in.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        ret = ::connect(in.fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLOUT;
+    ev.data.u64 = index;
+    if ((ret < 0 && errno != EINPROGRESS) || epoll_ctl(m_epollFd, EPOLL_CTL_ADD, in.fd, &ev) < 0) {
+        disconnect(index);
+        return;
+    }
+    in.state = State::CONNECTING;
+}
+
+// Closes the connection and tries again later, backing off while it fails.
+void FeedMux::disconnect(const int index) {
+    Instance& in = m_instances[index];
+    if (in.fd >= 0) {
+        close(in.fd);
+        in.fd = -1;
+    }
+    if (in.started) {
+        in.started = false;
+        --m_scenarios[in.scenario]->started;
+    }
+    in.state = State::IDLE;
+    in.writable = true;
+    in.skip = 0;
+    in.pending.clear();
+    in.first = in.end = 0;
+
+    in.backoffNs = in.backoffNs
+        ? std::min(in.backoffNs * 2, m_config.reconnectMaxNs) : m_config.reconnectMinNs;
+    in.retryNs = m_nowNs + in.backoffNs;
+    m_nextRetryNs = std::min(m_nextRetryNs, in.retryNs);
+    ++m_stats.reconnects;
+}
+
+void FeedMux::onConnected(const int index) {
+    Instance& in = m_instances[index];
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.u64 = index;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, in.fd, &ev);
+    in.state = State::CONNECTED;
+    in.backoffNs = 0;
+}
+
+void FeedMux::onReadable(const int index) {
+    Instance& in = m_instances[index];
+    char buf[256];
+    while (in.fd >= 0) {
+        const ssize_t n = recv(in.fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0 && errno == EAGAIN) {
+            return;
+        } else if (n <= 0) {
+            disconnect(index);  // the HAL closed the connection
+            return;
+        }
+        for (ssize_t i = 0; i < n && in.fd >= 0; ++i) {
+            if (in.skip > 0) {
+                --in.skip;
+            } else {
+                onControl(index, buf[i]);
+            }
+        }
+    }
+}
+
+void FeedMux::onControl(const int index, const char cmd) {
+    Instance& in = m_instances[index];
+    switch (cmd) {
+        case 0:
+            disconnect(index);  // the HAL quits, its next run connects again
+            break;
+        case 1:
+            if (!in.started) {
+                in.started = true;
+                ++m_scenarios[in.scenario]->started;
+            }
+            break;
+        case 2:
+            if (in.started) {
+                in.started = false;
+                --m_scenarios[in.scenario]->started;
+                in.first = in.end;  // what is written in part still goes
+            }
+            break;
+        case 3:  // a ping or a resume, with 8 bytes of payload
+        case 4:
+            in.skip = 8;
+            ++m_stats.ignored;
+            break;
+        default:
+            ++m_stats.ignored;
+            break;
+    }
+}
+
+void FeedMux::wait(const int timeoutMs) {
+    struct epoll_event events[kMaxEvents];
+    const int n = epoll_wait(m_epollFd, events, kMaxEvents, timeoutMs);
+    for (int i = 0; i < n; ++i) {
+        const int index = static_cast<int>(events[i].data.u64);
+        Instance& in = m_instances[index];
+        if (in.fd < 0) {
+            continue;  // closed for an earlier event
+        }
+
+        if (in.state == State::CONNECTING) {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(in.fd, SOL_SOCKET, SO_ERROR, &error, &len) < 0 || error) {
+                disconnect(index);
+            } else {
+                onConnected(index);
+            }
+            continue;
+        }
+
+        if (events[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR)) {
+            onReadable(index);
+        }
+        if (in.fd >= 0 && (events[i].events & EPOLLOUT)) {
+            flush(index);
+        }
+    }
+}
+
+void FeedMux::encode(Scenario* s, const uint64_t seq) {
+    NmeaFormat fmt;
+    fmt.timeDecimals = 3;
+    const TrajectoryPoint p = s->trajectory.at(Feeder::kBaseUtcMs + seq * s->epochMs);
+
+    std::string& out = s->ring[s->encoded % kRingEpochs];
+    char buf[256];
+    out.assign(buf, formatRMC(p, fmt, buf, sizeof(buf)));
+    out.append(buf, formatGGA(p, fmt, buf, sizeof(buf)));
+    if (s->config.vtg) {
+        out.append(buf, formatVTG(p, fmt, buf, sizeof(buf)));
+    }
+    if (s->config.gsvEvery > 0 && (seq % s->config.gsvEvery) == 0) {
+        for (int part = 1; part <= gsvParts(fmt); ++part) {
+            out.append(buf, formatGSV(p, fmt, part, buf, sizeof(buf)));
+        }
+    }
+    ++s->encoded;
+    ++m_stats.epochs;
+}
+
+void FeedMux::enqueue(const int index, const uint64_t encoded) {
+    Instance& in = m_instances[index];
+    if (in.first == in.end) {
+        in.first = encoded;
+    }
+    in.end = encoded + 1;
+    if (in.end - in.first > m_maxBacklog) {
+        m_stats.dropped += in.end - in.first - m_maxBacklog;
+        in.first = in.end - m_maxBacklog;
+    }
+}
+
+// Everything queued for the instance in one writev, what does not fit stays
+// for EPOLLOUT.
+void FeedMux::flush(const int index) {
+    Instance& in = m_instances[index];
+    const Scenario& s = *m_scenarios[in.scenario];
+
+    struct iovec iov[kRingEpochs + 1];
+    int count = 0;
+    if (!in.pending.empty()) {
+        iov[count].iov_base = const_cast<char*>(in.pending.data());
+        iov[count++].iov_len = in.pending.size();
+    }
+    for (uint64_t e = in.first; e < in.end; ++e) {
+        const std::string& epoch = s.ring[e % kRingEpochs];
+        iov[count].iov_base = const_cast<char*>(epoch.data());
+        iov[count++].iov_len = epoch.size();
+    }
+    if (count == 0) {
+        watchOutput(index, false);
+        return;
+    }
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    ssize_t n;
+    do {
+        n = sendmsg(in.fd, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno == EAGAIN) {
+            watchOutput(index, true);
+        } else {
+            disconnect(index);
+        }
+        return;
+    }
+    ++m_stats.writes;
+    m_stats.bytes += n;
+
+    size_t left = n;
+    if (!in.pending.empty()) {
+        if (left < in.pending.size()) {
+            in.pending.erase(0, left);
+            watchOutput(index, true);
+            return;
+        }
+        left -= in.pending.size();
+        in.pending.clear();
+        ++m_stats.delivered;
+    }
+    for (; in.first < in.end; ++in.first) {
+        const std::string& epoch = s.ring[in.first % kRingEpochs];
+        if (left < epoch.size()) {
+            if (left > 0) {
+                // keep the rest, the ring moves on without waiting for us
+                in.pending.assign(epoch, left, std::string::npos);
+                ++in.first;
+            }
+            watchOutput(index, true);
+            return;
+        }
+        left -= epoch.size();
+        ++m_stats.delivered;
+    }
+    watchOutput(index, false);
+}
+
+void FeedMux::watchOutput(const int index, const bool on) {
+    Instance& in = m_instances[index];
+    if (in.writable != on) {
+        return;
+    }
+    in.writable = !on;
+    struct epoll_event ev;
+    ev.events = on ? (EPOLLIN | EPOLLOUT) : EPOLLIN;
+    ev.data.u64 = index;
+    epoll_ctl(m_epollFd, EPOLL_CTL_MOD, in.fd, &ev);
+}
+
+int64_t FeedMux::tick(const int64_t nowNs) {
+    m_nowNs = nowNs;
+    if (m_epoch0Ns < 0) {
+        m_epoch0Ns = nowNs;
+    }
+
+    if (m_nextRetryNs <= nowNs) {
+        m_nextRetryNs = INT64_MAX;
+        for (size_t i = 0; i < m_instances.size(); ++i) {
+            Instance& in = m_instances[i];
+            if (in.state != State::IDLE) {
+                continue;
+            } else if (in.retryNs <= nowNs) {
+                connect(i);
+            } else {
+                m_nextRetryNs = std::min(m_nextRetryNs, in.retryNs);
+            }
+        }
+    }
+
+    int64_t nextNs = m_nextRetryNs;
+    for (const std::unique_ptr<Scenario>& s : m_scenarios) {
+        if (s->started == 0) {
+            continue;
+        }
+        const uint64_t due = (nowNs - m_epoch0Ns) / s->periodNs;
+        if (due >= s->nextSeq) {
+            // one epoch per tick, the ones a late tick missed are skipped
+            encode(s.get(), due);
+            s->nextSeq = due + 1;
+            for (const int index : s->instances) {
+                Instance& in = m_instances[index];
+                if (in.started) {
+                    enqueue(index, s->encoded - 1);
+                    if (in.writable) {
+                        flush(index);
+                    }
+                }
+            }
+        }
+        nextNs = std::min(nextNs, m_epoch0Ns + static_cast<int64_t>(s->nextSeq) * s->periodNs);
+    }
+    return nextNs;
+}
+
+FeedMux::Stats FeedMux::stats() const {
+    Stats stats = m_stats;
+    stats.instances = m_instances.size();
+    for (const Instance& in : m_instances) {
+        stats.connected += (in.state == State::CONNECTED);
+        stats.started += in.started;
+    }
+    return stats;
+}
+
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "impairment_proxy.h"
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace sim {
+
+// What an instance plays: the epochs of a trajectory at a rate. Instances on
+// the same scenario get the same bytes at the same time.
+struct MuxScenario {
+    double rateHz = 1;
+    int gsvEvery = 0;  // add GSV to every n-th epoch, 0 - never
+    bool vtg = false;  // add VTG to every epoch
+    double latitudeDegrees = 37.4220;
+    double longitudeDegrees = -122.0841;
+    double altitudeMeters = 30;
+    double speedMetersPerSec = 15;
+    double bearingDegrees = 0;
+    double turnRateDegreesPerSec = 2;
+};
+
+struct FeedMuxConfig {
+    // epochs queued for an instance which does not read, the oldest go first
+    size_t maxBacklogEpochs = 8;
+    int64_t reconnectMinNs = 250000000LL;
+    int64_t reconnectMaxNs = 8000000000LL;
+};
+
+// Feeds many HAL instances from one thread, in place of a Feeder process per
+// instance. It connects to the listener of every instance (virtual.gps.tcp.port,
+// or a unix socket, "@name" for the abstract namespace), reconnects when one
+// goes away, and speaks the control protocol of GnssHwConn per instance:
+// 0 - quit, 1 - start, 2 - stop. Pings and resumes are read and ignored:
+// the mux announces no capabilities, so the HAL treats it as a plain feed.
+//
+// Each scenario encodes an epoch once, into a ring the instances on it
+// share, and every instance gets it with one writev together with whatever
+// it has not taken yet. One epoll set covers all the sockets.
+//
+// Epoch `seq` of a scenario is due at seq periods after the first tick and
+// carries the UTC time Feeder::kBaseUtcMs + seq * epochMs, as a Feeder's
+// would. The epochs which fall due while no instance of a scenario is
+// started are skipped.
+class FeedMux {
+public:
+    struct Stats {
+        size_t instances = 0;
+        size_t connected = 0;
+        size_t started = 0;
+        uint64_t epochs = 0;      // encoded, once per scenario
+        uint64_t delivered = 0;   // epochs written out in full, per instance
+        uint64_t dropped = 0;     // from a full backlog
+        uint64_t writes = 0;      // writev calls
+        uint64_t bytes = 0;
+        uint64_t reconnects = 0;  // connections lost or refused
+        uint64_t ignored = 0;     // control bytes other than 0, 1 and 2
+    };
+
+    explicit FeedMux(const FeedMuxConfig& = {});
+    ~FeedMux();
+
+    FeedMux(const FeedMux&) = delete;
+    FeedMux& operator=(const FeedMux&) = delete;
+
+    // Return the index, or -1 if `scenario` is not one.
+    int addScenario(const MuxScenario&);
+    int addInstance(const Endpoint&, int scenario);
+
+    // Handles what the sockets have for up to `timeoutMs`.
+    void wait(int timeoutMs);
+    // Connects what is due to connect and sends the epochs due at `nowNs`
+    // (steady clock). Returns when it has something to do next.
+    int64_t tick(int64_t nowNs);
+
+    Stats stats() const;
+
+private:
+    static constexpr size_t kRingEpochs = 64;
+
+    struct Scenario {
+        Scenario(const MuxScenario&);
+
+        const MuxScenario config;
+        const Trajectory trajectory;
+        const int64_t epochMs;
+        const int64_t periodNs;
+        uint64_t nextSeq = 0;
+        uint64_t encoded = 0;  // epochs in the ring so far
+        std::string ring[kRingEpochs];
+        std::vector<int> instances;
+        int started = 0;
+    };
+
+    enum class State { IDLE, CONNECTING, CONNECTED };
+
+    struct Instance {
+        Endpoint endpoint;
+        int scenario = 0;
+        int fd = -1;
+        State state = State::IDLE;
+        bool started = false;
+        bool writable = true;  // false - waiting for EPOLLOUT
+        int skip = 0;          // payload bytes of a control message to come
+        // what to send: the unsent rest of an epoch written in part, then
+        // the epochs [first, end) of the ring of the scenario
+        std::string pending;
+        uint64_t first = 0;
+        uint64_t end = 0;
+        int64_t retryNs = 0;
+        int64_t backoffNs = 0;
+    };
+
+    void connect(int index);
+    void disconnect(int index);
+    void onConnected(int index);
+    void onReadable(int index);
+    void onControl(int index, char cmd);
+    void encode(Scenario*, uint64_t seq);
+    void enqueue(int index, uint64_t encoded);
+    void flush(int index);
+    void watchOutput(int index, bool on);
+
+    const FeedMuxConfig m_config;
+    const size_t m_maxBacklog;
+    const int m_epollFd;
+    std::vector<std::unique_ptr<Scenario>> m_scenarios;
+    std::vector<Instance> m_instances;
+    int64_t m_epoch0Ns = -1;
+    int64_t m_nowNs = 0;
+    int64_t m_nextRetryNs = 0;
+    Stats m_stats;
+};
+
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,436 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "feeder.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+namespace ciccloud {
+namespace sim {
+namespace {
+constexpr int64_t kDayMs = 24LL * 3600LL * 1000LL;
+constexpr int kHelloAttempts = 5;
+constexpr int64_t kHelloTimeoutNs = 200000000LL;
+
+uint64_t makeSessionId(const void* salt) {
+    // splitmix64 over the time and the address, unique enough for a feeder
+    uint64_t z = static_cast<uint64_t>(steadyNowNs()) ^ reinterpret_cast<uintptr_t>(salt) ^
+                 (static_cast<uint64_t>(getpid()) << 32);
+    z += 0x9e3779b97f4a7c15ULL;
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+int64_t clockNs(const clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+}  // namespace
+
+int64_t steadyNowNs() {
+    return clockNs(CLOCK_MONOTONIC);
+}
+
+Feeder::Feeder(const FeederConfig& config)
+    : m_config(config)
+    , m_trajectory(kBaseUtcMs, 37.4220, -122.0841, 30, 15, 0, 2)
+    , m_epochMs(epochMs(config.rateHz))
+    , m_periodNs(static_cast<int64_t>(1e9 / config.rateHz))
+    , m_sessionId(makeSessionId(this))
+    , m_lossState(m_sessionId | 1)
+    , m_stopRequested(false) {}
+
+Feeder::~Feeder() {
+    disconnect();
+}
+
+bool Feeder::connect() {
+    disconnect();
+
+    m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (m_fd < 0) {
+        return false;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(m_config.port);
+    if (inet_pton(AF_INET, m_config.host.c_str(), &addr.sin_addr) != 1 ||
+        ::connect(m_fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        disconnect();
+        return false;
+    }
+
+    const int one = 1;
+    setsockopt(m_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    if (m_config.udpPort) {
+        addr.sin_port = htons(m_config.udpPort);
+        m_udpFd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if (m_udpFd < 0 ||
+            ::connect(m_udpFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+            disconnect();
+            return false;
+        }
+    }
+    m_resync = (m_seq > 0);
+    m_started = false;
+    m_quit = false;
+    m_capsAcked = false;
+    m_helloDone = false;
+    m_numbered = false;
+    return true;
+}
+
+void Feeder::disconnect() {
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+    if (m_udpFd >= 0) {
+        close(m_udpFd);
+        m_udpFd = -1;
+    }
+}
+
+int64_t Feeder::epochMs(const double rateHz) {
+    return std::max<int64_t>(1, llround(1000 / rateHz));
+}
+
+int64_t Feeder::seqOf(const int64_t utcTimeOfDayMs, const int64_t epochMs) {
+    const int64_t base = kBaseUtcMs % kDayMs;
+    return (((utcTimeOfDayMs - base) % kDayMs + kDayMs) % kDayMs) / epochMs;
+}
+
+bool Feeder::pollControl(const int64_t timeoutNs) {
+    struct pollfd pfd = {.fd = m_fd, .events = POLLIN, .revents = 0};
+    struct timespec ts;
+    ts.tv_sec = timeoutNs / 1000000000LL;
+    ts.tv_nsec = timeoutNs % 1000000000LL;
+    if (ppoll(&pfd, 1, &ts, nullptr) <= 0) {
+        return true;
+    }
+
+    char cmd;
+    const ssize_t n = recv(m_fd, &cmd, 1, MSG_DONTWAIT);
+    if (n == 0) {
+        return false;  // the HAL closed the connection
+    } else if (n < 0) {
+        return (errno == EAGAIN) || (errno == EINTR);
+    }
+
+    switch (cmd) {
+        case 0: m_quit = true; break;
+        case 1: m_started = true; break;
+        case 2: m_started = false; break;
+        case 3: return answerPing();
+        case 4: {
+            char seq[8];
+            if (recv(m_fd, seq, sizeof(seq), MSG_WAITALL) != sizeof(seq)) {
+                return false;
+            }
+            m_resumeSeq = 0;
+            for (size_t i = 0; i < sizeof(seq); ++i) {
+                m_resumeSeq |= static_cast<uint64_t>(static_cast<unsigned char>(seq[i])) << (8 * i);
+            }
+            m_resumeReceived = true;
+            break;
+        }
+        default: break;
+    }
+    return !m_quit;
+}
+
+// Sleeps until the deadline, answering pings on the way: a ping left in the
+// socket until the next epoch would look like a long round trip.
+bool Feeder::waitUntil(const int64_t deadlineNs) {
+    for (int64_t nowNs = steadyNowNs(); nowNs < deadlineNs; nowNs = steadyNowNs()) {
+        if (!pollControl(deadlineNs - nowNs)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The clock the sentence times are in: epoch `seq` is due at its deadline
+// and carries kBaseUtcMs + seq * epochMs.
+int64_t Feeder::sentenceClockNs() const {
+    const int64_t epoch0Ns = m_deadlineNs - static_cast<int64_t>(m_seq) * m_periodNs;
+    const double scale = m_epochMs * 1e6 / m_periodNs;
+    return kBaseUtcMs * 1000000LL + static_cast<int64_t>((steadyNowNs() - epoch0Ns) * scale);
+}
+
+bool Feeder::answerPing() {
+    char t1[8];
+    if (recv(m_fd, t1, sizeof(t1), MSG_WAITALL) != sizeof(t1)) {
+        return false;
+    }
+    const int64_t t2Ns = sentenceClockNs();
+    m_capsAcked = true;
+    if (!m_config.timeSync) {
+        return true;
+    }
+
+    uint64_t t1Ns = 0;
+    for (size_t i = 0; i < sizeof(t1); ++i) {
+        t1Ns |= static_cast<uint64_t>(static_cast<unsigned char>(t1[i])) << (8 * i);
+    }
+
+    char buf[128];
+    const int len = snprintf(buf, sizeof(buf), "$PCCTS,%lld,%lld,%lld",
+                             static_cast<long long>(t1Ns), static_cast<long long>(t2Ns),
+                             static_cast<long long>(sentenceClockNs()));
+    return sendSentences(buf, finishSentence(buf, len, sizeof(buf)));
+}
+
+void Feeder::appendCapabilities(std::string* out) const {
+    char buf[64];
+    const int len = snprintf(buf, sizeof(buf), "$PCCCAP%s%s",
+                             m_config.timeSync ? ",TS" : "", resumable() ? ",SEQ" : "");
+    out->append(buf, finishSentence(buf, len, sizeof(buf)));
+}
+
+void Feeder::appendHeader(const uint64_t seq, std::string* out) const {
+    char buf[64];
+    const int len = snprintf(buf, sizeof(buf), "$PCCSEQ,%016llx,%llu",
+                             static_cast<unsigned long long>(m_sessionId),
+                             static_cast<unsigned long long>(seq));
+    out->append(buf, finishSentence(buf, len, sizeof(buf)));
+}
+
+void Feeder::appendPriority(std::string* out) const {
+    char buf[32];
+    const int len = snprintf(buf, sizeof(buf), "$PCCPRI,%d", m_config.priority);
+    out->append(buf, finishSentence(buf, len, sizeof(buf)));
+}
+
+// Says hello and replays what the HAL did not get, see FeedSession. A HAL
+// which does not answer does not know sessions: we go on without seqs.
+bool Feeder::hello() {
+    m_helloDone = true;
+    m_resumeReceived = false;
+
+    std::string msg;
+    char buf[64];
+    for (int attempt = 0; attempt < kHelloAttempts && !m_resumeReceived; ++attempt) {
+        // it may come before the HAL runs and be ignored, so say it again
+        msg.clear();
+        appendCapabilities(&msg);
+        const int len = snprintf(buf, sizeof(buf), "$PCCSES,%016llx,%llu",
+                                 static_cast<unsigned long long>(m_sessionId),
+                                 static_cast<unsigned long long>(m_recordSeq));
+        msg.append(buf, finishSentence(buf, len, sizeof(buf)));
+        if (!writeAll(msg.data(), msg.size())) {
+            return false;
+        }
+
+        const int64_t deadlineNs = steadyNowNs() + kHelloTimeoutNs;
+        for (int64_t nowNs = steadyNowNs(); !m_resumeReceived && nowNs < deadlineNs;
+             nowNs = steadyNowNs()) {
+            if (!pollControl(deadlineNs - nowNs)) {
+                return false;
+            }
+        }
+    }
+    if (!m_resumeReceived) {
+        return true;
+    }
+    m_capsAcked = true;
+    m_numbered = true;
+
+    const uint64_t windowFirstSeq = m_recordSeq - m_window.size();
+    const uint64_t from = std::max(m_resumeSeq, windowFirstSeq);
+    if (from >= m_recordSeq) {
+        return true;
+    }
+    msg.clear();
+    appendHeader(from, &msg);
+    for (uint64_t seq = from; seq < m_recordSeq; ++seq) {
+        msg.append(m_window[seq - windowFirstSeq]);
+        ++m_replayed;
+    }
+    return writeAll(msg.data(), msg.size());
+}
+
+bool Feeder::writeAll(const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = send(m_fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+// Over TCP, or as one datagram. A datagram lost on the way is no error,
+// that is what datagrams are for.
+bool Feeder::sendSentences(const char* data, const size_t size) {
+    if (m_udpFd < 0) {
+        // as a network would cut it, TCP_NODELAY keeps the pieces apart
+        const size_t piece = m_config.segmentBytes ? m_config.segmentBytes : size;
+        for (size_t off = 0; off < size; off += piece) {
+            if (!writeAll(data + off, std::min(piece, size - off))) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    char buf[64];
+    const int len = snprintf(buf, sizeof(buf), "$PCCDG,%016llx,%llu",
+                             static_cast<unsigned long long>(m_sessionId),
+                             static_cast<unsigned long long>(++m_datagramSeq));
+    m_datagram.assign(buf, finishSentence(buf, len, sizeof(buf)));
+    m_datagram.append(data, size);
+
+    if (m_config.datagramLoss > 0) {
+        m_lossState ^= m_lossState << 13;
+        m_lossState ^= m_lossState >> 7;
+        m_lossState ^= m_lossState << 17;
+        if ((m_lossState >> 11) * (1.0 / 9007199254740992.0) < m_config.datagramLoss) {
+            ++m_datagramsDropped;
+            return true;
+        }
+    }
+    send(m_udpFd, m_datagram.data(), m_datagram.size(), MSG_NOSIGNAL);
+    return true;
+}
+
+uint64_t Feeder::run(const uint64_t endSeq, std::atomic<int64_t>* sendTimesNs) {
+    const int64_t periodNs = static_cast<int64_t>(1e9 / m_config.rateHz);
+    NmeaFormat fmt;
+    fmt.timeDecimals = 3;
+
+    std::string epoch;
+    std::vector<std::string> sentences;
+    char buf[256];
+
+    while (m_seq < endSeq && !m_stopRequested && m_fd >= 0) {
+        if (!m_started) {
+            if (!pollControl(100000000LL)) {
+                break;
+            }
+            if (m_started && !m_resync && m_config.epoch0Ns) {
+                // join the shared schedule with the next epoch due
+                const int64_t nowNs = steadyNowNs();
+                m_seq = (nowNs > m_config.epoch0Ns)
+                    ? (nowNs - m_config.epoch0Ns + periodNs - 1) / periodNs : 0;
+                m_deadlineNs = m_config.epoch0Ns + static_cast<int64_t>(m_seq) * periodNs;
+            } else if (m_started && !m_resync) {
+                m_deadlineNs = steadyNowNs();  // a new session or a resumed one
+            }
+            continue;
+        } else if (!pollControl(0)) {
+            break;
+        } else if (resumable() && !m_helloDone) {
+            if (!hello()) {
+                break;
+            }
+            continue;
+        }
+
+        if (m_resync) {
+            // skip what fell due while we were disconnected
+            m_resync = false;
+            const int64_t nowNs = steadyNowNs();
+            if (m_deadlineNs < nowNs) {
+                const uint64_t missed = (nowNs - m_deadlineNs) / periodNs;
+                m_seq += missed;
+                m_deadlineNs += missed * periodNs;
+                if (m_seq >= endSeq) {
+                    break;
+                }
+            }
+        }
+
+        const TrajectoryPoint p = m_trajectory.at(kBaseUtcMs + m_seq * m_epochMs);
+        sentences.clear();
+        sentences.emplace_back(buf, formatRMC(p, fmt, buf, sizeof(buf)));
+        sentences.emplace_back(buf, formatGGA(p, fmt, buf, sizeof(buf)));
+        if (m_config.vtg) {
+            sentences.emplace_back(buf, formatVTG(p, fmt, buf, sizeof(buf)));
+        }
+        if (m_config.gsvEvery > 0 && (m_seq % m_config.gsvEvery) == 0) {
+            for (int part = 1; part <= gsvParts(fmt); ++part) {
+                sentences.emplace_back(buf, formatGSV(p, fmt, part, buf, sizeof(buf)));
+            }
+        }
+
+        if (!waitUntil(m_deadlineNs)) {
+            break;
+        }
+
+        epoch.clear();
+        if (m_config.timeSync && !m_capsAcked) {
+            // until the HAL reacts, it may have missed it while not running
+            appendCapabilities(&epoch);
+        }
+        if (m_config.priority >= 0) {
+            appendPriority(&epoch);
+        }
+        if (m_numbered) {
+            appendHeader(m_recordSeq, &epoch);
+        }
+        for (std::string& s : sentences) {
+            epoch.append(s);
+            if (resumable()) {
+                m_window.push_back(std::move(s));
+                if (m_window.size() > m_config.retransmitWindow) {
+                    m_window.pop_front();
+                }
+            }
+            ++m_recordSeq;
+        }
+
+        if (sendTimesNs) {
+            sendTimesNs[m_seq].store(steadyNowNs(), std::memory_order_relaxed);
+        }
+        const bool sent = sendSentences(epoch.data(), epoch.size());
+        if (sent || m_numbered) {
+            // a numbered epoch is in the window now, a replay will deliver it
+            ++m_seq;
+            m_deadlineNs += periodNs;
+        }
+        if (!sent) {
+            break;
+        }
+    }
+
+    return m_seq;
+}
+
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace sim {
+
+struct FeederConfig {
+    std::string host = "127.0.0.1";
+    uint16_t port = 8766;  // virtual.gps.tcp.port of the instance
+    double rateHz = 1;     // epochs per second
+    int gsvEvery = 0;      // add GSV to every n-th epoch, 0 - never
+    bool vtg = false;      // add VTG to every epoch
+    bool timeSync = true;  // announce "TS" in $PCCCAP and answer time pings
+    bool resume = true;    // announce "SEQ", number sentences, replay after reconnect
+    size_t retransmitWindow = 64;  // sentences kept for a replay
+    uint16_t udpPort = 0;  // send the sentences as datagrams to it, 0 - over TCP
+    double datagramLoss = 0;  // the share of datagrams dropped on purpose
+    size_t segmentBytes = 0;  // over TCP, write epochs in pieces of this size, 0 - whole
+    int priority = -1;        // announced with every epoch ($PCCPRI), -1 - not
+    // when epoch 0 is due (steady clock), 0 - when started. Feeders with the
+    // same one send the same epochs at the same time, as redundant receivers
+    // would, see FeedArbiter.
+    int64_t epoch0Ns = 0;
+};
+
+// A feeder for the HAL socket: it connects, waits for the start control byte
+// and sends RMC+GGA epochs at the configured rate until stopped. It speaks
+// the control protocol of GnssHwConn: 0 - quit, 1 - start, 2 - stop, and
+// 3 - a time ping with 8 bytes of payload, answered with $PCCTS, 4 - resume
+// from the seq in the 8 bytes of payload, the answer to a $PCCSES hello
+// (see FeedSession).
+//
+// With a udpPort, the TCP connection carries the control bytes only and
+// every epoch goes into one datagram with a $PCCDG header (see
+// DatagramFeed), pongs into datagrams of their own. There is no replay then.
+//
+// Epoch `seq` carries the synthetic UTC time kBaseUtcMs + seq * epochMs, so a
+// receiver can tell which epoch a fix came from (see seqOf). epochMs is the
+// period rounded to milliseconds, at least 1: above 1 kHz the sentence time
+// runs faster than real time.
+class Feeder {
+public:
+    static constexpr int64_t kBaseUtcMs = 1585742400000LL;  // 2020-04-01 12:00 UTC
+
+    explicit Feeder(const FeederConfig&);
+    ~Feeder();
+
+    bool connect();
+
+    // Sends epochs until `endSeq`, returns the next seq. Returns early on
+    // quit, a closed connection or requestStop(). The send time of each epoch
+    // is written to `sendTimesNs[seq]` (steady clock) if it is not null.
+    //
+    // The schedule is kept across connect() calls: like a real time feed, the
+    // epochs which fell due while disconnected are skipped, not sent late.
+    uint64_t run(uint64_t endSeq, std::atomic<int64_t>* sendTimesNs);
+    void requestStop() { m_stopRequested = true; }
+
+    // Closes the socket, as a disconnecting feeder would.
+    void disconnect();
+
+    // Sentences sent again after a reconnect.
+    uint64_t replayed() const { return m_replayed; }
+    // Datagrams dropped for datagramLoss.
+    uint64_t datagramsDropped() const { return m_datagramsDropped; }
+
+    static int64_t epochMs(double rateHz);
+    static int64_t seqOf(int64_t utcTimeOfDayMs, int64_t epochMs);
+
+private:
+    bool pollControl(int64_t timeoutNs);
+    bool waitUntil(int64_t deadlineNs);
+    bool answerPing();
+    bool hello();
+    void appendCapabilities(std::string* out) const;
+    void appendHeader(uint64_t seq, std::string* out) const;
+    void appendPriority(std::string* out) const;
+    int64_t sentenceClockNs() const;
+    bool writeAll(const char* data, size_t size);
+    bool sendSentences(const char* data, size_t size);
+    bool resumable() const { return m_config.resume && m_udpFd < 0; }
+
+    const FeederConfig m_config;
+    const Trajectory m_trajectory;
+    const int64_t m_epochMs;
+    const int64_t m_periodNs;
+    int m_fd = -1;
+    int m_udpFd = -1;
+    uint64_t m_seq = 0;
+    int64_t m_deadlineNs = 0;  // of m_seq
+    bool m_resync = false;      // reconnected, catch up with the schedule
+    bool m_started = false;
+    bool m_quit = false;
+    bool m_capsAcked = false;  // stop announcing once the HAL reacts
+    bool m_helloDone = false;
+    bool m_numbered = false;   // the HAL resumed us, sentences carry seqs
+    bool m_resumeReceived = false;
+    uint64_t m_resumeSeq = 0;
+
+    const uint64_t m_sessionId;
+    uint64_t m_recordSeq = 0;  // of the next data sentence
+    std::deque<std::string> m_window;  // the sentences before m_recordSeq
+    uint64_t m_replayed = 0;
+    uint64_t m_datagramSeq = 0;
+    uint64_t m_datagramsDropped = 0;
+    uint64_t m_lossState;  // xorshift
+    std::string m_datagram;
+    std::atomic<bool> m_stopRequested;
+};
+
+int64_t steadyNowNs();
+
+}  // namespace sim
+}  // namespace ciccloud
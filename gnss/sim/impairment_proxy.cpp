@@ -0,0 +1,314 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "impairment_proxy.h"
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "feeder.h"
+
+namespace ciccloud {
+namespace sim {
+namespace {
+constexpr size_t kMaxQueuedBytes = 1 << 20;  // stop reading the feeder above this
+
+int makeSocket(const Endpoint& ep, const bool server) {
+    const bool uds = !ep.udsPath.empty();
+    const int fd = socket(uds ? AF_UNIX : AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    int ret;
+    if (uds) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, ep.udsPath.c_str(), sizeof(addr.sun_path) - 1);
+        if (server) {
+            unlink(addr.sun_path);
+            ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        } else {
+            ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        }
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(ep.port);
+        if (inet_pton(AF_INET, ep.host.c_str(), &addr.sin_addr) != 1) {
+            close(fd);
+            return -1;
+        }
+        if (server) {
+            const int one = 1;
+            setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+            ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+        } else {
+            ret = connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+            if (ret == 0) {
+                const int one = 1;
+                setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+            }
+        }
+    }
+
+    if (ret < 0 || (server && listen(fd, 4) < 0)) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool sendAll(const int fd, const char* data, size_t size) {
+    while (size > 0) {
+        const ssize_t n = send(fd, data, size, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += n;
+        size -= n;
+    }
+    return true;
+}
+
+void closeFd(int* fd) {
+    if (*fd >= 0) {
+        close(*fd);
+        *fd = -1;
+    }
+}
+}  // namespace
+
+ImpairmentProxy::ImpairmentProxy(const Endpoint& listen, const Endpoint& upstream,
+                                 const ImpairmentConfig& config)
+    : m_listen(listen)
+    , m_upstream(upstream)
+    , m_config(config)
+    , m_rng(config.seed ? config.seed : 1) {}
+
+ImpairmentProxy::~ImpairmentProxy() {
+    stop();
+}
+
+bool ImpairmentProxy::start() {
+    m_listenFd = makeSocket(m_listen, true);
+    if (m_listenFd < 0) {
+        return false;
+    }
+    if (pipe2(m_wakeFd, O_CLOEXEC | O_NONBLOCK) < 0) {
+        closeFd(&m_listenFd);
+        return false;
+    }
+
+    m_quit = false;
+    m_thread = std::thread(&ImpairmentProxy::threadLoop, this);
+    return true;
+}
+
+void ImpairmentProxy::stop() {
+    if (m_thread.joinable()) {
+        m_quit = true;
+        const char c = 0;
+        (void)!write(m_wakeFd[1], &c, 1);
+        m_thread.join();
+    }
+    closeConnections();
+    closeFd(&m_listenFd);
+    closeFd(&m_wakeFd[0]);
+    closeFd(&m_wakeFd[1]);
+    if (!m_listen.udsPath.empty()) {
+        unlink(m_listen.udsPath.c_str());
+    }
+}
+
+std::vector<int64_t> ImpairmentProxy::disconnectTimesNs() const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    return m_disconnectTimesNs;
+}
+
+void ImpairmentProxy::closeConnections() {
+    closeFd(&m_downFd);
+    closeFd(&m_upFd);
+    m_queue.clear();
+}
+
+uint64_t ImpairmentProxy::nextRandom() {
+    // xorshift64*, good enough for delays and reproducible across runs
+    m_rng ^= m_rng >> 12;
+    m_rng ^= m_rng << 25;
+    m_rng ^= m_rng >> 27;
+    return m_rng * 2685821657736338717ULL;
+}
+
+int64_t ImpairmentProxy::sampleDelayNs() {
+    const auto uniform = [this]() {
+        return (nextRandom() >> 11) * (1.0 / 9007199254740992.0);
+    };
+
+    double ms = m_config.delayMs;
+    switch (m_config.distribution) {
+        case DelayDistribution::CONSTANT:
+            break;
+        case DelayDistribution::UNIFORM:
+            ms += (2 * uniform() - 1) * m_config.jitterMs;
+            break;
+        case DelayDistribution::NORMAL: {
+            const double u1 = std::max(uniform(), 1e-12);
+            const double u2 = uniform();
+            ms += m_config.jitterMs * std::sqrt(-2 * std::log(u1)) * std::cos(2 * M_PI * u2);
+            break;
+        }
+        case DelayDistribution::PARETO: {
+            // shape 2: the mean of the tail is 2 * scale
+            constexpr double kShape = 2;
+            const double scale = m_config.jitterMs / 2;
+            ms += scale / std::pow(std::max(uniform(), 1e-12), 1 / kShape) - scale;
+            break;
+        }
+    }
+    return static_cast<int64_t>(std::max(0.0, ms) * 1e6);
+}
+
+void ImpairmentProxy::threadLoop() {
+    const int64_t disconnectPeriodNs = static_cast<int64_t>(m_config.disconnectEverySec * 1e9);
+    int64_t nextDisconnectNs = INT64_MAX;
+    size_t queuedBytes = 0;
+    char buf[4096];
+
+    while (!m_quit) {
+        const int64_t nowNs = steadyNowNs();
+
+        if (m_downFd >= 0 && (m_disconnectRequested.exchange(false) || nowNs >= nextDisconnectNs)) {
+            closeConnections();
+            queuedBytes = 0;
+            nextDisconnectNs = INT64_MAX;
+            std::lock_guard<std::mutex> lock(m_mtx);
+            m_disconnectTimesNs.push_back(nowNs);
+        }
+
+        // release what is due, in order
+        size_t released = 0;
+        while (released < m_queue.size() && m_queue[released].releaseNs <= nowNs) {
+            const std::string& data = m_queue[released].data;
+            if (m_upFd >= 0 && sendAll(m_upFd, data.data(), data.size())) {
+                m_bytesForwarded += data.size();
+                ++m_writes;
+            }
+            queuedBytes -= data.size();
+            ++released;
+        }
+        m_queue.erase(m_queue.begin(), m_queue.begin() + released);
+        if (m_downFd < 0 && m_queue.empty()) {
+            closeFd(&m_upFd);  // drained after the feeder closed
+        }
+
+        int64_t wakeNs = std::min(nextDisconnectNs,
+                                  m_queue.empty() ? INT64_MAX : m_queue.front().releaseNs);
+        const int timeoutMs = (wakeNs == INT64_MAX)
+            ? 100  // to notice disconnect()
+            : static_cast<int>(std::min<int64_t>(100, (std::max<int64_t>(0, wakeNs - nowNs) + 999999) / 1000000));
+
+        struct pollfd pfds[4];
+        int n = 0;
+        pfds[n++] = {.fd = m_wakeFd[0], .events = POLLIN, .revents = 0};
+        pfds[n++] = {.fd = m_listenFd, .events = static_cast<short>(m_upFd < 0 ? POLLIN : 0), .revents = 0};
+        pfds[n++] = {.fd = m_downFd, .events = static_cast<short>(queuedBytes < kMaxQueuedBytes ? POLLIN : 0), .revents = 0};
+        pfds[n++] = {.fd = m_upFd, .events = POLLIN, .revents = 0};
+        if (poll(pfds, n, timeoutMs) <= 0) {
+            continue;
+        }
+
+        if (pfds[0].revents) {
+            while (read(m_wakeFd[0], buf, sizeof(buf)) > 0) {
+            }
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            const int fd = accept4(m_listenFd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (fd >= 0) {
+                m_upFd = makeSocket(m_upstream, false);
+                if (m_upFd < 0) {
+                    close(fd);  // the feeder will retry
+                } else {
+                    m_downFd = fd;
+                    m_lastReleaseNs = 0;
+                    m_linkFreeNs = 0;
+                    if (disconnectPeriodNs > 0) {
+                        nextDisconnectNs = steadyNowNs() + disconnectPeriodNs;
+                    }
+                }
+            }
+        }
+
+        if (pfds[2].revents & (POLLIN | POLLHUP | POLLERR)) {
+            const ssize_t len = recv(m_downFd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR)) {
+                // the feeder went away, what it sent is still delivered
+                closeFd(&m_downFd);
+                nextDisconnectNs = INT64_MAX;
+            } else if (len > 0) {
+                const int64_t rxNs = steadyNowNs();
+                for (ssize_t offset = 0; offset < len;) {
+                    size_t size = len - offset;
+                    if (m_config.maxChunk > 0) {
+                        const size_t chunk = 1 + nextRandom() % m_config.maxChunk;
+                        size = std::min(size, chunk);
+                    }
+                    // serialize onto the link, then propagate; a TCP stream
+                    // does not reorder, so never release before the previous chunk
+                    int64_t sentNs = rxNs;
+                    if (m_config.bandwidthBytesPerSec > 0) {
+                        sentNs = std::max(sentNs, m_linkFreeNs) +
+                                 static_cast<int64_t>(size * 1e9 / m_config.bandwidthBytesPerSec);
+                        m_linkFreeNs = sentNs;
+                    }
+                    const int64_t releaseNs = std::max(sentNs + sampleDelayNs(), m_lastReleaseNs);
+                    m_lastReleaseNs = releaseNs;
+                    m_queue.push_back({releaseNs, std::string(buf + offset, size)});
+                    queuedBytes += size;
+                    offset += size;
+                }
+            }
+        }
+
+        if (m_upFd >= 0 && (pfds[3].revents & (POLLIN | POLLHUP | POLLERR))) {
+            // control bytes from the HAL are not impaired
+            const ssize_t len = recv(m_upFd, buf, sizeof(buf), MSG_DONTWAIT);
+            if (len == 0 || (len < 0 && errno != EAGAIN && errno != EINTR) ||
+                (len > 0 && m_downFd >= 0 && !sendAll(m_downFd, buf, len))) {
+                closeConnections();
+                queuedBytes = 0;
+                nextDisconnectNs = INT64_MAX;
+            }
+        }
+    }
+}
+
+}  // namespace sim
+}  // namespace ciccloud
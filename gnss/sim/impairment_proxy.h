@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ciccloud {
+namespace sim {
+
+// A TCP port on the loopback, or a unix domain socket when `udsPath` is set.
+struct Endpoint {
+    std::string host = "127.0.0.1";
+    uint16_t port = 0;
+    std::string udsPath;
+};
+
+enum class DelayDistribution {
+    CONSTANT,  // delayMs
+    UNIFORM,   // delayMs +- jitterMs
+    NORMAL,    // mean delayMs, stddev jitterMs
+    PARETO,    // delayMs plus a heavy tailed part with mean jitterMs
+};
+
+struct ImpairmentConfig {
+    DelayDistribution distribution = DelayDistribution::CONSTANT;
+    double delayMs = 0;
+    double jitterMs = 0;
+    double bandwidthBytesPerSec = 0;  // 0 - unlimited
+    int maxChunk = 0;                 // split writes into 1..maxChunk bytes, 0 - as read
+    double disconnectEverySec = 0;    // force a disconnect periodically, 0 - never
+    uint32_t seed = 1;
+};
+
+// Sits between a feeder and GnssHwConn and impairs the feeder -> HAL
+// direction: delay and jitter (data is never reordered, as with TCP), a
+// bandwidth cap, writes which split sentences anywhere, even mid-field, and
+// forced disconnects. Control bytes from the HAL pass through.
+class ImpairmentProxy {
+public:
+    ImpairmentProxy(const Endpoint& listen, const Endpoint& upstream, const ImpairmentConfig&);
+    ~ImpairmentProxy();
+
+    bool start();
+    void stop();
+
+    // Drops both connections now, data in flight is lost.
+    void disconnect() { m_disconnectRequested = true; }
+
+    // Steady clock times of the disconnects so far.
+    std::vector<int64_t> disconnectTimesNs() const;
+    uint64_t bytesForwarded() const { return m_bytesForwarded; }
+    uint64_t writes() const { return m_writes; }
+
+private:
+    struct Chunk {
+        int64_t releaseNs;
+        std::string data;
+    };
+
+    void threadLoop();
+    void closeConnections();
+    uint64_t nextRandom();
+    int64_t sampleDelayNs();
+
+    const Endpoint m_listen;
+    const Endpoint m_upstream;
+    const ImpairmentConfig m_config;
+
+    int m_listenFd = -1;
+    int m_downFd = -1;  // the feeder
+    int m_upFd = -1;    // GnssHwConn
+    int m_wakeFd[2] = {-1, -1};
+
+    std::vector<Chunk> m_queue;  // ordered by releaseNs
+    int64_t m_lastReleaseNs = 0;
+    int64_t m_linkFreeNs = 0;  // with a bandwidth cap
+    uint64_t m_rng;
+
+    std::thread m_thread;
+    std::atomic<bool> m_quit{false};
+    std::atomic<bool> m_disconnectRequested{false};
+    std::atomic<uint64_t> m_bytesForwarded{0};
+    std::atomic<uint64_t> m_writes{0};
+    mutable std::mutex m_mtx;
+    std::vector<int64_t> m_disconnectTimesNs;
+};
+
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "nmea_generator.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+namespace ciccloud {
+namespace sim {
+namespace {
+constexpr double kEarthRadiusM = 6371000.0;
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kMpsToKnots = 1.0 / 0.514444;
+constexpr int kMaxUsedInFix = 12;
+
+double deg2rad(const double d) { return d * kPi / 180.0; }
+
+int64_t pow10(int n) {
+    int64_t r = 1;
+    for (; n > 0; --n) {
+        r *= 10;
+    }
+    return r;
+}
+
+// civil date from days since 1970-01-01 (Howard Hinnant's algorithm)
+void civilFromDays(int64_t z, int* y, int* m, int* d) {
+    z += 719468;
+    const int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+    const int64_t doe = z - era * 146097;
+    const int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    const int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    const int64_t mp = (5 * doy + 2) / 153;
+    *d = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    *m = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    *y = static_cast<int>(yoe + era * 400 + (*m <= 2));
+}
+
+// A formatter which tracks the remaining space, any overflow turns into 0.
+class Writer {
+public:
+    Writer(char* out, size_t size) : m_out(out), m_size(size) {}
+
+    __attribute__((format(printf, 2, 3)))
+    void printf(const char* fmt, ...) {
+        if (m_len >= m_size) {
+            return;
+        }
+        va_list ap;
+        va_start(ap, fmt);
+        const int n = vsnprintf(m_out + m_len, m_size - m_len, fmt, ap);
+        va_end(ap);
+        m_len = (n < 0) ? m_size : (m_len + n);
+    }
+
+    void time(const int64_t utcMs, const int decimals) {
+        const int64_t msOfDay = ((utcMs % 86400000) + 86400000) % 86400000;
+        const int hh = msOfDay / 3600000;
+        const int mm = (msOfDay / 60000) % 60;
+        const int ss = (msOfDay / 1000) % 60;
+        printf("%02d%02d%02d", hh, mm, ss);
+        if (decimals > 0) {
+            const int64_t frac = (msOfDay % 1000) * pow10(decimals) / 1000;
+            printf(".%0*lld", decimals, static_cast<long long>(frac));
+        }
+    }
+
+    // ddmm.mmmm or dddmm.mmmm followed by ",N" / ",S" / ",E" / ",W"
+    void angle(const double deg, const int degDigits, const int decimals,
+               const char pos, const char neg) {
+        const int64_t scale = pow10(decimals);
+        const int64_t units = std::llround(std::fabs(deg) * 60.0 * scale);
+        const int64_t d = units / (60 * scale);
+        const int64_t m = (units / scale) % 60;
+        const int64_t f = units % scale;
+        printf("%0*lld%02lld", degDigits, static_cast<long long>(d), static_cast<long long>(m));
+        if (decimals > 0) {
+            printf(".%0*lld", decimals, static_cast<long long>(f));
+        }
+        printf(",%c", (deg < 0) ? neg : pos);
+    }
+
+    size_t finish() { return finishSentence(m_out, m_len, m_size); }
+
+private:
+    char* const m_out;
+    const size_t m_size;
+    size_t m_len = 0;
+};
+
+// Pseudo satellite geometry which changes slowly with time.
+void satellite(const TrajectoryPoint& p, const int i, int* svid, int* elev, int* az, int* cn0) {
+    const int64_t minutes = p.utcMs / 60000;
+    *svid = 1 + ((i * 7 + 3) % 32);
+    *elev = 10 + static_cast<int>((i * 13 + minutes) % 80);
+    *az = static_cast<int>((i * 47 + minutes * 3) % 360);
+    *cn0 = 20 + static_cast<int>((i * 5 + minutes) % 30);
+}
+
+}  // namespace
+
+Trajectory::Trajectory(const int64_t startUtcMs, const double latitudeDegrees,
+                       const double longitudeDegrees, const double altitudeMeters,
+                       const double speedMetersPerSec, const double bearingDegrees,
+                       const double turnRateDegreesPerSec)
+    : m_startUtcMs(startUtcMs)
+    , m_lat0(latitudeDegrees)
+    , m_lon0(longitudeDegrees)
+    , m_alt0(altitudeMeters)
+    , m_speed(speedMetersPerSec)
+    , m_bearing0(bearingDegrees)
+    , m_turnRate(turnRateDegreesPerSec) {}
+
+TrajectoryPoint Trajectory::at(const int64_t utcMs) const {
+    const double t = (utcMs - m_startUtcMs) / 1000.0;
+    const double b0 = deg2rad(m_bearing0);
+    const double w = deg2rad(m_turnRate);
+    const double b = b0 + w * t;
+
+    double east;
+    double north;
+    if (std::fabs(w) < 1e-9) {
+        east = m_speed * t * std::sin(b0);
+        north = m_speed * t * std::cos(b0);
+    } else {
+        east = (m_speed / w) * (std::cos(b0) - std::cos(b));
+        north = (m_speed / w) * (std::sin(b) - std::sin(b0));
+    }
+
+    TrajectoryPoint p;
+    p.utcMs = utcMs;
+    p.latitudeDegrees = m_lat0 + (north / kEarthRadiusM) * 180.0 / kPi;
+    p.longitudeDegrees = m_lon0 + (east / (kEarthRadiusM * std::cos(deg2rad(m_lat0)))) * 180.0 / kPi;
+    p.altitudeMeters = m_alt0 + 5.0 * std::sin(t / 60.0);
+    p.speedMetersPerSec = m_speed;
+    p.bearingDegrees = std::fmod(std::fmod(m_bearing0 + m_turnRate * t, 360.0) + 360.0, 360.0);
+    return p;
+}
+
+size_t finishSentence(char* out, const size_t len, const size_t size) {
+    if (len < 1 || (len + 6) > size) {
+        return 0;
+    }
+
+    unsigned char sum = 0;
+    for (size_t i = 1; i < len; ++i) {
+        sum ^= static_cast<unsigned char>(out[i]);
+    }
+    snprintf(out + len, size - len, "*%02X\r\n", sum);
+    return len + 5;
+}
+
+size_t formatRMC(const TrajectoryPoint& p, const NmeaFormat& fmt, char* out, const size_t size) {
+    int year;
+    int month;
+    int day;
+    civilFromDays(p.utcMs / 86400000, &year, &month, &day);
+
+    Writer w(out, size);
+    w.printf("$%sRMC,", fmt.talker);
+    w.time(p.utcMs, fmt.timeDecimals);
+    w.printf(",%c,", fmt.valid ? 'A' : 'V');
+    w.angle(p.latitudeDegrees, 2, fmt.latLonDecimals, 'N', 'S');
+    w.printf(",");
+    w.angle(p.longitudeDegrees, 3, fmt.latLonDecimals, 'E', 'W');
+    w.printf(",%.1f,%.1f,%02d%02d%02d,004.2,W",
+             p.speedMetersPerSec * kMpsToKnots, p.bearingDegrees,
+             day, month, year % 100);
+    return w.finish();
+}
+
+size_t formatGGA(const TrajectoryPoint& p, const NmeaFormat& fmt, char* out, const size_t size) {
+    Writer w(out, size);
+    w.printf("$%sGGA,", fmt.talker);
+    w.time(p.utcMs, fmt.timeDecimals);
+    w.printf(",");
+    w.angle(p.latitudeDegrees, 2, fmt.latLonDecimals, 'N', 'S');
+    w.printf(",");
+    w.angle(p.longitudeDegrees, 3, fmt.latLonDecimals, 'E', 'W');
+    w.printf(",%d,%02d,0.9,%.1f,M,46.9,M,,", fmt.valid ? 1 : 0,
+             std::min(fmt.satellites, kMaxUsedInFix), p.altitudeMeters);
+    return w.finish();
+}
+
+size_t formatVTG(const TrajectoryPoint& p, const NmeaFormat& fmt, char* out, const size_t size) {
+    Writer w(out, size);
+    w.printf("$%sVTG,%.1f,T,,M,%.1f,N,%.1f,K,A", fmt.talker, p.bearingDegrees,
+             p.speedMetersPerSec * kMpsToKnots, p.speedMetersPerSec * 3.6);
+    return w.finish();
+}
+
+size_t formatGSA(const TrajectoryPoint& p, const NmeaFormat& fmt, char* out, const size_t size) {
+    Writer w(out, size);
+    w.printf("$%sGSA,A,%d", fmt.talker, fmt.valid ? 3 : 1);
+    for (int i = 0; i < kMaxUsedInFix; ++i) {
+        if (i < fmt.satellites) {
+            int svid;
+            int elev;
+            int az;
+            int cn0;
+            satellite(p, i, &svid, &elev, &az, &cn0);
+            w.printf(",%02d", svid);
+        } else {
+            w.printf(",");
+        }
+    }
+    w.printf(",1.5,0.9,1.2");
+    return w.finish();
+}
+
+int gsvParts(const NmeaFormat& fmt) {
+    return std::max(1, (fmt.satellites + 3) / 4);
+}
+
+size_t formatGSV(const TrajectoryPoint& p, const NmeaFormat& fmt, const int part,
+                 char* out, const size_t size) {
+    Writer w(out, size);
+    w.printf("$%sGSV,%d,%d,%02d", fmt.talker, gsvParts(fmt), part, fmt.satellites);
+    for (int i = (part - 1) * 4; i < std::min(part * 4, fmt.satellites); ++i) {
+        int svid;
+        int elev;
+        int az;
+        int cn0;
+        satellite(p, i, &svid, &elev, &az, &cn0);
+        w.printf(",%02d,%02d,%03d,%02d", svid, elev, az, cn0);
+    }
+    return w.finish();
+}
+
+const char* toString(const Corpus c) {
+    switch (c) {
+        case Corpus::RMC_GGA: return "rmc_gga";
+        case Corpus::MULTI_TALKER: return "multi_talker";
+        case Corpus::HIGH_NOISE: return "high_noise";
+        case Corpus::LONG_FRACTION: return "long_fraction";
+        default: return "?";
+    }
+}
+
+std::string makeCorpus(const Corpus corpus, const int epochs, const uint32_t seed) {
+    // 2020-04-01 12:00:00 UTC, driving in circles at 15 m/s
+    const Trajectory trajectory(1585742400000LL, 37.4220, -122.0841, 30, 15, 0, 2);
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<double> uniform(0, 1);
+
+    NmeaFormat fmt;
+    if (corpus == Corpus::LONG_FRACTION) {
+        fmt.latLonDecimals = 9;
+        fmt.timeDecimals = 3;
+    }
+
+    std::string result;
+    char buf[256];
+    auto append = [&](const size_t n) { result.append(buf, n); };
+
+    for (int e = 0; e < epochs; ++e) {
+        const TrajectoryPoint p = trajectory.at(1585742400000LL + e * 1000LL);
+
+        switch (corpus) {
+            case Corpus::RMC_GGA:
+            case Corpus::LONG_FRACTION:
+                append(formatRMC(p, fmt, buf, sizeof(buf)));
+                append(formatGGA(p, fmt, buf, sizeof(buf)));
+                break;
+
+            case Corpus::MULTI_TALKER: {
+                NmeaFormat gn = fmt;
+                strcpy(gn.talker, "GN");
+                append(formatRMC(p, gn, buf, sizeof(buf)));
+                append(formatGGA(p, gn, buf, sizeof(buf)));
+                append(formatRMC(p, fmt, buf, sizeof(buf)));
+                append(formatGGA(p, fmt, buf, sizeof(buf)));
+                append(formatVTG(p, fmt, buf, sizeof(buf)));
+                append(formatGSA(p, gn, buf, sizeof(buf)));
+                for (const char* talker : {"GP", "GL", "GA"}) {
+                    NmeaFormat sv = fmt;
+                    strcpy(sv.talker, talker);
+                    sv.satellites = 6 + (e % 5);
+                    for (int part = 1; part <= gsvParts(sv); ++part) {
+                        append(formatGSV(p, sv, part, buf, sizeof(buf)));
+                    }
+                }
+                break;
+            }
+
+            case Corpus::HIGH_NOISE:
+                for (int s = 0; s < 2; ++s) {
+                    NmeaFormat f = fmt;
+                    const double r = uniform(rng);
+                    f.valid = !(r >= 0.25 && r < 0.30);
+                    size_t n = (s == 0) ? formatRMC(p, f, buf, sizeof(buf))
+                                        : formatGGA(p, f, buf, sizeof(buf));
+                    if (n > 8 && r < 0.10) {
+                        buf[n / 2] ^= 0x01;  // bad checksum
+                    } else if (n > 8 && r < 0.20) {
+                        n = finishSentence(buf, n / 2, sizeof(buf));  // field error
+                    } else if (r < 0.25) {
+                        // line noise between sentences
+                        const int garbage = 1 + static_cast<int>(uniform(rng) * 16);
+                        for (int i = 0; i < garbage; ++i) {
+                            result.push_back(static_cast<char>(' ' + uniform(rng) * 94));
+                        }
+                    }
+                    append(n);
+                }
+                break;
+        }
+    }
+
+    return result;
+}
+
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// Synthetic trajectories and their NMEA encoding, for benchmarks and the host
+// side tools which feed the HAL.
+namespace ciccloud {
+namespace sim {
+
+struct TrajectoryPoint {
+    int64_t utcMs = 0;
+    double latitudeDegrees = 0;
+    double longitudeDegrees = 0;
+    double altitudeMeters = 0;
+    double speedMetersPerSec = 0;
+    double bearingDegrees = 0;
+};
+
+// Constant speed and turn rate (a circle, or a line for turnRate == 0) on a
+// locally flat earth around the start point.
+class Trajectory {
+public:
+    Trajectory(int64_t startUtcMs, double latitudeDegrees, double longitudeDegrees,
+               double altitudeMeters, double speedMetersPerSec,
+               double bearingDegrees, double turnRateDegreesPerSec);
+
+    TrajectoryPoint at(int64_t utcMs) const;
+
+private:
+    const int64_t m_startUtcMs;
+    const double m_lat0;
+    const double m_lon0;
+    const double m_alt0;
+    const double m_speed;
+    const double m_bearing0;
+    const double m_turnRate;
+};
+
+struct NmeaFormat {
+    char talker[3] = "GP";
+    int latLonDecimals = 4;  // of the minutes
+    int timeDecimals = 2;    // of the seconds
+    int satellites = 8;      // in view, the first up to 12 are used in fix
+    bool valid = true;       // 'A' or 'V' in RMC, fix quality in GGA
+};
+
+// Each formats one complete sentence ("$...*hh\r\n") into `out` and returns
+// its length, or 0 if it does not fit.
+size_t formatRMC(const TrajectoryPoint&, const NmeaFormat&, char* out, size_t size);
+size_t formatGGA(const TrajectoryPoint&, const NmeaFormat&, char* out, size_t size);
+size_t formatVTG(const TrajectoryPoint&, const NmeaFormat&, char* out, size_t size);
+size_t formatGSA(const TrajectoryPoint&, const NmeaFormat&, char* out, size_t size);
+// GSV carries 4 satellites per sentence, `part` counts from 1.
+int gsvParts(const NmeaFormat&);
+size_t formatGSV(const TrajectoryPoint&, const NmeaFormat&, int part, char* out, size_t size);
+
+// Appends "*hh\r\n" to a sentence "$...", returns the new length or 0.
+size_t finishSentence(char* out, size_t len, size_t size);
+
+enum class Corpus {
+    RMC_GGA,        // GPRMC + GPGGA per epoch, what the HAL parses
+    MULTI_TALKER,   // GP/GN/GL/GA talkers with RMC, GGA, GSA, GSV, VTG
+    HIGH_NOISE,     // RMC_GGA with ~30% broken sentences and line noise
+    LONG_FRACTION,  // RMC_GGA with 9 decimals of minutes and 3 of seconds
+};
+
+const char* toString(Corpus);
+
+// A deterministic byte stream of `epochs` 1 Hz epochs.
+std::string makeCorpus(Corpus, int epochs, uint32_t seed = 1);
+
+}  // namespace sim
+}  // namespace ciccloud
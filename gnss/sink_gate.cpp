@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sink_gate.h"
+
+namespace ciccloud {
+
+SinkGate::SinkGate(const GnssSink* downstream)
+    : m_downstream(downstream) {}
+
+void SinkGate::close() {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    m_open = false;
+}
+
+void SinkGate::gnssLocation(const Location& loc) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_open) {
+        m_downstream->gnssLocation(loc);
+    }
+}
+
+void SinkGate::gnssSvStatus(const SvInfo* svInfo, const size_t size) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_open) {
+        m_downstream->gnssSvStatus(svInfo, size);
+    }
+}
+
+void SinkGate::gnssStatus(const GnssStatus status) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_open) {
+        m_downstream->gnssStatus(status);
+    }
+}
+
+void SinkGate::gnssNmea(const int64_t timestampMs, const char* nmea, const size_t size) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_open) {
+        m_downstream->gnssNmea(timestampMs, nmea, size);
+    }
+}
+
+void SinkGate::gnssEpoch(const Location& fix) const {
+    std::lock_guard<std::mutex> lock(m_mtx);
+    if (m_open) {
+        m_downstream->gnssEpoch(fix);
+    }
+}
+
+bool SinkGate::wantsNmea() const {
+    return m_open && m_downstream->wantsNmea();
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <atomic>
+#include <mutex>
+#include "gnss_sink.h"
+
+namespace ciccloud {
+
+// Forwards to a sink until closed. Once close() returns no call is in
+// progress any more and none gets through, so what goes on delivering while
+// it is torn down (a GnssHwConn) cannot reach the sink. A gate does not open
+// again, the next one takes over.
+class SinkGate : public GnssSink {
+public:
+    explicit SinkGate(const GnssSink* downstream);
+
+    void close();  // waits for a call in progress
+
+    void gnssLocation(const Location&) const override;
+    void gnssSvStatus(const SvInfo* svInfo, size_t size) const override;
+    void gnssStatus(GnssStatus) const override;
+    void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const override;
+    void gnssEpoch(const Location& fix) const override;
+    bool wantsNmea() const override;
+
+private:
+    const GnssSink* const m_downstream;
+    mutable std::mutex m_mtx;  // held over the calls to downstream
+    std::atomic<bool> m_open{true};
+};
+
+}  // namespace ciccloud
@@ -0,0 +1,152 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sv_status_publisher.h"
+#include <log/log.h>
+#include <algorithm>
+#include <cmath>
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+
+// the azimuth wraps at 360
+float angleDelta(const float a, const float b) {
+    const float d = std::fabs(a - b);
+    return std::min(d, 360.f - d);
+}
+}  // namespace
+
+SvStatusPublisher::SvStatusPublisher(const GnssSink* downstream,
+                                     const SvStatusPublisherConfig& config,
+                                     const Clock& clock)
+    : m_downstream(downstream)
+    , m_clock(clock)
+    , m_minIntervalNs(std::max(config.minIntervalMs, 0) * kMsToNs)
+    , m_cn0Threshold(config.cn0ThresholdDbhz)
+    , m_angleThreshold(config.angleThresholdDegrees) {}
+
+SvStatusPublisher::Stats SvStatusPublisher::stats() const {
+    Stats stats;
+    stats.offered = m_offered.load(std::memory_order_relaxed);
+    stats.sent = m_sentCount.load(std::memory_order_relaxed);
+    stats.bytesOffered = m_bytesOffered.load(std::memory_order_relaxed);
+    stats.bytesSent = m_bytesSent.load(std::memory_order_relaxed);
+    return stats;
+}
+
+int64_t SvStatusPublisher::nextSendNs() const {
+    return m_pending ? m_lastSentNs + m_minIntervalNs : INT64_MAX;
+}
+
+void SvStatusPublisher::sendDue() const {
+    if (m_pending) {
+        maybeSend(m_clock.bootNanos());
+    }
+}
+
+void SvStatusPublisher::gnssLocation(const Location& loc) const {
+    m_downstream->gnssLocation(loc);
+    if (m_pending) {
+        maybeSend(m_clock.bootNanos());
+    }
+}
+
+void SvStatusPublisher::gnssSvStatus(const SvInfo* svInfo, size_t size) const {
+    size = std::min(size, kMaxSvInfo);
+    m_offered.fetch_add(1, std::memory_order_relaxed);
+    m_bytesOffered.fetch_add(size * sizeof(SvInfo), std::memory_order_relaxed);
+
+    std::copy(svInfo, svInfo + size, m_latest.begin());
+    m_latestSize = size;
+    // A change which was undone while it waited is no change.
+    m_pending = !m_hasSent || differs(svInfo, size);
+    if (m_pending) {
+        maybeSend(m_clock.bootNanos());
+    }
+}
+
+void SvStatusPublisher::gnssStatus(const GnssStatus status) const {
+    if (status == GnssStatus::SESSION_END) {
+        if (m_pending) {
+            send(m_clock.bootNanos());
+        }
+        const Stats s = stats();
+        ALOGI("%s:%d: %llu of %llu sv statuses sent, %llu callbacks and %llu bytes saved",
+              __PRETTY_FUNCTION__, __LINE__, static_cast<unsigned long long>(s.sent),
+              static_cast<unsigned long long>(s.offered),
+              static_cast<unsigned long long>(s.callbacksSaved()),
+              static_cast<unsigned long long>(s.bytesSaved()));
+    }
+    if (status == GnssStatus::SESSION_BEGIN || status == GnssStatus::SESSION_END) {
+        m_hasSent = false;
+        m_pending = false;
+        m_sentSize = 0;
+        m_latestSize = 0;
+    }
+    m_downstream->gnssStatus(status);
+}
+
+void SvStatusPublisher::gnssNmea(const int64_t timestampMs, const char* nmea,
+                                 const size_t size) const {
+    m_downstream->gnssNmea(timestampMs, nmea, size);
+}
+
+void SvStatusPublisher::gnssEpoch(const Location& fix) const {
+    m_downstream->gnssEpoch(fix);
+}
+
+// Both sets are ordered by constellation and svid (SvTable::snapshot), so a
+// satellite of one is at the same index in the other, and one which came or
+// went changes the size or an svid from there on: an index-wise compare
+// finds any change.
+bool SvStatusPublisher::differs(const SvInfo* svInfo, const size_t size) const {
+    if (size != m_sentSize) {
+        return true;
+    }
+    for (size_t i = 0; i < size; ++i) {
+        const SvInfo& a = svInfo[i];
+        const SvInfo& b = m_sent[i];
+        if (a.svid != b.svid || a.constellation != b.constellation ||
+            ((a.flags ^ b.flags) & SvFlags::USED_IN_FIX) ||
+            std::fabs(a.cN0Dbhz - b.cN0Dbhz) >= m_cn0Threshold ||
+            std::fabs(a.elevationDegrees - b.elevationDegrees) >= m_angleThreshold ||
+            angleDelta(a.azimuthDegrees, b.azimuthDegrees) >= m_angleThreshold) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void SvStatusPublisher::maybeSend(const int64_t nowNs) const {
+    if (!m_hasSent || (nowNs - m_lastSentNs) >= m_minIntervalNs) {
+        send(nowNs);
+    }
+}
+
+void SvStatusPublisher::send(const int64_t nowNs) const {
+    std::copy(m_latest.begin(), m_latest.begin() + m_latestSize, m_sent.begin());
+    m_sentSize = m_latestSize;
+    m_pending = false;
+    m_hasSent = true;
+    m_lastSentNs = nowNs;
+
+    m_sentCount.fetch_add(1, std::memory_order_relaxed);
+    m_bytesSent.fetch_add(m_sentSize * sizeof(SvInfo), std::memory_order_relaxed);
+    m_downstream->gnssSvStatus(m_sent.data(), m_sentSize);
+}
+
+}  // namespace ciccloud
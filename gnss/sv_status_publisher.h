@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "clock.h"
+#include "gnss_sink.h"
+
+namespace ciccloud {
+
+struct SvStatusPublisherConfig {
+    int minIntervalMs = 1000;       // at most one status per interval, 0 - no limit
+    int cn0ThresholdDbhz = 3;       // a C/N0 change that is worth a status
+    int angleThresholdDegrees = 5;  // same for elevation and azimuth
+};
+
+// Sends the satellite status downstream when it changes, not with every
+// epoch. A status is a change if a satellite came or went, its used in fix
+// flag flipped, or its C/N0, elevation or azimuth moved by the thresholds or
+// more since the status sent last. Changes within minIntervalMs of that one
+// wait, and the latest status goes out with the first location or status
+// after the interval, or from sendDue() at nextSendNs() if the feed went
+// quiet meanwhile. A session starts with the full status, and one which
+// ends sends what waits.
+//
+// Everything else passes through. Called from the worker thread only, the
+// stats from anywhere.
+class SvStatusPublisher : public GnssSink {
+public:
+    struct Stats {
+        uint64_t offered = 0;    // statuses from upstream
+        uint64_t sent = 0;       // of them, downstream
+        uint64_t bytesOffered = 0;
+        uint64_t bytesSent = 0;  // SvInfo bytes, what a callback copies
+
+        uint64_t callbacksSaved() const { return offered - sent; }
+        uint64_t bytesSaved() const { return bytesOffered - bytesSent; }
+    };
+
+    SvStatusPublisher(const GnssSink* downstream, const SvStatusPublisherConfig&,
+                      const Clock& clock = systemClock());
+
+    Stats stats() const;
+
+    // When a waiting change is due (boottime), INT64_MAX if none waits.
+    int64_t nextSendNs() const;
+    // Sends a waiting change if it is due.
+    void sendDue() const;
+
+    void gnssLocation(const Location&) const override;
+    void gnssSvStatus(const SvInfo* svInfo, size_t size) const override;
+    void gnssStatus(GnssStatus) const override;
+    void gnssNmea(int64_t timestampMs, const char* nmea, size_t size) const override;
+    void gnssEpoch(const Location& fix) const override;
+    bool wantsNmea() const override { return m_downstream->wantsNmea(); }
+
+private:
+    bool differs(const SvInfo* svInfo, size_t size) const;
+    void maybeSend(int64_t nowNs) const;
+    void send(int64_t nowNs) const;
+
+    const GnssSink* const m_downstream;
+    const Clock& m_clock;
+    const int64_t m_minIntervalNs;
+    const float m_cn0Threshold;
+    const float m_angleThreshold;
+
+    // by constellation and svid, as SvTable::snapshot() has them
+    mutable std::array<SvInfo, kMaxSvInfo> m_sent;
+    mutable size_t m_sentSize = 0;
+    mutable std::array<SvInfo, kMaxSvInfo> m_latest;
+    mutable size_t m_latestSize = 0;
+    mutable bool m_pending = false;  // m_latest differs from m_sent
+    mutable bool m_hasSent = false;
+    mutable int64_t m_lastSentNs = 0;
+
+    mutable std::atomic<uint64_t> m_offered{0};
+    mutable std::atomic<uint64_t> m_sentCount{0};
+    mutable std::atomic<uint64_t> m_bytesOffered{0};
+    mutable std::atomic<uint64_t> m_bytesSent{0};
+};
+
+}  // namespace ciccloud
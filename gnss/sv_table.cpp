@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "sv_table.h"
+
+namespace ciccloud {
+namespace {
+constexpr Constellation kConstellationOf[] = {
+    Constellation::GPS, Constellation::SBAS, Constellation::GLONASS,
+    Constellation::QZSS, Constellation::BEIDOU, Constellation::GALILEO,
+};
+
+float carrierFrequencyHz(const Constellation c) {
+    switch (c) {
+        case Constellation::GLONASS: return 1602.0e6f;  // L1OF channel 0
+        case Constellation::BEIDOU: return 1561.098e6f;  // B1I
+        default: return 1575.42e6f;
+    }
+}
+
+// The talkers' own constellations, as bits of the constellation index.
+uint8_t talkerConstellations(const SvTable::Talker t) {
+    switch (t) {
+        case SvTable::Talker::GP: return 0x03;  // GPS and SBAS
+        case SvTable::Talker::GL: return 0x04;
+        case SvTable::Talker::GQ: return 0x08;
+        case SvTable::Talker::GB: return 0x10;
+        case SvTable::Talker::GA: return 0x20;
+        default: return 0;
+    }
+}
+}  // namespace
+
+bool SvTable::fromNmea(const Talker talker, const int id, Constellation* c, int16_t* svid) {
+    auto set = [c, svid](const Constellation constellation, const int v) {
+        *c = constellation;
+        *svid = static_cast<int16_t>(v);
+        return true;
+    };
+
+    switch (talker) {
+        case Talker::GL:
+            if (id >= 65 && id <= 96) {
+                return set(Constellation::GLONASS, id - 64);
+            } else if (id >= 1 && id <= 32) {
+                return set(Constellation::GLONASS, id);
+            }
+            return false;
+
+        case Talker::GA:
+            if (id >= 1 && id <= 36) {
+                return set(Constellation::GALILEO, id);
+            } else if (id >= 301 && id <= 336) {
+                return set(Constellation::GALILEO, id - 300);
+            }
+            return false;
+
+        case Talker::GB:
+            if (id >= 1 && id <= 63) {
+                return set(Constellation::BEIDOU, id);
+            } else if (id >= 201 && id <= 263) {
+                return set(Constellation::BEIDOU, id - 200);
+            } else if (id >= 401 && id <= 463) {
+                return set(Constellation::BEIDOU, id - 400);
+            }
+            return false;
+
+        case Talker::GQ:
+            if (id >= 1 && id <= 10) {
+                return set(Constellation::QZSS, id + 192);
+            } else if (id >= 193 && id <= 202) {
+                return set(Constellation::QZSS, id);
+            }
+            return false;
+
+        default:  // GP and GN, by the NMEA 4.x ranges
+            if (id >= 1 && id <= 32) {
+                return set(Constellation::GPS, id);
+            } else if (id >= 33 && id <= 64) {
+                return set(Constellation::SBAS, id + 87);
+            } else if (id >= 65 && id <= 96 && talker == Talker::GN) {
+                return set(Constellation::GLONASS, id - 64);
+            } else if (id >= 193 && id <= 202) {
+                return set(Constellation::QZSS, id);
+            } else if (id >= 201 && id <= 263 && talker == Talker::GN) {
+                return set(Constellation::BEIDOU, id - 200);
+            } else if (id >= 301 && id <= 336 && talker == Talker::GN) {
+                return set(Constellation::GALILEO, id - 300);
+            }
+            return false;
+    }
+}
+
+int SvTable::constellationIndex(const Constellation c) {
+    switch (c) {
+        case Constellation::GPS: return 0;
+        case Constellation::SBAS: return 1;
+        case Constellation::GLONASS: return 2;
+        case Constellation::QZSS: return 3;
+        case Constellation::BEIDOU: return 4;
+        case Constellation::GALILEO: return 5;
+        default: return -1;
+    }
+}
+
+int SvTable::slot(const Constellation c, const int16_t svid) {
+    const int base = (c == Constellation::SBAS) ? 120 : (c == Constellation::QZSS) ? 192 : 0;
+    const int s = svid - base;
+    return (s >= 0 && s < kSlots) ? s : -1;
+}
+
+void SvTable::reset() {
+    m_inView.fill(0);
+    m_used.fill(0);
+    m_pendingView.fill(0);
+    m_nextPart.fill(0);
+    m_changed = true;
+}
+
+bool SvTable::beginViewPart(const Talker talker, const int part, const int parts) {
+    const uint8_t constellations = talkerConstellations(talker);
+    if (!constellations || part < 1 || part > parts) {
+        return false;
+    }
+
+    int& next = m_nextPart[static_cast<size_t>(talker)];
+    if (part == 1) {
+        for (int c = 0; c < kConstellations; ++c) {
+            if (constellations & (1 << c)) {
+                m_pendingView[c] = 0;
+            }
+        }
+    } else if (part != next) {
+        next = 0;  // a part went missing, keep what is in view
+        return false;
+    }
+    next = part + 1;
+    return true;
+}
+
+void SvTable::inView(const Constellation constellation, const int16_t svid, const float cN0Dbhz,
+                     const float elevationDegrees, const float azimuthDegrees) {
+    const int c = constellationIndex(constellation);
+    const int s = (c >= 0) ? slot(constellation, svid) : -1;
+    if (s < 0) {
+        return;
+    }
+
+    const size_t i = c * kSlots + s;
+    m_svid[i] = svid;
+    m_cN0Dbhz[i] = cN0Dbhz;
+    m_elevationDegrees[i] = elevationDegrees;
+    m_azimuthDegrees[i] = azimuthDegrees;
+    m_pendingView[c] |= Mask(1) << s;
+    m_changed = true;
+}
+
+void SvTable::endViewPart(const Talker talker, const int part, const int parts) {
+    int& next = m_nextPart[static_cast<size_t>(talker)];
+    if (part != parts || next != parts + 1) {
+        return;
+    }
+
+    const uint8_t constellations = talkerConstellations(talker);
+    for (int c = 0; c < kConstellations; ++c) {
+        if (constellations & (1 << c)) {
+            m_inView[c] = m_pendingView[c];
+        }
+    }
+    next = 0;
+    m_changed = true;
+}
+
+void SvTable::beginUsed(const Talker talker) {
+    m_pendingUsed.fill(0);
+    m_usedConstellations = talkerConstellations(talker);
+}
+
+void SvTable::used(const Constellation constellation, const int16_t svid) {
+    const int c = constellationIndex(constellation);
+    const int s = (c >= 0) ? slot(constellation, svid) : -1;
+    if (s < 0) {
+        return;
+    }
+
+    const Mask bit = Mask(1) << s;
+    if (!((m_inView[c] | m_pendingView[c]) & bit)) {
+        // used but not in GSV yet, there is no signal to report
+        const size_t i = c * kSlots + s;
+        m_svid[i] = svid;
+        m_cN0Dbhz[i] = 0;
+        m_elevationDegrees[i] = 0;
+        m_azimuthDegrees[i] = 0;
+    }
+    m_pendingUsed[c] |= bit;
+    m_usedConstellations |= 1 << c;
+}
+
+void SvTable::endUsed() {
+    for (int c = 0; c < kConstellations; ++c) {
+        if (m_usedConstellations & (1 << c)) {
+            m_used[c] = m_pendingUsed[c];
+            m_changed = true;
+        }
+    }
+}
+
+size_t SvTable::snapshot(SvInfo* out, const size_t capacity) {
+    size_t n = 0;
+    for (int c = 0; c < kConstellations && n < capacity; ++c) {
+        const Constellation constellation = kConstellationOf[c];
+        const float carrierHz = carrierFrequencyHz(constellation);
+        for (Mask bits = m_inView[c] | m_used[c]; bits && n < capacity; bits &= bits - 1) {
+            const int s = __builtin_ctzll(bits);
+            const size_t i = c * kSlots + s;
+            SvInfo& info = out[n++];
+            info.svid = m_svid[i];
+            info.constellation = constellation;
+            info.cN0Dbhz = m_cN0Dbhz[i];
+            info.elevationDegrees = m_elevationDegrees[i];
+            info.azimuthDegrees = m_azimuthDegrees[i];
+            info.carrierFrequencyHz = carrierHz;
+            info.flags = SvFlags::HAS_CARRIER_FREQUENCY;
+            if (m_used[c] & (Mask(1) << s)) {
+                info.flags |= SvFlags::USED_IN_FIX | SvFlags::HAS_EPHEMERIS_DATA;
+            }
+        }
+    }
+    m_changed = false;
+    return n;
+}
+
+}  // namespace ciccloud
@@ -0,0 +1,92 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include "gnss_types.h"
+
+namespace ciccloud {
+
+// The satellites of all constellations as GSV and GSA report them.
+//
+// A structure of arrays with a fixed slot per constellation and svid, plus a
+// bit per slot for "in view" and "used in fix", allocated with the table.
+// GSV comes in cycles of parts per talker: the parts update their satellites
+// in place and a complete cycle replaces the set in view of the talker's
+// constellations (GPS and SBAS share the GP talker). An incomplete cycle
+// leaves the set as it was. GSA replaces the set used in fix of the
+// constellations it names.
+//
+// Not thread safe.
+class SvTable {
+public:
+    // NMEA talkers with satellites of their own, GN is the combined one
+    enum class Talker : uint8_t { GP, GL, GA, GB, GQ, GN, COUNT };
+
+    static constexpr int kSlots = 64;  // per constellation
+
+    // NMEA satellite ids to HAL svid and constellation (SBAS 120+, GLONASS
+    // slots, QZSS 193+). Returns false for one we do not know.
+    static bool fromNmea(Talker, int nmeaId, Constellation*, int16_t* svid);
+
+    void reset();
+
+    // One GSV sentence: `part` of `parts`, with satellites through inView().
+    // Returns false if it does not continue the talker's cycle.
+    bool beginViewPart(Talker, int part, int parts);
+    void inView(Constellation, int16_t svid, float cN0Dbhz, float elevationDegrees,
+                float azimuthDegrees);
+    void endViewPart(Talker, int part, int parts);
+
+    // One GSA sentence: the used satellites, each through used(), replace
+    // those of the talker's constellations and of the ones they are in.
+    void beginUsed(Talker);
+    void used(Constellation, int16_t svid);
+    void endUsed();
+
+    bool changed() const { return m_changed; }
+
+    // The satellites in view or used, by constellation and svid, at most
+    // `capacity`. Clears changed().
+    size_t snapshot(SvInfo* out, size_t capacity);
+
+private:
+    static constexpr int kConstellations = 6;  // GPS, SBAS, GLONASS, QZSS, BEIDOU, GALILEO
+    static constexpr size_t kSize = kConstellations * kSlots;
+    using Mask = uint64_t;
+
+    static int constellationIndex(Constellation);
+    static int slot(Constellation, int16_t svid);
+
+    // the columns, by constellation index * kSlots + slot
+    std::array<int16_t, kSize> m_svid = {};
+    std::array<float, kSize> m_cN0Dbhz = {};
+    std::array<float, kSize> m_elevationDegrees = {};
+    std::array<float, kSize> m_azimuthDegrees = {};
+
+    std::array<Mask, kConstellations> m_inView = {};
+    std::array<Mask, kConstellations> m_used = {};
+    std::array<Mask, kConstellations> m_pendingView = {};  // of the current GSV cycles
+    std::array<Mask, kConstellations> m_pendingUsed = {};  // of the current GSA
+    uint8_t m_usedConstellations = 0;                      // bits of the GSA so far
+    std::array<int, static_cast<size_t>(Talker::COUNT)> m_nextPart = {};  // 0 - no cycle
+    bool m_changed = false;
+};
+
+}  // namespace ciccloud
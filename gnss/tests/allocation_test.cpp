@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// The fix pipeline must not allocate in the steady state: once a pass over
+// a corpus has warmed it up, another one calls operator new not once. It
+// runs the way GnssHwConn sets it up, the listener of a feed behind
+// FeedArbiter and SvStatusPublisher, into a sink which does what DataSink
+// does short of HIDL: fixes through a FixHub to an inline subscriber, the
+// receiver clock per epoch. The HIDL conversions and callbacks of DataSink
+// do not build on the host and are not covered.
+
+#include <gtest/gtest.h>
+#include <array>
+#include <string>
+#include "bench_counters.h"
+#include "feed_arbiter.h"
+#include "fix_hub.h"
+#include "gnss_clock.h"
+#include "gnss_hw_listener.h"
+#include "nmea_generator.h"
+#include "sv_status_publisher.h"
+#include "util.h"
+
+namespace ciccloud {
+namespace {
+using sim::Corpus;
+
+constexpr int kEpochs = 200;
+
+class HostSink : public GnssSink, private FixSubscriber {
+public:
+    HostSink() { m_fixes.subscribe(this, FixDelivery::INLINE); }
+    ~HostSink() { m_fixes.unsubscribe(this); }
+
+    void gnssLocation(const Location& loc) const override { m_fixes.publish(loc); }
+    void gnssSvStatus(const SvInfo* svInfo, const size_t size) const override {
+        for (size_t i = 0; i < size && i < m_svInfo.size(); ++i) {
+            m_svInfo[i] = svInfo[i];
+        }
+        ++m_svStatuses;
+    }
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, const size_t size) const override { m_nmeaBytes += size; }
+    void gnssEpoch(const Location& fix) const override {
+        GnssClockSample clock;
+        m_clockModel.update(fix.elapsedRealtimeNs, util::utcToGpsNanos(util::fixUtcNanos(fix)),
+                            &clock);
+    }
+
+    uint64_t locations() const { return m_locations; }
+
+private:
+    void onFix(const FixRef& fix) override {
+        m_lastLatitude = fix->location().latitudeDegrees;
+        ++m_locations;
+    }
+
+    mutable FixHub m_fixes;
+    mutable std::array<SvInfo, kMaxSvInfo> m_svInfo;
+    mutable uint64_t m_svStatuses = 0;
+    mutable size_t m_nmeaBytes = 0;
+    mutable GnssClockModel m_clockModel;
+    uint64_t m_locations = 0;
+    double m_lastLatitude = 0;
+};
+
+class AllocationTest : public ::testing::TestWithParam<Corpus> {};
+
+TEST_P(AllocationTest, SteadyStateDoesNotAllocate) {
+    // the first half warms up, the second one counts: one stream, so the
+    // second half goes on with newer epochs
+    const std::string data = sim::makeCorpus(GetParam(), 2 * kEpochs);
+    const size_t half = data.size() / 2;
+
+    HostSink sink;
+    SvStatusPublisher publisher(&sink, SvStatusPublisherConfig());
+    FeedArbiter arbiter(&publisher, FeedArbiterConfig());
+    FixFilterConfig filter;
+    filter.model = FixFilterModel::CONSTANT_VELOCITY;
+    GnssHwListener listener(arbiter.input(0), NmeaForwardConfig(), filter);
+    arbiter.connect(0, 1);
+
+    listener.consume(data.data(), half);
+    const uint64_t locations = sink.locations();
+    ASSERT_GT(locations, 0u);
+
+    const uint64_t before = bench::allocationCount();
+    listener.consume(data.data() + half, data.size() - half);
+    const uint64_t allocations = bench::allocationCount() - before;
+
+    EXPECT_GT(sink.locations(), locations);
+    EXPECT_EQ(0u, allocations) << "over " << sink.locations() - locations << " fixes";
+}
+
+INSTANTIATE_TEST_SUITE_P(Corpora, AllocationTest,
+                         ::testing::Values(Corpus::RMC_GGA, Corpus::MULTI_TALKER,
+                                           Corpus::HIGH_NOISE, Corpus::LONG_FRACTION),
+                         [](const ::testing::TestParamInfo<Corpus>& info) {
+                             return std::string(sim::toString(info.param));
+                         });
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "clock_sync.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kDayMs = 24 * 3600 * 1000;
+constexpr int64_t kBootNs = 3600 * 1000 * kMsToNs;
+
+class ClockSyncTest : public ::testing::Test {
+protected:
+    ClockSyncTest() { m_sync.setSupported(true); }
+
+    // A ping at `t1Ns` to a feeder ahead of boottime by `offsetNs`, `upNs`
+    // and `downNs` on the way and `turnNs` to answer.
+    void exchange(const int64_t t1Ns, const int64_t offsetNs, const int64_t upNs,
+                  const int64_t downNs, const int64_t turnNs) {
+        m_sync.onPingSent(t1Ns);
+        const int64_t t2Ns = t1Ns + upNs + offsetNs;
+        const int64_t t3Ns = t2Ns + turnNs;
+        m_sync.onPong(t1Ns, t2Ns, t3Ns, t3Ns - offsetNs + downNs);
+    }
+
+    // A fix of sentence time `todMs` arrived at `rxBootNs`.
+    void expectBootTime(const int64_t todMs, const int64_t rxBootNs, const int64_t wantBootNs,
+                        const int64_t wantUncertaintyNs) {
+        int64_t bootNs = 0;
+        int64_t uncertaintyNs = 0;
+        ASSERT_TRUE(m_sync.toBootTime(todMs, rxBootNs, &bootNs, &uncertaintyNs));
+        EXPECT_EQ(wantBootNs, bootNs);
+        EXPECT_EQ(wantUncertaintyNs, uncertaintyNs);
+    }
+
+    ClockSync m_sync;
+};
+
+TEST_F(ClockSyncTest, PingsOnlyAFeederWhichSupportsIt) {
+    ClockSync sync;
+    EXPECT_EQ(INT64_MAX, sync.nextPingNs());
+    int64_t bootNs;
+    int64_t uncertaintyNs;
+    EXPECT_FALSE(sync.toBootTime(0, kBootNs, &bootNs, &uncertaintyNs));
+
+    // fast at first, then at the slow period
+    m_sync.onPingSent(kBootNs);
+    EXPECT_EQ(kBootNs + ClockSync::kFastPingPeriodNs, m_sync.nextPingNs());
+    for (uint64_t i = 0; i < ClockSync::kFastPings; ++i) {
+        exchange(kBootNs + i * kMsToNs, 0, kMsToNs, kMsToNs, 0);
+    }
+    EXPECT_EQ(kBootNs + (ClockSync::kFastPings - 1) * kMsToNs + ClockSync::kPingPeriodNs,
+              m_sync.nextPingNs());
+}
+
+TEST_F(ClockSyncTest, TakesOffsetAndDelayFromAnExchange) {
+    // the feeder clock reads noon at kBootNs; 10 ms up, 10 ms down, 2 ms to
+    // answer: the offset is exact, the uncertainty the half round trip
+    const int64_t offsetNs = kDayMs / 2 * kMsToNs - kBootNs;
+    exchange(kBootNs, offsetNs, 10 * kMsToNs, 10 * kMsToNs, 2 * kMsToNs);
+    ASSERT_TRUE(m_sync.synchronized());
+
+    const int64_t t4Ns = kBootNs + 22 * kMsToNs;
+    // a fix taken 300 ms before it arrived
+    expectBootTime(kDayMs / 2 + 22 - 300, t4Ns, t4Ns - 300 * kMsToNs, 10 * kMsToNs);
+}
+
+TEST_F(ClockSyncTest, SplitsAnAsymmetricPathInTheMiddle) {
+    // 4 ms up, 16 ms down: off by half the difference, within the
+    // uncertainty
+    exchange(kBootNs, 0, 4 * kMsToNs, 16 * kMsToNs, 0);
+    const int64_t t4Ns = kBootNs + 20 * kMsToNs;
+    int64_t bootNs;
+    int64_t uncertaintyNs;
+    ASSERT_TRUE(m_sync.toBootTime((kBootNs / kMsToNs) % kDayMs, t4Ns, &bootNs, &uncertaintyNs));
+    EXPECT_EQ(kBootNs + 6 * kMsToNs, bootNs);
+    EXPECT_EQ(10 * kMsToNs, uncertaintyNs);
+}
+
+TEST_F(ClockSyncTest, KeepsTheSampleWithTheSmallestRoundTrip) {
+    exchange(kBootNs, 0, 40 * kMsToNs, 40 * kMsToNs, 0);
+    exchange(kBootNs + 1000 * kMsToNs, 0, 2 * kMsToNs, 2 * kMsToNs, 0);
+    // a slow one after it and a late answer to an old ping do not count
+    exchange(kBootNs + 2000 * kMsToNs, 0, 50 * kMsToNs, 50 * kMsToNs, 0);
+    m_sync.onPingSent(kBootNs + 3000 * kMsToNs);
+    m_sync.onPong(kBootNs, kBootNs, kBootNs, kBootNs);
+
+    // aged 3 s past the best sample: 100 ppm of it on top
+    const int64_t rxNs = kBootNs + 1004 * kMsToNs + 3000 * kMsToNs;
+    expectBootTime((rxNs / kMsToNs) % kDayMs, rxNs, rxNs, 2 * kMsToNs + 3 * 100 * 1000);
+}
+
+TEST_F(ClockSyncTest, ForgetsTheBestSampleAfterKSamples) {
+    exchange(kBootNs, 0, kMsToNs, kMsToNs, 0);
+    for (size_t i = 1; i <= ClockSync::kSamples; ++i) {
+        exchange(kBootNs + i * 1000 * kMsToNs, 0, 5 * kMsToNs, 5 * kMsToNs, 0);
+    }
+    const int64_t rxNs = kBootNs + ClockSync::kSamples * 1000 * kMsToNs + 10 * kMsToNs;
+    expectBootTime((rxNs / kMsToNs) % kDayMs, rxNs, rxNs, 5 * kMsToNs);
+}
+
+TEST_F(ClockSyncTest, GrowsTheUncertaintyWithAge) {
+    exchange(kBootNs, 0, 5 * kMsToNs, 5 * kMsToNs, 0);
+    const int64_t t4Ns = kBootNs + 10 * kMsToNs;
+    for (const int64_t ageS : {0, 1, 10, 60}) {
+        const int64_t rxNs = t4Ns + ageS * 1000 * kMsToNs;
+        expectBootTime((rxNs / kMsToNs) % kDayMs, rxNs, rxNs, 5 * kMsToNs + ageS * 1000 * 100);
+    }
+}
+
+TEST_F(ClockSyncTest, PicksTheDayAcrossMidnight) {
+    // the feeder reads 00:00:00.100 at kBootNs
+    const int64_t offsetNs = 100 * kMsToNs - kBootNs;
+    exchange(kBootNs - 10 * kMsToNs, offsetNs, 5 * kMsToNs, 5 * kMsToNs, 0);
+
+    // taken at 23:59:59.900, the day before
+    expectBootTime(kDayMs - 100, kBootNs, kBootNs - 200 * kMsToNs, 5 * kMsToNs);
+    // a sentence time ahead of the arrival is clamped to it
+    expectBootTime(150, kBootNs, kBootNs, 5 * kMsToNs);
+}
+
+TEST_F(ClockSyncTest, ResetForgetsTheEstimate) {
+    exchange(kBootNs, 0, kMsToNs, kMsToNs, 0);
+    ASSERT_TRUE(m_sync.synchronized());
+    m_sync.reset();
+    EXPECT_FALSE(m_sync.synchronized());
+    EXPECT_FALSE(m_sync.supported());
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "conn_controller.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <memory>
+
+namespace ciccloud {
+namespace {
+constexpr int kTimeoutMs = 5000;
+
+class NullSink : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override {}
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+};
+
+// Counts the connections made, on an ephemeral port, or fails to make them.
+class ConnControllerTest : public ::testing::Test {
+protected:
+    ConnController::Factory factory() {
+        return [this](const GnssSink* sink) -> std::unique_ptr<GnssHwConn> {
+            ++m_opens;
+            EXPECT_NE(sink, &m_sink);  // behind a gate
+            if (m_fail) {
+                return nullptr;
+            }
+            GnssHwConnConfig config;
+            config.tcpPort = 0;
+            return std::make_unique<GnssHwConn>(sink, config);
+        };
+    }
+
+    NullSink m_sink;
+    std::atomic<int> m_opens{0};
+    std::atomic<bool> m_fail{false};
+};
+
+TEST_F(ConnControllerTest, OpensStartsAndCloses) {
+    ConnController controller(&m_sink, factory());
+    EXPECT_FALSE(controller.start());
+
+    controller.open();
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::OPEN);
+    EXPECT_TRUE(controller.start());
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::STARTED);
+
+    controller.close();
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::CLOSED);
+    EXPECT_EQ(m_opens, 1);
+}
+
+TEST_F(ConnControllerTest, AFailedOpenEndsClosedAndIsTriedAgain) {
+    ConnController controller(&m_sink, factory());
+    m_fail = true;
+    controller.open();
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::CLOSED);
+    EXPECT_FALSE(controller.start());
+
+    m_fail = false;
+    controller.open();
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::OPEN);
+    EXPECT_EQ(m_opens, 2);
+}
+
+// The gate of the first connection is shut, it must not be kept on.
+TEST_F(ConnControllerTest, ACloseAndAnOpenInARowMakeANewConnection) {
+    ConnController controller(&m_sink, factory());
+    controller.open();
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+
+    for (int i = 0; i < 10; ++i) {
+        controller.close();
+        controller.open();
+    }
+    ASSERT_TRUE(controller.waitIdle(kTimeoutMs));
+    EXPECT_EQ(controller.state(), ConnController::State::OPEN);
+    EXPECT_GE(m_opens, 2);
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,132 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "datagram_feed.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace ciccloud {
+namespace {
+constexpr char kEpoch[] = "$GPRMC,120000.000,A*00\r\n";
+
+// "$...*hh\r\n" of "$..."
+std::string finish(const std::string& line) {
+    unsigned char sum = 0;
+    for (size_t i = 1; i < line.size(); ++i) {
+        sum ^= static_cast<unsigned char>(line[i]);
+    }
+    char hh[8];
+    snprintf(hh, sizeof(hh), "*%02X\r\n", sum);
+    return line + hh;
+}
+
+std::string datagram(const uint64_t sessionId, const uint64_t seq) {
+    char header[64];
+    snprintf(header, sizeof(header), "$PCCDG,%016llx,%llu",
+             static_cast<unsigned long long>(sessionId), static_cast<unsigned long long>(seq));
+    return finish(header) + kEpoch;
+}
+
+// The sentences past the header, or "dropped".
+std::string accept(DatagramFeed* feed, const std::string& data) {
+    const char* sentences = feed->accept(data.data(), data.size());
+    return sentences ? std::string(sentences, data.data() + data.size()) : "dropped";
+}
+
+TEST(DatagramFeedTest, TakesDatagramsWithoutAHeaderAsTheyAre) {
+    DatagramFeed feed;
+    EXPECT_EQ(kEpoch, accept(&feed, kEpoch));
+    EXPECT_EQ(kEpoch, accept(&feed, kEpoch));
+    EXPECT_EQ(2u, feed.received());
+    EXPECT_EQ(0u, feed.stale());
+}
+
+TEST(DatagramFeedTest, DropsStaleDatagramsAndCountsTheLost) {
+    DatagramFeed feed;
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 1)));
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 4)));
+    EXPECT_EQ("dropped", accept(&feed, datagram(7, 3)));  // reordered
+    EXPECT_EQ("dropped", accept(&feed, datagram(7, 4)));  // duplicated
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 5)));
+    EXPECT_EQ(2u, feed.stale());
+    EXPECT_EQ(2u, feed.lost());
+}
+
+TEST(DatagramFeedTest, DropsAMalformedHeader) {
+    DatagramFeed feed;
+    EXPECT_EQ("dropped", accept(&feed, finish("$PCCDG,zz") + kEpoch));
+    EXPECT_EQ("dropped", accept(&feed, finish("$PCCDG," + std::string(100, '1')) + kEpoch));
+    EXPECT_EQ(2u, feed.rejected());
+    // a header alone is an empty epoch
+    EXPECT_EQ("", accept(&feed, finish("$PCCDG,7,1")));
+}
+
+TEST(DatagramFeedTest, DropsAHeaderWithoutItsChecksum) {
+    DatagramFeed feed;
+    std::string bad = datagram(7, 1);
+    bad[bad.find('*') + 2] ^= 1;
+    EXPECT_EQ("dropped", accept(&feed, bad));
+    EXPECT_EQ("dropped", accept(&feed, std::string("$PCCDG,7,1\r\n") + kEpoch));
+    EXPECT_EQ("dropped", accept(&feed, std::string("$PCCDG,7,1*\r\n") + kEpoch));
+    EXPECT_EQ("dropped", accept(&feed, std::string("$PCCDG,7,1*g0\r\n") + kEpoch));
+    EXPECT_EQ(4u, feed.rejected());
+
+    // none of them started a session
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(8, 1)));
+}
+
+TEST(DatagramFeedTest, RejectsDatagramsWithoutAHeaderDuringASession) {
+    DatagramFeed feed;
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 1)));
+    EXPECT_EQ("dropped", accept(&feed, kEpoch));
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 2)));
+    EXPECT_EQ(1u, feed.rejected());
+
+    // a feeder which does not number them connects: it takes over, and the
+    // old session does not take the feed back
+    feed.onConnect();
+    EXPECT_EQ(kEpoch, accept(&feed, kEpoch));
+    EXPECT_EQ("dropped", accept(&feed, datagram(7, 3)));
+    EXPECT_EQ(kEpoch, accept(&feed, kEpoch));
+    EXPECT_EQ(1u, feed.rejected());
+    EXPECT_EQ(1u, feed.stale());
+}
+
+TEST(DatagramFeedTest, ANewSessionTakesOverOnlyAfterAConnect) {
+    DatagramFeed feed;
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 10)));
+
+    // late datagrams of a session which is over, or of a stranger
+    EXPECT_EQ("dropped", accept(&feed, datagram(6, 99)));
+    EXPECT_EQ("dropped", accept(&feed, datagram(8, 1)));
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 11)));
+    EXPECT_EQ(2u, feed.stale());
+
+    // a new feeder connects: the next new session is its own, and the old
+    // one cannot take the feed back
+    feed.onConnect();
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(7, 12)));
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(8, 1)));
+    EXPECT_EQ("dropped", accept(&feed, datagram(7, 13)));
+    EXPECT_EQ(kEpoch, accept(&feed, datagram(8, 2)));
+    EXPECT_EQ(3u, feed.stale());
+    EXPECT_EQ(0u, feed.lost());
+}
+
+}  // namespace
+}  // namespace ciccloud
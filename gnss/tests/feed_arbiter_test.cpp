@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "feed_arbiter.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include "clock.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kPeriodMs = 100;
+constexpr int64_t kBootNs = 1000 * kMsToNs;
+
+// What comes out of the arbiter: the sentence times of the locations, and
+// how many NMEA sentences.
+class Recorder : public GnssSink {
+public:
+    void gnssLocation(const Location& loc) const override { times.push_back(loc.utcTimeOfDayMs); }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override { ++nmea; }
+
+    mutable std::vector<int64_t> times;
+    mutable int nmea = 0;
+};
+
+class FeedArbiterTest : public ::testing::Test {
+protected:
+    FeedArbiterTest() : m_clock(0, kBootNs), m_arbiter(&m_recorder, FeedArbiterConfig(), m_clock) {}
+
+    // Epoch `step` of the feeds runs at step periods on. Its sentence time
+    // is `timeMs`, none if negative, then the position is the same always.
+    void epoch(const int feed, const int step, const int64_t timeMs) {
+        m_clock.advanceTo(kBootNs + step * kPeriodMs * kMsToNs);
+        Location loc;
+        loc.flags = LocationFlags::HAS_LAT_LONG;
+        loc.latitudeDegrees = 37.422;
+        loc.longitudeDegrees = -122.084;
+        loc.utcTimeOfDayMs = timeMs;
+        const GnssSink* input = m_arbiter.input(feed);
+        input->gnssLocation(loc);  // RMC
+        input->gnssNmea(0, "$GPRMC", 6);
+        input->gnssLocation(loc);  // GGA, the same epoch
+        input->gnssNmea(0, "$GPGGA", 6);
+    }
+    void epoch(const int feed, const int step) { epoch(feed, step, step * kPeriodMs); }
+
+    // Both feeds, feed 0 preferred, through steps [first, end).
+    void both(const int first, const int end) {
+        for (int step = first; step < end; ++step) {
+            epoch(0, step);
+            epoch(1, step);
+        }
+    }
+
+    std::vector<int64_t> steps(const std::vector<int>& list) const {
+        std::vector<int64_t> times;
+        for (const int step : list) {
+            times.push_back(step * kPeriodMs);
+            times.push_back(step * kPeriodMs);
+        }
+        return times;
+    }
+
+    Recorder m_recorder;
+    SimulatedClock m_clock;
+    FeedArbiter m_arbiter;
+};
+
+TEST_F(FeedArbiterTest, PassesASingleFeed) {
+    m_arbiter.connect(0, 0);
+    for (int step = 0; step < 3; ++step) {
+        epoch(0, step);
+    }
+    EXPECT_EQ(steps({0, 1, 2}), m_recorder.times);
+    EXPECT_EQ(6, m_recorder.nmea);
+    EXPECT_EQ(3u, m_arbiter.stats().epochs);
+    EXPECT_EQ(0, m_arbiter.stats().active);
+}
+
+TEST_F(FeedArbiterTest, DeliversOnlyThePreferredFeed) {
+    m_arbiter.connect(0, 1);
+    m_arbiter.connect(1, 0);
+    m_arbiter.setPriority(0, 0);
+    m_arbiter.setPriority(1, 1);
+    both(0, 4);
+
+    EXPECT_EQ(steps({0, 1, 2, 3}), m_recorder.times);
+    EXPECT_EQ(8, m_recorder.nmea);
+    const FeedArbiter::Stats stats = m_arbiter.stats();
+    EXPECT_EQ(0, stats.active);
+    EXPECT_EQ(4u, stats.epochs);
+    EXPECT_EQ(4u, stats.standby);
+    EXPECT_EQ(0u, stats.failovers);
+}
+
+TEST_F(FeedArbiterTest, AmongEqualsTheOlderConnectionIsPreferred) {
+    m_arbiter.connect(0, 1);
+    m_arbiter.connect(1, 0);
+    both(0, 4);
+    EXPECT_EQ(1, m_arbiter.stats().active);
+}
+
+TEST_F(FeedArbiterTest, FailsOverWhenTheActiveFeedStallsAndBackWhenItRecovers) {
+    m_arbiter.connect(0, 0);
+    m_arbiter.connect(1, 1);
+    both(0, 4);
+
+    // feed 0 stalls: its epoch 4 is lost, the margin is not over yet
+    epoch(1, 4);
+    epoch(1, 5);
+    EXPECT_EQ(1, m_arbiter.stats().active);
+    EXPECT_EQ(1u, m_arbiter.stats().failovers);
+
+    // healthy again after two epochs on time
+    epoch(0, 6);
+    epoch(1, 6);
+    both(7, 9);
+    EXPECT_EQ(steps({0, 1, 2, 3, 5, 6, 7, 8}), m_recorder.times);
+    const FeedArbiter::Stats stats = m_arbiter.stats();
+    EXPECT_EQ(0, stats.active);
+    EXPECT_EQ(2u, stats.failovers);
+    EXPECT_EQ(0u, stats.duplicates);
+}
+
+TEST_F(FeedArbiterTest, SuppressesWhatARedundantFeedRepeatsAfterADisconnect) {
+    m_arbiter.connect(0, 0);
+    m_arbiter.connect(1, 1);
+    // feed 1 is an epoch behind
+    for (int step = 1; step < 4; ++step) {
+        epoch(0, step);
+        epoch(1, step, (step - 1) * kPeriodMs);
+    }
+    m_arbiter.disconnect(0);
+    for (int step = 4; step < 6; ++step) {
+        epoch(1, step, (step - 1) * kPeriodMs);
+    }
+
+    // nothing lost and nothing twice
+    EXPECT_EQ(steps({1, 2, 3, 4}), m_recorder.times);
+    const FeedArbiter::Stats stats = m_arbiter.stats();
+    EXPECT_EQ(1, stats.active);
+    EXPECT_EQ(1u, stats.duplicates);
+}
+
+TEST_F(FeedArbiterTest, KeepsTheEpochsOfAStationaryFeedWithoutTime) {
+    m_arbiter.connect(0, 0);
+    for (int step = 0; step < 5; ++step) {
+        epoch(0, step, -1);
+    }
+    // two locations per epoch, one epoch per period
+    EXPECT_EQ(std::vector<int64_t>(10, -1), m_recorder.times);
+    EXPECT_EQ(5u, m_arbiter.stats().epochs);
+}
+
+TEST_F(FeedArbiterTest, FailsOverBetweenStationaryFeedsWithoutTime) {
+    m_arbiter.connect(0, 0);
+    m_arbiter.connect(1, 1);
+    for (int step = 0; step < 4; ++step) {
+        epoch(0, step, -1);
+        epoch(1, step, -1);
+    }
+    EXPECT_EQ(4u, m_arbiter.stats().epochs);
+
+    // the first epoch of feed 1 may repeat the last of feed 0, the ones
+    // after are its own
+    for (int step = 4; step < 8; ++step) {
+        epoch(1, step, -1);
+    }
+    const FeedArbiter::Stats stats = m_arbiter.stats();
+    EXPECT_EQ(1, stats.active);
+    EXPECT_EQ(1u, stats.failovers);
+    EXPECT_EQ(1u, stats.duplicates);
+    EXPECT_EQ(6u, stats.epochs);
+}
+
+}  // namespace
+}  // namespace ciccloud
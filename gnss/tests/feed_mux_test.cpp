@@ -0,0 +1,292 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "feed_mux.h"
+#include <gtest/gtest.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stddef.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace ciccloud {
+namespace sim {
+namespace {
+constexpr int64_t kPeriodNs = 100000000;  // of a 10 Hz scenario
+
+// A listener as GnssHwConn has one, TCP on the loopback or a unix socket in
+// the abstract namespace, and the connection it accepts.
+class Hal {
+public:
+    Hal() : m_fd(socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr), len);
+        listen(m_fd, 4);
+        getsockname(m_fd, reinterpret_cast<struct sockaddr*>(&addr), &len);
+        m_endpoint.port = ntohs(addr.sin_port);
+    }
+
+    explicit Hal(const std::string& name) : m_fd(socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) {
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        memcpy(addr.sun_path + 1, name.data(), name.size());
+        bind(m_fd, reinterpret_cast<struct sockaddr*>(&addr),
+             offsetof(struct sockaddr_un, sun_path) + 1 + name.size());
+        listen(m_fd, 4);
+        m_endpoint.udsPath = "@" + name;
+    }
+
+    ~Hal() {
+        hangUp();
+        close(m_fd);
+    }
+
+    const Endpoint& endpoint() const { return m_endpoint; }
+
+    bool accept() {
+        struct pollfd pfd = {m_fd, POLLIN, 0};
+        if (poll(&pfd, 1, 1000) != 1) {
+            return false;
+        }
+        m_conn = ::accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+        return m_conn >= 0;
+    }
+    void hangUp() {
+        if (m_conn >= 0) {
+            close(m_conn);
+            m_conn = -1;
+        }
+    }
+
+    void send(const std::string& control) {
+        ASSERT_EQ(static_cast<ssize_t>(control.size()),
+                  ::send(m_conn, control.data(), control.size(), MSG_NOSIGNAL));
+    }
+
+    // What came in until `lines` lines are complete, or nothing came for
+    // `timeoutMs`.
+    std::string readLines(const size_t lines, const int timeoutMs = 1000) {
+        std::string data;
+        size_t count = 0;
+        struct pollfd pfd = {m_conn, POLLIN, 0};
+        while (count < lines && poll(&pfd, 1, timeoutMs) == 1) {
+            char buf[4096];
+            const ssize_t n = recv(m_conn, buf, sizeof(buf), 0);
+            if (n <= 0) {
+                break;
+            }
+            data.append(buf, n);
+            count += std::count(buf, buf + n, '\n');
+        }
+        return data;
+    }
+
+private:
+    const int m_fd;
+    int m_conn = -1;
+    Endpoint m_endpoint;
+};
+
+MuxScenario makeScenario() {
+    MuxScenario s;
+    s.rateHz = 10;
+    return s;
+}
+
+// Brings every instance of `mux` up: a connection to each of `hals`.
+void connectAll(FeedMux* mux, const std::vector<Hal*>& hals, const int64_t nowNs) {
+    mux->tick(nowNs);
+    for (Hal* hal : hals) {
+        mux->wait(100);
+        ASSERT_TRUE(hal->accept());
+    }
+    while (mux->stats().connected < hals.size()) {
+        mux->wait(100);
+    }
+}
+
+void start(FeedMux* mux, const std::vector<Hal*>& hals) {
+    for (Hal* hal : hals) {
+        hal->send(std::string(1, '\x01'));
+    }
+    while (mux->stats().started < hals.size()) {
+        mux->wait(100);
+    }
+}
+
+size_t countLines(const std::string& data, const char* prefix) {
+    size_t count = 0;
+    for (size_t at = data.find(prefix); at != std::string::npos; at = data.find(prefix, at + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+TEST(FeedMuxTest, SendsNothingUntilStarted) {
+    Hal hal;
+    FeedMux mux;
+    mux.addInstance(hal.endpoint(), mux.addScenario(makeScenario()));
+    connectAll(&mux, {&hal}, 0);
+
+    for (int seq = 1; seq <= 3; ++seq) {
+        mux.tick(seq * kPeriodNs);
+    }
+    EXPECT_EQ(0u, mux.stats().epochs);
+
+    start(&mux, {&hal});
+    for (int seq = 4; seq <= 6; ++seq) {
+        mux.tick(seq * kPeriodNs);
+    }
+    const std::string data = hal.readLines(6);
+    EXPECT_EQ(3u, countLines(data, "$GPRMC"));
+    EXPECT_EQ(3u, countLines(data, "$GPGGA"));
+    const FeedMux::Stats stats = mux.stats();
+    EXPECT_EQ(3u, stats.epochs);
+    EXPECT_EQ(3u, stats.delivered);
+    EXPECT_EQ(data.size(), stats.bytes);
+
+    // a stop holds the epochs back again
+    hal.send(std::string(1, '\x02'));
+    while (mux.stats().started > 0) {
+        mux.wait(100);
+    }
+    mux.tick(7 * kPeriodNs);
+    EXPECT_EQ(3u, mux.stats().epochs);
+}
+
+TEST(FeedMuxTest, EncodesOncePerScenario) {
+    Hal tcp;
+    Hal uds("gnss_feed_mux_test_" + std::to_string(getpid()));
+    FeedMux mux;
+    const int scenario = mux.addScenario(makeScenario());
+    mux.addInstance(tcp.endpoint(), scenario);
+    mux.addInstance(uds.endpoint(), scenario);
+    connectAll(&mux, {&tcp, &uds}, 0);
+    start(&mux, {&tcp, &uds});
+
+    for (int seq = 1; seq <= 5; ++seq) {
+        mux.tick(seq * kPeriodNs);
+    }
+    const std::string data = tcp.readLines(10);
+    EXPECT_EQ(10u, countLines(data, "\n"));
+    EXPECT_EQ(data, uds.readLines(10));
+    const FeedMux::Stats stats = mux.stats();
+    EXPECT_EQ(5u, stats.epochs);
+    EXPECT_EQ(10u, stats.delivered);
+}
+
+TEST(FeedMuxTest, SkipsThePayloadOfPingsAndResumes) {
+    Hal hal;
+    FeedMux mux;
+    mux.addInstance(hal.endpoint(), mux.addScenario(makeScenario()));
+    connectAll(&mux, {&hal}, 0);
+
+    // the payloads are full of start bytes, none of which may count
+    hal.send(std::string(1, '\x03') + std::string(8, '\x01') + '\x04' + std::string(8, '\x01'));
+    while (mux.stats().ignored < 2) {
+        mux.wait(100);
+    }
+    EXPECT_EQ(0u, mux.stats().started);
+    start(&mux, {&hal});
+}
+
+TEST(FeedMuxTest, DropsTheOldestOfAFullBacklog) {
+    Hal hal("gnss_feed_mux_test_backlog_" + std::to_string(getpid()));
+    FeedMuxConfig config;
+    config.maxBacklogEpochs = 4;
+    FeedMux mux(config);
+    MuxScenario scenario = makeScenario();
+    scenario.gsvEvery = 1;
+    mux.addInstance(hal.endpoint(), mux.addScenario(scenario));
+    connectAll(&mux, {&hal}, 0);
+    start(&mux, {&hal});
+
+    // the HAL reads nothing, and without wait() the mux never learns that
+    // the socket drained: once it is full, every epoch goes to the backlog
+    int seq = 1;
+    for (; seq < 100000 && mux.stats().dropped == 0; ++seq) {
+        mux.tick(seq * kPeriodNs);
+    }
+    ASSERT_GT(mux.stats().dropped, 0u);
+    for (int i = 0; i < 10; ++i, ++seq) {
+        mux.tick(seq * kPeriodNs);
+    }
+    // the backlog, and maybe the rest of an epoch written in part
+    const FeedMux::Stats stats = mux.stats();
+    EXPECT_GE(stats.epochs, stats.delivered + stats.dropped + config.maxBacklogEpochs);
+    EXPECT_LE(stats.epochs, stats.delivered + stats.dropped + config.maxBacklogEpochs + 1);
+
+    // once the HAL reads, all of it comes, and every sentence whole
+    std::string data;
+    while (mux.stats().delivered + stats.dropped < stats.epochs ||
+           data.size() < mux.stats().bytes) {
+        data += hal.readLines(SIZE_MAX, 0);
+        mux.wait(10);
+    }
+    EXPECT_EQ(stats.epochs, mux.stats().delivered + stats.dropped);
+    size_t begin = 0;
+    for (size_t end = data.find('\n'); end != std::string::npos; end = data.find('\n', begin)) {
+        const std::string line = data.substr(begin, end + 1 - begin);
+        ASSERT_EQ('$', line[0]) << line;
+        ASSERT_EQ(0u, line.rfind('$')) << line;
+        begin = end + 1;
+    }
+    EXPECT_EQ(data.size(), begin);
+}
+
+TEST(FeedMuxTest, ReconnectsWhenTheHalGoesAway) {
+    Hal hal;
+    FeedMuxConfig config;
+    FeedMux mux(config);
+    mux.addInstance(hal.endpoint(), mux.addScenario(makeScenario()));
+    connectAll(&mux, {&hal}, 0);
+    start(&mux, {&hal});
+
+    hal.hangUp();
+    while (mux.stats().connected > 0) {
+        mux.wait(100);
+    }
+    FeedMux::Stats stats = mux.stats();
+    EXPECT_EQ(1u, stats.reconnects);
+    EXPECT_EQ(0u, stats.started);
+
+    // not before the back-off is over
+    EXPECT_EQ(config.reconnectMinNs, mux.tick(0));
+    connectAll(&mux, {&hal}, config.reconnectMinNs);
+    start(&mux, {&hal});
+
+    // a quit closes it too
+    hal.send(std::string(1, '\0'));
+    while (mux.stats().connected > 0) {
+        mux.wait(100);
+    }
+    EXPECT_EQ(2u, mux.stats().reconnects);
+}
+
+}  // namespace
+}  // namespace sim
+}  // namespace ciccloud
@@ -0,0 +1,164 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "feed_session.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+
+namespace ciccloud {
+namespace {
+constexpr uint64_t kSession = 0x0123456789abcdefULL;
+
+// How many of `n` sentences on the wire the session lets through.
+int deliver(FeedSession* session, const int n) {
+    int accepted = 0;
+    for (int i = 0; i < n; ++i) {
+        accepted += session->accept();
+    }
+    return accepted;
+}
+
+uint64_t takeResume(FeedSession* session) {
+    uint64_t seq = UINT64_MAX;
+    EXPECT_TRUE(session->resumePending(&seq));
+    session->onResumeSent();
+    return seq;
+}
+
+TEST(FeedSessionTest, TakesAFeederWithoutSessionsAsItIs) {
+    FeedSession session;
+    EXPECT_EQ(5, deliver(&session, 5));
+    uint64_t seq;
+    EXPECT_FALSE(session.resumePending(&seq));
+    EXPECT_EQ(-1, session.priority());
+}
+
+TEST(FeedSessionTest, ANewSessionStartsWhereTheFeederIs) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    EXPECT_EQ(10u, takeResume(&session));
+    session.onHeader(kSession, 10);
+    EXPECT_EQ(3, deliver(&session, 3));
+    EXPECT_EQ(0u, session.resumes());
+    EXPECT_EQ(0u, session.duplicates());
+    EXPECT_EQ(0u, session.lost());
+}
+
+TEST(FeedSessionTest, ResumesAKnownSessionAtTheFirstSeqNotDelivered) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    takeResume(&session);
+    session.onHeader(kSession, 10);
+    deliver(&session, 5);  // 10..14
+    session.onDisconnect();
+
+    // the feeder sent up to 19 meanwhile, we ask for 15 on
+    session.onHello(kSession, 20);
+    EXPECT_EQ(15u, takeResume(&session));
+    EXPECT_EQ(1u, session.resumes());
+    session.onHeader(kSession, 15);
+    EXPECT_EQ(5, deliver(&session, 5));
+    EXPECT_EQ(0u, session.duplicates());
+    EXPECT_EQ(0u, session.lost());
+}
+
+TEST(FeedSessionTest, NeverAsksForMoreThanTheFeederHas) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    takeResume(&session);
+    session.onHeader(kSession, 10);
+    deliver(&session, 5);
+    session.onDisconnect();
+
+    session.onHello(kSession, 12);
+    EXPECT_EQ(12u, takeResume(&session));
+}
+
+TEST(FeedSessionTest, DropsDuplicatesAndCountsTheLost) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    takeResume(&session);
+    session.onHeader(kSession, 10);
+    deliver(&session, 5);  // 10..14
+
+    // a replay from 12: 12..14 again, then 15 and 16
+    session.onHeader(kSession, 12);
+    EXPECT_EQ(2, deliver(&session, 5));
+    EXPECT_EQ(3u, session.duplicates());
+
+    // 17..19 never came
+    session.onHeader(kSession, 20);
+    EXPECT_EQ(1, deliver(&session, 1));
+    EXPECT_EQ(3u, session.lost());
+}
+
+TEST(FeedSessionTest, AHeaderWithoutAHelloStartsTheSession) {
+    FeedSession session;
+    session.onHeader(kSession, 100);
+    EXPECT_EQ(2, deliver(&session, 2));
+    EXPECT_EQ(0u, session.lost());
+    uint64_t seq;
+    EXPECT_FALSE(session.resumePending(&seq));
+}
+
+TEST(FeedSessionTest, AnotherSessionStartsOver) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    takeResume(&session);
+    session.onHeader(kSession, 10);
+    deliver(&session, 5);
+    session.onDisconnect();
+
+    session.onHello(kSession + 1, 3);
+    EXPECT_EQ(3u, takeResume(&session));
+    EXPECT_EQ(0u, session.resumes());
+    session.onHeader(kSession + 1, 3);
+    EXPECT_EQ(2, deliver(&session, 2));
+    EXPECT_EQ(0u, session.duplicates());
+}
+
+TEST(FeedSessionTest, AResumeStaysPendingUntilSent) {
+    FeedSession session;
+    session.onHello(kSession, 10);
+    uint64_t seq = 0;
+    EXPECT_TRUE(session.resumePending(&seq));
+    EXPECT_TRUE(session.resumePending(&seq));  // the write failed, try again
+    EXPECT_EQ(10u, seq);
+    session.onResumeSent();
+    EXPECT_FALSE(session.resumePending(&seq));
+
+    // one for a feeder which left is not sent to the next
+    session.onHello(kSession, 10);
+    session.onDisconnect();
+    EXPECT_FALSE(session.resumePending(&seq));
+}
+
+TEST(FeedSessionTest, ADisconnectEndsTheNumberingAndThePriority) {
+    FeedSession session;
+    session.onHeader(kSession, 10);
+    session.onPriority(3);
+    EXPECT_EQ(3, session.priority());
+    deliver(&session, 5);
+
+    session.onDisconnect();
+    EXPECT_EQ(-1, session.priority());
+    // unnumbered until the next header, nothing is a duplicate
+    EXPECT_EQ(3, deliver(&session, 3));
+    EXPECT_EQ(0u, session.duplicates());
+}
+
+}  // namespace
+}  // namespace ciccloud
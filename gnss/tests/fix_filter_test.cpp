@@ -0,0 +1,267 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fix_filter.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <cstdint>
+#include <random>
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kEarthRadiusMeters = 6371000;
+constexpr double kLat0 = 37.422;
+constexpr double kLon0 = -122.084;
+constexpr int64_t kPeriodMs = 100;
+constexpr float kHdop = 1;  // 4 m for a GPS fix
+constexpr int kGps = 1;
+
+// A point of a track, on a plane around (kLat0, kLon0).
+struct Truth {
+    double east = 0;
+    double north = 0;
+    double speed = 0;
+    double bearingDegrees = 0;
+};
+
+// Straight on, or turning at `turnDegreesPerSec`, from the origin.
+Truth track(const double t, const double speed, const double bearing0Degrees,
+            const double turnDegreesPerSec) {
+    Truth p;
+    p.speed = speed;
+    const double b0 = bearing0Degrees * kPi / 180;
+    if (turnDegreesPerSec == 0) {
+        p.east = speed * t * std::sin(b0);
+        p.north = speed * t * std::cos(b0);
+        p.bearingDegrees = bearing0Degrees;
+    } else {
+        const double w = turnDegreesPerSec * kPi / 180;
+        const double r = speed / w;
+        p.east = r * (std::cos(b0) - std::cos(b0 + w * t));
+        p.north = r * (std::sin(b0 + w * t) - std::sin(b0));
+        p.bearingDegrees = std::fmod(bearing0Degrees + turnDegreesPerSec * t + 360, 360);
+    }
+    return p;
+}
+
+double eastOf(const Location& loc) {
+    return (loc.longitudeDegrees - kLon0) * kPi / 180 * kEarthRadiusMeters *
+           std::cos(kLat0 * kPi / 180);
+}
+double northOf(const Location& loc) {
+    return (loc.latitudeDegrees - kLat0) * kPi / 180 * kEarthRadiusMeters;
+}
+double errorOf(const Location& loc, const Truth& p) {
+    return std::hypot(eastOf(loc) - p.east, northOf(loc) - p.north);
+}
+
+// A fix of `p` as GGA and RMC would give it, with the noise of a GPS fix.
+class Receiver {
+public:
+    Location fix(const Truth& p, const int64_t timeMs, const bool withVelocity = true) {
+        const double sigma = horizontalErrorMeters(kHdop, kGps) / std::sqrt(2.);
+        Location loc;
+        loc.flags = LocationFlags::HAS_LAT_LONG | LocationFlags::HAS_HORIZONTAL_ACCURACY;
+        loc.latitudeDegrees = kLat0 + (p.north + sigma * m_normal(m_rng)) / kEarthRadiusMeters * 180 / kPi;
+        loc.longitudeDegrees = kLon0 + (p.east + sigma * m_normal(m_rng)) /
+            (kEarthRadiusMeters * std::cos(kLat0 * kPi / 180)) * 180 / kPi;
+        loc.horizontalAccuracyMeters = horizontalErrorMeters(kHdop, kGps);
+        loc.utcTimeOfDayMs = timeMs;
+        if (withVelocity) {
+            loc.flags |= LocationFlags::HAS_SPEED | LocationFlags::HAS_BEARING |
+                         LocationFlags::HAS_SPEED_ACCURACY;
+            const double ve = p.speed * std::sin(p.bearingDegrees * kPi / 180) + 0.5 * m_normal(m_rng);
+            const double vn = p.speed * std::cos(p.bearingDegrees * kPi / 180) + 0.5 * m_normal(m_rng);
+            loc.speedMetersPerSec = std::hypot(ve, vn);
+            loc.bearingDegrees = std::fmod(std::atan2(ve, vn) * 180 / kPi + 360, 360);
+            loc.speedAccuracyMetersPerSecond = 0.5;
+        }
+        return loc;
+    }
+
+private:
+    std::mt19937 m_rng{42};
+    std::normal_distribution<double> m_normal;
+};
+
+// The RMS position error of the raw fixes and of the filtered ones, over
+// the second half of `epochs` epochs of a track.
+struct Errors {
+    double raw = 0;
+    double filtered = 0;
+};
+
+Errors run(const FixFilterModel model, const double turnDegreesPerSec, const int epochs,
+           const bool withVelocity) {
+    FixFilterConfig config;
+    config.model = model;
+    FixFilter filter(config);
+    Receiver receiver;
+    double raw = 0;
+    double filtered = 0;
+    for (int i = 0; i < epochs; ++i) {
+        const Truth p = track(i * kPeriodMs / 1000., 15, 30, turnDegreesPerSec);
+        Location loc = receiver.fix(p, 43200000 + i * kPeriodMs, withVelocity);
+        const double rawError = errorOf(loc, p);
+        filter.update(&loc, kGps);
+        if (i >= epochs / 2) {
+            raw += rawError * rawError;
+            filtered += errorOf(loc, p) * errorOf(loc, p);
+        }
+    }
+    const int n = epochs - epochs / 2;
+    return {std::sqrt(raw / n), std::sqrt(filtered / n)};
+}
+
+TEST(FixFilterTest, OffLeavesTheFixAlone) {
+    FixFilter filter(FixFilterConfig{});
+    EXPECT_FALSE(filter.enabled());
+    Receiver receiver;
+    const Location before = receiver.fix(track(0, 15, 30, 0), 0);
+    Location loc = before;
+    filter.update(&loc, kGps);
+    EXPECT_EQ(before.latitudeDegrees, loc.latitudeDegrees);
+    EXPECT_EQ(before.longitudeDegrees, loc.longitudeDegrees);
+    EXPECT_EQ(before.horizontalAccuracyMeters, loc.horizontalAccuracyMeters);
+}
+
+TEST(FixFilterTest, ConstantVelocityConvergesOnAStraightTrack) {
+    FixFilterConfig config;
+    config.model = FixFilterModel::CONSTANT_VELOCITY;
+    FixFilter filter(config);
+    Receiver receiver;
+    Location loc;
+    Truth p;
+    for (int i = 0; i < 300; ++i) {
+        p = track(i * kPeriodMs / 1000., 15, 30, 0);
+        loc = receiver.fix(p, 43200000 + i * kPeriodMs);
+        filter.update(&loc, kGps);
+    }
+    // within three of the sigmas it gives, which are below the ones of a fix
+    ASSERT_TRUE(loc.flags & LocationFlags::HAS_SPEED_ACCURACY);
+    ASSERT_TRUE(loc.flags & LocationFlags::HAS_BEARING_ACCURACY);
+    EXPECT_LT(loc.speedAccuracyMetersPerSecond, 0.5);
+    EXPECT_NEAR(15, loc.speedMetersPerSec, 3 * loc.speedAccuracyMetersPerSecond);
+    EXPECT_NEAR(30, loc.bearingDegrees, 3 * loc.bearingAccuracyDegrees);
+    EXPECT_LT(errorOf(loc, p), 3 * loc.horizontalAccuracyMeters);
+
+    const Errors e = run(FixFilterModel::CONSTANT_VELOCITY, 0, 300, true);
+    EXPECT_LT(e.filtered, e.raw / 2);
+}
+
+TEST(FixFilterTest, ConstantVelocityLearnsTheVelocityFromPositions) {
+    FixFilterConfig config;
+    config.model = FixFilterModel::CONSTANT_VELOCITY;
+    FixFilter filter(config);
+    Receiver receiver;
+    Location loc;
+    for (int i = 0; i < 300; ++i) {
+        loc = receiver.fix(track(i * kPeriodMs / 1000., 15, 30, 0), 43200000 + i * kPeriodMs,
+                           false);
+        filter.update(&loc, kGps);
+    }
+    const Errors e = run(FixFilterModel::CONSTANT_VELOCITY, 0, 300, false);
+    EXPECT_LT(e.filtered, e.raw / 1.5);
+}
+
+TEST(FixFilterTest, BothModelsFollowATurn) {
+    // 15 m/s at 10 deg/s: 2.6 m/s^2 to the side
+    for (const FixFilterModel model :
+         {FixFilterModel::CONSTANT_VELOCITY, FixFilterModel::CONSTANT_ACCELERATION}) {
+        const Errors e = run(model, 10, 400, true);
+        EXPECT_LT(e.filtered, e.raw) << static_cast<int>(model);
+    }
+    // without velocities, only the one which models the acceleration
+    const Errors cv = run(FixFilterModel::CONSTANT_VELOCITY, 10, 400, false);
+    const Errors ca = run(FixFilterModel::CONSTANT_ACCELERATION, 10, 400, false);
+    EXPECT_LT(ca.filtered, ca.raw);
+    EXPECT_LT(ca.filtered, cv.filtered);
+}
+
+TEST(FixFilterTest, TheAccuracyShrinksAsFixesCome) {
+    for (const FixFilterModel model :
+         {FixFilterModel::CONSTANT_VELOCITY, FixFilterModel::CONSTANT_ACCELERATION}) {
+        FixFilterConfig config;
+        config.model = model;
+        FixFilter filter(config);
+        Receiver receiver;
+        float accuracy = horizontalErrorMeters(kHdop, kGps);
+        for (int i = 0; i < 20; ++i) {
+            Location loc = receiver.fix(Truth(), 43200000 + i * kPeriodMs);
+            filter.update(&loc, kGps);
+            EXPECT_LE(loc.horizontalAccuracyMeters, accuracy + 1e-6) << i;
+            accuracy = loc.horizontalAccuracyMeters;
+        }
+        EXPECT_LT(accuracy, horizontalErrorMeters(kHdop, kGps) / 2);
+    }
+}
+
+TEST(FixFilterTest, MeasuresAnEpochOnce) {
+    FixFilterConfig config;
+    config.model = FixFilterModel::CONSTANT_VELOCITY;
+    FixFilter filter(config);
+    Receiver receiver;
+    Location loc;
+    for (int i = 0; i < 5; ++i) {
+        loc = receiver.fix(Truth(), 43200000 + i * kPeriodMs);
+        filter.update(&loc, kGps);
+    }
+    // GGA after RMC: the same sentence time adds nothing
+    Location again = receiver.fix(Truth(), 43200000 + 4 * kPeriodMs);
+    filter.update(&again, kGps);
+    EXPECT_FLOAT_EQ(loc.horizontalAccuracyMeters, again.horizontalAccuracyMeters);
+    EXPECT_DOUBLE_EQ(loc.latitudeDegrees, again.latitudeDegrees);
+}
+
+TEST(FixFilterTest, AnInvalidFixOnlyPredicts) {
+    FixFilterConfig config;
+    config.model = FixFilterModel::CONSTANT_VELOCITY;
+    FixFilter filter(config);
+    Receiver receiver;
+    Location loc;
+    for (int i = 0; i < 5; ++i) {
+        loc = receiver.fix(Truth(), 43200000 + i * kPeriodMs);
+        filter.update(&loc, kGps);
+    }
+    Location invalid = receiver.fix(Truth(), 43200000 + 5 * kPeriodMs);
+    filter.update(&invalid, 0);
+    EXPECT_GT(invalid.horizontalAccuracyMeters, loc.horizontalAccuracyMeters);
+}
+
+TEST(FixFilterTest, StartsOverAfterAGapButNotAtMidnight) {
+    FixFilterConfig config;
+    config.model = FixFilterModel::CONSTANT_VELOCITY;
+    FixFilter filter(config);
+    Receiver receiver;
+    const int64_t kDayMs = 86400000;
+    Location loc;
+    for (int i = 0; i < 5; ++i) {
+        loc = receiver.fix(Truth(), kDayMs - 5 * kPeriodMs + i * kPeriodMs);
+        filter.update(&loc, kGps);
+    }
+    const float settled = loc.horizontalAccuracyMeters;
+    loc = receiver.fix(Truth(), 0);  // the next epoch, past midnight
+    filter.update(&loc, kGps);
+    EXPECT_LT(loc.horizontalAccuracyMeters, settled);
+
+    loc = receiver.fix(Truth(), 20000);  // 20 s later
+    filter.update(&loc, kGps);
+    EXPECT_FLOAT_EQ(horizontalErrorMeters(kHdop, kGps), loc.horizontalAccuracyMeters);
+}
+
+}  // namespace
+}  // namespace ciccloud
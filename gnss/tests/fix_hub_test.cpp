@@ -0,0 +1,243 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "fix_hub.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ciccloud {
+namespace {
+
+Location makeLocation(const int i) {
+    Location loc;
+    loc.flags = LocationFlags::HAS_LAT_LONG;
+    loc.latitudeDegrees = i;
+    return loc;
+}
+
+// Keeps the fixes it gets, or only their sequence numbers.
+class Recorder : public FixSubscriber {
+public:
+    explicit Recorder(const bool keep = false) : m_keep(keep) {}
+
+    void onFix(const FixRef& fix) override {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_seqs.push_back(fix->seq());
+        if (m_keep) {
+            m_kept.push_back(fix);
+        }
+    }
+
+    std::vector<uint64_t> seqs() const {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_seqs;
+    }
+    void release() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_kept.clear();
+    }
+
+private:
+    const bool m_keep;
+    mutable std::mutex m_mtx;
+    std::vector<uint64_t> m_seqs;
+    std::vector<FixRef> m_kept;
+};
+
+// Blocks in its first onFix() until opened, so that what is published
+// meanwhile waits in its queue or slot.
+class GatedRecorder : public Recorder {
+public:
+    void onFix(const FixRef& fix) override {
+        Recorder::onFix(fix);
+        std::unique_lock<std::mutex> lock(m_gateMtx);
+        m_entered = true;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this]() { return m_open; });
+    }
+
+    void waitEntered() {
+        std::unique_lock<std::mutex> lock(m_gateMtx);
+        m_cv.wait(lock, [this]() { return m_entered; });
+    }
+    void open() {
+        std::lock_guard<std::mutex> lock(m_gateMtx);
+        m_open = true;
+        m_cv.notify_all();
+    }
+
+private:
+    std::mutex m_gateMtx;
+    std::condition_variable m_cv;
+    bool m_entered = false;
+    bool m_open = false;
+};
+
+bool waitDelivered(const FixHub& hub, const FixSubscriber* s, const uint64_t n) {
+    const auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (hub.stats(s).delivered < n) {
+        if (std::chrono::steady_clock::now() > deadline) {
+            return false;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+TEST(FixHubTest, InlineGetsEveryFixInOrder) {
+    FixHub hub;
+    Recorder r;
+    ASSERT_TRUE(hub.subscribe(&r, FixDelivery::INLINE));
+    for (int i = 0; i < 5; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    EXPECT_EQ((std::vector<uint64_t>{1, 2, 3, 4, 5}), r.seqs());
+    EXPECT_EQ(5u, hub.stats(&r).delivered);
+    hub.unsubscribe(&r);
+}
+
+TEST(FixHubTest, SubscribersAreLimited) {
+    FixHub hub;
+    std::vector<Recorder> recorders(FixHub::kMaxSubscribers + 1);
+    for (size_t i = 0; i < FixHub::kMaxSubscribers; ++i) {
+        ASSERT_TRUE(hub.subscribe(&recorders[i], FixDelivery::INLINE));
+    }
+    EXPECT_FALSE(hub.subscribe(&recorders[0], FixDelivery::INLINE));  // already is
+    EXPECT_FALSE(hub.subscribe(&recorders.back(), FixDelivery::INLINE));
+    hub.unsubscribe(&recorders[0]);
+    EXPECT_TRUE(hub.subscribe(&recorders.back(), FixDelivery::INLINE));
+    for (Recorder& r : recorders) {
+        hub.unsubscribe(&r);
+    }
+}
+
+TEST(FixHubTest, FullQueueDropsTheOldest) {
+    FixHub hub;
+    GatedRecorder slow;
+    Recorder fast;
+    ASSERT_TRUE(hub.subscribe(&slow, FixDelivery::QUEUE, 4));
+    ASSERT_TRUE(hub.subscribe(&fast, FixDelivery::INLINE));
+
+    hub.publish(makeLocation(1));
+    slow.waitEntered();  // holds fix 1
+    for (int i = 2; i <= 11; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    // the publisher went on, and so did the others
+    EXPECT_EQ(11u, fast.seqs().size());
+    EXPECT_EQ(6u, hub.stats(&slow).dropped);
+
+    slow.open();
+    ASSERT_TRUE(waitDelivered(hub, &slow, 5));
+    EXPECT_EQ((std::vector<uint64_t>{1, 8, 9, 10, 11}), slow.seqs());
+    hub.unsubscribe(&slow);
+    hub.unsubscribe(&fast);
+}
+
+TEST(FixHubTest, LatestOnlySupersedes) {
+    FixHub hub;
+    GatedRecorder slow;
+    ASSERT_TRUE(hub.subscribe(&slow, FixDelivery::LATEST));
+
+    hub.publish(makeLocation(1));
+    slow.waitEntered();
+    for (int i = 2; i <= 10; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    EXPECT_EQ(8u, hub.stats(&slow).superseded);
+
+    slow.open();
+    ASSERT_TRUE(waitDelivered(hub, &slow, 2));
+    EXPECT_EQ((std::vector<uint64_t>{1, 10}), slow.seqs());
+    EXPECT_EQ(0u, hub.stats(&slow).dropped);
+    hub.unsubscribe(&slow);
+}
+
+TEST(FixHubTest, PoolIsReused) {
+    FixHub hub;
+    Recorder r;
+    ASSERT_TRUE(hub.subscribe(&r, FixDelivery::INLINE));
+    hub.publish(makeLocation(0));
+    const size_t pool = hub.poolSize();
+    EXPECT_GT(pool, 0u);
+    for (int i = 1; i < 10000; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    EXPECT_EQ(pool, hub.poolSize());
+    hub.unsubscribe(&r);
+}
+
+TEST(FixHubTest, PoolGrowsWithWhatSubscribersKeep) {
+    FixHub hub;
+    Recorder keeper(true);
+    ASSERT_TRUE(hub.subscribe(&keeper, FixDelivery::INLINE));
+    hub.publish(makeLocation(0));
+    const size_t pool = hub.poolSize();
+    for (size_t i = 1; i <= pool; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    EXPECT_GT(hub.poolSize(), pool);
+
+    // and is reused once they let go
+    keeper.release();
+    const size_t grown = hub.poolSize();
+    for (size_t i = 0; i < 4 * grown; ++i) {
+        hub.publish(makeLocation(i));
+        keeper.release();
+    }
+    EXPECT_EQ(grown, hub.poolSize());
+    hub.unsubscribe(&keeper);
+}
+
+TEST(FixHubTest, UnsubscribeReleasesWhatWasWaiting) {
+    FixHub hub;
+    GatedRecorder slow;
+    ASSERT_TRUE(hub.subscribe(&slow, FixDelivery::QUEUE, 16));
+    hub.publish(makeLocation(0));
+    slow.waitEntered();
+    const size_t pool = hub.poolSize();
+    // 17 held: 1 in onFix() and 16 waiting
+    for (int i = 0; i < 16; ++i) {
+        hub.publish(makeLocation(i));
+    }
+
+    std::thread opener([&slow]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        slow.open();
+    });
+    hub.unsubscribe(&slow);
+    opener.join();
+    // not called any more once unsubscribe() returned
+    EXPECT_EQ(1u, slow.seqs().size());
+
+    // the waiting fixes went back to the pool: a subscriber which keeps
+    // as many as the pool has fits in it
+    Recorder keeper(true);
+    ASSERT_TRUE(hub.subscribe(&keeper, FixDelivery::INLINE));
+    for (size_t i = 0; i < pool; ++i) {
+        hub.publish(makeLocation(i));
+    }
+    EXPECT_EQ(pool, hub.poolSize());
+    keeper.release();
+    hub.unsubscribe(&keeper);
+}
+
+}  // namespace
+}  // namespace ciccloud
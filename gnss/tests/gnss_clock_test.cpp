@@ -0,0 +1,173 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "gnss_clock.h"
+#include <gtest/gtest.h>
+#include <cmath>
+#include <random>
+#include "util.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kSecondNs = 1000000000LL;
+constexpr int64_t kGps0Ns = 1269648018LL * kSecondNs;  // 2020-04-01 in GPS time
+constexpr int64_t kBoot0Ns = 3600 * kSecondNs;
+
+// What a measurement says GPS time is.
+int64_t gpsTimeOf(const GnssClockSample& s) {
+    return s.timeNs - (s.fullBiasNs + static_cast<int64_t>(s.biasNs));
+}
+
+TEST(GnssClockModelTest, FullBiasStaysPutWhileTheFeedJitters) {
+    GnssClockModel model;
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int64_t> jitterNs(-5000000, 5000000);
+
+    GnssClockSample first;
+    ASSERT_TRUE(model.update(kBoot0Ns, kGps0Ns, &first));
+    EXPECT_EQ(kBoot0Ns - kGps0Ns, first.fullBiasNs);
+    EXPECT_EQ(kBoot0Ns, first.timeNs);
+
+    GnssClockSample prev = first;
+    for (int i = 1; i <= 600; ++i) {
+        const int64_t gpsNs = kGps0Ns + i * kSecondNs;
+        GnssClockSample s;
+        ASSERT_TRUE(model.update(kBoot0Ns + i * kSecondNs + jitterNs(rng), gpsNs, &s));
+        EXPECT_EQ(first.fullBiasNs, s.fullBiasNs);
+        EXPECT_EQ(first.discontinuities, s.discontinuities);
+        EXPECT_EQ(gpsNs, gpsTimeOf(s));
+        EXPECT_GT(s.timeNs, prev.timeNs);
+        // the loop smooths the jitter out of the bias
+        EXPECT_LT(std::abs(s.biasNs), 5000000);
+        prev = s;
+    }
+}
+
+TEST(GnssClockModelTest, BiasFollowsADriftingFeed) {
+    GnssClockModel model;
+    constexpr int64_t kDriftNsps = 20000;  // boottime runs 20 ppm fast
+    GnssClockSample s;
+    for (int i = 0; i <= 4000; ++i) {
+        ASSERT_TRUE(model.update(kBoot0Ns + i * (kSecondNs + kDriftNsps),
+                                 kGps0Ns + i * kSecondNs, &s));
+    }
+    EXPECT_EQ(0u, s.discontinuities);
+    EXPECT_EQ(kBoot0Ns - kGps0Ns, s.fullBiasNs);
+    // the model keeps up with the offset, 80 ms by now
+    EXPECT_NEAR(4000 * kDriftNsps, s.biasNs, 100000);
+    EXPECT_NEAR(kDriftNsps, s.driftNsps, kDriftNsps / 10);
+}
+
+TEST(GnssClockModelTest, SmallStepIsAbsorbed) {
+    GnssClockModel model;
+    GnssClockSample s;
+    ASSERT_TRUE(model.update(kBoot0Ns, kGps0Ns, &s));
+    const int64_t stepNs = GnssClockModel::kResyncNs / 2;
+    ASSERT_TRUE(model.update(kBoot0Ns + kSecondNs + stepNs, kGps0Ns + kSecondNs, &s));
+    EXPECT_EQ(0u, s.discontinuities);
+    EXPECT_EQ(kBoot0Ns - kGps0Ns, s.fullBiasNs);
+}
+
+TEST(GnssClockModelTest, LargeStepResyncs) {
+    GnssClockModel model;
+    GnssClockSample s;
+    ASSERT_TRUE(model.update(kBoot0Ns, kGps0Ns, &s));
+    ASSERT_TRUE(model.update(kBoot0Ns + kSecondNs, kGps0Ns + kSecondNs, &s));
+    const uint32_t discontinuities = s.discontinuities;
+
+    // the feeder's clock stepped by 2 s
+    const int64_t gpsNs = kGps0Ns + 2 * kSecondNs;
+    const int64_t bootNs = kBoot0Ns + 4 * kSecondNs;
+    ASSERT_TRUE(model.update(bootNs, gpsNs, &s));
+    EXPECT_EQ(discontinuities + 1, s.discontinuities);
+    EXPECT_EQ(bootNs - gpsNs, s.fullBiasNs);
+    EXPECT_EQ(0, s.biasNs);
+    EXPECT_EQ(gpsNs, gpsTimeOf(s));
+
+    // and stays on the new timeline
+    ASSERT_TRUE(model.update(bootNs + kSecondNs, gpsNs + kSecondNs, &s));
+    EXPECT_EQ(discontinuities + 1, s.discontinuities);
+    EXPECT_EQ(bootNs - gpsNs, s.fullBiasNs);
+}
+
+TEST(GnssClockModelTest, ResetStartsANewTimeline) {
+    GnssClockModel model;
+    GnssClockSample s;
+    ASSERT_TRUE(model.update(kBoot0Ns, kGps0Ns, &s));
+    const uint32_t discontinuities = s.discontinuities;
+
+    model.reset();
+    model.reset();  // once is enough
+    // a new session may start anywhere, even before the last epoch
+    const int64_t gpsNs = kGps0Ns - 10 * kSecondNs;
+    const int64_t bootNs = kBoot0Ns + 30 * kSecondNs;
+    ASSERT_TRUE(model.update(bootNs, gpsNs, &s));
+    EXPECT_EQ(discontinuities + 1, s.discontinuities);
+    EXPECT_EQ(bootNs - gpsNs, s.fullBiasNs);
+}
+
+TEST(GnssClockModelTest, RejectsAnEpochNotAfterThePreviousOne) {
+    GnssClockModel model;
+    GnssClockSample s;
+    ASSERT_TRUE(model.update(kBoot0Ns, kGps0Ns, &s));
+    ASSERT_TRUE(model.update(kBoot0Ns + kSecondNs, kGps0Ns + kSecondNs, &s));
+    const GnssClockSample before = s;
+
+    EXPECT_FALSE(model.update(kBoot0Ns + 2 * kSecondNs, kGps0Ns + kSecondNs, &s));
+    EXPECT_FALSE(model.update(kBoot0Ns + 2 * kSecondNs, kGps0Ns, &s));
+    EXPECT_EQ(before.timeNs, s.timeNs);
+
+    ASSERT_TRUE(model.update(kBoot0Ns + 2 * kSecondNs, kGps0Ns + 2 * kSecondNs, &s));
+    EXPECT_EQ(before.discontinuities, s.discontinuities);
+    EXPECT_EQ(before.fullBiasNs, s.fullBiasNs);
+}
+
+// A fix of the feed at `utcMs`, taken at boottime `bootNs`.
+Location fixAt(const int64_t utcMs, const int64_t bootNs) {
+    Location fix;
+    fix.timestampMs = utcMs;
+    fix.utcTimeOfDayMs = utcMs % (24 * 3600 * 1000);
+    fix.elapsedRealtimeNs = bootNs;
+    return fix;
+}
+
+TEST(GnssSessionClockTest, ANewSessionStartsANewTimeline) {
+    constexpr int64_t kUtc0Ms = 1585742400000LL;  // 2020-04-01 12:00
+    GnssSessionClock clock;
+    clock.onStatus(GnssStatus::SESSION_BEGIN);
+    GnssClockSample s;
+    for (int i = 0; i < 5; ++i) {
+        ASSERT_TRUE(clock.onEpoch(fixAt(kUtc0Ms + i * 1000, kBoot0Ns + i * kSecondNs), &s));
+    }
+    const GnssClockSample first = s;
+    const int64_t gpsNs = util::utcToGpsNanos(kUtc0Ms * 1000000);
+    EXPECT_EQ(gpsNs + 4 * kSecondNs, s.gpsTimeNs);
+    clock.onStatus(GnssStatus::SESSION_END);
+    clock.onStatus(GnssStatus::ENGINE_OFF);
+
+    // the feeder replays from where the last session started, 50 ms late:
+    // rejected as not after the last epoch, and absorbed as a small step if
+    // the session did not start over
+    clock.onStatus(GnssStatus::SESSION_BEGIN);
+    const int64_t bootNs = kBoot0Ns + 10 * kSecondNs + 50000000;
+    ASSERT_TRUE(clock.onEpoch(fixAt(kUtc0Ms, bootNs), &s));
+    EXPECT_EQ(first.discontinuities + 1, s.discontinuities);
+    EXPECT_EQ(bootNs - gpsNs, s.fullBiasNs);
+    EXPECT_EQ(0, s.biasNs);
+}
+
+}  // namespace
+}  // namespace ciccloud
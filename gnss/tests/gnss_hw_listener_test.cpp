@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "gnss_hw_listener.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kNoonMs = 12 * 3600 * 1000;
+
+// Counts the epochs the listener hands out.
+class Recorder : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override { ++locations; }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+    void gnssEpoch(const Location&) const override { ++epochs; }
+
+    mutable int locations = 0;
+    mutable int epochs = 0;
+};
+
+class GnssHwListenerTest : public ::testing::Test {
+protected:
+    GnssHwListenerTest()
+        : m_trajectory(kNoonMs, 37.422, -122.084, 10, 0, 0, 0)
+        , m_listener(&m_recorder) {}
+
+    enum Sentence { RMC, GGA, GSV, BROKEN_RMC };
+
+    // One 1 Hz epoch `i` of the `sentences`, in a read of its own.
+    void epoch(const int i, std::initializer_list<Sentence> sentences) {
+        const sim::TrajectoryPoint p = m_trajectory.at(kNoonMs + i * 1000);
+        const sim::NmeaFormat format;
+        std::string data;
+        char buf[128];
+        for (const Sentence s : sentences) {
+            size_t n = 0;
+            switch (s) {
+                case RMC:
+                case BROKEN_RMC:
+                    n = sim::formatRMC(p, format, buf, sizeof(buf));
+                    break;
+                case GGA:
+                    n = sim::formatGGA(p, format, buf, sizeof(buf));
+                    break;
+                case GSV:
+                    n = sim::formatGSV(p, format, 1, buf, sizeof(buf));
+                    break;
+            }
+            ASSERT_GT(n, 5u);
+            if (s == BROKEN_RMC) {
+                buf[n - 3] = (buf[n - 3] == '0') ? '1' : '0';  // the checksum
+            }
+            data.append(buf, n);
+        }
+        m_listener.consume(data.data(), data.size(), i * 1000000000LL);
+    }
+
+    sim::Trajectory m_trajectory;
+    Recorder m_recorder;
+    GnssHwListener m_listener;
+};
+
+TEST_F(GnssHwListenerTest, TheFirstRmcLeadsTheEpochs) {
+    for (int i = 0; i < 4; ++i) {
+        epoch(i, {RMC, GGA, GSV});
+    }
+    EXPECT_EQ(3u, m_listener.epochs());
+    EXPECT_EQ(4, m_recorder.epochs);
+}
+
+TEST_F(GnssHwListenerTest, AGsvAheadOfTheFirstFixDoesNotLead) {
+    // what was left of an epoch before the connection
+    epoch(0, {GSV});
+    for (int i = 1; i < 4; ++i) {
+        epoch(i, {RMC, GGA});
+    }
+    EXPECT_EQ(2u, m_listener.epochs());
+    EXPECT_EQ(3, m_recorder.epochs);
+}
+
+TEST_F(GnssHwListenerTest, ABrokenSentenceDoesNotLead) {
+    epoch(0, {BROKEN_RMC, GGA});
+    for (int i = 1; i < 4; ++i) {
+        epoch(i, {GGA, GSV});
+    }
+    EXPECT_EQ(3u, m_listener.epochs());
+    EXPECT_EQ(4, m_recorder.epochs);
+}
+
+TEST_F(GnssHwListenerTest, AFeederOfGgaOnlyAfterOneOfRmcLeadsWithGga) {
+    for (int i = 0; i < 3; ++i) {
+        epoch(i, {RMC, GGA});
+    }
+    EXPECT_EQ(2u, m_listener.epochs());
+    EXPECT_EQ(3, m_recorder.epochs);
+
+    // reconnected to another feeder
+    m_listener.reset();
+    for (int i = 3; i < 7; ++i) {
+        epoch(i, {GGA, GSV});
+    }
+    EXPECT_EQ(5u, m_listener.epochs());
+    EXPECT_EQ(7, m_recorder.epochs);
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "jitter_buffer.h"
+#include <gtest/gtest.h>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "clock.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kBootNs = 1000 * 1000 * kMsToNs;
+constexpr int64_t kDayMs = 24 * 3600 * 1000;
+constexpr int64_t kNoonMs = kDayMs / 2;
+
+// What the release thread hands out: sentence times, and when on the clock.
+class Recorder : public GnssSink {
+public:
+    struct Event {
+        int64_t todMs;
+        int64_t atMs;  // past kBootNs
+        bool epoch;
+        bool operator==(const Event& o) const {
+            return todMs == o.todMs && atMs == o.atMs && epoch == o.epoch;
+        }
+    };
+
+    explicit Recorder(const Clock& clock) : m_clock(clock) {}
+
+    void gnssLocation(const Location& loc) const override { record(loc, false); }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+    void gnssEpoch(const Location& fix) const override { record(fix, true); }
+
+    // Waits for `n` events in all, false if they do not come.
+    bool waitFor(const size_t n) const {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        return m_cv.wait_for(lock, std::chrono::seconds(5), [&]() { return m_events.size() >= n; });
+    }
+
+    std::vector<Event> events() const {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        return m_events;
+    }
+
+private:
+    void record(const Location& loc, const bool epoch) const {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_events.push_back({loc.utcTimeOfDayMs, (m_clock.bootNanos() - kBootNs) / kMsToNs, epoch});
+        m_cv.notify_all();
+    }
+
+    const Clock& m_clock;
+    mutable std::mutex m_mtx;
+    mutable std::condition_variable m_cv;
+    mutable std::vector<Event> m_events;
+};
+
+class JitterBufferTest : public ::testing::Test {
+protected:
+    JitterBufferTest() : m_clock(0, kBootNs), m_recorder(m_clock) {
+        JitterBufferConfig config;
+        config.targetDelayMs = 100;
+        config.adaptive = false;
+        m_buffer = std::make_unique<JitterBuffer>(&m_recorder, config, m_clock);
+    }
+
+    static Location at(const int64_t todMs) {
+        Location loc;
+        loc.flags = LocationFlags::HAS_LAT_LONG;
+        loc.utcTimeOfDayMs = todMs;
+        return loc;
+    }
+
+    // The location of sentence time `todMs` arrives `atMs` past kBootNs.
+    void arrive(const int64_t atMs, const int64_t todMs) {
+        m_clock.advanceTo(kBootNs + atMs * kMsToNs);
+        m_buffer->gnssLocation(at(todMs));
+    }
+
+    // Moves the clock and waits for `n` events out in all.
+    void releaseAt(const int64_t atMs, const size_t n) {
+        m_clock.advanceTo(kBootNs + atMs * kMsToNs);
+        ASSERT_TRUE(m_recorder.waitFor(n)) << "at " << atMs << " ms";
+    }
+
+    SimulatedClock m_clock;
+    Recorder m_recorder;
+    std::unique_ptr<JitterBuffer> m_buffer;
+};
+
+TEST_F(JitterBufferTest, PlaysOutAtTheCadenceOfTheSentenceTimes) {
+    ASSERT_TRUE(m_buffer->ok());
+    // 100 ms apart on the feeder, 10-70 ms of network jitter. Each location
+    // is due 100 ms after its sentence time on the first one's transit, plus
+    // 1 us of base drift per location.
+    arrive(0, kNoonMs);
+    releaseAt(100, 1);
+    arrive(140, kNoonMs + 100);
+    releaseAt(201, 2);
+    arrive(210, kNoonMs + 200);
+    releaseAt(301, 3);
+    arrive(370, kNoonMs + 300);
+    releaseAt(401, 4);
+    arrive(420, kNoonMs + 400);
+    releaseAt(501, 5);
+
+    const std::vector<Recorder::Event> want = {
+            {kNoonMs, 100, false},       {kNoonMs + 100, 201, false}, {kNoonMs + 200, 301, false},
+            {kNoonMs + 300, 401, false}, {kNoonMs + 400, 501, false},
+    };
+    EXPECT_EQ(want, m_recorder.events());
+    const JitterBuffer::Stats stats = m_buffer->stats();
+    EXPECT_EQ(5u, stats.released);
+    EXPECT_EQ(0u, stats.late);
+    EXPECT_EQ(0u, stats.dropped);
+}
+
+TEST_F(JitterBufferTest, CountsLateAndDropped) {
+    arrive(0, kNoonMs);
+    releaseAt(100, 1);
+
+    // due at 200, it arrives at 250 and goes out at once
+    arrive(250, kNoonMs + 100);
+    ASSERT_TRUE(m_recorder.waitFor(2));
+    EXPECT_EQ(250, m_recorder.events()[1].atMs);
+
+    // older than what went out
+    arrive(260, kNoonMs + 50);
+
+    // a burst of 33, one more than fits
+    for (int i = 0; i < 33; ++i) {
+        m_buffer->gnssLocation(at(kNoonMs + 200 + i * 100));
+    }
+
+    const JitterBuffer::Stats stats = m_buffer->stats();
+    EXPECT_EQ(2u, stats.released);
+    EXPECT_EQ(1u, stats.late);
+    EXPECT_EQ(2u, stats.dropped);
+}
+
+TEST_F(JitterBufferTest, StartsOverAfterTheFeederJumpsBack) {
+    arrive(0, kNoonMs);        // due at 100
+    arrive(50, kNoonMs + 100);  // due at 150
+
+    // an hour back: what is queued goes, the new timeline plays out
+    arrive(80, kNoonMs - 3600 * 1000);
+    releaseAt(180, 1);
+    arrive(185, kNoonMs - 3600 * 1000 + 100);
+    releaseAt(281, 2);
+
+    const std::vector<Recorder::Event> want = {
+            {kNoonMs - 3600 * 1000, 180, false},
+            {kNoonMs - 3600 * 1000 + 100, 281, false},
+    };
+    EXPECT_EQ(want, m_recorder.events());
+    const JitterBuffer::Stats stats = m_buffer->stats();
+    EXPECT_EQ(2u, stats.released);
+    EXPECT_EQ(2u, stats.dropped);
+}
+
+TEST_F(JitterBufferTest, UnwrapsMidnight) {
+    arrive(0, kDayMs - 100);
+    releaseAt(100, 1);
+    arrive(110, 0);
+    releaseAt(201, 2);
+    arrive(220, 100);
+    releaseAt(301, 3);
+
+    const std::vector<Recorder::Event> want = {
+            {kDayMs - 100, 100, false},
+            {0, 201, false},
+            {100, 301, false},
+    };
+    EXPECT_EQ(want, m_recorder.events());
+    EXPECT_EQ(0u, m_buffer->stats().dropped);
+}
+
+TEST_F(JitterBufferTest, ReleasesAnEpochWithItsLocation) {
+    arrive(0, kNoonMs);
+    m_buffer->gnssEpoch(at(kNoonMs));
+    EXPECT_TRUE(m_recorder.events().empty());  // held with the location
+
+    // not of the queued location, or without a time: through at once
+    m_buffer->gnssEpoch(at(kNoonMs + 500));
+    m_buffer->gnssEpoch(at(-1));
+    EXPECT_EQ(2u, m_recorder.events().size());
+
+    releaseAt(100, 4);
+    const std::vector<Recorder::Event> want = {
+            {kNoonMs + 500, 0, true},
+            {-1, 0, true},
+            {kNoonMs, 100, false},
+            {kNoonMs, 100, true},
+    };
+    EXPECT_EQ(want, m_recorder.events());
+}
+
+}  // namespace
+}  // namespace ciccloud
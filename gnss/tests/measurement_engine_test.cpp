@@ -0,0 +1,400 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "measurement_engine.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include "almanac.h"
+
+namespace ciccloud {
+namespace {
+constexpr double kPi = 3.14159265358979323846;
+constexpr double kDegToRad = kPi / 180;
+constexpr double kSpeedOfLight = 299792458.0;
+constexpr double kMu = 3.986005e14;
+constexpr double kEarthRotation = 7.2921151467e-5;
+constexpr double kWgs84A = 6378137.0;
+constexpr double kWgs84E2 = 6.69437999014e-3;
+constexpr double kWeekSeconds = 604800;
+constexpr int64_t kSecToNs = 1000000000LL;
+constexpr int64_t kWeekNs = 604800LL * kSecToNs;
+// week 142 of the third rollover, at the time of applicability
+constexpr int64_t kToaNs = (2048 + 142) * kWeekNs + 405504LL * kSecToNs;
+
+// PRN 1 to 8 of the bundled almanac, data/gps_almanac.yuma.
+constexpr char kAlmanac[] = R"(
+******** Week 142 almanac for PRN-01 ********
+ID:                         01
+Health:                     000
+Eccentricity:               0.1192190133E-001
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9525808563
+Rate of Right Ascen(r/s):  -0.7753894018E-008
+SQRT(A)  (m 1/2):           5153.970404
+Right Ascen at Week(rad):  -0.2786964592E+001
+Argument of Perigee(rad):   0.934854634
+Mean Anom(rad):            -0.9224233378E+000
+Af0(s):                    -0.4141784139E-004
+Af1(s/s):                   0.6246528880E-011
+week:                        142
+
+******** Week 142 almanac for PRN-02 ********
+ID:                         02
+Health:                     000
+Eccentricity:               0.1935016954E-001
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9559030015
+Rate of Right Ascen(r/s):  -0.7888803996E-008
+SQRT(A)  (m 1/2):           5153.521655
+Right Ascen at Week(rad):  -0.2805811215E+001
+Argument of Perigee(rad):   0.191387678
+Mean Anom(rad):             0.8222133504E+000
+Af0(s):                    -0.1786229479E-003
+Af1(s/s):                  -0.4242521391E-011
+week:                        142
+
+******** Week 142 almanac for PRN-03 ********
+ID:                         03
+Health:                     000
+Eccentricity:               0.9284960620E-002
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9609337858
+Rate of Right Ascen(r/s):  -0.8100457613E-008
+SQRT(A)  (m 1/2):           5153.779527
+Right Ascen at Week(rad):  -0.2782347570E+001
+Argument of Perigee(rad):   1.441659172
+Mean Anom(rad):             0.5972797366E+000
+Af0(s):                     0.1804324205E-003
+Af1(s/s):                   0.9226692286E-011
+week:                        142
+
+******** Week 142 almanac for PRN-04 ********
+ID:                         04
+Health:                     000
+Eccentricity:               0.4112229426E-002
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9585934834
+Rate of Right Ascen(r/s):  -0.8095262264E-008
+SQRT(A)  (m 1/2):           5153.493421
+Right Ascen at Week(rad):  -0.2798536712E+001
+Argument of Perigee(rad):   0.663890509
+Mean Anom(rad):             0.2568978832E+001
+Af0(s):                    -0.4481226812E-004
+Af1(s/s):                   0.8907970184E-011
+week:                        142
+
+******** Week 142 almanac for PRN-05 ********
+ID:                         05
+Health:                     000
+Eccentricity:               0.1236324520E-001
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9477289787
+Rate of Right Ascen(r/s):  -0.8171087555E-008
+SQRT(A)  (m 1/2):           5153.596371
+Right Ascen at Week(rad):  -0.2780404733E+001
+Argument of Perigee(rad):   1.155379012
+Mean Anom(rad):             0.3066930061E+001
+Af0(s):                    -0.2820674179E-004
+Af1(s/s):                   0.4202820333E-011
+week:                        142
+
+******** Week 142 almanac for PRN-06 ********
+ID:                         06
+Health:                     000
+Eccentricity:               0.4532493651E-002
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9559666248
+Rate of Right Ascen(r/s):  -0.7943943977E-008
+SQRT(A)  (m 1/2):           5153.997269
+Right Ascen at Week(rad):  -0.2801381797E+001
+Argument of Perigee(rad):  -1.090316004
+Mean Anom(rad):             0.7381517761E-002
+Af0(s):                     0.1087904095E-003
+Af1(s/s):                  -0.8088864868E-011
+week:                        142
+
+******** Week 142 almanac for PRN-07 ********
+ID:                         07
+Health:                     000
+Eccentricity:               0.1110715040E-001
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9697908957
+Rate of Right Ascen(r/s):  -0.7894889173E-008
+SQRT(A)  (m 1/2):           5153.716356
+Right Ascen at Week(rad):  -0.1739114388E+001
+Argument of Perigee(rad):   2.585185906
+Mean Anom(rad):            -0.2345446052E+001
+Af0(s):                    -0.6062849830E-004
+Af1(s/s):                   0.2960406924E-011
+week:                        142
+
+******** Week 142 almanac for PRN-08 ********
+ID:                         08
+Health:                     000
+Eccentricity:               0.1256831764E-001
+Time of Applicability(s):  405504.0000
+Orbital Inclination(rad):   0.9739761869
+Rate of Right Ascen(r/s):  -0.7736142558E-008
+SQRT(A)  (m 1/2):           5153.297768
+Right Ascen at Week(rad):  -0.1751891736E+001
+Argument of Perigee(rad):   0.743500783
+Mean Anom(rad):             0.7079062230E+000
+Af0(s):                    -0.7154242478E-004
+Af1(s/s):                   0.6463786105E-011
+week:                        142
+
+)";
+
+// The same model as MeasurementEngine, one satellite at a time with libm,
+// the true anomaly (IS-GPS-200 table 20-IV), Kepler's equation and the
+// light time solved to convergence and the velocity by central differences.
+struct Reference {
+    int16_t svid;
+    double pseudorangeMeters;
+    double pseudorangeRateMps;
+    double elevationDegrees;
+    double azimuthDegrees;
+};
+
+// ECEF (of the transmission time) of the satellite at `tk` past toa.
+void orbit(const AlmanacEntry& e, const double tk, double p[3]) {
+    const double a = e.sqrtA * e.sqrtA;
+    const double mk = e.meanAnomalyRad + std::sqrt(kMu / (a * a * a)) * tk;
+    double ek = mk;
+    for (int k = 0; k < 50; ++k) {
+        const double step = (ek - e.eccentricity * std::sin(ek) - mk) /
+                            (1 - e.eccentricity * std::cos(ek));
+        ek -= step;
+        if (std::fabs(step) < 1e-15) {
+            break;
+        }
+    }
+    const double nu = std::atan2(std::sqrt(1 - e.eccentricity * e.eccentricity) * std::sin(ek),
+                                 std::cos(ek) - e.eccentricity);
+    const double phi = nu + e.argumentOfPerigeeRad;
+    const double r = a * (1 - e.eccentricity * std::cos(ek));
+    const double xp = r * std::cos(phi);
+    const double yp = r * std::sin(phi);
+    const double omega = e.rightAscensionRad +
+                         (e.rateOfRightAscensionRadPerSec - kEarthRotation) * tk -
+                         kEarthRotation * e.toaSeconds;
+    p[0] = xp * std::cos(omega) - yp * std::cos(e.inclinationRad) * std::sin(omega);
+    p[1] = xp * std::sin(omega) + yp * std::cos(e.inclinationRad) * std::cos(omega);
+    p[2] = yp * std::sin(e.inclinationRad);
+}
+
+std::vector<Reference> reference(const std::vector<AlmanacEntry>& almanac, const Location& rx,
+                                 const int64_t gpsTimeNs) {
+    const double lat = rx.latitudeDegrees * kDegToRad;
+    const double lon = rx.longitudeDegrees * kDegToRad;
+    const double nu = kWgs84A / std::sqrt(1 - kWgs84E2 * std::sin(lat) * std::sin(lat));
+    const double r[3] = {(nu + rx.altitudeMeters) * std::cos(lat) * std::cos(lon),
+                         (nu + rx.altitudeMeters) * std::cos(lat) * std::sin(lon),
+                         (nu * (1 - kWgs84E2) + rx.altitudeMeters) * std::sin(lat)};
+    const double east[3] = {-std::sin(lon), std::cos(lon), 0};
+    const double north[3] = {-std::sin(lat) * std::cos(lon), -std::sin(lat) * std::sin(lon),
+                             std::cos(lat)};
+    const double up[3] = {std::cos(lat) * std::cos(lon), std::cos(lat) * std::sin(lon),
+                          std::sin(lat)};
+    const double bearing = rx.bearingDegrees * kDegToRad;
+    double rv[3];
+    for (int k = 0; k < 3; ++k) {
+        rv[k] = rx.speedMetersPerSec * (std::sin(bearing) * east[k] + std::cos(bearing) * north[k]);
+    }
+
+    std::vector<Reference> out;
+    const double t = gpsTimeNs * 1e-9;
+    for (const AlmanacEntry& e : almanac) {
+        const double toa = (e.week % 1024) * kWeekSeconds + e.toaSeconds;
+        const double rollover = 1024 * kWeekSeconds;
+        double travel = 0.075;
+        double tk = 0;
+        double d[3];
+        double range = 0;
+        for (int k = 0; k < 20; ++k) {
+            tk = std::remainder(t - travel - toa, rollover);
+            double p[3];
+            orbit(e, tk, p);
+            const double theta = kEarthRotation * travel;
+            d[0] = p[0] * std::cos(theta) + p[1] * std::sin(theta) - r[0];
+            d[1] = p[1] * std::cos(theta) - p[0] * std::sin(theta) - r[1];
+            d[2] = p[2] - r[2];
+            range = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+            const double next = range / kSpeedOfLight;
+            const bool done = std::fabs(next - travel) < 1e-15;
+            travel = next;
+            if (done) {
+                break;
+            }
+        }
+
+        const double h = 0.01;
+        double p0[3], p1[3];
+        orbit(e, tk - h, p0);
+        orbit(e, tk + h, p1);
+        double rate = 0, u = 0, en[2] = {0, 0};
+        for (int k = 0; k < 3; ++k) {
+            rate += ((p1[k] - p0[k]) / (2 * h) - rv[k]) * d[k] / range;
+            u += d[k] * up[k];
+            en[0] += d[k] * east[k];
+            en[1] += d[k] * north[k];
+        }
+        const double elevation = std::atan2(u, std::hypot(en[0], en[1])) / kDegToRad;
+        if (elevation < MeasurementEngine::kElevationMaskDegrees) {
+            continue;
+        }
+        double azimuth = std::atan2(en[0], en[1]) / kDegToRad;
+        if (azimuth < 0) {
+            azimuth += 360;
+        }
+        const double clock = e.af0 + e.af1 * tk;
+        out.push_back({e.prn, range - kSpeedOfLight * clock, rate - kSpeedOfLight * e.af1,
+                       elevation, azimuth});
+    }
+    std::sort(out.begin(), out.end(), [](const Reference& a, const Reference& b) {
+        return a.elevationDegrees > b.elevationDegrees;
+    });
+    return out;
+}
+
+Location receiver(const double lat, const double lon, const double alt, const double speed,
+                  const double bearing) {
+    Location rx;
+    rx.flags = LocationFlags::HAS_LAT_LONG | LocationFlags::HAS_ALTITUDE |
+               LocationFlags::HAS_SPEED | LocationFlags::HAS_BEARING;
+    rx.latitudeDegrees = lat;
+    rx.longitudeDegrees = lon;
+    rx.altitudeMeters = alt;
+    rx.speedMetersPerSec = speed;
+    rx.bearingDegrees = bearing;
+    return rx;
+}
+
+class MeasurementEngineTest : public ::testing::Test {
+protected:
+    void SetUp() override {
+        ASSERT_TRUE(parseYumaAlmanac(kAlmanac, strlen(kAlmanac), &m_almanac));
+        ASSERT_EQ(m_almanac.size(), 8u);
+    }
+
+    // When in the day around toa the most of the eight are in view of `rx`.
+    int64_t busiestTimeNs(const Location& rx) const {
+        MeasurementEngine engine(m_almanac);
+        std::vector<Measurement> out(MeasurementEngine::kMaxSatellites);
+        int64_t best = kToaNs;
+        size_t most = 0;
+        for (int64_t dt = -12 * 3600; dt <= 12 * 3600; dt += 600) {
+            const size_t n = engine.update(rx, kToaNs + dt * kSecToNs, out.data(), out.size());
+            if (n > most) {
+                most = n;
+                best = kToaNs + dt * kSecToNs;
+            }
+        }
+        return best;
+    }
+
+    std::vector<AlmanacEntry> m_almanac;
+};
+
+// Receivers around the globe, moving, over half a day, every satellite in
+// view within a few mm and tenths of a mm/s of the reference.
+TEST_F(MeasurementEngineTest, MatchesTheReference) {
+    const Location receivers[] = {
+        receiver(37.422, -122.084, 10, 0, 0),
+        receiver(-33.86, 151.21, 50, 30, 45),
+        receiver(64.13, -21.9, 0, 250, 270),   // an aircraft
+        receiver(0.5, 32.58, 1200, 15, 180),
+        receiver(-77.85, 166.67, 20, 5, 90),
+        receiver(51.48, 0, 8000, 220, 135),
+    };
+
+    MeasurementEngine engine(m_almanac);
+    std::vector<Measurement> out(MeasurementEngine::kMaxSatellites);
+    size_t compared = 0;
+    for (const Location& rx : receivers) {
+        for (int64_t dt = -6 * 3600; dt <= 6 * 3600; dt += 1800) {
+            const int64_t gpsTimeNs = kToaNs + dt * kSecToNs;
+            const std::vector<Reference> want = reference(m_almanac, rx, gpsTimeNs);
+            const size_t n = engine.update(rx, gpsTimeNs, out.data(), out.size());
+            ASSERT_EQ(n, want.size()) << rx.latitudeDegrees << " at " << dt;
+            for (size_t i = 0; i < n; ++i) {
+                SCOPED_TRACE(testing::Message() << "PRN " << want[i].svid << " from "
+                             << rx.latitudeDegrees << " at " << dt);
+                EXPECT_EQ(out[i].svid, want[i].svid);
+                EXPECT_NEAR(out[i].pseudorangeMeters, want[i].pseudorangeMeters, 5e-3);
+                EXPECT_NEAR(out[i].pseudorangeRateMps, want[i].pseudorangeRateMps, 1e-4);
+                EXPECT_NEAR(out[i].elevationDegrees, want[i].elevationDegrees, 1e-4);
+                EXPECT_NEAR(out[i].azimuthDegrees, want[i].azimuthDegrees, 1e-4);
+
+                const int64_t txNs = gpsTimeNs - std::llround(want[i].pseudorangeMeters *
+                                                              (1e9 / kSpeedOfLight));
+                EXPECT_NEAR(out[i].receivedSvTimeNs, txNs % kWeekNs, 1);
+            }
+            compared += n;
+        }
+    }
+    EXPECT_GT(compared, 150u);
+}
+
+// A time one rollover earlier gives the same measurements, but for the
+// resolution of the time in seconds.
+TEST_F(MeasurementEngineTest, IgnoresTheRollover) {
+    const Location rx = receiver(37.422, -122.084, 10, 20, 45);
+    MeasurementEngine engine(m_almanac);
+    std::vector<Measurement> a(MeasurementEngine::kMaxSatellites);
+    std::vector<Measurement> b(MeasurementEngine::kMaxSatellites);
+    const int64_t gpsTimeNs = busiestTimeNs(rx);
+    const size_t n = engine.update(rx, gpsTimeNs, a.data(), a.size());
+    ASSERT_GT(n, 0u);
+    ASSERT_EQ(engine.update(rx, gpsTimeNs - 1024 * kWeekNs, b.data(), b.size()), n);
+    for (size_t i = 0; i < n; ++i) {
+        EXPECT_EQ(a[i].svid, b[i].svid);
+        EXPECT_NEAR(a[i].pseudorangeMeters, b[i].pseudorangeMeters, 1e-3);
+        EXPECT_NEAR(a[i].pseudorangeRateMps, b[i].pseudorangeRateMps, 1e-6);
+    }
+}
+
+// Unhealthy satellites are left out, as are those past the capacity.
+TEST_F(MeasurementEngineTest, SkipsUnhealthySatellitesAndStopsAtTheCapacity) {
+    const Location rx = receiver(37.422, -122.084, 10, 0, 0);
+    std::vector<Measurement> out(MeasurementEngine::kMaxSatellites);
+    const int64_t gpsTimeNs = busiestTimeNs(rx);
+    MeasurementEngine all(m_almanac);
+    const size_t n = all.update(rx, gpsTimeNs, out.data(), out.size());
+    ASSERT_GE(n, 2u);
+    const int16_t first = out[0].svid;
+
+    std::vector<AlmanacEntry> almanac = m_almanac;
+    for (AlmanacEntry& e : almanac) {
+        e.health = (e.prn == first) ? 1 : 0;
+    }
+    MeasurementEngine healthy(almanac);
+    EXPECT_EQ(healthy.satellites(), m_almanac.size() - 1);
+    ASSERT_EQ(healthy.update(rx, gpsTimeNs, out.data(), out.size()), n - 1);
+    for (size_t i = 0; i < n - 1; ++i) {
+        EXPECT_NE(out[i].svid, first);
+    }
+
+    EXPECT_EQ(all.update(rx, gpsTimeNs, out.data(), 1), 1u);
+    EXPECT_EQ(out[0].svid, first);
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "nmea_forwarder.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace ciccloud {
+namespace {
+
+// The NMEA callbacks: what each carried and its timestamp.
+class Recorder : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override {}
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(const int64_t timestampMs, const char* nmea, const size_t size) const override {
+        callbacks.emplace_back(nmea, size);
+        timestamps.push_back(timestampMs);
+    }
+    bool wantsNmea() const override { return wanted; }
+
+    mutable std::vector<std::string> callbacks;
+    mutable std::vector<int64_t> timestamps;
+    bool wanted = false;
+};
+
+std::string sentence(const char* type) {
+    return std::string("$") + type + ",1,2,3*00\r\n";
+}
+
+class NmeaForwarderTest : public ::testing::Test {
+protected:
+    // One epoch of the `types`, at `timestampMs`.
+    void epoch(NmeaForwarder* forwarder, const std::vector<const char*>& types,
+               const int64_t timestampMs = 0) {
+        forwarder->beginEpoch();
+        for (const char* type : types) {
+            const std::string s = sentence(type);
+            forwarder->forward(timestampMs, s.c_str(), s.size());
+        }
+        forwarder->endEpoch();
+    }
+
+    std::vector<std::string> sentences(const std::vector<const char*>& types) const {
+        std::vector<std::string> result;
+        for (const char* type : types) {
+            result.push_back(sentence(type));
+        }
+        return result;
+    }
+
+    Recorder m_recorder;
+};
+
+TEST_F(NmeaForwarderTest, ParsesTheModes) {
+    NmeaForwardMode mode = NmeaForwardMode::ALL;
+    EXPECT_TRUE(parseNmeaForwardMode("off", &mode));
+    EXPECT_EQ(NmeaForwardMode::OFF, mode);
+    EXPECT_TRUE(parseNmeaForwardMode("on_demand", &mode));
+    EXPECT_EQ(NmeaForwardMode::ON_DEMAND, mode);
+    EXPECT_TRUE(parseNmeaForwardMode("all", &mode));
+    EXPECT_EQ(NmeaForwardMode::ALL, mode);
+    EXPECT_FALSE(parseNmeaForwardMode("on", &mode));
+    EXPECT_FALSE(parseNmeaForwardMode("", &mode));
+    EXPECT_EQ(NmeaForwardMode::ALL, mode);
+}
+
+TEST_F(NmeaForwarderTest, ForwardsEverySentenceByDefault) {
+    NmeaForwarder forwarder(&m_recorder, NmeaForwardConfig());
+    epoch(&forwarder, {"GPRMC", "GPGGA", "GLGSV"});
+    EXPECT_EQ(sentences({"GPRMC", "GPGGA", "GLGSV"}), m_recorder.callbacks);
+    EXPECT_EQ(3u, forwarder.sentences());
+    EXPECT_EQ(3u, forwarder.callbacks());
+}
+
+TEST_F(NmeaForwarderTest, ForwardsNothingWhenOff) {
+    NmeaForwardConfig config;
+    config.mode = NmeaForwardMode::OFF;
+    NmeaForwarder forwarder(&m_recorder, config);
+    epoch(&forwarder, {"GPRMC", "GPGGA"});
+    EXPECT_TRUE(m_recorder.callbacks.empty());
+}
+
+TEST_F(NmeaForwarderTest, AllowsTypesOfAnyTalkerOrOfOne) {
+    NmeaForwardConfig config;
+    // the broken entries are ignored, the rest still apply
+    config.sentences = "GGA,GLGSV,,RM,GPGSAX";
+    NmeaForwarder forwarder(&m_recorder, config);
+    epoch(&forwarder, {"GPRMC", "GPGGA", "GNGGA", "GPGSV", "GLGSV", "GPGSA", "GP"});
+    EXPECT_EQ(sentences({"GPGGA", "GNGGA", "GLGSV"}), m_recorder.callbacks);
+}
+
+TEST_F(NmeaForwarderTest, TakesAtMostKMaxTypes) {
+    NmeaForwardConfig config;
+    config.sentences = "AAA,BBB,CCC,DDD,EEE,FFF,GGG,HHH,GGA";
+    NmeaForwarder forwarder(&m_recorder, config);
+    epoch(&forwarder, {"GPHHH", "GPGGA"});
+    EXPECT_EQ(sentences({"GPHHH"}), m_recorder.callbacks);
+}
+
+TEST_F(NmeaForwarderTest, ForwardsEveryNthEpoch) {
+    NmeaForwardConfig config;
+    config.decimation = 3;
+    NmeaForwarder forwarder(&m_recorder, config);
+    for (int i = 0; i < 7; ++i) {
+        epoch(&forwarder, {"GPRMC"}, i * 1000);
+    }
+    EXPECT_EQ(std::vector<int64_t>({0, 3000, 6000}), m_recorder.timestamps);
+}
+
+TEST_F(NmeaForwarderTest, OnDemandAsksTheSinkOncePerEpoch) {
+    NmeaForwardConfig config;
+    config.mode = NmeaForwardMode::ON_DEMAND;
+    NmeaForwarder forwarder(&m_recorder, config);
+    epoch(&forwarder, {"GPRMC"}, 0);
+
+    m_recorder.wanted = true;
+    epoch(&forwarder, {"GPRMC"}, 1000);
+
+    // asked at the start of the epoch, it keeps to the answer until the end
+    forwarder.beginEpoch();
+    m_recorder.wanted = false;
+    const std::string s = sentence("GPGGA");
+    forwarder.forward(2000, s.c_str(), s.size());
+    forwarder.endEpoch();
+
+    epoch(&forwarder, {"GPRMC"}, 3000);
+    EXPECT_EQ(std::vector<int64_t>({1000, 2000}), m_recorder.timestamps);
+}
+
+TEST_F(NmeaForwarderTest, BatchesAnEpoch) {
+    NmeaForwardConfig config;
+    config.batch = true;
+    NmeaForwarder forwarder(&m_recorder, config);
+    forwarder.beginEpoch();
+    for (const char* type : {"GPRMC", "GPGGA"}) {
+        const std::string s = sentence(type);
+        forwarder.forward(type[2] == 'R' ? 100 : 150, s.c_str(), s.size());
+    }
+    EXPECT_TRUE(m_recorder.callbacks.empty());
+    forwarder.endEpoch();
+
+    ASSERT_EQ(1u, m_recorder.callbacks.size());
+    EXPECT_EQ(sentence("GPRMC") + sentence("GPGGA"), m_recorder.callbacks[0]);
+    EXPECT_EQ(std::vector<int64_t>({100}), m_recorder.timestamps);  // of the first
+    EXPECT_EQ(2u, forwarder.sentences());
+    EXPECT_EQ(1u, forwarder.callbacks());
+
+    // a reset in the middle of an epoch sends what there is
+    forwarder.beginEpoch();
+    const std::string s = sentence("GPRMC");
+    forwarder.forward(200, s.c_str(), s.size());
+    forwarder.reset();
+    EXPECT_EQ(2u, m_recorder.callbacks.size());
+}
+
+TEST_F(NmeaForwarderTest, SendsAFullBatchEarly) {
+    NmeaForwardConfig config;
+    config.batch = true;
+    NmeaForwarder forwarder(&m_recorder, config);
+    const std::string s = sentence("GPGSV");
+    const size_t perBatch = NmeaForwarder::kBatchSize / s.size();
+
+    forwarder.beginEpoch();
+    for (size_t i = 0; i < perBatch + 1; ++i) {
+        forwarder.forward(static_cast<int64_t>(i), s.c_str(), s.size());
+    }
+    ASSERT_EQ(1u, m_recorder.callbacks.size());
+    EXPECT_EQ(perBatch * s.size(), m_recorder.callbacks[0].size());
+    forwarder.endEpoch();
+
+    ASSERT_EQ(2u, m_recorder.callbacks.size());
+    EXPECT_EQ(s, m_recorder.callbacks[1]);
+    EXPECT_EQ(std::vector<int64_t>({0, static_cast<int64_t>(perBatch)}), m_recorder.timestamps);
+    EXPECT_EQ(perBatch + 1, forwarder.sentences());
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sink_gate.h"
+#include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace ciccloud {
+namespace {
+
+// Counts the calls, and can hold a location call until released.
+class Recorder : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        ++calls;
+        m_entered = true;
+        m_cv.notify_all();
+        m_cv.wait(lock, [this]() { return !m_hold; });
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override { ++calls; }
+    void gnssStatus(GnssStatus) const override { ++calls; }
+    void gnssNmea(int64_t, const char*, size_t) const override { ++calls; }
+    void gnssEpoch(const Location&) const override { ++calls; }
+
+    void hold() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_hold = true;
+    }
+    void waitEntered() {
+        std::unique_lock<std::mutex> lock(m_mtx);
+        m_cv.wait(lock, [this]() { return m_entered; });
+    }
+    void release() {
+        std::lock_guard<std::mutex> lock(m_mtx);
+        m_hold = false;
+        m_cv.notify_all();
+    }
+
+    mutable std::atomic<int> calls{0};
+
+private:
+    mutable std::mutex m_mtx;
+    mutable std::condition_variable m_cv;
+    mutable bool m_entered = false;
+    bool m_hold = false;
+};
+
+void deliverAll(const GnssSink& sink) {
+    const Location loc;
+    const SvInfo sv = {};
+    sink.gnssLocation(loc);
+    sink.gnssSvStatus(&sv, 1);
+    sink.gnssStatus(GnssStatus::SESSION_BEGIN);
+    sink.gnssNmea(0, "$GPGGA*00", 9);
+    sink.gnssEpoch(loc);
+}
+
+TEST(SinkGateTest, ForwardsUntilClosed) {
+    Recorder recorder;
+    SinkGate gate(&recorder);
+    EXPECT_TRUE(gate.wantsNmea());
+    deliverAll(gate);
+    EXPECT_EQ(recorder.calls, 5);
+
+    gate.close();
+    deliverAll(gate);
+    EXPECT_EQ(recorder.calls, 5);
+    EXPECT_FALSE(gate.wantsNmea());
+}
+
+TEST(SinkGateTest, CloseWaitsForACallInProgress) {
+    Recorder recorder;
+    SinkGate gate(&recorder);
+    recorder.hold();
+    std::thread delivery([&]() { gate.gnssLocation(Location()); });
+    recorder.waitEntered();
+
+    std::atomic<bool> closed{false};
+    std::thread closer([&]() {
+        gate.close();
+        closed = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    EXPECT_FALSE(closed);
+
+    recorder.release();
+    closer.join();
+    delivery.join();
+    EXPECT_TRUE(closed);
+    EXPECT_EQ(recorder.calls, 1);
+}
+
+}  // namespace
+}  // namespace ciccloud
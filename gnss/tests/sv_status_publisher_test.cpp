@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "sv_status_publisher.h"
+#include <gtest/gtest.h>
+#include <cstdint>
+#include <vector>
+#include "clock.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kBootNs = 1000 * kMsToNs;
+
+// The statuses which come out: how many satellites each, and the C/N0 of
+// the first.
+class Recorder : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override { ++locations; }
+    void gnssSvStatus(const SvInfo* svInfo, size_t size) const override {
+        sizes.push_back(size);
+        firstCn0.push_back(size ? svInfo[0].cN0Dbhz : 0);
+    }
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+
+    mutable std::vector<size_t> sizes;
+    mutable std::vector<float> firstCn0;
+    mutable int locations = 0;
+};
+
+SvInfo sv(const int16_t svid, const float cn0 = 30, const float elevation = 45,
+          const float azimuth = 180, const uint8_t flags = SvFlags::USED_IN_FIX) {
+    SvInfo info;
+    info.svid = svid;
+    info.constellation = Constellation::GPS;
+    info.cN0Dbhz = cn0;
+    info.elevationDegrees = elevation;
+    info.azimuthDegrees = azimuth;
+    info.flags = flags;
+    return info;
+}
+
+class SvStatusPublisherTest : public ::testing::Test {
+protected:
+    SvStatusPublisherTest()
+        : m_clock(0, kBootNs), m_publisher(&m_recorder, SvStatusPublisherConfig(), m_clock) {
+        m_publisher.gnssStatus(GnssStatus::SESSION_BEGIN);
+    }
+
+    // The status of the epoch at `atMs` into the session.
+    void status(const int64_t atMs, const std::vector<SvInfo>& svs) {
+        m_clock.advanceTo(kBootNs + atMs * kMsToNs);
+        m_publisher.gnssSvStatus(svs.data(), svs.size());
+    }
+
+    void location(const int64_t atMs) {
+        m_clock.advanceTo(kBootNs + atMs * kMsToNs);
+        m_publisher.gnssLocation(Location());
+    }
+
+    size_t sent() const { return m_recorder.sizes.size(); }
+
+    Recorder m_recorder;
+    SimulatedClock m_clock;
+    SvStatusPublisher m_publisher;
+};
+
+TEST_F(SvStatusPublisherTest, SendsTheFirstStatusAtOnceAndNoRepeats) {
+    status(0, {sv(1), sv(2)});
+    ASSERT_EQ(1u, sent());
+    for (int i = 1; i < 5; ++i) {
+        status(i * 1000, {sv(1), sv(2)});
+    }
+    EXPECT_EQ(1u, sent());
+}
+
+TEST_F(SvStatusPublisherTest, SendsChangesOfTheThresholdsOrMore) {
+    status(0, {sv(1), sv(2)});
+
+    // under the thresholds: 3 dB-Hz, 5 degrees, the azimuth across north
+    status(1000, {sv(1, 32.5f, 49.5f, 184.5f), sv(2)});
+    EXPECT_EQ(1u, sent());
+    SvStatusPublisher publisher(&m_recorder, SvStatusPublisherConfig(), m_clock);
+    const SvInfo north[] = {sv(1, 30, 45, 358)};
+    publisher.gnssSvStatus(north, 1);
+    const SvInfo across[] = {sv(1, 30, 45, 2)};
+    m_clock.advance(1000 * kMsToNs);
+    publisher.gnssSvStatus(across, 1);
+    EXPECT_EQ(2u, sent());
+
+    // each of these is a change
+    status(2000, {sv(1, 33), sv(2)});
+    status(3000, {sv(1, 33, 50), sv(2)});
+    status(4000, {sv(1, 33, 50, 185), sv(2)});
+    status(5000, {sv(1, 33, 50, 185, 0), sv(2)});
+    status(6000, {sv(1, 33, 50, 185, 0)});
+    status(7000, {sv(1, 33, 50, 185, 0), sv(3)});
+    EXPECT_EQ(std::vector<size_t>({2, 1, 2, 2, 2, 2, 1, 2}), m_recorder.sizes);
+}
+
+TEST_F(SvStatusPublisherTest, HoldsChangesForTheIntervalAndSendsTheLatest) {
+    status(0, {sv(1)});
+    status(200, {sv(1, 40)});
+    status(400, {sv(1, 50)});
+    EXPECT_EQ(1u, sent());
+
+    // the first location past the interval takes it along
+    location(900);
+    EXPECT_EQ(1u, sent());
+    location(1000);
+    EXPECT_EQ(std::vector<float>({30, 50}), m_recorder.firstCn0);
+    EXPECT_EQ(2, m_recorder.locations);
+}
+
+TEST_F(SvStatusPublisherTest, ForgetsAChangeWhichWasUndone) {
+    status(0, {sv(1)});
+    status(200, {sv(1, 40)});
+    status(400, {sv(1, 31)});
+    location(1000);
+    EXPECT_EQ(1u, sent());
+    EXPECT_EQ(INT64_MAX, m_publisher.nextSendNs());
+}
+
+TEST_F(SvStatusPublisherTest, SendsAWaitingChangeWhenTheFeedWentQuiet) {
+    status(0, {sv(1)});
+    EXPECT_EQ(INT64_MAX, m_publisher.nextSendNs());
+    status(300, {sv(1, 40)});
+    EXPECT_EQ(kBootNs + 1000 * kMsToNs, m_publisher.nextSendNs());
+
+    // nothing more comes: the worker wakes up for it
+    m_clock.advanceTo(kBootNs + 999 * kMsToNs);
+    m_publisher.sendDue();
+    EXPECT_EQ(1u, sent());
+    m_clock.advanceTo(kBootNs + 1000 * kMsToNs);
+    m_publisher.sendDue();
+    EXPECT_EQ(std::vector<float>({30, 40}), m_recorder.firstCn0);
+    EXPECT_EQ(INT64_MAX, m_publisher.nextSendNs());
+}
+
+TEST_F(SvStatusPublisherTest, SendsAWaitingChangeAtTheSessionEndAndStartsOver) {
+    status(0, {sv(1)});
+    status(100, {sv(1, 40)});
+    m_publisher.gnssStatus(GnssStatus::SESSION_END);
+    EXPECT_EQ(std::vector<float>({30, 40}), m_recorder.firstCn0);
+    EXPECT_EQ(INT64_MAX, m_publisher.nextSendNs());
+
+    // the next session gets the full status at once, the same or not
+    m_publisher.gnssStatus(GnssStatus::SESSION_BEGIN);
+    status(200, {sv(1, 40)});
+    EXPECT_EQ(3u, sent());
+}
+
+TEST_F(SvStatusPublisherTest, CountsWhatItSaved) {
+    for (int i = 0; i < 10; ++i) {
+        status(i * 100, {sv(1), sv(2), sv(3)});
+    }
+    status(1000, {sv(1)});
+
+    const SvStatusPublisher::Stats stats = m_publisher.stats();
+    EXPECT_EQ(11u, stats.offered);
+    EXPECT_EQ(2u, stats.sent);
+    EXPECT_EQ(9u, stats.callbacksSaved());
+    EXPECT_EQ(31 * sizeof(SvInfo), stats.bytesOffered);
+    EXPECT_EQ(4 * sizeof(SvInfo), stats.bytesSent);
+    EXPECT_EQ(27 * sizeof(SvInfo), stats.bytesSaved());
+}
+
+TEST_F(SvStatusPublisherTest, PassesEverythingWithoutAnInterval) {
+    SvStatusPublisherConfig config;
+    config.minIntervalMs = 0;
+    SvStatusPublisher publisher(&m_recorder, config, m_clock);
+    const SvInfo a[] = {sv(1)};
+    const SvInfo b[] = {sv(1, 40)};
+    publisher.gnssSvStatus(a, 1);
+    publisher.gnssSvStatus(b, 1);
+    publisher.gnssSvStatus(a, 1);
+    EXPECT_EQ(3u, sent());
+}
+
+}  // namespace
+}  // namespace ciccloud
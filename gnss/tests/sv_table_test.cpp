@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "sv_table.h"
+#include <gtest/gtest.h>
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace ciccloud {
+namespace {
+using Talker = SvTable::Talker;
+constexpr size_t kCapacity = 64;  // as GnssSink takes them
+
+struct Sv {
+    Constellation constellation;
+    int16_t svid;
+    float cN0Dbhz;
+};
+
+// A GSV cycle of `talker` in parts of up to four satellites.
+void gsv(SvTable* table, const Talker talker, const std::vector<Sv>& svs) {
+    const int parts = std::max<int>(1, (svs.size() + 3) / 4);
+    for (int part = 1; part <= parts; ++part) {
+        ASSERT_TRUE(table->beginViewPart(talker, part, parts));
+        for (size_t i = (part - 1) * 4; i < svs.size() && i < static_cast<size_t>(part) * 4; ++i) {
+            table->inView(svs[i].constellation, svs[i].svid, svs[i].cN0Dbhz, 45, 90);
+        }
+        table->endViewPart(talker, part, parts);
+    }
+}
+
+void gsa(SvTable* table, const Talker talker, const std::vector<Sv>& svs) {
+    table->beginUsed(talker);
+    for (const Sv& sv : svs) {
+        table->used(sv.constellation, sv.svid);
+    }
+    table->endUsed();
+}
+
+// (constellation, svid) of a snapshot, and the ones used in fix.
+using Ids = std::vector<std::pair<Constellation, int16_t>>;
+struct Snapshot {
+    Ids inView;
+    Ids used;
+    std::vector<SvInfo> infos;
+};
+
+Snapshot snapshot(SvTable* table, const size_t capacity = kCapacity) {
+    Snapshot s;
+    s.infos.resize(capacity);
+    s.infos.resize(table->snapshot(s.infos.data(), capacity));
+    for (const SvInfo& info : s.infos) {
+        s.inView.emplace_back(info.constellation, info.svid);
+        if (info.flags & SvFlags::USED_IN_FIX) {
+            s.used.emplace_back(info.constellation, info.svid);
+        }
+    }
+    return s;
+}
+
+TEST(SvTableTest, MapsTheNmeaIdRanges) {
+    const struct {
+        Talker talker;
+        int id;
+        Constellation constellation;
+        int16_t svid;
+    } cases[] = {
+        {Talker::GP, 5, Constellation::GPS, 5},
+        {Talker::GP, 46, Constellation::SBAS, 133},
+        {Talker::GN, 70, Constellation::GLONASS, 6},
+        {Talker::GL, 70, Constellation::GLONASS, 6},
+        {Talker::GQ, 2, Constellation::QZSS, 194},
+        {Talker::GP, 195, Constellation::QZSS, 195},
+        {Talker::GB, 412, Constellation::BEIDOU, 12},
+        {Talker::GN, 212, Constellation::BEIDOU, 12},
+        {Talker::GA, 311, Constellation::GALILEO, 11},
+    };
+    for (const auto& c : cases) {
+        Constellation constellation;
+        int16_t svid;
+        ASSERT_TRUE(SvTable::fromNmea(c.talker, c.id, &constellation, &svid)) << c.id;
+        EXPECT_EQ(c.constellation, constellation) << c.id;
+        EXPECT_EQ(c.svid, svid) << c.id;
+    }
+
+    Constellation constellation;
+    int16_t svid;
+    EXPECT_FALSE(SvTable::fromNmea(Talker::GP, 70, &constellation, &svid));  // GN only
+    EXPECT_FALSE(SvTable::fromNmea(Talker::GA, 40, &constellation, &svid));
+    EXPECT_FALSE(SvTable::fromNmea(Talker::GP, 0, &constellation, &svid));
+}
+
+TEST(SvTableTest, ACompleteCycleReplacesTheSetInView) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::GPS, 7, 31},
+                             {Constellation::GPS, 12, 32}, {Constellation::SBAS, 133, 33},
+                             {Constellation::GPS, 20, 34}});
+    EXPECT_TRUE(table.changed());
+    EXPECT_EQ((Ids{{Constellation::GPS, 3}, {Constellation::GPS, 7}, {Constellation::GPS, 12},
+                   {Constellation::GPS, 20}, {Constellation::SBAS, 133}}),
+              snapshot(&table).inView);
+    EXPECT_FALSE(table.changed());
+
+    gsv(&table, Talker::GP, {{Constellation::GPS, 7, 40}});
+    const Snapshot s = snapshot(&table);
+    EXPECT_EQ((Ids{{Constellation::GPS, 7}}), s.inView);
+    EXPECT_EQ(40, s.infos[0].cN0Dbhz);
+    EXPECT_EQ(45, s.infos[0].elevationDegrees);
+    EXPECT_EQ(90, s.infos[0].azimuthDegrees);
+    EXPECT_TRUE(s.infos[0].flags & SvFlags::HAS_CARRIER_FREQUENCY);
+    EXPECT_FLOAT_EQ(1575.42e6f, s.infos[0].carrierFrequencyHz);
+}
+
+TEST(SvTableTest, AnIncompleteCycleKeepsTheSetInView) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::GPS, 7, 31}});
+
+    // part 2 of 3 goes missing
+    ASSERT_TRUE(table.beginViewPart(Talker::GP, 1, 3));
+    table.inView(Constellation::GPS, 9, 35, 10, 20);
+    table.endViewPart(Talker::GP, 1, 3);
+    EXPECT_FALSE(table.beginViewPart(Talker::GP, 3, 3));
+    table.endViewPart(Talker::GP, 3, 3);
+
+    EXPECT_EQ((Ids{{Constellation::GPS, 3}, {Constellation::GPS, 7}}), snapshot(&table).inView);
+    EXPECT_FALSE(table.beginViewPart(Talker::GP, 0, 3));
+    EXPECT_FALSE(table.beginViewPart(Talker::GN, 1, 1));  // no constellation of its own
+}
+
+TEST(SvTableTest, TalkersReplaceOnlyTheirConstellations) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::SBAS, 133, 33}});
+    gsv(&table, Talker::GL, {{Constellation::GLONASS, 6, 30}});
+    gsv(&table, Talker::GA, {{Constellation::GALILEO, 11, 30}});
+    gsv(&table, Talker::GP, {{Constellation::GPS, 4, 30}});
+
+    const Snapshot s = snapshot(&table);
+    EXPECT_EQ((Ids{{Constellation::GPS, 4}, {Constellation::GLONASS, 6},
+                   {Constellation::GALILEO, 11}}),
+              s.inView);
+    EXPECT_FLOAT_EQ(1602.0e6f, s.infos[1].carrierFrequencyHz);
+}
+
+TEST(SvTableTest, AGsaReplacesTheUsedSetOfTheConstellationsItNames) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::GPS, 7, 31}});
+    gsv(&table, Talker::GL, {{Constellation::GLONASS, 6, 30}});
+    gsa(&table, Talker::GN, {{Constellation::GPS, 3, 0}, {Constellation::GLONASS, 6, 0}});
+    EXPECT_EQ((Ids{{Constellation::GPS, 3}, {Constellation::GLONASS, 6}}), snapshot(&table).used);
+
+    // a GN GSA of GPS only leaves GLONASS as it was
+    gsa(&table, Talker::GN, {{Constellation::GPS, 7, 0}});
+    EXPECT_EQ((Ids{{Constellation::GPS, 7}, {Constellation::GLONASS, 6}}), snapshot(&table).used);
+
+    // an empty GP GSA clears GPS
+    gsa(&table, Talker::GP, {});
+    EXPECT_EQ((Ids{{Constellation::GLONASS, 6}}), snapshot(&table).used);
+}
+
+TEST(SvTableTest, ReportsAUsedSatelliteNotInViewWithoutSignal) {
+    SvTable table;
+    gsa(&table, Talker::GP, {{Constellation::GPS, 9, 0}});
+    const Snapshot s = snapshot(&table);
+    ASSERT_EQ((Ids{{Constellation::GPS, 9}}), s.inView);
+    EXPECT_EQ(0, s.infos[0].cN0Dbhz);
+    EXPECT_TRUE(s.infos[0].flags & SvFlags::USED_IN_FIX);
+}
+
+TEST(SvTableTest, TheSnapshotStopsAtItsCapacity) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::GPS, 7, 31},
+                             {Constellation::GPS, 12, 32}});
+    EXPECT_EQ((Ids{{Constellation::GPS, 3}, {Constellation::GPS, 7}}), snapshot(&table, 2).inView);
+}
+
+TEST(SvTableTest, IgnoresSatellitesOutOfItsSlots) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}, {Constellation::GPS, 99, 31},
+                             {Constellation::UNKNOWN, 1, 32}});
+    EXPECT_EQ((Ids{{Constellation::GPS, 3}}), snapshot(&table).inView);
+}
+
+TEST(SvTableTest, ResetForgetsEverything) {
+    SvTable table;
+    gsv(&table, Talker::GP, {{Constellation::GPS, 3, 30}});
+    gsa(&table, Talker::GP, {{Constellation::GPS, 3, 0}});
+    snapshot(&table);
+    table.reset();
+    EXPECT_TRUE(table.changed());
+    EXPECT_TRUE(snapshot(&table).inView.empty());
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "thread_policy.h"
+#include <gtest/gtest.h>
+#include <sched.h>
+#include <string>
+#include <vector>
+
+namespace ciccloud {
+namespace {
+
+// The CPUs of a list, empty if it does not parse.
+std::vector<int> cpus(const char* list) {
+    cpu_set_t set;
+    std::vector<int> result;
+    if (parseCpuList(list, &set)) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+            if (CPU_ISSET(cpu, &set)) {
+                result.push_back(cpu);
+            }
+        }
+    }
+    return result;
+}
+
+TEST(ParseCpuListTest, TakesSinglesAndRanges) {
+    EXPECT_EQ(std::vector<int>({3}), cpus("3"));
+    EXPECT_EQ(std::vector<int>({0, 1, 2, 3}), cpus("0-3"));
+    EXPECT_EQ(std::vector<int>({2, 3, 6}), cpus("2-3,6"));
+    EXPECT_EQ(std::vector<int>({1, 5, 6, 7}), cpus("5-7,1"));
+    EXPECT_EQ(std::vector<int>({4}), cpus("4-4,4"));
+}
+
+TEST(ParseCpuListTest, TakesATrailingComma) {
+    // what a list put together in a shell loop ends with
+    EXPECT_EQ(std::vector<int>({2, 3}), cpus("2,3,"));
+}
+
+TEST(ParseCpuListTest, RejectsWhatIsNotAList) {
+    EXPECT_TRUE(cpus("").empty());
+    EXPECT_TRUE(cpus(",").empty());
+    EXPECT_TRUE(cpus("1,,2").empty());
+    EXPECT_TRUE(cpus("a").empty());
+    EXPECT_TRUE(cpus("1-").empty());
+    EXPECT_TRUE(cpus("-1").empty());
+    EXPECT_TRUE(cpus("1;2").empty());
+    EXPECT_TRUE(cpus("3-1").empty());
+}
+
+TEST(ParseCpuListTest, RejectsCpusOutOfRange) {
+    // 1024 with glibc and 64 bit bionic, 32 with 32 bit bionic
+    const std::string last = std::to_string(CPU_SETSIZE - 1);
+    const std::string over = std::to_string(CPU_SETSIZE);
+    EXPECT_EQ(std::vector<int>({CPU_SETSIZE - 1}), cpus(last.c_str()));
+    EXPECT_TRUE(cpus(over.c_str()).empty());
+    EXPECT_TRUE(cpus(("0-" + over).c_str()).empty());
+    EXPECT_TRUE(cpus("99999999999999999999").empty());
+}
+
+TEST(ParseSchedClassTest, TakesWhatToStringGives) {
+    for (const SchedClass schedClass : {SchedClass::DEFAULT, SchedClass::FIFO, SchedClass::RR}) {
+        SchedClass parsed;
+        ASSERT_TRUE(parseSchedClass(toString(schedClass), &parsed));
+        EXPECT_EQ(schedClass, parsed);
+    }
+    SchedClass parsed;
+    EXPECT_FALSE(parseSchedClass("batch", &parsed));
+}
+
+}  // namespace
+}  // namespace ciccloud
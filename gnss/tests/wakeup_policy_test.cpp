@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wakeup_policy.h"
+#include <gtest/gtest.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "gnss_hw_listener.h"
+#include "nmea_generator.h"
+
+namespace ciccloud {
+namespace {
+constexpr int64_t kMsToNs = 1000000;
+constexpr int64_t kPeriodNs = 1000 * kMsToNs;
+constexpr int64_t kBootNs = 3600 * 1000 * kMsToNs;
+constexpr size_t kWindow = 8;  // WakeupPolicy::kWindow
+
+class NullSink : public GnssSink {
+public:
+    void gnssLocation(const Location&) const override {}
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+};
+
+// The policy on the accepted end of a loopback TCP connection.
+class WakeupPolicyTest : public ::testing::Test {
+protected:
+    WakeupPolicyTest() : m_policy(config(2)) {}
+
+    static WakeupPolicyConfig config(const int maxHoldMs) {
+        WakeupPolicyConfig c;
+        c.maxHoldMs = maxHoldMs;
+        return c;
+    }
+
+    void SetUp() override {
+        const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_GE(listenFd, 0);
+        struct sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t len = sizeof(addr);
+        ASSERT_EQ(0, bind(listenFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)));
+        ASSERT_EQ(0, listen(listenFd, 1));
+        ASSERT_EQ(0, getsockname(listenFd, reinterpret_cast<struct sockaddr*>(&addr), &len));
+        m_peerFd = socket(AF_INET, SOCK_STREAM, 0);
+        ASSERT_EQ(0, connect(m_peerFd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)));
+        m_fd = accept(listenFd, nullptr, nullptr);
+        close(listenFd);
+        ASSERT_GE(m_fd, 0);
+        m_policy.reset(m_fd);
+    }
+
+    void TearDown() override {
+        close(m_fd);
+        close(m_peerFd);
+    }
+
+    int kernelLowat() const {
+        int lowat = 0;
+        socklen_t len = sizeof(lowat);
+        EXPECT_EQ(0, getsockopt(m_fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, &len));
+        return lowat;
+    }
+
+    // Epochs `first` to `last` of `bytes` each, one period apart, are complete.
+    void epochs(WakeupPolicy* policy, const uint64_t first, const uint64_t last,
+                const size_t bytes) {
+        for (uint64_t n = first; n <= last; ++n) {
+            policy->onEpochs(n, bytes + n % 3, kBootNs + n * kPeriodNs);
+        }
+    }
+
+    WakeupPolicy m_policy;
+    int m_fd = -1;
+    int m_peerFd = -1;
+};
+
+TEST_F(WakeupPolicyTest, HoldsTheWakeupForTheSmallestEpochOfTheWindow) {
+    epochs(&m_policy, 1, kWindow - 1, 500);
+    EXPECT_EQ(1, m_policy.lowat());
+    EXPECT_EQ(-1, m_policy.timeoutMs(kBootNs + kWindow * kPeriodNs));
+
+    epochs(&m_policy, kWindow, kWindow, 500);
+    EXPECT_EQ(500, m_policy.lowat());
+    EXPECT_EQ(500, kernelLowat());
+
+    // the next epoch is due a period after the last one began, then it may
+    // be held for maxHoldMs
+    const int64_t dueNs = kBootNs + (kWindow + 1) * kPeriodNs;
+    EXPECT_EQ(1002, m_policy.timeoutMs(kBootNs + kWindow * kPeriodNs));
+    EXPECT_FALSE(m_policy.due(dueNs));
+    EXPECT_TRUE(m_policy.due(dueNs + 2 * kMsToNs));
+    EXPECT_EQ(0, m_policy.timeoutMs(dueNs + 3 * kMsToNs));
+}
+
+TEST_F(WakeupPolicyTest, UnlearnsWhenAShorterEpochWasHeld) {
+    epochs(&m_policy, 1, kWindow, 500);
+    ASSERT_EQ(500, m_policy.lowat());
+
+    // 300 bytes were sitting below the mark: wake on every segment again
+    m_policy.onPolled(300);
+    EXPECT_EQ(1, m_policy.lowat());
+    EXPECT_EQ(1, kernelLowat());
+    EXPECT_EQ(-1, m_policy.timeoutMs(kBootNs + (kWindow + 2) * kPeriodNs));
+
+    // until a window of the new size is known
+    epochs(&m_policy, kWindow + 1, 2 * kWindow - 1, 300);
+    EXPECT_EQ(1, m_policy.lowat());
+    epochs(&m_policy, 2 * kWindow, 2 * kWindow, 300);
+    EXPECT_EQ(300, m_policy.lowat());
+    EXPECT_EQ(300, kernelLowat());
+}
+
+TEST_F(WakeupPolicyTest, WakesOnEverySegmentWhileTheFeedPauses) {
+    epochs(&m_policy, 1, kWindow, 500);
+    ASSERT_EQ(500, m_policy.lowat());
+
+    m_policy.onPolled(0);
+    EXPECT_EQ(1, kernelLowat());
+
+    // what it knew still holds for the next epoch
+    epochs(&m_policy, kWindow + 1, kWindow + 1, 500);
+    EXPECT_EQ(500, kernelLowat());
+}
+
+TEST_F(WakeupPolicyTest, StaysAtOneWithoutSoRcvlowat) {
+    int pipeFds[2];
+    ASSERT_EQ(0, pipe(pipeFds));
+    WakeupPolicy policy(config(2));
+    policy.reset(pipeFds[0]);
+    epochs(&policy, 1, 2 * kWindow, 500);
+    EXPECT_EQ(1, policy.lowat());
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+TEST_F(WakeupPolicyTest, DoesNothingWithoutAHold) {
+    WakeupPolicy policy(config(0));
+    policy.reset(m_fd);
+    epochs(&policy, 1, 2 * kWindow, 500);
+    EXPECT_EQ(1, policy.lowat());
+    EXPECT_EQ(1, kernelLowat());
+    EXPECT_EQ(-1, policy.timeoutMs(kBootNs));
+}
+
+TEST_F(WakeupPolicyTest, LearnsTheEpochsTheListenerFinds) {
+    // a GSV left of an epoch before the connection, then RMC, GGA, GSV
+    const sim::Trajectory trajectory(0, 37.422, -122.084, 10, 3, 90, 0);
+    const sim::NmeaFormat format;
+    NullSink sink;
+    GnssHwListener listener(&sink);
+    std::vector<size_t> sizes;
+    char buf[128];
+    for (int i = 0; i < 12; ++i) {
+        const sim::TrajectoryPoint p = trajectory.at(i * 1000);
+        std::string data;
+        if (i == 0) {
+            data.append(buf, sim::formatGSV(p, format, 2, buf, sizeof(buf)));
+        }
+        const size_t start = data.size();
+        data.append(buf, sim::formatRMC(p, format, buf, sizeof(buf)));
+        data.append(buf, sim::formatGGA(p, format, buf, sizeof(buf)));
+        data.append(buf, sim::formatGSV(p, format, 1, buf, sizeof(buf)));
+        sizes.push_back(data.size() - start);
+
+        listener.consume(data.data(), data.size(), kBootNs + i * kPeriodNs);
+        m_policy.onEpochs(listener.epochs(), listener.lastEpochBytes(),
+                          listener.epochStartRxBootNs());
+    }
+
+    // 11 complete epochs, the last 8 of them make the window
+    ASSERT_EQ(11u, listener.epochs());
+    EXPECT_EQ(sizes[10], listener.lastEpochBytes());
+    const int smallest = *std::min_element(sizes.begin() + 3, sizes.begin() + 11);
+    EXPECT_EQ(smallest, m_policy.lowat());
+    EXPECT_EQ(smallest, kernelLowat());
+}
+
+}  // namespace
+}  // namespace ciccloud
@@ -0,0 +1,145 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "thread_policy.h"
+#include <errno.h>
+#include <log/log.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+
+namespace ciccloud {
+namespace {
+
+bool lockMemoryOnce() {
+    static std::once_flag once;
+    static bool locked = false;
+    std::call_once(once, []() {
+        locked = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+        if (!locked) {
+            ALOGW("%s:%d: mlockall failed: %s", __PRETTY_FUNCTION__, __LINE__, strerror(errno));
+        }
+    });
+    return locked;
+}
+
+}  // namespace
+
+bool applyThreadPolicy(const ThreadPolicyConfig& config) {
+    if (config.isDefault()) {
+        return true;
+    }
+
+    bool ok = true;
+    if (config.lockMemory) {
+        ok &= lockMemoryOnce();
+    }
+
+    if (!config.cpus.empty()) {
+        cpu_set_t set;
+        if (!parseCpuList(config.cpus.c_str(), &set)) {
+            ALOGW("%s:%d: bad CPU list '%s'", __PRETTY_FUNCTION__, __LINE__, config.cpus.c_str());
+            ok = false;
+        } else if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            ALOGW("%s:%d: sched_setaffinity(%s) failed: %s", __PRETTY_FUNCTION__, __LINE__,
+                  config.cpus.c_str(), strerror(errno));
+            ok = false;
+        }
+    }
+
+    if (config.schedClass != SchedClass::DEFAULT) {
+        // children must not inherit a real time class they did not ask for
+        const int policy = ((config.schedClass == SchedClass::FIFO) ? SCHED_FIFO : SCHED_RR) |
+                           SCHED_RESET_ON_FORK;
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = config.priority;
+        if (sched_setscheduler(0, policy, &param) < 0) {
+            ALOGW("%s:%d: sched_setscheduler(%s, %d) failed: %s", __PRETTY_FUNCTION__, __LINE__,
+                  toString(config.schedClass), config.priority, strerror(errno));
+            ok = false;
+        }
+    } else if (config.nice != 0) {
+        // per thread on Linux, where the "process" is the thread id
+        if (setpriority(PRIO_PROCESS, syscall(SYS_gettid), config.nice) < 0) {
+            ALOGW("%s:%d: setpriority(%d) failed: %s", __PRETTY_FUNCTION__, __LINE__,
+                  config.nice, strerror(errno));
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+const char* toString(const SchedClass schedClass) {
+    switch (schedClass) {
+        case SchedClass::DEFAULT: return "other";
+        case SchedClass::FIFO: return "fifo";
+        case SchedClass::RR: return "rr";
+    }
+    return "?";
+}
+
+bool parseSchedClass(const char* name, SchedClass* schedClass) {
+    if (!strcmp(name, "fifo")) {
+        *schedClass = SchedClass::FIFO;
+    } else if (!strcmp(name, "rr")) {
+        *schedClass = SchedClass::RR;
+    } else if (!strcmp(name, "other")) {
+        *schedClass = SchedClass::DEFAULT;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+bool parseCpuList(const char* list, cpu_set_t* set) {
+    CPU_ZERO(set);
+    const char* p = list;
+    while (*p) {
+        char* end;
+        const long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p) {
+            return false;
+        } else if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p) {
+                return false;
+            }
+        }
+        if (first < 0 || last < first || last >= CPU_SETSIZE) {
+            return false;
+        }
+        for (long cpu = first; cpu <= last; ++cpu) {
+            CPU_SET(cpu, set);
+        }
+        if (*end == ',') {
+            ++end;
+        } else if (*end != '\0') {
+            return false;
+        }
+        p = end;
+    }
+    return CPU_COUNT(set) > 0;
+}
+
+}  // namespace ciccloud
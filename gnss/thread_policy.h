@@ -0,0 +1,61 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <sched.h>
+#include <string>
+
+namespace ciccloud {
+
+enum class SchedClass {
+    DEFAULT,  // SCHED_OTHER, with `nice`
+    FIFO,     // SCHED_FIFO at `priority`
+    RR,       // SCHED_RR at `priority`
+};
+
+// How the threads of the HAL which carry a fix run: what a busy host lets
+// them have of the CPU. Everything off by default. The real time classes
+// need CAP_SYS_NICE (or RLIMIT_RTPRIO), a negative nice value too, and
+// lockMemory CAP_IPC_LOCK (or RLIMIT_MEMLOCK): what the kernel refuses is
+// logged and the thread runs on without it. The service, user gps, has
+// none of these: a device which wants them grants the capabilities to
+// vendor.gnss-2-0 in an .rc and sepolicy of its own.
+struct ThreadPolicyConfig {
+    SchedClass schedClass = SchedClass::DEFAULT;
+    int priority = 1;         // 1..99, the real time classes only
+    int nice = 0;             // -20..19, DEFAULT only
+    std::string cpus;         // the CPUs to run on, like "2-3,6", empty - any
+    bool lockMemory = false;  // mlockall, for the whole process
+
+    bool isDefault() const {
+        return schedClass == SchedClass::DEFAULT && nice == 0 && cpus.empty() && !lockMemory;
+    }
+};
+
+// Applies the policy to the calling thread, and locks the memory of the
+// process the first time it is asked to. False if any of it failed.
+bool applyThreadPolicy(const ThreadPolicyConfig&);
+
+const char* toString(SchedClass);
+// "fifo", "rr" or "other", as toString gives them.
+bool parseSchedClass(const char* name, SchedClass*);
+
+// A CPU list as in /sys/devices/system/cpu/online: "0-3,6", a trailing comma
+// allowed. False if it is empty or names a CPU past CPU_SETSIZE.
+bool parseCpuList(const char* list, cpu_set_t*);
+
+}  // namespace ciccloud
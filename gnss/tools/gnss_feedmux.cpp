@@ -0,0 +1,222 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+// Feeds many HAL instances from one host process, in place of a feeder per
+// instance (see FeedMux):
+//   $ gnss_cic_cloud_feedmux --instances 127.0.0.1:8766-8865 [--instances unix:/run/gnss/%d:0-99]
+//         [--rate 10] [--scenarios K] [--gsv-every K] [--vtg] [--backlog N] [--stats-every S]
+//
+// An --instances is HOST:PORT or a range of ports HOST:FIRST-LAST, HOST a
+// numeric IPv4 address, or a unix socket unix:PATH, with a range
+// unix:PATH:FIRST-LAST for a PATH with one %d in it and no other '%' ("@" in
+// front for the abstract namespace). Instance i plays scenario
+// i % K: the same trajectory, started on a bearing 360 / K degrees further
+// for every next one. The instances on a scenario share its encoding.
+
+#include <arpa/inet.h>
+#include <signal.h>
+#include <sys/resource.h>
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "feed_mux.h"
+#include "feeder.h"
+
+namespace ciccloud {
+namespace {
+using sim::Endpoint;
+using sim::FeedMux;
+using sim::FeedMuxConfig;
+using sim::MuxScenario;
+using sim::steadyNowNs;
+
+volatile sig_atomic_t g_quit = 0;
+
+// "FIRST-LAST" or "N" at the end of `s`, after the last ':'.
+bool parseRange(const std::string& s, std::string* head, int* first, int* last) {
+    const size_t colon = s.rfind(':');
+    if (colon == std::string::npos) {
+        return false;
+    }
+    const char* range = s.c_str() + colon + 1;
+    char* end;
+    *first = strtol(range, &end, 10);
+    *last = *first;
+    if (end == range) {
+        return false;
+    } else if (*end == '-') {
+        const char* second = end + 1;
+        *last = strtol(second, &end, 10);
+        if (end == second) {
+            return false;
+        }
+    }
+    *head = s.substr(0, colon);
+    return *end == '\0' && *first <= *last;
+}
+
+bool parseInstances(const std::string& spec, std::vector<Endpoint>* out) {
+    Endpoint ep;
+    std::string head;
+    int first;
+    int last;
+    if (spec.compare(0, 5, "unix:") == 0) {
+        const std::string path = spec.substr(5);
+        if (path.find("%d") == std::string::npos) {
+            ep.udsPath = path;
+            out->push_back(ep);
+            return !path.empty();
+        } else if (!parseRange(path, &head, &first, &last)) {
+            return false;
+        }
+        // the number goes in by hand: the path is no format string
+        const size_t at = head.find("%d");
+        if (at == std::string::npos || head.find('%') != at ||
+            head.find('%', at + 2) != std::string::npos) {
+            return false;
+        }
+        for (int i = first; i <= last; ++i) {
+            ep.udsPath = head.substr(0, at) + std::to_string(i) + head.substr(at + 2);
+            out->push_back(ep);
+        }
+        return true;
+    }
+
+    // FeedMux takes numeric IPv4 addresses only, a name would never connect
+    struct in_addr addr;
+    if (!parseRange(spec, &head, &first, &last) || first < 1 || last > 65535 ||
+        inet_pton(AF_INET, head.c_str(), &addr) != 1) {
+        return false;
+    }
+    ep.host = head;
+    for (int port = first; port <= last; ++port) {
+        ep.port = port;
+        out->push_back(ep);
+    }
+    return true;
+}
+
+// An fd per instance, thousands of them.
+void raiseFdLimit() {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+void printStats(const FeedMux::Stats& s) {
+    printf("instances %zu connected %zu started %zu epochs %llu delivered %llu dropped %llu "
+           "writes %llu bytes %llu reconnects %llu\n",
+           s.instances, s.connected, s.started,
+           static_cast<unsigned long long>(s.epochs),
+           static_cast<unsigned long long>(s.delivered),
+           static_cast<unsigned long long>(s.dropped),
+           static_cast<unsigned long long>(s.writes),
+           static_cast<unsigned long long>(s.bytes),
+           static_cast<unsigned long long>(s.reconnects));
+    fflush(stdout);
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s --instances IPV4:PORT[-LAST] | unix:PATH[:FIRST-LAST] [--instances ...]\n"
+            "          [--rate HZ] [--scenarios K] [--gsv-every K] [--vtg] [--backlog N]\n"
+            "          [--stats-every S]\n",
+            argv0);
+}
+
+}  // namespace
+}  // namespace ciccloud
+
+int main(int argc, char* argv[]) {
+    using namespace ciccloud;
+
+    std::vector<Endpoint> instances;
+    MuxScenario scenario;
+    int scenarios = 1;
+    FeedMuxConfig config;
+    double statsEverySec = 10;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--vtg")) {
+            scenario.vtg = true;
+        } else if (!value) {
+            usage(argv[0]);
+            return 1;
+        } else if (!strcmp(arg, "--instances")) {
+            if (!parseInstances(argv[++i], &instances)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--rate")) {
+            scenario.rateHz = atof(argv[++i]);
+        } else if (!strcmp(arg, "--scenarios")) {
+            scenarios = std::max(1, atoi(argv[++i]));
+        } else if (!strcmp(arg, "--gsv-every")) {
+            scenario.gsvEvery = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--backlog")) {
+            config.maxBacklogEpochs = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--stats-every")) {
+            statsEverySec = atof(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (instances.empty() || !(scenario.rateHz > 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    raiseFdLimit();
+    FeedMux mux(config);
+    for (int k = 0; k < scenarios; ++k) {
+        MuxScenario s = scenario;
+        s.bearingDegrees = 360.0 * k / scenarios;
+        mux.addScenario(s);
+    }
+    for (size_t i = 0; i < instances.size(); ++i) {
+        mux.addInstance(instances[i], i % scenarios);
+    }
+
+    signal(SIGINT, [](int) { g_quit = 1; });
+    signal(SIGTERM, [](int) { g_quit = 1; });
+    signal(SIGPIPE, SIG_IGN);
+
+    const int64_t statsEveryNs = static_cast<int64_t>(statsEverySec * 1e9);
+    int64_t statsNs = (statsEveryNs > 0) ? steadyNowNs() + statsEveryNs : INT64_MAX;
+    while (!g_quit) {
+        const int64_t nextNs = std::min(mux.tick(steadyNowNs()), statsNs);
+        // rounded up: waking early would only tick again for nothing
+        const int64_t waitNs = nextNs - steadyNowNs();
+        mux.wait(static_cast<int>(std::clamp<int64_t>((waitNs + 999999) / 1000000, 0, 1000)));
+        if (steadyNowNs() >= statsNs) {
+            printStats(mux.stats());
+            statsNs += statsEveryNs;
+        }
+    }
+
+    printStats(mux.stats());
+    return 0;
+}
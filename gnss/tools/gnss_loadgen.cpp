@@ -0,0 +1,447 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Synthetic feeder and end-to-end load benchmark.
+//
+// Feed a running HAL instance (the port is virtual.gps.tcp.port):
+//   $ gnss_cic_cloud_loadgen --port 8766 --rate 10 [--epochs N] [--gsv-every K] [--vtg]
+// (--priority N announces the priority of the feed among several, see FeedArbiter)
+//
+// Sweep fix rates against an in-process GnssHwConn on loopback and find the
+// knee, where the delivered rate falls behind or the latency takes off:
+//   $ gnss_cic_cloud_loadgen --loopback [--rates 10,100,1000] [--seconds 3]
+//
+// --udp-port sends the epochs as datagrams (virtual.gps.udp.port), with
+// --udp-loss a share of them is dropped on the way. --io-uring runs the HAL
+// side on io_uring (virtual.gps.io_uring) if the kernel has it; sys/fix and
+// cpu_us/fix are what its I/O threads spend per fix, to compare the loops.
+// wake/fix and read/fix count the wakeups and reads of the worker for feed
+// data; --segment N writes epochs in N byte pieces as a network would cut
+// them and --max-hold-ms (virtual.gps.wakeup.max_hold_ms, 0 - off) tunes
+// how the HAL side holds wakeups until an epoch is complete. With --gsv-every
+// the sweep also shows how many satellite statuses the HAL side held back
+// as unchanged (virtual.gps.sv_status.*). --feeds N runs N redundant
+// feeders on one schedule against virtual.gps.feeds = N, the first of them
+// preferred: it fails half way through every step, and the sweep shows what
+// the failover cost and how many duplicate epochs were suppressed.
+
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "feeder.h"
+#include "gnss_hw_conn.h"
+
+namespace ciccloud {
+namespace {
+using sim::Feeder;
+using sim::FeederConfig;
+using sim::steadyNowNs;
+
+constexpr uint64_t kMaxEpochsPerStep = 500000;
+
+// Stands in for IGnssCallback: timestamps the first fix of every epoch.
+// It is armed while the session of a step runs, the worker thread only
+// delivers then: runStep() disarms it once the session has ended, before
+// the timestamps go away.
+class MeasuringSink : public GnssSink {
+public:
+    void arm(std::atomic<int64_t>* deliveredNs, const uint64_t capacity, const int64_t epochMs) {
+        m_capacity.store(0, std::memory_order_release);
+        m_deliveredNs.store(deliveredNs, std::memory_order_relaxed);
+        m_epochMs.store(epochMs, std::memory_order_relaxed);
+        m_capacity.store(capacity, std::memory_order_release);  // publishes the two above
+    }
+    void disarm() { arm(nullptr, 0, 1); }
+
+    void gnssLocation(const Location& loc) const override {
+        const uint64_t capacity = m_capacity.load(std::memory_order_acquire);
+        if (capacity) {
+            std::atomic<int64_t>* deliveredNs = m_deliveredNs.load(std::memory_order_relaxed);
+            const int64_t seq = Feeder::seqOf(loc.utcTimeOfDayMs,
+                                              m_epochMs.load(std::memory_order_relaxed));
+            if (seq >= 0 && static_cast<uint64_t>(seq) < capacity) {
+                int64_t expected = 0;
+                deliveredNs[seq].compare_exchange_strong(expected, steadyNowNs(),
+                                                         std::memory_order_relaxed);
+            }
+        }
+        ++m_locations;
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override { ++m_svStatus; }
+    void gnssStatus(const GnssStatus status) const override {
+        if (status == GnssStatus::SESSION_END) {
+            ++m_sessionEnds;
+        }
+    }
+    void gnssNmea(int64_t, const char*, size_t) const override { ++m_nmea; }
+
+    mutable std::atomic<uint64_t> m_locations{0};
+    mutable std::atomic<uint64_t> m_svStatus{0};
+    mutable std::atomic<uint64_t> m_nmea{0};
+    // the worker delivers nothing after SESSION_END until the next start
+    mutable std::atomic<uint64_t> m_sessionEnds{0};
+
+private:
+    std::atomic<std::atomic<int64_t>*> m_deliveredNs{nullptr};
+    std::atomic<int64_t> m_epochMs{1};
+    std::atomic<uint64_t> m_capacity{0};
+};
+
+struct StepResult {
+    double targetHz = 0;
+    double offeredHz = 0;
+    double deliveredHz = 0;
+    uint64_t sent = 0;
+    uint64_t delivered = 0;
+    double p50Ms = 0;
+    double p90Ms = 0;
+    double p99Ms = 0;
+    double maxMs = 0;
+    double syscallsPerFix = 0;
+    double cpuUsPerFix = 0;
+    double wakeupsPerFix = 0;
+    double readsPerFix = 0;
+    uint64_t timerWakeups = 0;
+};
+
+double percentile(std::vector<int64_t>* v, const double p) {
+    if (v->empty()) {
+        return 0;
+    }
+    const size_t i = std::min(v->size() - 1, static_cast<size_t>(p * v->size()));
+    std::nth_element(v->begin(), v->begin() + i, v->end());
+    return (*v)[i] / 1e6;
+}
+
+StepResult runStep(GnssHwConn* conn, MeasuringSink* sink, const FeederConfig& feederConfig,
+                   const double rateHz, const double seconds, const int feeds) {
+    const uint64_t epochs = std::min<uint64_t>(kMaxEpochsPerStep,
+                                               std::max(1.0, rateHz * seconds));
+    // of every feeder, an epoch counts as sent when the first one sent it
+    std::vector<std::unique_ptr<std::atomic<int64_t>[]>> feederSentNs;
+    for (int f = 0; f < feeds; ++f) {
+        feederSentNs.emplace_back(new std::atomic<int64_t>[epochs]);
+        for (uint64_t i = 0; i < epochs; ++i) {
+            feederSentNs.back()[i] = 0;
+        }
+    }
+    std::unique_ptr<std::atomic<int64_t>[]> deliveredNs(new std::atomic<int64_t>[epochs]);
+    for (uint64_t i = 0; i < epochs; ++i) {
+        deliveredNs[i] = 0;
+    }
+    sink->arm(deliveredNs.get(), epochs, Feeder::epochMs(rateHz));
+    const uint64_t sessionEnds = sink->m_sessionEnds;
+    if (!conn->start()) {
+        fprintf(stderr, "GnssHwConn failed to start\n");
+        exit(1);
+    }
+
+    FeederConfig config = feederConfig;
+    config.rateHz = rateHz;
+    if (feeds > 1) {
+        config.epoch0Ns = steadyNowNs() + 500000000LL;  // time for all to connect
+    }
+    std::vector<std::unique_ptr<Feeder>> feeders;
+    for (int f = 0; f < feeds; ++f) {
+        if (feeds > 1) {
+            config.priority = f;
+        }
+        feeders.push_back(std::make_unique<Feeder>(config));
+        for (int i = 0; !feeders.back()->connect(); ++i) {
+            if (i > 50) {
+                fprintf(stderr, "could not connect to port %u\n", config.port);
+                exit(1);
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+    }
+
+    StepResult r;
+    r.targetHz = rateHz;
+    const GnssHwConn::IoStats io0 = conn->ioStats();
+    std::vector<uint64_t> sent(feeds, 0);
+    std::vector<std::thread> standbys;
+    for (int f = 1; f < feeds; ++f) {
+        standbys.emplace_back([&, f]() { sent[f] = feeders[f]->run(epochs, feederSentNs[f].get()); });
+    }
+    // the preferred feeder fails half way if there are others
+    sent[0] = feeders[0]->run((feeds > 1) ? epochs / 2 : epochs, feederSentNs[0].get());
+    if (feeds > 1) {
+        feeders[0]->disconnect();
+    }
+    for (std::thread& t : standbys) {
+        t.join();
+    }
+    r.sent = *std::max_element(sent.begin(), sent.end());
+
+    // let the pipeline drain
+    const int64_t drainDeadlineNs = steadyNowNs() + 2000000000LL;
+    while (steadyNowNs() < drainDeadlineNs &&
+           (r.sent == 0 || deliveredNs[r.sent - 1].load() == 0)) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    const GnssHwConn::IoStats io1 = conn->ioStats();
+    // end the session and wait until the worker has, it may still be
+    // delivering what came late
+    conn->stop();
+    while (sink->m_sessionEnds == sessionEnds) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    sink->disarm();
+    for (std::unique_ptr<Feeder>& feeder : feeders) {
+        feeder->disconnect();
+    }
+
+    const auto sentNs = [&feederSentNs](const uint64_t i) {
+        int64_t first = 0;
+        for (const auto& s : feederSentNs) {
+            const int64_t t = s[i].load();
+            first = (t && (!first || t < first)) ? t : first;
+        }
+        return first;
+    };
+    std::vector<int64_t> latencies;
+    latencies.reserve(r.sent);
+    int64_t lastDeliveredNs = 0;
+    for (uint64_t i = 0; i < r.sent; ++i) {
+        const int64_t d = deliveredNs[i].load();
+        if (d && sentNs(i)) {
+            latencies.push_back(d - sentNs(i));
+            lastDeliveredNs = std::max(lastDeliveredNs, d);
+        }
+    }
+    r.delivered = latencies.size();
+
+    if (r.sent > 1) {
+        const int64_t firstNs = sentNs(0);
+        r.offeredHz = (r.sent - 1) * 1e9 / std::max<int64_t>(1, sentNs(r.sent - 1) - firstNs);
+        r.deliveredHz = (r.delivered > 1)
+            ? (r.delivered - 1) * 1e9 / std::max<int64_t>(1, lastDeliveredNs - firstNs)
+            : 0;
+    }
+    r.p50Ms = percentile(&latencies, .50);
+    r.p90Ms = percentile(&latencies, .90);
+    r.p99Ms = percentile(&latencies, .99);
+    r.maxMs = percentile(&latencies, 1.0);
+    if (r.delivered) {
+        r.syscallsPerFix = static_cast<double>(io1.syscalls - io0.syscalls) / r.delivered;
+        r.cpuUsPerFix = (io1.cpuNs - io0.cpuNs) / 1e3 / r.delivered;
+        r.wakeupsPerFix = static_cast<double>(io1.wakeups - io0.wakeups) / r.delivered;
+        r.readsPerFix = static_cast<double>(io1.reads - io0.reads) / r.delivered;
+    }
+    r.timerWakeups = io1.timerWakeups - io0.timerWakeups;
+    return r;
+}
+
+std::vector<double> parseRates(const char* s) {
+    std::vector<double> rates;
+    while (*s) {
+        char* end;
+        const double r = strtod(s, &end);
+        if (end == s) {
+            break;
+        }
+        if (r > 0) {
+            rates.push_back(r);
+        }
+        s = (*end == ',') ? (end + 1) : end;
+    }
+    return rates;
+}
+
+int loopback(const FeederConfig& feederConfig, GnssHwConnConfig config,
+             const std::vector<double>& rates, const double seconds) {
+    MeasuringSink sink;
+    const int feeds = std::clamp(config.feeds, 1, FeedArbiter::kMaxFeeds);
+    config.tcpPort = feederConfig.port;
+    config.udpPort = feederConfig.udpPort;
+    GnssHwConn conn(&sink, config);
+    if (!conn.ok()) {
+        fprintf(stderr, "GnssHwConn failed to start\n");
+        return 1;
+    }
+
+    printf("loop: %s\n", conn.ioStats().ioUring ? "io_uring" : "epoll");
+    printf("%10s %10s %10s %9s %8s %9s %9s %9s %9s %8s %10s %9s %9s %6s\n", "target_hz",
+           "offered", "delivered", "sent", "drops", "p50_ms", "p90_ms", "p99_ms", "max_ms",
+           "sys/fix", "cpu_us/fix", "wake/fix", "read/fix", "timer");
+
+    std::vector<StepResult> results;
+    for (const double rate : rates) {
+        const StepResult r = runStep(&conn, &sink, feederConfig, rate, seconds, feeds);
+        printf("%10.0f %10.1f %10.1f %9llu %8llu %9.3f %9.3f %9.3f %9.3f %8.2f %10.2f %9.2f %9.2f %6llu\n",
+               r.targetHz, r.offeredHz, r.deliveredHz,
+               static_cast<unsigned long long>(r.sent),
+               static_cast<unsigned long long>(r.sent - r.delivered),
+               r.p50Ms, r.p90Ms, r.p99Ms, r.maxMs, r.syscallsPerFix, r.cpuUsPerFix,
+               r.wakeupsPerFix, r.readsPerFix, static_cast<unsigned long long>(r.timerWakeups));
+        fflush(stdout);
+        results.push_back(r);
+    }
+
+    const DatagramFeed& datagrams = conn.datagramFeed();
+    if (datagrams.received()) {
+        printf("datagrams: %llu received in %llu reads, %llu lost, %llu stale, %llu rejected, "
+               "%llu truncated\n",
+               static_cast<unsigned long long>(datagrams.received()),
+               static_cast<unsigned long long>(datagrams.batches()),
+               static_cast<unsigned long long>(datagrams.lost()),
+               static_cast<unsigned long long>(datagrams.stale()),
+               static_cast<unsigned long long>(datagrams.rejected()),
+               static_cast<unsigned long long>(datagrams.truncated()));
+    }
+
+    const SvStatusPublisher::Stats sv = conn.svStatusStats();
+    if (sv.offered) {
+        printf("sv status: %llu of %llu sent, %llu callbacks and %llu bytes saved\n",
+               static_cast<unsigned long long>(sv.sent),
+               static_cast<unsigned long long>(sv.offered),
+               static_cast<unsigned long long>(sv.callbacksSaved()),
+               static_cast<unsigned long long>(sv.bytesSaved()));
+    }
+
+    const FeedArbiter::Stats fs = conn.feedStats();
+    if (feeds > 1) {
+        printf("feeds: %llu epochs delivered, %llu duplicates and %llu standby epochs suppressed, "
+               "%llu failovers, %.2f locations per epoch\n",
+               static_cast<unsigned long long>(fs.epochs),
+               static_cast<unsigned long long>(fs.duplicates),
+               static_cast<unsigned long long>(fs.standby),
+               static_cast<unsigned long long>(fs.failovers),
+               fs.epochs ? static_cast<double>(sink.m_locations) / fs.epochs : 0.0);
+    }
+
+    // The knee: the first rate which is not sustained. Either we could not
+    // even offer it (backpressure), deliveries lag, fixes are lost, or the
+    // tail latency is an order of magnitude above the lightest load. Losses
+    // we make ourselves do not count, with some slack for their randomness.
+    const double lossAllowance = feederConfig.datagramLoss > 0
+        ? std::min(1.0, 1.5 * feederConfig.datagramLoss + 0.01) : 0;
+    const double baseP99 = results.empty() ? 0 : std::max(results.front().p99Ms, 0.1);
+    const StepResult* lastGood = nullptr;
+    for (const StepResult& r : results) {
+        const bool saturated = (r.offeredHz < .95 * r.targetHz) ||
+                               (r.deliveredHz < .95 * r.offeredHz * (1 - lossAllowance)) ||
+                               (r.delivered < r.sent * (1 - lossAllowance)) ||
+                               (r.p99Ms > 10 * baseP99);
+        if (saturated) {
+            printf("knee: between %.0f Hz and %.0f Hz\n",
+                   lastGood ? lastGood->targetHz : 0.0, r.targetHz);
+            return 0;
+        }
+        lastGood = &r;
+    }
+    printf("knee: above %.0f Hz, no saturation in the tested range\n",
+           lastGood ? lastGood->targetHz : 0.0);
+    return 0;
+}
+
+int feed(const FeederConfig& config, const uint64_t epochs) {
+    Feeder feeder(config);
+    while (!feeder.connect()) {
+        fprintf(stderr, "waiting for %s:%u\n", config.host.c_str(), config.port);
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+    }
+
+    const int64_t t0 = steadyNowNs();
+    const uint64_t sent = feeder.run(epochs, nullptr);
+    const double s = (steadyNowNs() - t0) / 1e9;
+    printf("sent %llu epochs in %.1f s\n", static_cast<unsigned long long>(sent), s);
+    return 0;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--host H] [--port P] [--rate HZ] [--epochs N] [--gsv-every K] [--vtg]\n"
+            "       %s --loopback [--port P] [--rates HZ,HZ,...] [--seconds S] [--gsv-every K] [--vtg]\n"
+            "       either with [--udp-port P] [--udp-loss FRACTION] [--io-uring] [--segment N]\n"
+            "       [--max-hold-ms MS] [--priority N]\n"
+            "       --loopback also with [--feeds N]\n",
+            argv0, argv0);
+}
+
+}  // namespace
+}  // namespace ciccloud
+
+int main(int argc, char* argv[]) {
+    using namespace ciccloud;
+
+    FeederConfig config;
+    GnssHwConnConfig halConfig;
+    bool loopbackMode = false;
+    uint64_t epochs = UINT64_MAX;
+    double seconds = 3;
+    std::vector<double> rates = {10, 100, 500, 1000, 2000, 5000, 10000, 20000};
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--loopback")) {
+            loopbackMode = true;
+            config.port = 18766;
+        } else if (!strcmp(arg, "--vtg")) {
+            config.vtg = true;
+        } else if (!strcmp(arg, "--io-uring")) {
+            halConfig.ioUring = true;
+        } else if (!value) {
+            usage(argv[0]);
+            return 1;
+        } else if (!strcmp(arg, "--host")) {
+            config.host = argv[++i];
+        } else if (!strcmp(arg, "--port")) {
+            config.port = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--rate")) {
+            config.rateHz = atof(argv[++i]);
+        } else if (!strcmp(arg, "--rates")) {
+            rates = parseRates(argv[++i]);
+        } else if (!strcmp(arg, "--epochs")) {
+            epochs = strtoull(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(arg, "--gsv-every")) {
+            config.gsvEvery = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--udp-port")) {
+            config.udpPort = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--udp-loss")) {
+            config.datagramLoss = atof(argv[++i]);
+        } else if (!strcmp(arg, "--segment")) {
+            config.segmentBytes = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--max-hold-ms")) {
+            halConfig.wakeup.maxHoldMs = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--priority")) {
+            config.priority = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--feeds")) {
+            halConfig.feeds = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (loopbackMode) {
+        return loopback(config, halConfig, rates, seconds);
+    } else {
+        return feed(config, epochs);
+    }
+}
@@ -0,0 +1,403 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Network impairment for the feeder -> HAL link.
+//
+// Run the proxy between a feeder and a HAL instance (TCP or unix sockets):
+//   $ gnss_cic_cloud_netem --listen 8767 --upstream 8766 --delay-ms 40 --jitter-ms 10
+//         [--dist constant|uniform|normal|pareto] [--bandwidth BYTES_PER_SEC]
+//         [--max-chunk N] [--disconnect-every S] [--listen-uds PATH] [--upstream-uds PATH]
+//
+// Run the scenario suite against an in-process GnssHwConn, with a feeder
+// which reconnects like a real one, and report fix age and recovery time:
+//   $ gnss_cic_cloud_netem --scenarios [--rate 10] [--seconds 10] [--jitter-buffer MS]
+//         [--no-resume]
+//
+// ivl_dev is how far the interval between consecutive fixes is from the
+// nominal period, which is what a jitter buffer is meant to fix. ts_err is
+// how far the elapsedRealtime of a fix is from when the epoch was due at the
+// feeder, and ts_unc the uncertainty the HAL claims for it. dups are fixes
+// of an epoch older than one delivered already, replayed the sentences the feeder resent after reconnects
+// (--no-resume turns session resumption off, see FeedSession).
+
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "feeder.h"
+#include "gnss_hw_conn.h"
+#include "impairment_proxy.h"
+#include "util.h"
+
+namespace ciccloud {
+namespace {
+using sim::DelayDistribution;
+using sim::Endpoint;
+using sim::Feeder;
+using sim::FeederConfig;
+using sim::ImpairmentConfig;
+using sim::ImpairmentProxy;
+using sim::steadyNowNs;
+
+constexpr uint16_t kHalPort = 18767;
+constexpr uint16_t kProxyPort = 18768;
+
+// Stands in for IGnssCallback: timestamps the first fix of every epoch and
+// keeps its elapsedRealtime, moved to the steady clock.
+class DeliverySink : public GnssSink {
+public:
+    DeliverySink(std::atomic<int64_t>* deliveredNs, int64_t* fixTimeNs, int64_t* uncertaintyNs,
+                 const uint64_t capacity, const int64_t epochMs)
+        : m_deliveredNs(deliveredNs)
+        , m_fixTimeNs(fixTimeNs)
+        , m_uncertaintyNs(uncertaintyNs)
+        , m_capacity(capacity)
+        , m_epochMs(epochMs)
+        , m_bootToSteadyNs(steadyNowNs() - util::bootNanos()) {}
+
+    void gnssLocation(const Location& loc) const override {
+        const int64_t seq = Feeder::seqOf(loc.utcTimeOfDayMs, m_epochMs);
+        if (seq >= 0 && static_cast<uint64_t>(seq) < m_capacity) {
+            int64_t expected = 0;
+            if (m_deliveredNs[seq].compare_exchange_strong(expected, steadyNowNs(),
+                                                           std::memory_order_relaxed)) {
+                m_fixTimeNs[seq] = loc.elapsedRealtimeNs + m_bootToSteadyNs;
+                m_uncertaintyNs[seq] = loc.elapsedRealtimeUncertaintyNs;
+            }
+            // every epoch has several fixes, a replay would go back in time
+            if (seq < m_lastSeq) {
+                ++m_duplicates;
+            }
+            m_lastSeq = std::max(m_lastSeq, seq);
+        }
+    }
+    void gnssSvStatus(const SvInfo*, size_t) const override {}
+    void gnssStatus(GnssStatus) const override {}
+    void gnssNmea(int64_t, const char*, size_t) const override {}
+
+    uint64_t duplicates() const { return m_duplicates; }
+
+private:
+    std::atomic<int64_t>* const m_deliveredNs;
+    int64_t* const m_fixTimeNs;
+    int64_t* const m_uncertaintyNs;
+    const uint64_t m_capacity;
+    const int64_t m_epochMs;
+    const int64_t m_bootToSteadyNs;
+    mutable int64_t m_lastSeq = 0;  // only the callback thread touches it
+    mutable std::atomic<uint64_t> m_duplicates{0};
+};
+
+struct Scenario {
+    const char* name;
+    ImpairmentConfig config;
+};
+
+std::vector<Scenario> makeScenarios() {
+    std::vector<Scenario> scenarios;
+    ImpairmentConfig c;
+    scenarios.push_back({"baseline", c});
+
+    c = ImpairmentConfig();
+    c.distribution = DelayDistribution::NORMAL;
+    c.delayMs = 40;
+    c.jitterMs = 10;
+    scenarios.push_back({"wan_40ms_normal", c});
+
+    c = ImpairmentConfig();
+    c.distribution = DelayDistribution::PARETO;
+    c.delayMs = 20;
+    c.jitterMs = 30;
+    scenarios.push_back({"pareto_tail", c});
+
+    c = ImpairmentConfig();
+    c.bandwidthBytesPerSec = 2000;  // some headroom over 10 Hz RMC+GGA and pings
+    scenarios.push_back({"bandwidth_2000Bps", c});
+
+    c = ImpairmentConfig();
+    c.maxChunk = 7;
+    scenarios.push_back({"split_writes_7B", c});
+
+    c = ImpairmentConfig();
+    c.delayMs = 20;
+    c.disconnectEverySec = 3;
+    scenarios.push_back({"disconnect_3s", c});
+    return scenarios;
+}
+
+double percentile(std::vector<int64_t> v, const double p) {
+    if (v.empty()) {
+        return 0;
+    }
+    const size_t i = std::min(v.size() - 1, static_cast<size_t>(p * v.size()));
+    std::nth_element(v.begin(), v.begin() + i, v.end());
+    return v[i] / 1e6;
+}
+
+void runScenario(const Scenario& scenario, const double rateHz, const double seconds,
+                 const int jitterBufferMs, const bool resume) {
+    const uint64_t epochs = std::max(1.0, rateHz * seconds);
+    std::unique_ptr<std::atomic<int64_t>[]> sentNs(new std::atomic<int64_t>[epochs]);
+    std::unique_ptr<std::atomic<int64_t>[]> deliveredNs(new std::atomic<int64_t>[epochs]);
+    std::vector<int64_t> fixTimeNs(epochs);
+    std::vector<int64_t> uncertaintyNs(epochs);
+    for (uint64_t i = 0; i < epochs; ++i) {
+        sentNs[i] = 0;
+        deliveredNs[i] = 0;
+    }
+
+    DeliverySink sink(deliveredNs.get(), fixTimeNs.data(), uncertaintyNs.data(), epochs,
+                      Feeder::epochMs(rateHz));
+    GnssHwConnConfig connConfig;
+    connConfig.tcpPort = kHalPort;
+    connConfig.jitterBuffer.targetDelayMs = jitterBufferMs;
+    GnssHwConn conn(&sink, connConfig);
+    if (!conn.ok() || !conn.start()) {
+        fprintf(stderr, "GnssHwConn failed to start\n");
+        exit(1);
+    }
+
+    Endpoint listen;
+    listen.port = kProxyPort;
+    Endpoint upstream;
+    upstream.port = kHalPort;
+    ImpairmentProxy proxy(listen, upstream, scenario.config);
+    if (!proxy.start()) {
+        fprintf(stderr, "could not listen on port %u\n", kProxyPort);
+        exit(1);
+    }
+
+    FeederConfig feederConfig;
+    feederConfig.port = kProxyPort;
+    feederConfig.rateHz = rateHz;
+    feederConfig.resume = resume;
+    Feeder feeder(feederConfig);
+
+    // like a real feeder: reconnect whenever the link drops
+    const int64_t endNs = steadyNowNs() + static_cast<int64_t>((seconds + 2) * 1e9);
+    uint64_t seq = 0;
+    int connects = 0;
+    while (seq < epochs && steadyNowNs() < endNs) {
+        if (!feeder.connect()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            continue;
+        }
+        ++connects;
+        seq = feeder.run(epochs, sentNs.get());
+        feeder.disconnect();
+    }
+
+    // let the delayed data drain
+    std::this_thread::sleep_for(std::chrono::milliseconds(
+        static_cast<int64_t>(500 + scenario.config.delayMs + 4 * scenario.config.jitterMs)));
+    proxy.stop();
+
+    const int64_t periodNs = static_cast<int64_t>(1e9 / rateHz);
+
+    // the feeder keeps one schedule across reconnects, the earliest send
+    // is the closest to it
+    int64_t epoch0Ns = INT64_MAX;
+    for (uint64_t i = 0; i < epochs; ++i) {
+        if (const int64_t s = sentNs[i].load()) {
+            epoch0Ns = std::min<int64_t>(epoch0Ns, s - i * periodNs);
+        }
+    }
+
+    std::vector<int64_t> ages;
+    std::vector<int64_t> deliveries;
+    std::vector<int64_t> intervalDeviations;
+    std::vector<int64_t> timestampErrors;
+    std::vector<int64_t> uncertainties;
+    uint64_t sent = 0;
+    for (uint64_t i = 0; i < epochs; ++i) {
+        const int64_t s = sentNs[i].load();
+        const int64_t d = deliveredNs[i].load();
+        sent += (s != 0);
+        if (s && d) {
+            ages.push_back(d - s);
+            deliveries.push_back(d);
+            timestampErrors.push_back(std::abs(fixTimeNs[i] - (epoch0Ns + static_cast<int64_t>(i) * periodNs)));
+            uncertainties.push_back(uncertaintyNs[i]);
+            const int64_t prev = (i > 0) ? deliveredNs[i - 1].load() : 0;
+            if (prev) {
+                intervalDeviations.push_back(std::abs((d - prev) - periodNs));
+            }
+        }
+    }
+    std::sort(deliveries.begin(), deliveries.end());
+
+    // recovery: from a forced disconnect to the next fix delivered, a
+    // replayed one counts
+    std::vector<int64_t> recoveries;
+    for (const int64_t t : proxy.disconnectTimesNs()) {
+        const auto it = std::upper_bound(deliveries.begin(), deliveries.end(), t);
+        if (it != deliveries.end()) {
+            recoveries.push_back(*it - t);
+        }
+    }
+
+    printf("%-18s %6llu %6llu %9.1f %9.1f %9.1f %11.1f %10.1f %10.1f %6zu %9.1f %9.1f %8.1f %5llu %8llu\n",
+           scenario.name,
+           static_cast<unsigned long long>(sent), static_cast<unsigned long long>(ages.size()),
+           percentile(ages, .50), percentile(ages, .99), percentile(ages, 1.0),
+           percentile(intervalDeviations, .99),
+           percentile(timestampErrors, .99), percentile(uncertainties, .50),
+           recoveries.size(), percentile(recoveries, .50), percentile(recoveries, 1.0),
+           proxy.writes() / std::max(1.0, static_cast<double>(sent)),
+           static_cast<unsigned long long>(sink.duplicates()),
+           static_cast<unsigned long long>(feeder.replayed()));
+    fflush(stdout);
+}
+
+int scenarios(const double rateHz, const double seconds, const int jitterBufferMs,
+              const bool resume) {
+    printf("%-18s %6s %6s %9s %9s %9s %11s %10s %10s %6s %9s %9s %8s %5s %8s\n", "scenario",
+           "sent", "fixes", "age_p50", "age_p99", "age_max", "ivl_dev_p99", "ts_err_p99",
+           "ts_unc_p50", "discon", "recov_p50", "recov_max", "writes/ep", "dups", "replayed");
+    for (const Scenario& s : makeScenarios()) {
+        runScenario(s, rateHz, seconds, jitterBufferMs, resume);
+    }
+    return 0;
+}
+
+volatile sig_atomic_t g_quit = 0;
+
+int proxy(const Endpoint& listen, const Endpoint& upstream, const ImpairmentConfig& config) {
+    ImpairmentProxy proxy(listen, upstream, config);
+    if (!proxy.start()) {
+        fprintf(stderr, "could not listen\n");
+        return 1;
+    }
+
+    signal(SIGINT, [](int) { g_quit = 1; });
+    signal(SIGTERM, [](int) { g_quit = 1; });
+    while (!g_quit) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    }
+
+    proxy.stop();
+    printf("forwarded %llu bytes in %llu writes, %zu forced disconnects\n",
+           static_cast<unsigned long long>(proxy.bytesForwarded()),
+           static_cast<unsigned long long>(proxy.writes()),
+           proxy.disconnectTimesNs().size());
+    return 0;
+}
+
+bool parseDistribution(const char* s, DelayDistribution* d) {
+    if (!strcmp(s, "constant")) {
+        *d = DelayDistribution::CONSTANT;
+    } else if (!strcmp(s, "uniform")) {
+        *d = DelayDistribution::UNIFORM;
+    } else if (!strcmp(s, "normal")) {
+        *d = DelayDistribution::NORMAL;
+    } else if (!strcmp(s, "pareto")) {
+        *d = DelayDistribution::PARETO;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+void usage(const char* argv0) {
+    fprintf(stderr,
+            "usage: %s [--listen PORT | --listen-uds PATH] [--upstream PORT | --upstream-uds PATH]\n"
+            "          [--delay-ms MS] [--jitter-ms MS] [--dist constant|uniform|normal|pareto]\n"
+            "          [--bandwidth BYTES_PER_SEC] [--max-chunk N] [--disconnect-every S] [--seed N]\n"
+            "       %s --scenarios [--rate HZ] [--seconds S] [--jitter-buffer MS] [--no-resume]\n",
+            argv0, argv0);
+}
+
+}  // namespace
+}  // namespace ciccloud
+
+int main(int argc, char* argv[]) {
+    using namespace ciccloud;
+
+    Endpoint listen;
+    listen.port = 8767;
+    Endpoint upstream;
+    upstream.port = 8766;
+    ImpairmentConfig config;
+    bool scenarioMode = false;
+    double rateHz = 10;
+    double seconds = 10;
+    int jitterBufferMs = 0;
+    bool resume = true;
+
+    for (int i = 1; i < argc; ++i) {
+        const char* arg = argv[i];
+        const char* value = (i + 1 < argc) ? argv[i + 1] : nullptr;
+        if (!strcmp(arg, "--scenarios")) {
+            scenarioMode = true;
+        } else if (!strcmp(arg, "--no-resume")) {
+            resume = false;
+        } else if (!value) {
+            usage(argv[0]);
+            return 1;
+        } else if (!strcmp(arg, "--listen")) {
+            listen.port = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--listen-uds")) {
+            listen.udsPath = argv[++i];
+        } else if (!strcmp(arg, "--upstream")) {
+            upstream.port = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--upstream-uds")) {
+            upstream.udsPath = argv[++i];
+        } else if (!strcmp(arg, "--delay-ms")) {
+            config.delayMs = atof(argv[++i]);
+        } else if (!strcmp(arg, "--jitter-ms")) {
+            config.jitterMs = atof(argv[++i]);
+            if (config.distribution == DelayDistribution::CONSTANT) {
+                config.distribution = DelayDistribution::UNIFORM;
+            }
+        } else if (!strcmp(arg, "--dist")) {
+            if (!parseDistribution(argv[++i], &config.distribution)) {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (!strcmp(arg, "--bandwidth")) {
+            config.bandwidthBytesPerSec = atof(argv[++i]);
+        } else if (!strcmp(arg, "--max-chunk")) {
+            config.maxChunk = atoi(argv[++i]);
+        } else if (!strcmp(arg, "--disconnect-every")) {
+            config.disconnectEverySec = atof(argv[++i]);
+        } else if (!strcmp(arg, "--seed")) {
+            config.seed = strtoul(argv[++i], nullptr, 10);
+        } else if (!strcmp(arg, "--rate")) {
+            rateHz = atof(argv[++i]);
+        } else if (!strcmp(arg, "--seconds")) {
+            seconds = atof(argv[++i]);
+        } else if (!strcmp(arg, "--jitter-buffer")) {
+            jitterBufferMs = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (scenarioMode) {
+        return scenarios(rateHz, seconds, jitterBufferMs, resume);
+    } else {
+        return proxy(listen, upstream, config);
+    }
+}
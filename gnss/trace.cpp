@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#ifdef __ANDROID__
+#include <cutils/trace.h>
+#else
+#include <fcntl.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#endif
+
+namespace ciccloud {
+namespace trace {
+
+#ifdef __ANDROID__
+
+bool enabled() {
+    return atrace_is_tag_enabled(ATRACE_TAG_HAL);
+}
+
+void begin(const char* name) {
+    atrace_begin(ATRACE_TAG_HAL, name);
+}
+
+void end() {
+    atrace_end(ATRACE_TAG_HAL);
+}
+
+void counter(const char* name, const int64_t value) {
+    atrace_int64(ATRACE_TAG_HAL, name, value);
+}
+
+void asyncBegin(const char* name, const int32_t cookie) {
+    atrace_async_begin(ATRACE_TAG_HAL, name, cookie);
+}
+
+void asyncEnd(const char* name, const int32_t cookie) {
+    atrace_async_end(ATRACE_TAG_HAL, name, cookie);
+}
+
+#else  // __ANDROID__
+
+namespace {
+// atrace writes the same records, so the host traces open in the same tools.
+int markerFd() {
+    static const int fd = []() {
+        int fd = open("/sys/kernel/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        if (fd < 0) {
+            fd = open("/sys/kernel/debug/tracing/trace_marker", O_WRONLY | O_CLOEXEC);
+        }
+        return fd;
+    }();
+    return fd;
+}
+
+__attribute__((format(printf, 1, 2)))
+void writeMarker(const char* fmt, ...) {
+    char buf[256];
+    va_list ap;
+    va_start(ap, fmt);
+    const int n = vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    if (n > 0) {
+        const size_t len = (static_cast<size_t>(n) < sizeof(buf)) ? n : (sizeof(buf) - 1);
+        (void)!write(markerFd(), buf, len);
+    }
+}
+
+int pid() {
+    static const int p = getpid();
+    return p;
+}
+}  // namespace
+
+// Only when asked for with CICCLOUD_GNSS_TRACE=1 in the environment: as root
+// the marker always opens, and each record is a write whether ftrace is on or
+// not.
+bool enabled() {
+    static const bool on = []() {
+        const char* env = getenv("CICCLOUD_GNSS_TRACE");
+        return env && atoi(env) != 0 && markerFd() >= 0;
+    }();
+    return on;
+}
+
+void begin(const char* name) {
+    writeMarker("B|%d|%s", pid(), name);
+}
+
+void end() {
+    writeMarker("E|%d", pid());
+}
+
+void counter(const char* name, const int64_t value) {
+    writeMarker("C|%d|%s|%lld", pid(), name, static_cast<long long>(value));
+}
+
+void asyncBegin(const char* name, const int32_t cookie) {
+    writeMarker("S|%d|%s|%d", pid(), name, static_cast<int>(cookie));
+}
+
+void asyncEnd(const char* name, const int32_t cookie) {
+    writeMarker("F|%d|%s|%d", pid(), name, static_cast<int>(cookie));
+}
+
+#endif  // __ANDROID__
+
+}  // namespace trace
+}  // namespace ciccloud
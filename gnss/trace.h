@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#pragma once
+#include <cstdint>
+
+// Trace events for the GNSS pipeline. On Android they go to atrace (and so to
+// systrace/perfetto with the "hal" category), elsewhere they are written to
+// the ftrace trace_marker in the same text format if CICCLOUD_GNSS_TRACE=1 is
+// in the environment. Build with -DCICCLOUD_GNSS_TRACE=0 to compile every
+// trace point out.
+#ifndef CICCLOUD_GNSS_TRACE
+#define CICCLOUD_GNSS_TRACE 1
+#endif
+
+namespace ciccloud {
+namespace trace {
+
+bool enabled();
+void begin(const char* name);
+void end();
+void counter(const char* name, int64_t value);
+void asyncBegin(const char* name, int32_t cookie);
+void asyncEnd(const char* name, int32_t cookie);
+
+class ScopedSlice {
+public:
+    explicit ScopedSlice(const char* name) : m_active(enabled()) {
+        if (m_active) {
+            begin(name);
+        }
+    }
+    ~ScopedSlice() {
+        if (m_active) {
+            end();
+        }
+    }
+    ScopedSlice(const ScopedSlice&) = delete;
+    ScopedSlice& operator=(const ScopedSlice&) = delete;
+
+private:
+    const bool m_active;
+};
+
+}  // namespace trace
+}  // namespace ciccloud
+
+#if CICCLOUD_GNSS_TRACE
+#define GNSS_TRACE_CONCAT2(a, b) a##b
+#define GNSS_TRACE_CONCAT(a, b) GNSS_TRACE_CONCAT2(a, b)
+#define GNSS_TRACE_ENABLED() (::ciccloud::trace::enabled())
+#define GNSS_TRACE_SCOPE(name) \
+    ::ciccloud::trace::ScopedSlice GNSS_TRACE_CONCAT(gnssTraceSlice, __LINE__)(name)
+#define GNSS_TRACE_COUNTER(name, value) \
+    do { if (::ciccloud::trace::enabled()) ::ciccloud::trace::counter(name, value); } while (0)
+#define GNSS_TRACE_ASYNC_BEGIN(name, cookie) \
+    do { if (::ciccloud::trace::enabled()) ::ciccloud::trace::asyncBegin(name, cookie); } while (0)
+#define GNSS_TRACE_ASYNC_END(name, cookie) \
+    do { if (::ciccloud::trace::enabled()) ::ciccloud::trace::asyncEnd(name, cookie); } while (0)
+#else
+#define GNSS_TRACE_ENABLED() (false)
+#define GNSS_TRACE_SCOPE(name) ((void)0)
+#define GNSS_TRACE_COUNTER(name, value) ((void)0)
+#define GNSS_TRACE_ASYNC_BEGIN(name, cookie) ((void)0)
+#define GNSS_TRACE_ASYNC_END(name, cookie) ((void)0)
+#endif
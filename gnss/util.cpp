@@ -15,24 +15,52 @@
  */
 
 #include "util.h"
+#include <time.h>
+#include <algorithm>
 #include <chrono>
 
 namespace ciccloud {
 namespace util {
+namespace {
+constexpr int64_t kGpsEpochUnixSeconds = 315964800;  // 1980-01-06
+constexpr int64_t kGpsLeapSeconds = 18;
+constexpr int64_t kDayMs = 86400000;
+}  // namespace
 
 int64_t nowNanos() {
     using namespace std::chrono;
     return time_point_cast<nanoseconds>(system_clock::now()).time_since_epoch().count();
 }
 
-ahg20::ElapsedRealtime makeElapsedRealtime(long long timestampNs) {
-    ahg20::ElapsedRealtime ts = {
-        .flags = ahg20::ElapsedRealtimeFlags::HAS_TIMESTAMP_NS |
-                 ahg20::ElapsedRealtimeFlags::HAS_TIME_UNCERTAINTY_NS,
-        .timestampNs = static_cast<uint64_t>(timestampNs),
-        .timeUncertaintyNs = 1000000};
+int64_t bootNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_BOOTTIME, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+int64_t realtimeToBootNanos(const int64_t realtimeNs, const int64_t bootNowNs) {
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    const int64_t ageNs = now.tv_sec * 1000000000LL + now.tv_nsec - realtimeNs;
+    return bootNowNs - std::max<int64_t>(0, ageNs);
+}
+
+int64_t utcToGpsNanos(const int64_t utcNs) {
+    return utcNs + (kGpsLeapSeconds - kGpsEpochUnixSeconds) * 1000000000LL;
+}
+
+int64_t fixUtcNanos(const Location& loc) {
+    if (loc.utcTimeOfDayMs < 0) {
+        return loc.timestampMs * 1000000;
+    }
 
-    return ts;
+    int64_t ms = loc.timestampMs - loc.timestampMs % kDayMs + loc.utcTimeOfDayMs;
+    if (ms - loc.timestampMs > kDayMs / 2) {
+        ms -= kDayMs;
+    } else if (loc.timestampMs - ms > kDayMs / 2) {
+        ms += kDayMs;
+    }
+    return ms * 1000000;
 }
 
 }  // namespace util
@@ -15,17 +15,27 @@
  */
 
 #pragma once
-
-#include <android/hardware/gnss/2.0/types.h>
+#include <cstdint>
+#include "gnss_types.h"
 
 namespace ciccloud {
-namespace ahg20 = ::android::hardware::gnss::V2_0;
-
 namespace util {
 
-int64_t nowNanos();
+int64_t nowNanos();   // UTC, for timestamps the framework shows as time
+int64_t bootNanos();  // CLOCK_BOOTTIME, the base of elapsedRealtime
+
+// Moves `realtimeNs`, a CLOCK_REALTIME instant of the recent past like a
+// kernel receive timestamp, to CLOCK_BOOTTIME, given bootNanos() of now.
+int64_t realtimeToBootNanos(int64_t realtimeNs, int64_t bootNowNs);
+
+// GPS time (since 1980-01-06, no leap seconds) of a UTC time in nanoseconds
+// since the Unix epoch, with the leap seconds as of 2017.
+int64_t utcToGpsNanos(int64_t utcNs);
 
-ahg20::ElapsedRealtime makeElapsedRealtime(long long timestampNs);
+// When a fix was taken, UTC: its time of day from the sentence on the date
+// of its timestampMs (the nearest one, around midnight), or timestampMs if
+// the sentence had no time.
+int64_t fixUtcNanos(const Location&);
 
 }  // namespace util
 }  // namespace ciccloud
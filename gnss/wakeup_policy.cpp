@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "wakeup_policy.h"
+#include <errno.h>
+#include <log/log.h>
+#include <sys/socket.h>
+#include <algorithm>
+#include <cstring>
+
+namespace ciccloud {
+
+WakeupPolicy::WakeupPolicy(const WakeupPolicyConfig& config)
+    : m_maxHoldNs(config.maxHoldMs * 1000000LL) {}
+
+void WakeupPolicy::reset(const int fd) {
+    m_fd = fd;
+    m_lowat = 1;  // the kernel default for a new socket
+    m_known = 0;
+    m_epochs = 0;
+    m_epochStartNs = 0;
+    m_periodNs = 0;
+    m_deadlineNs = INT64_MAX;
+}
+
+void WakeupPolicy::onEpochs(const uint64_t epochs, const size_t lastEpochBytes,
+                            const int64_t epochStartRxBootNs) {
+    if (m_maxHoldNs <= 0 || epochs == m_epochs) {
+        return;
+    }
+    if (m_epochs && epochs == m_epochs + 1) {
+        // clamped, so a pause of the feed does not count as a long period
+        const int64_t periodNs = epochStartRxBootNs - m_epochStartNs;
+        m_periodNs = m_periodNs ? (m_periodNs * 7 + std::min(periodNs, 2 * m_periodNs)) / 8
+                                : periodNs;
+    }
+    m_epochs = epochs;
+    m_epochStartNs = epochStartRxBootNs;
+    m_sizes[m_known++ % kWindow] = lastEpochBytes;
+    if (m_known < kWindow || !m_periodNs) {
+        return;
+    }
+
+    setLowat(*std::min_element(m_sizes.begin(), m_sizes.end()));
+    m_deadlineNs = m_epochStartNs + m_periodNs + m_maxHoldNs;
+}
+
+int WakeupPolicy::timeoutMs(const int64_t nowNs) const {
+    if (m_deadlineNs == INT64_MAX) {
+        return -1;
+    }
+    return (m_deadlineNs <= nowNs) ? 0 : static_cast<int>((m_deadlineNs - nowNs + 999999) / 1000000);
+}
+
+void WakeupPolicy::onPolled(const size_t bytes) {
+    m_deadlineNs = INT64_MAX;
+    if (bytes) {
+        ALOGV("%s: %zu bytes were held below a low water mark of %d", __PRETTY_FUNCTION__, bytes, m_lowat);
+        m_known = 0;
+    }
+    setLowat(1);
+}
+
+void WakeupPolicy::setLowat(int lowat) {
+    lowat = std::min(std::max(lowat, 1), kMaxLowat);
+    if (lowat == m_lowat || m_fd < 0) {
+        return;
+    }
+    if (setsockopt(m_fd, SOL_SOCKET, SO_RCVLOWAT, &lowat, sizeof(lowat)) < 0) {
+        ALOGW("%s: setsockopt(SO_RCVLOWAT, %d) failed: %s", __PRETTY_FUNCTION__, lowat, strerror(errno));
+        return;
+    }
+    m_lowat = lowat;
+}
+
+}  // namespace ciccloud
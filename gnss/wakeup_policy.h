@@ -0,0 +1,75 @@
+/*
+ * Copyright (C) 2020 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+namespace ciccloud {
+
+struct WakeupPolicyConfig {
+    int maxHoldMs = 2;  // how late an epoch may be picked up, 0 - wake on every segment
+};
+
+// Wakes the epoll loop once per epoch of the TCP feed rather than once per
+// segment. It learns how big the epochs are (the smallest of the last
+// kWindow) and how far apart, and sets SO_RCVLOWAT on the client socket to
+// the epoch size, so the kernel holds the wakeup until a whole epoch is in.
+//
+// An epoch smaller than that would be held until the next one, so the loop
+// looks at the socket itself at most maxHoldMs after an epoch was due. Data
+// found then means the epochs shrank: the policy unlearns and wakes on
+// every segment again until it knows the new size. Nothing found means the
+// feed paused: the low water mark goes back to 1 until the next epoch.
+class WakeupPolicy {
+public:
+    explicit WakeupPolicy(const WakeupPolicyConfig&);
+
+    // A new client, nothing is known about its epochs.
+    void reset(int fd);
+
+    // After a wakeup's data went to the listener, see GnssHwListener::epochs().
+    void onEpochs(uint64_t epochs, size_t lastEpochBytes, int64_t epochStartRxBootNs);
+
+    // How long the loop may sleep before it has to look at the socket, in
+    // ms, -1 if it does not have to.
+    int timeoutMs(int64_t nowNs) const;
+    // If the loop has to look now, it reports what it found to onPolled.
+    bool due(int64_t nowNs) const { return nowNs >= m_deadlineNs; }
+    void onPolled(size_t bytes);
+
+    int lowat() const { return m_lowat; }
+
+private:
+    static constexpr size_t kWindow = 8;
+    static constexpr int kMaxLowat = 64 * 1024;
+
+    void setLowat(int lowat);
+
+    const int64_t m_maxHoldNs;
+    int m_fd = -1;
+    int m_lowat = 1;
+    std::array<size_t, kWindow> m_sizes;  // of the last epochs, a ring
+    size_t m_known = 0;                   // how many of m_sizes are
+    uint64_t m_epochs = 0;
+    int64_t m_epochStartNs = 0;
+    int64_t m_periodNs = 0;  // between epoch starts, smoothed
+    int64_t m_deadlineNs = INT64_MAX;
+};
+
+}  // namespace ciccloud